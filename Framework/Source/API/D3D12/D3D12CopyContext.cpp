@@ -152,7 +152,8 @@ namespace Falcor
 
         //Get buffer data
         std::vector<uint8> result;
-		uint32_t actualRowSize = footprint.Footprint.Width * getFormatBytesPerBlock(pTexture->getFormat());
+        // rowSize is the unpadded size of a row. For compressed formats a row is a row of blocks, and rowCount is the number of block rows.
+        uint32_t actualRowSize = (uint32_t)rowSize;
         result.resize(rowCount * actualRowSize);
         uint8* pData = reinterpret_cast<uint8*>(pBuffer->map(Buffer::MapType::Read));
 
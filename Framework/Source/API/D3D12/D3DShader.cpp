@@ -36,7 +36,7 @@ namespace Falcor
         ID3DBlobPtr pBlob;
     };
 
-    const char* getTargetString(ShaderType type)
+    const char* Shader::getTargetProfile(ShaderType type)
     {
         switch (type)
         {
@@ -134,7 +134,7 @@ namespace Falcor
             nullptr,
             nullptr,
             entryPointName.c_str(),
-            getTargetString(mType),
+            getTargetProfile(mType),
             d3dFlags,
             0,
             &pCode,
@@ -161,14 +161,30 @@ namespace Falcor
 
     bool Shader::init(const Blob& shaderBlob, const std::string& entryPointName, CompilerFlags flags, std::string& log)
     {
-        if (shaderBlob.type != Blob::Type::String)
+        ShaderData* pData = (ShaderData*)mpPrivateData;
+        if (shaderBlob.type == Blob::Type::Bytecode)
+        {
+            // Precompiled DXBC, e.g. loaded from the program cache. Copy it into a D3D blob.
+            ID3DBlob* pCode;
+            if (FAILED(D3DCreateBlob(shaderBlob.data.size(), &pCode)))
+            {
+                logError("Can't create a D3D blob for precompiled shader bytecode");
+                return false;
+            }
+            memcpy(pCode->GetBufferPointer(), shaderBlob.data.data(), shaderBlob.data.size());
+            pData->pBlob = pCode;
+            pCode->Release();
+        }
+        else if (shaderBlob.type == Blob::Type::String)
+        {
+            // Compile the shader
+            pData->pBlob = compile(shaderBlob, entryPointName, flags, log);
+        }
+        else
         {
-            logError("D3D shader compilation only supports string inputs");
+            logError("D3D shaders can only be created from HLSL strings or DXBC bytecode");
             return false;
         }
-        // Compile the shader
-        ShaderData* pData = (ShaderData*)mpPrivateData;
-        pData->pBlob = compile(shaderBlob, entryPointName, flags, log);
 
         if (pData->pBlob == nullptr)
         {
@@ -27,7 +27,9 @@
 ***************************************************************************/
 #pragma once
 #include <string>
+#include <map>
 #include <unordered_set>
+#include "Utils/HashUtils.h"
 
 namespace Falcor
 {
@@ -61,11 +63,74 @@ namespace Falcor
             DumpIntermediates     = 0x2,
         };
 
-        class DefineList : public std::map<std::string, std::string>
+        /** A list of macro definitions.
+            The list keeps a 64-bit hash of its contents, which is updated incrementally when defines are added or removed. The hash doesn't depend on the order of the operations, so it can be used to look up program versions without comparing the whole list.
+        */
+        class DefineList
         {
         public:
-            void add(const std::string& name, const std::string& val = "") { (*this)[name] = val; }
-            void remove(const std::string& name) {(*this).erase(name); }
+            using Map = std::map<std::string, std::string>;
+            using const_iterator = Map::const_iterator;
+
+            /** Add a define. If the define already exists, its value is replaced.
+                \return true if the list changed, false if the define already existed with the same value
+            */
+            bool add(const std::string& name, const std::string& val = "")
+            {
+                auto it = mDefines.find(name);
+                if(it != mDefines.end())
+                {
+                    if(it->second == val) return false;
+                    mHash -= hashDefine(it->first, it->second);
+                    it->second = val;
+                }
+                else
+                {
+                    it = mDefines.emplace(name, val).first;
+                }
+                mHash += hashDefine(it->first, it->second);
+                return true;
+            }
+
+            /** Remove a define.
+                \return true if the define existed
+            */
+            bool remove(const std::string& name)
+            {
+                auto it = mDefines.find(name);
+                if(it == mDefines.end()) return false;
+                mHash -= hashDefine(it->first, it->second);
+                mDefines.erase(it);
+                return true;
+            }
+
+            void clear() { mDefines.clear(); mHash = 0; }
+            size_t size() const { return mDefines.size(); }
+            bool empty() const { return mDefines.empty(); }
+            const_iterator begin() const { return mDefines.begin(); }
+            const_iterator end() const { return mDefines.end(); }
+            const_iterator find(const std::string& name) const { return mDefines.find(name); }
+
+            /** Get the hash of the list
+            */
+            uint64_t getHash() const { return mHash; }
+
+            /** Compares the hashes first, so lists with different contents are usually rejected without comparing strings
+            */
+            bool operator==(const DefineList& other) const { return (mHash == other.mHash) && (mDefines == other.mDefines); }
+            bool operator!=(const DefineList& other) const { return !(*this == other); }
+
+            struct HashFunc
+            {
+                std::size_t operator()(const DefineList& list) const { return (std::size_t)list.getHash(); }
+            };
+
+        private:
+            // The hash of the list is the sum of the hashes of its defines, so that adding or removing a define is O(1)
+            static uint64_t hashDefine(const std::string& name, const std::string& value) { return hashString(value, hashString(name)); }
+
+            Map mDefines;
+            uint64_t mHash = 0;
         };
 
         /** create a shader object
@@ -93,6 +158,10 @@ namespace Falcor
 
 
 #ifdef FALCOR_D3D
+        /** Get the shader model the HLSL compiler targets for a shader stage (for example "vs_5_1")
+        */
+        static const char* getTargetProfile(ShaderType type);
+
         ID3DBlobPtr getD3DBlob() const;
         virtual ID3DBlobPtr compile(const Blob& blob, const std::string&  entryPointName, CompilerFlags flags, std::string& errorLog);
 #endif
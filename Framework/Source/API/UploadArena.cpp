@@ -0,0 +1,81 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Framework.h"
+#include "UploadArena.h"
+#include "API/Device.h"
+
+namespace Falcor
+{
+    UploadArena::SharedPtr UploadArena::create(size_t pageSize)
+    {
+        if (pageSize == 0)
+        {
+            pageSize = gpDevice->getResourceAllocator()->getPageSize();
+        }
+        return SharedPtr(new UploadArena(pageSize));
+    }
+
+    UploadArena::Allocation UploadArena::allocate(size_t size, size_t alignment)
+    {
+        assert(alignment > 0);
+        size_t offset = align_to(alignment, mOffset);
+
+        if (mActivePages == 0 || offset + size > mPages[mActivePages - 1].pBuffer->getSize())
+        {
+            if (mActivePages == mPages.size())
+            {
+                mPages.emplace_back();
+            }
+
+            Page& page = mPages[mActivePages++];
+            size_t bufferSize = std::max(mPageSize, size);
+            if (page.pBuffer == nullptr || page.pBuffer->getSize() < bufferSize)
+            {
+                page.pBuffer = Buffer::create(bufferSize, Resource::BindFlags::None, Buffer::CpuAccess::Write, nullptr);
+            }
+
+            // The buffer is mapped once per reset. Discarding moves it to new memory, so the GPU can keep reading the previous content.
+            page.pData = (uint8_t*)page.pBuffer->map(Buffer::MapType::WriteDiscard);
+            offset = 0;
+        }
+
+        const Page& page = mPages[mActivePages - 1];
+        Allocation allocation;
+        allocation.pBuffer = page.pBuffer.get();
+        allocation.offset = offset;
+        allocation.pData = page.pData + offset;
+        mOffset = offset + size;
+        return allocation;
+    }
+
+    void UploadArena::reset()
+    {
+        mActivePages = 0;
+        mOffset = 0;
+    }
+}
@@ -0,0 +1,88 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <vector>
+#include "API/Buffer.h"
+
+namespace Falcor
+{
+    /** Linear allocator for data uploaded to the GPU, like per-instance data which is rewritten every frame.
+        The arena owns a set of CPU-writable buffers, which live in the pages of the device's ResourceAllocator. Allocations are carved out of them linearly, and copied to their destination with CopyContext::copyBufferRegion().
+        reset() starts a new set of allocations. Each buffer is then mapped with MapType::WriteDiscard on its first use, which moves it to fresh memory. The memory the GPU may still be reading is released once its fence is reached.
+    */
+    class UploadArena
+    {
+    public:
+        using SharedPtr = std::shared_ptr<UploadArena>;
+        using SharedConstPtr = std::shared_ptr<const UploadArena>;
+
+        /** Create an arena
+            \param[in] pageSize Size of the arena's buffers. Buffers which fit in a page of the resource allocator share its pages. 0 uses the resource allocator's page size.
+        */
+        static SharedPtr create(size_t pageSize = 0);
+
+        struct Allocation
+        {
+            const Buffer* pBuffer = nullptr;    ///< The upload buffer holding the data
+            size_t offset = 0;                  ///< Offset of the data in the buffer
+            uint8_t* pData = nullptr;           ///< CPU pointer the data should be written to
+        };
+
+        /** Allocate memory. It stays valid until the next call to reset().
+            \param[in] size Number of bytes. Allocations larger than the page size get a buffer of their own.
+            \param[in] alignment Alignment of the offset in the buffer
+        */
+        Allocation allocate(size_t size, size_t alignment = 16);
+
+        /** Start a new set of allocations, usually once per frame
+        */
+        void reset();
+
+        /** Get the size of the arena's buffers
+        */
+        size_t getPageSize() const { return mPageSize; }
+
+        /** Get the number of buffers used since the last reset
+        */
+        uint32_t getActivePageCount() const { return mActivePages; }
+
+    private:
+        UploadArena(size_t pageSize) : mPageSize(pageSize) {}
+
+        struct Page
+        {
+            Buffer::SharedPtr pBuffer;
+            uint8_t* pData = nullptr;
+        };
+
+        size_t mPageSize;
+        std::vector<Page> mPages;
+        uint32_t mActivePages = 0;  // The pages in use since the last reset. The last one is the page allocations are made from.
+        size_t mOffset = 0;         // The current offset in the last active page
+    };
+}
@@ -91,6 +91,23 @@ struct CameraData
     float4x4            rightEyePrevViewProjMat;
 };
 
+/*******************************************************************
+                    Instancing
+*******************************************************************/
+/**
+Per-instance data of a batched draw. The vertex shader reads it from gInstanceData[gFirstInstance + SV_InstanceID].
+*/
+struct PerInstanceData
+{
+    float4x4            worldMat               DEFAULTS(float4x4());            ///< World transform.
+    float4x4            prevWorldMat           DEFAULTS(float4x4());            ///< World transform of the previous frame.
+    float4x4            worldInvTransposeMat   DEFAULTS(float4x4());            ///< Matrix for transforming normals. Only the upper 3x3 is used.
+    uint32_t            drawId                 DEFAULTS(0);                     ///< Zero-based order/ID of the mesh instance in the frame.
+    uint32_t            pad0;
+    uint32_t            pad1;
+    uint32_t            pad2;
+};
+
 /*******************************************************************
                     Material
 *******************************************************************/
@@ -427,6 +444,7 @@ static_assert((sizeof(MaterialLayerValues) % sizeof(float4)) == 0, "MaterialLaye
 static_assert((sizeof(MaterialDesc) % sizeof(float4)) == 0, "MaterialDesc has a wrong size");
 static_assert((sizeof(MaterialValues) % sizeof(float4)) == 0, "MaterialValues has a wrong size");
 static_assert((sizeof(MaterialData) % sizeof(float4)) == 0, "MaterialData has a wrong size");
+static_assert((sizeof(PerInstanceData) % sizeof(float4)) == 0, "PerInstanceData has a wrong size");
 #undef SamplerState
 #undef Texture2D
 } // namespace Falcor
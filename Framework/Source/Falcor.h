@@ -58,6 +58,7 @@
 #include "API/VertexLayout.h"
 #include "API/Window.h"
 #include "API/TypedBuffer.h"
+#include "API/UploadArena.h"
 #include "API/CopyContext.h"
 #include "API/ComputeContext.h"
 #include "API/QueryHeap.h"
@@ -130,6 +131,7 @@
 #include "Utils/Platform/OS.h"
 #include "Utils/Platform/ProgressBar.h"
 #include "Utils/ThreadPool.h"
+#include "Utils/JobSystem.h"
 
 // VR
 #include "VR/OpenVR/VRSystem.h"
@@ -31,6 +31,17 @@
 #include "Utils/AABB.h"
 #include "Utils/Math/FalcorMath.h"
 #include "API/ConstantBuffer.h"
+#include "Utils/Platform/OS.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define FALCOR_CULLING_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define FALCOR_TARGET_AVX2
+#else
+#define FALCOR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
 
 namespace Falcor
 {
@@ -114,6 +125,7 @@ namespace Falcor
 
                 mFrustumPlanes[i].xyz = glm::vec3(plane);
                 mFrustumPlanes[i].sign = glm::sign(mFrustumPlanes[i].xyz);
+                mFrustumPlanes[i].absXyz = glm::abs(mFrustumPlanes[i].xyz);
                 mFrustumPlanes[i].negW = -plane.w;
             }
 
@@ -179,21 +191,185 @@ namespace Falcor
         mEnablePersistentViewMat = persistent;
     }
 
+    // AABB vs. frustum test
+    // See method 4b: https://fgiesen.wordpress.com/2010/10/17/view-frustum-culling/
+    // The box is outside of a plane if the distance of its center is lower than its projected radius, dot(extent, abs(normal)).
+    // All the code paths evaluate the dot products in the same order, so they give the same results.
+    static inline float dot3(float x0, float y0, float z0, float x1, float y1, float z1)
+    {
+        return x0 * x1 + y0 * y1 + z0 * z1;
+    }
+
     bool Camera::isObjectCulled(const BoundingBox& box) const
+    {
+        BoundingBoxStreams stream;
+        for (int i = 0; i < 3; i++)
+        {
+            stream.pCenter[i] = &box.center[i];
+            stream.pExtent[i] = &box.extent[i];
+        }
+        stream.count = 1;
+
+        uint32_t visible = 0;
+        cullBoundingBoxes(stream, &visible, CullingPath::Scalar);
+        return visible == 0;
+    }
+
+    Camera::FrustumTestResult Camera::testBoundingBox(const BoundingBox& box, uint32_t& planeMask) const
     {
         calculateCameraParameters();
 
-        bool isInside = true;
-        // AABB vs. frustum test
-        // See method 4b: https://fgiesen.wordpress.com/2010/10/17/view-frustum-culling/
         for (int plane = 0; plane < 6; plane++)
         {
-            glm::vec3 signedExtent = box.extent * mFrustumPlanes[plane].sign;
-            float dr = glm::dot(box.center + signedExtent, mFrustumPlanes[plane].xyz);
-            isInside = isInside && (dr > mFrustumPlanes[plane].negW);
+            if ((planeMask & (1 << plane)) == 0) continue;
+
+            const auto& p = mFrustumPlanes[plane];
+            float distance = dot3(box.center.x, box.center.y, box.center.z, p.xyz.x, p.xyz.y, p.xyz.z);
+            float radius = dot3(box.extent.x, box.extent.y, box.extent.z, p.absXyz.x, p.absXyz.y, p.absXyz.z);
+            if ((distance + radius) <= p.negW)
+            {
+                return FrustumTestResult::Outside;
+            }
+            if ((distance - radius) > p.negW)
+            {
+                planeMask &= ~(1 << plane);
+            }
+        }
+
+        return (planeMask == 0) ? FrustumTestResult::Inside : FrustumTestResult::Intersecting;
+    }
+
+    template<typename PlaneType>
+    static void cullBoundingBoxesScalar(const PlaneType* pPlanes, const BoundingBoxStreams& boxes, uint32_t first, uint32_t* visibilityMask)
+    {
+        for (uint32_t i = first; i < boxes.count; i++)
+        {
+            bool isInside = true;
+            for (int plane = 0; plane < 6; plane++)
+            {
+                const PlaneType& p = pPlanes[plane];
+                float distance = dot3(boxes.pCenter[0][i], boxes.pCenter[1][i], boxes.pCenter[2][i], p.xyz.x, p.xyz.y, p.xyz.z);
+                float radius = dot3(boxes.pExtent[0][i], boxes.pExtent[1][i], boxes.pExtent[2][i], p.absXyz.x, p.absXyz.y, p.absXyz.z);
+                isInside = isInside && ((distance + radius) > p.negW);
+            }
+            visibilityMask[i >> 5] |= (isInside ? 1u : 0u) << (i & 31);
+        }
+    }
+
+#ifdef FALCOR_CULLING_SIMD
+    template<typename PlaneType>
+    static uint32_t cullBoundingBoxesSse(const PlaneType* pPlanes, const BoundingBoxStreams& boxes, uint32_t* visibilityMask)
+    {
+        __m128 planes[6][7];
+        for (int plane = 0; plane < 6; plane++)
+        {
+            const PlaneType& p = pPlanes[plane];
+            const float values[] = { p.xyz.x, p.xyz.y, p.xyz.z, p.absXyz.x, p.absXyz.y, p.absXyz.z, p.negW };
+            for (int i = 0; i < 7; i++) planes[plane][i] = _mm_set1_ps(values[i]);
+        }
+
+        uint32_t count = boxes.count & ~3u;
+        for (uint32_t i = 0; i < count; i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(boxes.pCenter[0] + i);
+            __m128 cy = _mm_loadu_ps(boxes.pCenter[1] + i);
+            __m128 cz = _mm_loadu_ps(boxes.pCenter[2] + i);
+            __m128 ex = _mm_loadu_ps(boxes.pExtent[0] + i);
+            __m128 ey = _mm_loadu_ps(boxes.pExtent[1] + i);
+            __m128 ez = _mm_loadu_ps(boxes.pExtent[2] + i);
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int plane = 0; plane < 6; plane++)
+            {
+                const __m128* p = planes[plane];
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, p[0]), _mm_mul_ps(cy, p[1])), _mm_mul_ps(cz, p[2]));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, p[3]), _mm_mul_ps(ey, p[4])), _mm_mul_ps(ez, p[5]));
+                inside = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_add_ps(distance, radius), p[6]));
+            }
+            visibilityMask[i >> 5] |= (uint32_t)_mm_movemask_ps(inside) << (i & 31);
+        }
+        return count;
+    }
+
+    template<typename PlaneType>
+    FALCOR_TARGET_AVX2 static uint32_t cullBoundingBoxesAvx2(const PlaneType* pPlanes, const BoundingBoxStreams& boxes, uint32_t* visibilityMask)
+    {
+        __m256 planes[6][7];
+        for (int plane = 0; plane < 6; plane++)
+        {
+            const PlaneType& p = pPlanes[plane];
+            const float values[] = { p.xyz.x, p.xyz.y, p.xyz.z, p.absXyz.x, p.absXyz.y, p.absXyz.z, p.negW };
+            for (int i = 0; i < 7; i++) planes[plane][i] = _mm256_set1_ps(values[i]);
         }
 
-        return !isInside;
+        uint32_t count = boxes.count & ~7u;
+        for (uint32_t i = 0; i < count; i += 8)
+        {
+            __m256 cx = _mm256_loadu_ps(boxes.pCenter[0] + i);
+            __m256 cy = _mm256_loadu_ps(boxes.pCenter[1] + i);
+            __m256 cz = _mm256_loadu_ps(boxes.pCenter[2] + i);
+            __m256 ex = _mm256_loadu_ps(boxes.pExtent[0] + i);
+            __m256 ey = _mm256_loadu_ps(boxes.pExtent[1] + i);
+            __m256 ez = _mm256_loadu_ps(boxes.pExtent[2] + i);
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int plane = 0; plane < 6; plane++)
+            {
+                const __m256* p = planes[plane];
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, p[0]), _mm256_mul_ps(cy, p[1])), _mm256_mul_ps(cz, p[2]));
+                __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, p[3]), _mm256_mul_ps(ey, p[4])), _mm256_mul_ps(ez, p[5]));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), p[6], _CMP_GT_OQ));
+            }
+            visibilityMask[i >> 5] |= (uint32_t)_mm256_movemask_ps(inside) << (i & 31);
+        }
+        return count;
+    }
+#endif
+
+    bool Camera::isCullingPathSupported(CullingPath path)
+    {
+        switch (path)
+        {
+        case CullingPath::Auto:
+        case CullingPath::Scalar:
+            return true;
+#ifdef FALCOR_CULLING_SIMD
+        case CullingPath::Sse:
+            return true;
+        case CullingPath::Avx2:
+        {
+            static const bool supported = isAvx2Supported();
+            return supported;
+        }
+#endif
+        default:
+            return false;
+        }
+    }
+
+    void Camera::cullBoundingBoxes(const BoundingBoxStreams& boxes, uint32_t* visibilityMask, CullingPath path) const
+    {
+        calculateCameraParameters();
+        memset(visibilityMask, 0, ((boxes.count + 31) / 32) * sizeof(uint32_t));
+
+        if (path == CullingPath::Auto || isCullingPathSupported(path) == false)
+        {
+            path = isCullingPathSupported(CullingPath::Avx2) ? CullingPath::Avx2 : (isCullingPathSupported(CullingPath::Sse) ? CullingPath::Sse : CullingPath::Scalar);
+        }
+
+        // The SIMD paths process full vectors, the rest of the boxes are handled by the scalar path
+        uint32_t first = 0;
+#ifdef FALCOR_CULLING_SIMD
+        if (path == CullingPath::Avx2)
+        {
+            first = cullBoundingBoxesAvx2(mFrustumPlanes, boxes, visibilityMask);
+        }
+        else if (path == CullingPath::Sse)
+        {
+            first = cullBoundingBoxesSse(mFrustumPlanes, boxes, visibilityMask);
+        }
+#endif
+        cullBoundingBoxesScalar(mFrustumPlanes, boxes, first, visibilityMask);
     }
 
     void Camera::setRightEyeMatrices(const glm::mat4& view, const glm::mat4& proj)
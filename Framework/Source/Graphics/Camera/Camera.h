@@ -36,6 +36,7 @@
 namespace Falcor
 {
     struct BoundingBox;
+    struct BoundingBoxStreams;
     class ConstantBuffer;
 
     /** Camera class. Default transform matrices are interpreted as left eye transform during stereo rendering.
@@ -49,6 +50,27 @@ namespace Falcor
         // Default dimensions of full frame cameras and 35mm film
         static const float kDefaultFrameHeight;
 
+        /** Result of testing a bounding box against the view frustum
+        */
+        enum class FrustumTestResult
+        {
+            Outside,        ///< The box is outside the frustum
+            Intersecting,   ///< The box intersects at least one of the frustum planes
+            Inside          ///< The box is fully inside the frustum
+        };
+
+        static const uint32_t kAllFrustumPlanes = 0x3f;   ///< Plane mask which includes the 6 frustum planes
+
+        /** Instruction set used by cullBoundingBoxes()
+        */
+        enum class CullingPath
+        {
+            Auto,       ///< The widest path supported by the CPU
+            Scalar,
+            Sse,        ///< 4 boxes at a time
+            Avx2        ///< 8 boxes at a time
+        };
+
         /** Create a new camera object.
         */
         static SharedPtr create();
@@ -161,6 +183,25 @@ namespace Falcor
         */
         bool isObjectCulled(const BoundingBox& box) const;
 
+        /** Test a batch of bounding boxes against the frustum.
+            All the paths compute the plane distances in the same order, so they return the same results as isObjectCulled().
+            \param[in] boxes The bounding boxes
+            \param[out] visibilityMask Bit (i % 32) of word (i / 32) is set if box i is visible. Must hold (boxes.count + 31) / 32 words.
+            \param[in] path The instruction set to use. Paths which the CPU doesn't support fall back to the widest supported one.
+        */
+        void cullBoundingBoxes(const BoundingBoxStreams& boxes, uint32_t* visibilityMask, CullingPath path = CullingPath::Auto) const;
+
+        /** Check if a culling path is supported by the CPU
+        */
+        static bool isCullingPathSupported(CullingPath path);
+
+        /** Test a bounding box against the frustum planes, for hierarchical culling.
+            \param[in] box The bounding box to test
+            \param[in,out] planeMask Bit i is set if plane i needs to be tested. On return, the bits of the planes the box is fully inside of are cleared, so the box's children can skip them.
+            \return Whether the box is outside the frustum, intersects it or is fully inside of it. Boxes which only intersect planes which were masked out are reported as inside.
+        */
+        FrustumTestResult testBoundingBox(const BoundingBox& box, uint32_t& planeMask) const;
+
         /** Set camera data into a program's constant buffer.
             \param[in] pBuffer The constant buffer to set the parameters into.
             \param[in] varName The name of the light variable in the program.
@@ -224,6 +265,7 @@ namespace Falcor
             glm::vec3   xyz;    ///< Camera frustum plane position
             float       negW;   ///< Camera frustum plane, sign of the coordinates
             glm::vec3   sign;   ///< Camera frustum plane position
+            glm::vec3   absXyz; ///< Absolute value of the plane normal. Dotted with a box's extent, gives the box's projected radius.
         } mutable mFrustumPlanes[6];
     };
 }
\ No newline at end of file
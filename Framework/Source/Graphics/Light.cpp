@@ -334,8 +334,13 @@ namespace Falcor
         {
             if (mpMeshInstance)
             {
-                mat4& mx = (mat4&)mpMeshInstance->getTransformMatrix();
-                pGui->addFloat3Var("World Position", (vec3&)mx[3], -FLT_MAX, FLT_MAX);
+                const vec3 oldPosition = vec3(mpMeshInstance->getTransformMatrix()[3]);
+                vec3 position = oldPosition;
+                if (pGui->addFloat3Var("World Position", position, -FLT_MAX, FLT_MAX))
+                {
+                    // Move the base transform, the world matrix is recomputed from it
+                    mpMeshInstance->setTranslation(mpMeshInstance->getTranslation() + position - oldPosition, true);
+                }
             }
 
             Light::renderUI(pGui);
@@ -35,6 +35,7 @@
 #include "MaterialSystem.h"
 #include "Graphics/Program/ProgramVars.h"
 #include "Graphics/Program/GraphicsProgram.h"
+#include "Utils/HashUtils.h"
 #include <cstring>
 
 namespace Falcor
@@ -370,7 +371,46 @@ namespace Falcor
 
     bool Material::operator==(const Material& other) const
     {
-        return std::memcmp(&mData, &other.mData, sizeof(mData)) == 0 && mData.samplerState == other.mData.samplerState;
+        const MaterialValues& values = mData.values;
+        const MaterialValues& otherValues = other.mData.values;
+        if(std::memcmp(&mData.desc, &other.mData.desc, sizeof(mData.desc)) != 0 ||
+            std::memcmp(&values.layers, &otherValues.layers, sizeof(values.layers)) != 0 ||
+            std::memcmp(&values.height, &otherValues.height, sizeof(values.height)) != 0 ||
+            std::memcmp(&values.alphaThreshold, &otherValues.alphaThreshold, sizeof(values.alphaThreshold)) != 0)
+        {
+            return false;
+        }
+
+        auto pTextures = (const Texture::SharedPtr*)&mData.textures;
+        auto pOtherTextures = (const Texture::SharedPtr*)&other.mData.textures;
+        for(uint32_t i = 0; i < kTexCount; i++)
+        {
+            if(pTextures[i] != pOtherTextures[i])
+            {
+                return false;
+            }
+        }
+        return mData.samplerState == other.mData.samplerState && mDoubleSided == other.mDoubleSided;
+    }
+
+    uint64_t Material::getContentHash() const
+    {
+        // Hash the same bytes operator== compares
+        const MaterialValues& values = mData.values;
+        uint64_t hash = hashBytes(&mData.desc, sizeof(mData.desc));
+        hash = hashBytes(&values.layers, sizeof(values.layers), hash);
+        hash = hashBytes(&values.height, sizeof(values.height), hash);
+        hash = hashBytes(&values.alphaThreshold, sizeof(values.alphaThreshold), hash);
+
+        auto pTextures = (const Texture::SharedPtr*)&mData.textures;
+        for(uint32_t i = 0; i < kTexCount; i++)
+        {
+            const Texture* pTexture = pTextures[i].get();
+            hash = hashBytes(&pTexture, sizeof(pTexture), hash);
+        }
+        const Sampler* pSampler = mData.samplerState.get();
+        hash = hashBytes(&pSampler, sizeof(pSampler), hash);
+        return hashBytes(&mDoubleSided, sizeof(mDoubleSided), hash);
     }
 
     void Material::setLayerTexture(uint32_t layerId, const Texture::SharedPtr& pTexture)
@@ -305,10 +305,14 @@ namespace Falcor
         */
         Sampler::SharedPtr getSampler() const { return mData.samplerState; }
 
-        /** Comparison operator. Compares Materials by their data values.
+        /** Comparison operator. Compares Materials by their data values. The material ID is unique to each material, so it's not compared.
         */
         bool operator==(const Material& other) const;
 
+        /** Get a hash of the data compared by operator==. Materials which compare equal have the same hash.
+        */
+        uint64_t getContentHash() const;
+
         /** The a string for a MaterialDesc string which can be patched into the shader. It can be used to statically compile the material into a program, resulting in better generated code
         */
         const std::string& getMaterialDescStr() const { finalize(); return mDescString; }
@@ -28,8 +28,8 @@
 #include "Framework.h"
 #include "Animation.h"
 #include "AnimationController.h"
-#include "glm/gtc/matrix_transform.hpp"
-#include "glm/gtx/transform.hpp"
+#include "AnimationClip.h"
+#include <algorithm>
 
 namespace Falcor
 {
@@ -46,9 +46,9 @@ namespace Falcor
     Animation::~Animation() = default;
 
     template<typename T>
-    uint32_t findCurrentFrame(T channel, float ticks)
+    uint32_t findCurrentFrame(const T& channel, uint32_t firstKey, float ticks)
     {
-        uint32_t curKeyID = channel.lastKeyUsed;
+        uint32_t curKeyID = firstKey;
         while(curKeyID < channel.keys.size() - 1)
         {
             if(channel.keys[curKeyID + 1].time > ticks)
@@ -60,6 +60,13 @@ namespace Falcor
         return curKeyID;
     }
 
+    template<typename T>
+    uint32_t searchCurrentFrame(const T& channel, float ticks)
+    {
+        auto it = std::upper_bound(channel.keys.begin(), channel.keys.end(), ticks, [](float t, const auto& key) { return t < key.time; });
+        return (it == channel.keys.begin()) ? 0 : (uint32_t)(it - channel.keys.begin()) - 1;
+    }
+
     glm::vec3 interpolate(const glm::vec3& start, const glm::vec3& end, float ratio)
     {
         return start + ((end - start) * ratio);
@@ -71,30 +78,25 @@ namespace Falcor
     }
 
     template<typename KeyType>
-    KeyType Animation::calcCurrentKey(AnimationChannel<KeyType>& channel, float ticks, float lastUpdateTime)
+    KeyType Animation::calcCurrentKey(const AnimationChannel<KeyType>& channel, float ticks, uint32_t* pLastKey, const KeyType& defaultValue) const
     {
-        KeyType curValue;
+        KeyType curValue = defaultValue;
         if(channel.keys.size() > 0)
         {
-            if(ticks < lastUpdateTime)
-            {
-                channel.lastKeyUsed = 0;
-            }
-
             // search for the next keyframe
-            uint32_t curKeyIndex = findCurrentFrame(channel, ticks);
+            uint32_t curKeyIndex = pLastKey ? findCurrentFrame(channel, *pLastKey, ticks) : searchCurrentFrame(channel, ticks);
             uint32_t nextKeyIndex = (curKeyIndex + 1) % channel.keys.size();
             const AnimationKey<KeyType>& curKey = channel.keys[curKeyIndex];
             const AnimationKey<KeyType>& nextKey = channel.keys[nextKeyIndex];
 
-            assert(ticks >= curKey.time);
-            // Interpolate between them
+            // Interpolate between them. When the next key wrapped around, the interval continues into the next loop.
             float diff = nextKey.time - curKey.time;
             if(diff < 0)
             {
                 diff += mDuration;
             }
-            else if(diff == 0)
+
+            if(diff <= 0 || ticks <= curKey.time)
             {
                 curValue = curKey.value;
             }
@@ -103,34 +105,98 @@ namespace Falcor
                 float ratio = (ticks - curKey.time) / diff;
                 curValue = interpolate(curKey.value, nextKey.value, ratio);
             }
-            channel.lastKeyUsed = curKeyIndex;
+
+            if(pLastKey)
+            {
+                *pLastKey = curKeyIndex;
+            }
         }
         return curValue;
     }
 
-    void Animation::animate(double totalTime, AnimationController* pAnimationController)
+    uint32_t* Animation::updateCursor(Cursor* pCursor, float ticks) const
+    {
+        if(pCursor == nullptr)
+        {
+            return nullptr;
+        }
+
+        // Restart the search when the animation looped or jumped back. The keys are only allocated the first time.
+        const size_t keyCount = mAnimationSets.size() * 3;
+        if(pCursor->keys.size() != keyCount || ticks < pCursor->lastTicks)
+        {
+            pCursor->keys.assign(keyCount, 0);
+        }
+        pCursor->lastTicks = ticks;
+        return pCursor->keys.data();
+    }
+
+    void Animation::sampleSet(const AnimationSet& set, float ticks, uint32_t* pKeys, glm::vec3& translation, glm::quat& rotation, glm::vec3& scaling) const
+    {
+        translation = calcCurrentKey(set.translation, ticks, pKeys ? &pKeys[0] : nullptr, glm::vec3(0));
+        scaling = calcCurrentKey(set.scaling, ticks, pKeys ? &pKeys[1] : nullptr, glm::vec3(1));
+        rotation = calcCurrentKey(set.rotation, ticks, pKeys ? &pKeys[2] : nullptr, glm::quat(1, 0, 0, 0));
+    }
+
+    void Animation::animate(double totalTime, AnimationController* pAnimationController, Cursor* pCursor) const
     {
         // Calculate the relative time
         float ticks = (float)fmod(totalTime * mTicksPerSecond, mDuration);
 
-        for(auto& Key : mAnimationSets)
+        if(mpClip)
         {
-            glm::mat4 translation;
-            translation[3] = glm::vec4(calcCurrentKey(Key.translation, ticks, Key.lastUpdateTime), 1);
+            mpClip->animate(ticks, pAnimationController);
+            return;
+        }
 
-            glm::mat4 scaling;
-            if (Key.scaling.keys.size() > 0)
-            {
-                glm::scale(calcCurrentKey(Key.scaling, ticks, Key.lastUpdateTime));
-            }
+        uint32_t* pKeys = updateCursor(pCursor, ticks);
+        for(uint32_t i = 0; i < (uint32_t)mAnimationSets.size(); i++)
+        {
+            const AnimationSet& set = mAnimationSets[i];
+            glm::vec3 translation, scaling;
+            glm::quat rotation;
+            sampleSet(set, ticks, pKeys ? pKeys + i * 3 : nullptr, translation, rotation, scaling);
+            pAnimationController->setBoneLocalTransform(set.boneID, translation, rotation, scaling);
+        }
+    }
+
+    void Animation::samplePose(double totalTime, glm::vec3* pTranslations, glm::quat* pRotations, glm::vec3* pScalings, Cursor* pCursor) const
+    {
+        float ticks = (float)fmod(totalTime * mTicksPerSecond, mDuration);
+
+        if(mpClip)
+        {
+            mpClip->samplePose(ticks, pTranslations, pRotations, pScalings);
+            return;
+        }
 
-            glm::quat q = calcCurrentKey(Key.rotation, ticks, Key.lastUpdateTime);
-            glm::mat4 rotation = glm::mat4_cast(q);
+        uint32_t* pKeys = updateCursor(pCursor, ticks);
+        for(uint32_t i = 0; i < (uint32_t)mAnimationSets.size(); i++)
+        {
+            const AnimationSet& set = mAnimationSets[i];
+            sampleSet(set, ticks, pKeys ? pKeys + i * 3 : nullptr, pTranslations[set.boneID], pRotations[set.boneID], pScalings[set.boneID]);
+        }
+    }
 
-            Key.lastUpdateTime = ticks;
+    void Animation::compress(uint32_t sampleRate)
+    {
+        if(mpClip) return;
+        mpClip = AnimationClip::create(mAnimationSets, mDuration, mTicksPerSecond, sampleRate);
+        std::vector<AnimationSet>().swap(mAnimationSets);
+    }
 
-            glm::mat4 T = translation * rotation * scaling;
-            pAnimationController->setBoneLocalTransform(Key.boneID, T);
+    size_t Animation::getMemorySize() const
+    {
+        if(mpClip)
+        {
+            return sizeof(*this) + mpClip->getMemorySize();
+        }
+
+        size_t size = sizeof(*this) + mAnimationSets.size() * sizeof(AnimationSet);
+        for(const auto& set : mAnimationSets)
+        {
+            size += set.translation.keys.size() * sizeof(AnimationKey<glm::vec3>) + set.scaling.keys.size() * sizeof(AnimationKey<glm::vec3>) + set.rotation.keys.size() * sizeof(AnimationKey<glm::quat>);
         }
+        return size;
     }
 }
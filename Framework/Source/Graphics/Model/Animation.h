@@ -33,12 +33,15 @@
 namespace Falcor
 {
     class AnimationController;
+    class AnimationClip;
 
     class Animation
     {
     public:
         using UniquePtr = std::unique_ptr<Animation>;
         using UniqueConstPtr = std::unique_ptr<const Animation>;
+        using SharedPtr = std::shared_ptr<Animation>;
+        using SharedConstPtr = std::shared_ptr<const Animation>;
 
         template<typename T>
         struct AnimationKey
@@ -51,7 +54,6 @@ namespace Falcor
         struct AnimationChannel
         {
             std::vector<AnimationKey<T>> keys;
-            uint32_t lastKeyUsed = 0;
         };
 
         struct AnimationSet
@@ -60,13 +62,52 @@ namespace Falcor
             AnimationChannel<glm::vec3> translation;
             AnimationChannel<glm::vec3> scaling;
             AnimationChannel<glm::quat> rotation;
-            float lastUpdateTime = 0;
+        };
+
+        /** The position of a playback in the key-frames. Animations can be shared between controllers, so the state of the key search is kept by the caller.
+            Sampling forward from the last position doesn't search the whole channel.
+        */
+        struct Cursor
+        {
+            std::vector<uint32_t> keys;     // The last key used by each channel
+            float lastTicks = 0;
         };
 
         static UniquePtr create(const std::string& name, const std::vector<AnimationSet>& animationSets, float duration, float ticksPerSecond);
         ~Animation();
-        void animate(double totalTime, AnimationController* pAnimationController);
+
+        /** Apply the animation to a controller.
+            \param[in] totalTime The time in seconds. The animation loops.
+            \param[in] pCursor Optional playback position, updated by the call. Without it, the keys are found with a binary search.
+        */
+        void animate(double totalTime, AnimationController* pAnimationController, Cursor* pCursor = nullptr) const;
+
+        /** Sample the animation without applying it to a controller. Only the bones which the animation drives are written.
+            \param[in] totalTime The time in seconds. The animation loops.
+            \param[out] pTranslations, pRotations, pScalings Arrays indexed by bone ID.
+            \param[in] pCursor Optional playback position, updated by the call.
+        */
+        void samplePose(double totalTime, glm::vec3* pTranslations, glm::quat* pRotations, glm::vec3* pScalings, Cursor* pCursor = nullptr) const;
         const std::string& getName() const { return mName; }
+        float getDuration() const { return mDuration; }
+        float getTicksPerSecond() const { return mTicksPerSecond; }
+
+        /** Get the key-frames of the animation. This is empty once the animation is compressed, use getClip()->decompress() to get key-frames back.
+        */
+        const std::vector<AnimationSet>& getAnimationSets() const { return mAnimationSets; }
+
+        /** Replace the key-frames with an AnimationClip. Sampling the clip doesn't search for keys, and it uses a fraction of the memory.
+            \param[in] sampleRate The number of samples per second.
+        */
+        void compress(uint32_t sampleRate);
+
+        /** Get the compressed channels, or nullptr if the animation is not compressed
+        */
+        const AnimationClip* getClip() const { return mpClip.get(); }
+
+        /** Get the size of the key-frames, or of the clip if the animation is compressed, in bytes
+        */
+        size_t getMemorySize() const;
 
     private:
         Animation(const std::string& name, const std::vector<AnimationSet>& animationSets, float duration, float ticksPerSecond);
@@ -76,8 +117,12 @@ namespace Falcor
         float mTicksPerSecond;
 
         std::vector<AnimationSet> mAnimationSets;
+        std::unique_ptr<AnimationClip> mpClip;
+
+        uint32_t* updateCursor(Cursor* pCursor, float ticks) const;
+        void sampleSet(const AnimationSet& set, float ticks, uint32_t* pKeys, glm::vec3& translation, glm::quat& rotation, glm::vec3& scaling) const;
 
         template<typename _KeyType>
-        _KeyType calcCurrentKey(AnimationChannel<_KeyType>& channel, float ticks, float lastUpdateTime);
+        _KeyType calcCurrentKey(const AnimationChannel<_KeyType>& channel, float ticks, uint32_t* pLastKey, const _KeyType& defaultValue) const;
     };
 }
\ No newline at end of file
@@ -0,0 +1,354 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Framework.h"
+#include "AnimationClip.h"
+#include "AnimationController.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Falcor
+{
+    // The three smallest components of a unit quaternion are in [-1/sqrt(2), 1/sqrt(2)]
+    static const float kSqrt2 = 1.41421356f;
+    static const float kRotationScale = float(0x7fff);
+    static const float kVectorScale = float(0xffff);
+
+    static glm::vec3 lerpKeys(const glm::vec3& start, const glm::vec3& end, float ratio)
+    {
+        return start + ((end - start) * ratio);
+    }
+
+    static glm::quat lerpKeys(const glm::quat& start, const glm::quat& end, float ratio)
+    {
+        return glm::slerp(start, end, ratio);
+    }
+
+    /** Sample raw keys the same way Animation does, but with a binary search instead of the forward search from the last key
+    */
+    template<typename KeyType>
+    static KeyType sampleKeys(const std::vector<Animation::AnimationKey<KeyType>>& keys, float ticks, float duration, const KeyType& defaultValue)
+    {
+        if (keys.empty()) return defaultValue;
+
+        auto it = std::upper_bound(keys.begin(), keys.end(), ticks, [](float t, const Animation::AnimationKey<KeyType>& key) { return t < key.time; });
+        if (it == keys.begin()) return keys.front().value;
+
+        const size_t curKeyIndex = (it - keys.begin()) - 1;
+        const auto& curKey = keys[curKeyIndex];
+        const auto& nextKey = keys[(curKeyIndex + 1) % keys.size()];
+        float diff = nextKey.time - curKey.time;
+        if (diff < 0)
+        {
+            diff += duration;
+        }
+        if (diff <= 0 || ticks <= curKey.time) return curKey.value;
+        return lerpKeys(curKey.value, nextKey.value, (ticks - curKey.time) / diff);
+    }
+
+    /** Store the three smallest components in 15 bits each. The index of the largest component is kept in the top bits of the first two words, and its sign is made positive.
+    */
+    static void encodeRotation(const glm::quat& q, uint16_t* pDst)
+    {
+        float c[4] = { q.x, q.y, q.z, q.w };
+        uint32_t largest = 0;
+        for (uint32_t i = 1; i < 4; i++)
+        {
+            if (std::abs(c[i]) > std::abs(c[largest])) largest = i;
+        }
+        const float sign = (c[largest] < 0) ? -1.0f : 1.0f;
+
+        uint32_t values[3];
+        for (uint32_t i = 0, j = 0; i < 4; i++)
+        {
+            if (i == largest) continue;
+            const float normalized = glm::clamp((c[i] * sign * kSqrt2 + 1) * 0.5f, 0.0f, 1.0f);
+            values[j++] = (uint32_t)std::lround(normalized * kRotationScale);
+        }
+        pDst[0] = uint16_t(values[0] | ((largest >> 1) << 15));
+        pDst[1] = uint16_t(values[1] | ((largest & 1) << 15));
+        pDst[2] = uint16_t(values[2]);
+    }
+
+    static glm::quat decodeRotation(const uint16_t* pSrc)
+    {
+        // The components stored in the three words, for each index of the largest component
+        static const uint8_t kStoredComponents[4][3] = { { 1, 2, 3 }, { 0, 2, 3 }, { 0, 1, 3 }, { 0, 1, 2 } };
+        const uint32_t largest = ((pSrc[0] >> 15) << 1) | (pSrc[1] >> 15);
+        const float a = (pSrc[0] & 0x7fff) * (kSqrt2 / kRotationScale) - (1 / kSqrt2);
+        const float b = (pSrc[1] & 0x7fff) * (kSqrt2 / kRotationScale) - (1 / kSqrt2);
+        const float c = pSrc[2] * (kSqrt2 / kRotationScale) - (1 / kSqrt2);
+
+        float q[4];
+        q[kStoredComponents[largest][0]] = a;
+        q[kStoredComponents[largest][1]] = b;
+        q[kStoredComponents[largest][2]] = c;
+        q[largest] = std::sqrt(std::max(0.0f, 1 - a * a - b * b - c * c));
+        return glm::quat(q[3], q[0], q[1], q[2]);
+    }
+
+    AnimationClip::UniquePtr AnimationClip::create(const std::vector<Animation::AnimationSet>& animationSets, float duration, float ticksPerSecond, uint32_t sampleRate, float constantThreshold)
+    {
+        UniquePtr pClip = UniquePtr(new AnimationClip);
+        const float seconds = (ticksPerSecond > 0) ? duration / ticksPerSecond : 0;
+        pClip->mDuration = duration;
+        pClip->mFrameCount = std::max(2u, (uint32_t)std::ceil(seconds * sampleRate) + 1);
+        pClip->mFramesPerTick = (duration > 0) ? (pClip->mFrameCount - 1) / duration : 0;
+
+        const uint32_t frameCount = pClip->mFrameCount;
+        std::vector<float> times(frameCount);
+        for (uint32_t f = 0; f < frameCount; f++)
+        {
+            times[f] = duration * f / (frameCount - 1);
+        }
+
+        // Resample the channels and split them into constants and animated tracks
+        std::vector<std::vector<glm::vec3>> vectorTracks;
+        std::vector<std::vector<glm::quat>> rotationTracks;
+        std::vector<glm::vec3> vectors(frameCount);
+        std::vector<glm::quat> rotations(frameCount);
+
+        auto addVectorChannel = [&](const std::vector<Animation::AnimationKey<glm::vec3>>& keys, const glm::vec3& defaultValue)
+        {
+            bool constant = true;
+            for (uint32_t f = 0; f < frameCount; f++)
+            {
+                vectors[f] = sampleKeys(keys, times[f], duration, defaultValue);
+                const glm::vec3 diff = glm::abs(vectors[f] - vectors[0]);
+                constant = constant && (diff.x <= constantThreshold) && (diff.y <= constantThreshold) && (diff.z <= constantThreshold);
+            }
+
+            if (constant)
+            {
+                pClip->mConstantVectors.push_back(vectors[0]);
+                return (uint32_t)(pClip->mConstantVectors.size() - 1) | kConstantBit;
+            }
+            vectorTracks.push_back(vectors);
+            return (uint32_t)(vectorTracks.size() - 1);
+        };
+
+        auto addRotationChannel = [&](const std::vector<Animation::AnimationKey<glm::quat>>& keys)
+        {
+            bool constant = true;
+            for (uint32_t f = 0; f < frameCount; f++)
+            {
+                rotations[f] = glm::normalize(sampleKeys(keys, times[f], duration, glm::quat(1, 0, 0, 0)));
+
+                // q and -q are the same rotation
+                if (glm::dot(rotations[f], rotations[0]) < 0)
+                {
+                    rotations[f] = -rotations[f];
+                }
+                const glm::quat& q0 = rotations[0];
+                const glm::quat& q = rotations[f];
+                constant = constant && (std::abs(q.x - q0.x) <= constantThreshold) && (std::abs(q.y - q0.y) <= constantThreshold) && (std::abs(q.z - q0.z) <= constantThreshold) && (std::abs(q.w - q0.w) <= constantThreshold);
+            }
+
+            if (constant)
+            {
+                pClip->mConstantRotations.push_back(rotations[0]);
+                return (uint32_t)(pClip->mConstantRotations.size() - 1) | kConstantBit;
+            }
+            rotationTracks.push_back(rotations);
+            return (uint32_t)(rotationTracks.size() - 1);
+        };
+
+        pClip->mSets.resize(animationSets.size());
+        for (size_t i = 0; i < animationSets.size(); i++)
+        {
+            const Animation::AnimationSet& animationSet = animationSets[i];
+            Set& set = pClip->mSets[i];
+            set.boneID = animationSet.boneID;
+            set.translation = addVectorChannel(animationSet.translation.keys, glm::vec3(0));
+            set.rotation = addRotationChannel(animationSet.rotation.keys);
+            set.scaling = addVectorChannel(animationSet.scaling.keys, glm::vec3(1));
+        }
+
+        // Quantize the animated tracks
+        pClip->mAnimatedRotationCount = (uint32_t)rotationTracks.size();
+        pClip->mFrameStride = 3 * (uint32_t)(rotationTracks.size() + vectorTracks.size());
+        pClip->mFrames.resize((size_t)pClip->mFrameStride * frameCount);
+        pClip->mRanges.resize(vectorTracks.size());
+
+        for (uint32_t r = 0; r < (uint32_t)rotationTracks.size(); r++)
+        {
+            for (uint32_t f = 0; f < frameCount; f++)
+            {
+                encodeRotation(rotationTracks[r][f], &pClip->mFrames[f * pClip->mFrameStride + 3 * r]);
+            }
+        }
+
+        for (uint32_t v = 0; v < (uint32_t)vectorTracks.size(); v++)
+        {
+            const auto& track = vectorTracks[v];
+            glm::vec3 minValue = track[0];
+            glm::vec3 maxValue = track[0];
+            for (const auto& value : track)
+            {
+                minValue = glm::min(minValue, value);
+                maxValue = glm::max(maxValue, value);
+            }
+            const glm::vec3 extent = maxValue - minValue;
+            pClip->mRanges[v].min = minValue;
+            pClip->mRanges[v].step = extent / kVectorScale;
+
+            const uint32_t offset = 3 * (pClip->mAnimatedRotationCount + v);
+            for (uint32_t f = 0; f < frameCount; f++)
+            {
+                uint16_t* pDst = &pClip->mFrames[f * pClip->mFrameStride + offset];
+                for (int c = 0; c < 3; c++)
+                {
+                    const float normalized = (extent[c] > 0) ? (track[f][c] - minValue[c]) / extent[c] : 0;
+                    pDst[c] = (uint16_t)std::lround(glm::clamp(normalized, 0.0f, 1.0f) * kVectorScale);
+                }
+            }
+        }
+
+        return pClip;
+    }
+
+    void AnimationClip::findFrames(float ticks, const uint16_t*& pFrame0, const uint16_t*& pFrame1, float& t) const
+    {
+        const float position = glm::clamp(ticks * mFramesPerTick, 0.0f, float(mFrameCount - 1));
+        const uint32_t frame = std::min((uint32_t)position, mFrameCount - 2);
+        t = position - frame;
+        pFrame0 = mFrames.data() + (size_t)frame * mFrameStride;
+        pFrame1 = pFrame0 + mFrameStride;
+    }
+
+    glm::vec3 AnimationClip::sampleVector(uint32_t channel, const uint16_t* pFrame0, const uint16_t* pFrame1, float t) const
+    {
+        if (channel & kConstantBit)
+        {
+            return mConstantVectors[channel & ~kConstantBit];
+        }
+
+        const Range& range = mRanges[channel];
+        const uint32_t offset = 3 * (mAnimatedRotationCount + channel);
+        const glm::vec3 v0(pFrame0[offset], pFrame0[offset + 1], pFrame0[offset + 2]);
+        const glm::vec3 v1(pFrame1[offset], pFrame1[offset + 1], pFrame1[offset + 2]);
+        return range.min + lerpKeys(v0, v1, t) * range.step;
+    }
+
+    glm::quat AnimationClip::sampleRotation(uint32_t channel, const uint16_t* pFrame0, const uint16_t* pFrame1, float t) const
+    {
+        if (channel & kConstantBit)
+        {
+            return mConstantRotations[channel & ~kConstantBit];
+        }
+
+        // The samples are dense, so a normalized lerp is close enough to a slerp
+        const glm::quat q0 = decodeRotation(pFrame0 + 3 * channel);
+        glm::quat q1 = decodeRotation(pFrame1 + 3 * channel);
+        if (glm::dot(q0, q1) < 0)
+        {
+            q1 = -q1;
+        }
+        return glm::normalize(q0 * (1 - t) + q1 * t);
+    }
+
+    void AnimationClip::animate(float ticks, AnimationController* pAnimationController) const
+    {
+        const uint16_t* pFrame0;
+        const uint16_t* pFrame1;
+        float t;
+        findFrames(ticks, pFrame0, pFrame1, t);
+
+        for (const auto& set : mSets)
+        {
+            pAnimationController->setBoneLocalTransform(set.boneID, sampleVector(set.translation, pFrame0, pFrame1, t), sampleRotation(set.rotation, pFrame0, pFrame1, t), sampleVector(set.scaling, pFrame0, pFrame1, t));
+        }
+    }
+
+    void AnimationClip::samplePose(float ticks, glm::vec3* pTranslations, glm::quat* pRotations, glm::vec3* pScalings) const
+    {
+        const uint16_t* pFrame0;
+        const uint16_t* pFrame1;
+        float t;
+        findFrames(ticks, pFrame0, pFrame1, t);
+
+        for (const auto& set : mSets)
+        {
+            pTranslations[set.boneID] = sampleVector(set.translation, pFrame0, pFrame1, t);
+            pRotations[set.boneID] = sampleRotation(set.rotation, pFrame0, pFrame1, t);
+            pScalings[set.boneID] = sampleVector(set.scaling, pFrame0, pFrame1, t);
+        }
+    }
+
+    void AnimationClip::sample(uint32_t setID, float ticks, glm::vec3& translation, glm::quat& rotation, glm::vec3& scaling) const
+    {
+        const uint16_t* pFrame0;
+        const uint16_t* pFrame1;
+        float t;
+        findFrames(ticks, pFrame0, pFrame1, t);
+
+        const Set& set = mSets[setID];
+        translation = sampleVector(set.translation, pFrame0, pFrame1, t);
+        rotation = sampleRotation(set.rotation, pFrame0, pFrame1, t);
+        scaling = sampleVector(set.scaling, pFrame0, pFrame1, t);
+    }
+
+    void AnimationClip::decompress(std::vector<Animation::AnimationSet>& animationSets) const
+    {
+        animationSets.resize(mSets.size());
+        for (size_t i = 0; i < mSets.size(); i++)
+        {
+            const Set& set = mSets[i];
+            Animation::AnimationSet& animationSet = animationSets[i];
+            animationSet.boneID = set.boneID;
+            animationSet.translation.keys.clear();
+            animationSet.rotation.keys.clear();
+            animationSet.scaling.keys.clear();
+
+            const uint32_t keyCount = (set.translation & set.rotation & set.scaling & kConstantBit) ? 1 : mFrameCount;
+            for (uint32_t f = 0; f < mFrameCount; f++)
+            {
+                const uint16_t* pFrame = mFrames.data() + (size_t)f * mFrameStride;
+                const float time = mDuration * f / (mFrameCount - 1);
+                if (f == 0 || (set.translation & kConstantBit) == 0)
+                {
+                    animationSet.translation.keys.push_back({ sampleVector(set.translation, pFrame, pFrame, 0), time });
+                }
+                if (f == 0 || (set.rotation & kConstantBit) == 0)
+                {
+                    animationSet.rotation.keys.push_back({ sampleRotation(set.rotation, pFrame, pFrame, 0), time });
+                }
+                if (f == 0 || (set.scaling & kConstantBit) == 0)
+                {
+                    animationSet.scaling.keys.push_back({ sampleVector(set.scaling, pFrame, pFrame, 0), time });
+                }
+                if (f + 1 == keyCount) break;
+            }
+        }
+    }
+
+    size_t AnimationClip::getMemorySize() const
+    {
+        return sizeof(*this) + mSets.size() * sizeof(Set) + mConstantVectors.size() * sizeof(glm::vec3) + mConstantRotations.size() * sizeof(glm::quat)
+            + mRanges.size() * sizeof(Range) + mFrames.size() * sizeof(uint16_t);
+    }
+}
@@ -0,0 +1,129 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <vector>
+#include <memory>
+#include "Animation.h"
+
+namespace Falcor
+{
+    class AnimationController;
+
+    /** Compressed, read-only storage for the channels of an Animation.
+        Channels are resampled at a fixed rate, so the samples around any time are found with a single multiplication and no search. Seeking costs the same as playing forward.
+        Rotations are stored in 48 bits using the smallest-three encoding. Translations and scales are stored as 16-bit values, quantized over the range of their channel.
+        Channels which don't change are stored once, in full precision.
+        The samples of all the animated channels of a frame are stored together, so sampling a time reads two contiguous blocks of memory.
+    */
+    class AnimationClip
+    {
+    public:
+        using UniquePtr = std::unique_ptr<AnimationClip>;
+        using UniqueConstPtr = std::unique_ptr<const AnimationClip>;
+
+        static const uint32_t kDefaultSampleRate = 30;
+
+        /** Compress the channels of an animation.
+            \param[in] animationSets The channels. Channels without keys use the identity value, like in Animation.
+            \param[in] duration The duration of the animation, in ticks.
+            \param[in] ticksPerSecond The number of ticks per second.
+            \param[in] sampleRate The number of samples per second.
+            \param[in] constantThreshold A channel whose components stay within this distance of their first sample is stored as a constant.
+        */
+        static UniquePtr create(const std::vector<Animation::AnimationSet>& animationSets, float duration, float ticksPerSecond, uint32_t sampleRate = kDefaultSampleRate, float constantThreshold = 1e-5f);
+
+        /** Sample the channels and set the local transforms of the bones.
+            \param[in] ticks The time, in [0, duration].
+            \param[in] pAnimationController The controller which owns the bones.
+        */
+        void animate(float ticks, AnimationController* pAnimationController) const;
+
+        /** Sample the channels without applying them to a controller. Only the bones which have an animation set are written.
+            \param[in] ticks The time, in [0, duration].
+            \param[out] pTranslations, pRotations, pScalings Arrays indexed by bone ID.
+        */
+        void samplePose(float ticks, glm::vec3* pTranslations, glm::quat* pRotations, glm::vec3* pScalings) const;
+
+        /** Sample the channels of a single bone.
+            \param[in] setID The index of the bone's animation set, in the order it was passed to create().
+            \param[in] ticks The time, in [0, duration].
+        */
+        void sample(uint32_t setID, float ticks, glm::vec3& translation, glm::quat& rotation, glm::vec3& scaling) const;
+
+        /** Convert back to key-frames, with a key per sample of animated channels and a single key for constant channels
+        */
+        void decompress(std::vector<Animation::AnimationSet>& animationSets) const;
+
+        uint32_t getSetCount() const { return (uint32_t)mSets.size(); }
+        uint32_t getFrameCount() const { return mFrameCount; }
+
+        /** Get the number of channels which are stored per frame. The rest are constant.
+        */
+        uint32_t getAnimatedChannelCount() const { return mAnimatedRotationCount + (uint32_t)mRanges.size(); }
+
+        /** Get the size of the compressed data in bytes
+        */
+        size_t getMemorySize() const;
+
+    private:
+        AnimationClip() = default;
+
+        // Channels refer either to an animated track or to a constant
+        static const uint32_t kConstantBit = 0x80000000;
+
+        struct Set
+        {
+            uint32_t boneID;
+            uint32_t translation;
+            uint32_t rotation;
+            uint32_t scaling;
+        };
+
+        struct Range
+        {
+            glm::vec3 min;
+            glm::vec3 step;
+        };
+
+        std::vector<Set> mSets;
+        std::vector<glm::vec3> mConstantVectors;
+        std::vector<glm::quat> mConstantRotations;
+        std::vector<Range> mRanges;         // One per animated translation or scaling track
+        std::vector<uint16_t> mFrames;      // Frame-major. Each frame holds the rotation tracks followed by the translation and scaling tracks, 3 values each.
+
+        uint32_t mAnimatedRotationCount = 0;
+        uint32_t mFrameStride = 0;          // In uint16_t
+        uint32_t mFrameCount = 0;
+        float mDuration = 0;
+        float mFramesPerTick = 0;
+
+        void findFrames(float ticks, const uint16_t*& pFrame0, const uint16_t*& pFrame1, float& t) const;
+        glm::vec3 sampleVector(uint32_t channel, const uint16_t* pFrame0, const uint16_t* pFrame1, float t) const;
+        glm::quat sampleRotation(uint32_t channel, const uint16_t* pFrame0, const uint16_t* pFrame1, float t) const;
+    };
+}
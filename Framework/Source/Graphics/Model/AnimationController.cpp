@@ -30,10 +30,170 @@
 #include "Model.h"
 #include <fstream>
 #include "Animation.h"
+#include "Utils/JobSystem.h"
 #include <algorithm>
 
+#if defined(_M_X64) || defined(__x86_64__)
+#define FALCOR_ANIMATION_SIMD
+#include <immintrin.h>
+#endif
+
 namespace Falcor
 {
+    // Small enough to balance characters with very different bone counts across the threads
+    static const uint32_t kControllersPerBatch = 4;
+
+#ifdef FALCOR_ANIMATION_SIMD
+    static __m128 cross(__m128 a, __m128 b)
+    {
+        const __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+        const __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+        const __m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+        return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+    }
+
+    static float dot3(__m128 a, __m128 b)
+    {
+        const __m128 m = _mm_mul_ps(a, b);
+        return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2))));
+    }
+#endif
+
+    /** Build translate(t) * mat4_cast(q) * scale(s)
+    */
+    static void composeTransform(const glm::vec3& t, const glm::quat& q, const glm::vec3& s, glm::mat4& m)
+    {
+#ifdef FALCOR_ANIMATION_SIMD
+        // Each rotation column is a unit axis plus two vectors of products of the quaternion components, with per-lane signs
+        const __m128 quat = _mm_setr_ps(q.x, q.y, q.z, q.w);
+        const __m128 quat2 = _mm_add_ps(quat, quat);
+
+        // (1 - 2(yy + zz), 2(xy + wz), 2(xz - wy))
+        __m128 a = _mm_mul_ps(_mm_shuffle_ps(quat, quat, _MM_SHUFFLE(3, 0, 0, 1)), _mm_shuffle_ps(quat2, quat2, _MM_SHUFFLE(3, 2, 1, 1)));
+        __m128 b = _mm_mul_ps(_mm_shuffle_ps(quat, quat, _MM_SHUFFLE(3, 3, 3, 2)), _mm_shuffle_ps(quat2, quat2, _MM_SHUFFLE(3, 1, 2, 2)));
+        __m128 c0 = _mm_add_ps(_mm_setr_ps(1, 0, 0, 0), _mm_add_ps(_mm_mul_ps(a, _mm_setr_ps(-1, 1, 1, 0)), _mm_mul_ps(b, _mm_setr_ps(-1, 1, -1, 0))));
+
+        // (2(xy - wz), 1 - 2(xx + zz), 2(yz + wx))
+        a = _mm_mul_ps(_mm_shuffle_ps(quat, quat, _MM_SHUFFLE(3, 1, 0, 0)), _mm_shuffle_ps(quat2, quat2, _MM_SHUFFLE(3, 2, 0, 1)));
+        b = _mm_mul_ps(_mm_shuffle_ps(quat, quat, _MM_SHUFFLE(3, 3, 2, 3)), _mm_shuffle_ps(quat2, quat2, _MM_SHUFFLE(3, 0, 2, 2)));
+        __m128 c1 = _mm_add_ps(_mm_setr_ps(0, 1, 0, 0), _mm_add_ps(_mm_mul_ps(a, _mm_setr_ps(1, -1, 1, 0)), _mm_mul_ps(b, _mm_setr_ps(-1, -1, 1, 0))));
+
+        // (2(xz + wy), 2(yz - wx), 1 - 2(xx + yy))
+        a = _mm_mul_ps(_mm_shuffle_ps(quat, quat, _MM_SHUFFLE(3, 0, 1, 0)), _mm_shuffle_ps(quat2, quat2, _MM_SHUFFLE(3, 0, 2, 2)));
+        b = _mm_mul_ps(_mm_shuffle_ps(quat, quat, _MM_SHUFFLE(3, 1, 3, 3)), _mm_shuffle_ps(quat2, quat2, _MM_SHUFFLE(3, 1, 0, 1)));
+        __m128 c2 = _mm_add_ps(_mm_setr_ps(0, 0, 1, 0), _mm_add_ps(_mm_mul_ps(a, _mm_setr_ps(1, 1, -1, 0)), _mm_mul_ps(b, _mm_setr_ps(1, -1, -1, 0))));
+
+        _mm_storeu_ps(&m[0][0], _mm_mul_ps(c0, _mm_set1_ps(s.x)));
+        _mm_storeu_ps(&m[1][0], _mm_mul_ps(c1, _mm_set1_ps(s.y)));
+        _mm_storeu_ps(&m[2][0], _mm_mul_ps(c2, _mm_set1_ps(s.z)));
+        _mm_storeu_ps(&m[3][0], _mm_setr_ps(t.x, t.y, t.z, 1));
+#else
+        const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+        const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+        const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+        m[0] = glm::vec4(1 - 2 * (yy + zz), 2 * (xy + wz), 2 * (xz - wy), 0) * s.x;
+        m[1] = glm::vec4(2 * (xy - wz), 1 - 2 * (xx + zz), 2 * (yz + wx), 0) * s.y;
+        m[2] = glm::vec4(2 * (xz + wy), 2 * (yz - wx), 1 - 2 * (xx + yy), 0) * s.z;
+        m[3] = glm::vec4(t, 1);
+#endif
+    }
+
+    /** Split an affine transform without shear into translation, rotation and scale
+    */
+    static void decomposeTransform(const glm::mat4& m, glm::vec3& t, glm::quat& r, glm::vec3& s)
+    {
+        t = glm::vec3(m[3]);
+        const glm::vec3 axes[3] = { glm::vec3(m[0]), glm::vec3(m[1]), glm::vec3(m[2]) };
+        s = glm::vec3(glm::length(axes[0]), glm::length(axes[1]), glm::length(axes[2]));
+        if (glm::dot(glm::cross(axes[0], axes[1]), axes[2]) < 0)
+        {
+            s.x = -s.x;
+        }
+
+        glm::mat3 rotation;
+        for (int i = 0; i < 3; i++)
+        {
+            if (s[i] != 0)
+            {
+                rotation[i] = axes[i] / s[i];
+            }
+        }
+        r = glm::normalize(glm::quat_cast(rotation));
+    }
+
+    static glm::quat nlerp(const glm::quat& a, glm::quat b, float t)
+    {
+        if (glm::dot(a, b) < 0)
+        {
+            b = -b;
+        }
+        return glm::normalize(a * (1 - t) + b * t);
+    }
+
+    static void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& result)
+    {
+#ifdef FALCOR_ANIMATION_SIMD
+        const __m128 a0 = _mm_loadu_ps(&a[0][0]);
+        const __m128 a1 = _mm_loadu_ps(&a[1][0]);
+        const __m128 a2 = _mm_loadu_ps(&a[2][0]);
+        const __m128 a3 = _mm_loadu_ps(&a[3][0]);
+        for (int i = 0; i < 4; i++)
+        {
+            __m128 c = _mm_mul_ps(a0, _mm_set1_ps(b[i][0]));
+            c = _mm_add_ps(c, _mm_mul_ps(a1, _mm_set1_ps(b[i][1])));
+            c = _mm_add_ps(c, _mm_mul_ps(a2, _mm_set1_ps(b[i][2])));
+            c = _mm_add_ps(c, _mm_mul_ps(a3, _mm_set1_ps(b[i][3])));
+            _mm_storeu_ps(&result[i][0], c);
+        }
+#else
+        result = a * b;
+#endif
+    }
+
+    /** Calculate transpose(inverse(m)) of an affine matrix.
+        The inverse-transpose of the upper 3x3 part is its cofactor matrix divided by the determinant, and the columns of the cofactor matrix are cross products of the columns of the 3x3 part.
+        The translation of the inverse ends up in the last row.
+    */
+    static void calcInverseTranspose(const glm::mat4& m, glm::mat4& result)
+    {
+#ifdef FALCOR_ANIMATION_SIMD
+        const __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+        const __m128 a0 = _mm_and_ps(_mm_loadu_ps(&m[0][0]), mask);
+        const __m128 a1 = _mm_and_ps(_mm_loadu_ps(&m[1][0]), mask);
+        const __m128 a2 = _mm_and_ps(_mm_loadu_ps(&m[2][0]), mask);
+        const __m128 t = _mm_and_ps(_mm_loadu_ps(&m[3][0]), mask);
+        __m128 c0 = cross(a1, a2);
+        __m128 c1 = cross(a2, a0);
+        __m128 c2 = cross(a0, a1);
+        const float det = dot3(a0, c0);
+        const __m128 invDet = _mm_set1_ps(det != 0 ? 1 / det : 0);
+        c0 = _mm_mul_ps(c0, invDet);
+        c1 = _mm_mul_ps(c1, invDet);
+        c2 = _mm_mul_ps(c2, invDet);
+        _mm_storeu_ps(&result[0][0], c0);
+        _mm_storeu_ps(&result[1][0], c1);
+        _mm_storeu_ps(&result[2][0], c2);
+        _mm_storeu_ps(&result[3][0], _mm_setr_ps(0, 0, 0, 1));
+        result[0][3] = -dot3(c0, t);
+        result[1][3] = -dot3(c1, t);
+        result[2][3] = -dot3(c2, t);
+#else
+        const glm::vec3 a0(m[0]), a1(m[1]), a2(m[2]), t(m[3]);
+        glm::vec3 c0 = glm::cross(a1, a2);
+        glm::vec3 c1 = glm::cross(a2, a0);
+        glm::vec3 c2 = glm::cross(a0, a1);
+        const float det = glm::dot(a0, c0);
+        const float invDet = det != 0 ? 1 / det : 0;
+        c0 *= invDet;
+        c1 *= invDet;
+        c2 *= invDet;
+        result[0] = glm::vec4(c0, -glm::dot(c0, t));
+        result[1] = glm::vec4(c1, -glm::dot(c1, t));
+        result[2] = glm::vec4(c2, -glm::dot(c2, t));
+        result[3] = glm::vec4(0, 0, 0, 1);
+#endif
+    }
+
     void dumpBonesHeirarchy(const std::string& filename, Bone* pBone, uint32_t count)
     {
         std::ofstream dotfile;
@@ -63,51 +223,431 @@ namespace Falcor
 
     AnimationController::UniquePtr AnimationController::create(const std::vector<Bone>& Bones)
     {
-        return UniquePtr(new AnimationController(Bones));
+        return UniquePtr(new AnimationController(createSkeleton(Bones)));
     }
 
     AnimationController::UniquePtr AnimationController::create(const AnimationController& other)
     {
-        return UniquePtr(new AnimationController(other.mBones));
+        UniquePtr pController = UniquePtr(new AnimationController(other.mpSkeleton));
+        for(const auto& pAnimation : other.mAnimations)
+        {
+            pController->addAnimation(pAnimation);
+        }
+        pController->setActiveAnimation(other.mActiveAnimation);
+        return pController;
     }
 
-    AnimationController::AnimationController(const std::vector<Bone>& Bones)
+    AnimationController::AnimationController(const std::shared_ptr<const Skeleton>& pSkeleton) : mpSkeleton(pSkeleton)
     {
-        mBones = Bones;
-        mBoneTransforms.resize(mBones.size());
-        mBoneInvTransposeTransforms.resize(mBones.size());
+        const Skeleton& skeleton = *mpSkeleton;
+        const size_t boneCount = skeleton.bones.size();
+        mBoneTransforms.resize(boneCount);
+        mBoneInvTransposeTransforms.resize(boneCount);
+        mPose.localTransforms.resize(boneCount);
+        mPose.globalTransforms.resize(boneCount);
+        for(size_t i = 0; i < boneCount; i++)
+        {
+            const Bone& bone = skeleton.bones[skeleton.evalOrder[i]];
+            mPose.localTransforms[i] = bone.localTransform;
+            mPose.globalTransforms[i] = bone.globalTransform;
+        }
+
         setActiveAnimation(kBindPoseAnimationId);
     }
 
+    void AnimationController::PoseBuffer::resize(size_t count)
+    {
+        translations.resize(count);
+        rotations.resize(count);
+        scalings.resize(count);
+    }
+
+    std::shared_ptr<const AnimationController::Skeleton> AnimationController::createSkeleton(const std::vector<Bone>& bones)
+    {
+        auto pSkeleton = std::make_shared<Skeleton>();
+        pSkeleton->bones = bones;
+        sortBones(*pSkeleton);
+
+        PoseBuffer& bindPose = pSkeleton->bindPose;
+        bindPose.resize(bones.size());
+        for(uint32_t i = 0; i < (uint32_t)bones.size(); i++)
+        {
+            decomposeTransform(bones[i].originalLocalTransform, bindPose.translations[i], bindPose.rotations[i], bindPose.scalings[i]);
+        }
+        return pSkeleton;
+    }
+
+    void AnimationController::sortBones(Skeleton& skeleton)
+    {
+        std::vector<Bone>& bones = skeleton.bones;
+        std::vector<uint32_t>& evalOrder = skeleton.evalOrder;
+        std::vector<uint32_t>& boneToEvalIndex = skeleton.boneToEvalIndex;
+        const uint32_t boneCount = (uint32_t)bones.size();
+        std::vector<std::vector<uint32_t>> children(boneCount);
+        std::vector<uint32_t> stack;
+        for (uint32_t i = 0; i < boneCount; i++)
+        {
+            const uint32_t parentID = bones[i].parentID;
+            if (parentID == kInvalidBoneID)
+            {
+                stack.push_back(i);
+            }
+            else if (parentID >= boneCount || parentID == i)
+            {
+                logWarning("AnimationController: bone '" + bones[i].name + "' has an invalid parent. Treating it as a root.");
+                bones[i].parentID = kInvalidBoneID;
+                stack.push_back(i);
+            }
+            else
+            {
+                children[parentID].push_back(i);
+            }
+        }
+
+        // Depth-first, so that the bones of a sub-tree are next to each other. Siblings keep their original order.
+        std::reverse(stack.begin(), stack.end());
+        evalOrder.clear();
+        evalOrder.reserve(boneCount);
+        while (stack.empty() == false)
+        {
+            const uint32_t boneID = stack.back();
+            stack.pop_back();
+            evalOrder.push_back(boneID);
+            stack.insert(stack.end(), children[boneID].rbegin(), children[boneID].rend());
+        }
+
+        boneToEvalIndex.assign(boneCount, (uint32_t)kInvalidBoneID);
+        for (uint32_t i = 0; i < (uint32_t)evalOrder.size(); i++)
+        {
+            boneToEvalIndex[evalOrder[i]] = i;
+        }
+
+        // Bones which are part of a cycle can't be reached from a root
+        if (evalOrder.size() != boneCount)
+        {
+            logWarning("AnimationController: the bone hierarchy contains a cycle. Bones which can't be reached from a root are treated as roots.");
+            for (uint32_t i = 0; i < boneCount; i++)
+            {
+                if (boneToEvalIndex[i] == kInvalidBoneID)
+                {
+                    bones[i].parentID = kInvalidBoneID;
+                    boneToEvalIndex[i] = (uint32_t)evalOrder.size();
+                    evalOrder.push_back(i);
+                }
+            }
+        }
+
+        skeleton.evalParents.resize(boneCount);
+        skeleton.evalOffsets.resize(boneCount);
+        for (uint32_t i = 0; i < boneCount; i++)
+        {
+            const Bone& bone = bones[evalOrder[i]];
+            skeleton.evalParents[i] = (bone.parentID == kInvalidBoneID) ? (uint32_t)kInvalidBoneID : boneToEvalIndex[bone.parentID];
+            assert(skeleton.evalParents[i] == kInvalidBoneID || skeleton.evalParents[i] < i);
+            skeleton.evalOffsets[i] = bone.offset;
+        }
+    }
+
     void AnimationController::addAnimation(Animation::UniquePtr pAnimation)
     {
-        mAnimations.push_back(std::move(pAnimation));
+        addAnimation(Animation::SharedConstPtr(std::move(pAnimation)));
+    }
+
+    void AnimationController::addAnimation(const Animation::SharedConstPtr& pAnimation)
+    {
+        mAnimations.push_back(pAnimation);
+        mCursors.emplace_back();
+    }
+
+    size_t AnimationController::getInstanceMemorySize() const
+    {
+        size_t size = sizeof(*this);
+        size += (mBoneTransforms.capacity() + mBoneInvTransposeTransforms.capacity() + mPose.localTransforms.capacity() + mPose.globalTransforms.capacity()) * sizeof(glm::mat4);
+        size += mAnimations.capacity() * sizeof(Animation::SharedConstPtr) + mCursors.capacity() * sizeof(Animation::Cursor);
+        for(const auto& cursor : mCursors)
+        {
+            size += cursor.keys.capacity() * sizeof(uint32_t);
+        }
+        for(const PoseBuffer* pBuffer : { &mBlend.pose, &mBlend.sample, &mBlend.layerPose })
+        {
+            size += (pBuffer->translations.capacity() + pBuffer->scalings.capacity()) * sizeof(glm::vec3) + pBuffer->rotations.capacity() * sizeof(glm::quat);
+        }
+        for(const auto& layer : mLayers)
+        {
+            size += sizeof(Layer) + layer.boneMask.capacity() * sizeof(float) + layer.animations.capacity() * sizeof(LayerAnimation);
+        }
+        return size;
     }
 
     AnimationController::~AnimationController() = default;
 
     void AnimationController::setBoneLocalTransform(uint32_t boneID, const glm::mat4& transform)
     {
-        assert(boneID < mBones.size());
-        mBones[boneID].localTransform = transform;
+        assert(boneID < getBoneCount());
+        mPose.localTransforms[mpSkeleton->boneToEvalIndex[boneID]] = transform;
+    }
+
+    void AnimationController::setBoneLocalTransform(uint32_t boneID, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+    {
+        assert(boneID < getBoneCount());
+        composeTransform(translation, rotation, scale, mPose.localTransforms[mpSkeleton->boneToEvalIndex[boneID]]);
     }
 
     void AnimationController::animate(double currentTime)
     {
-        if(mActiveAnimation != kBindPoseAnimationId)
+        mCurrentTime = currentTime;
+        if(mLayers.size())
+        {
+            evaluateLayers();
+        }
+        else if(mActiveAnimation != kBindPoseAnimationId)
+        {
+            mAnimations[mActiveAnimation]->animate(currentTime, this, &mCursors[mActiveAnimation]);
+        }
+        calculateBoneTransforms();
+    }
+
+    void AnimationController::calculateBoneTransforms()
+    {
+        // The local transforms of blended poses are built here, so each bone is only touched once
+        const bool blended = (mLayers.size() != 0);
+        const Skeleton& skeleton = *mpSkeleton;
+        const PoseBuffer& pose = mBlend.pose;
+        glm::mat4* pLocal = mPose.localTransforms.data();
+        glm::mat4* pGlobal = mPose.globalTransforms.data();
+        for(uint32_t i = 0; i < (uint32_t)skeleton.evalOrder.size(); i++)
+        {
+            if(blended)
+            {
+                const uint32_t boneID = skeleton.evalOrder[i];
+                composeTransform(pose.translations[boneID], pose.rotations[boneID], pose.scalings[boneID], pLocal[i]);
+            }
+
+            const uint32_t parent = skeleton.evalParents[i];
+            if(parent == kInvalidBoneID)
+            {
+                pGlobal[i] = pLocal[i];
+            }
+            else
+            {
+                multiply(pGlobal[parent], pLocal[i], pGlobal[i]);
+            }
+
+            const uint32_t boneID = skeleton.evalOrder[i];
+            multiply(pGlobal[i], skeleton.evalOffsets[i], mBoneTransforms[boneID]);
+            calcInverseTranspose(mBoneTransforms[boneID], mBoneInvTransposeTransforms[boneID]);
+        }
+    }
+
+    void AnimationController::animateBatch(AnimationController* const* ppControllers, uint32_t count, double currentTime, JobSystem* pJobSystem)
+    {
+        auto animateRange = [&](uint32_t first, uint32_t last)
+        {
+            for (uint32_t i = first; i < last; i++)
+            {
+                ppControllers[i]->animate(currentTime);
+            }
+        };
+
+        if (pJobSystem && count > kControllersPerBatch)
+        {
+            pJobSystem->parallelFor(count, kControllersPerBatch, animateRange);
+        }
+        else
+        {
+            animateRange(0, count);
+        }
+    }
+
+    uint32_t AnimationController::addLayer(LayerBlendMode mode, float weight)
+    {
+        Layer layer;
+        layer.mode = mode;
+        layer.weight = weight;
+        layer.animations.reserve(mAnimations.size());
+        if(mLayers.empty())
+        {
+            mBlend.pose.resize(getBoneCount());
+            mBlend.sample.resize(getBoneCount());
+            mBlend.layerPose.resize(getBoneCount());
+        }
+        mLayers.push_back(std::move(layer));
+        return (uint32_t)mLayers.size() - 1;
+    }
+
+    void AnimationController::setLayerWeight(uint32_t layerID, float weight)
+    {
+        assert(layerID < mLayers.size());
+        mLayers[layerID].weight = weight;
+    }
+
+    void AnimationController::setLayerBoneMask(uint32_t layerID, const std::vector<float>& boneWeights)
+    {
+        assert(layerID < mLayers.size());
+        if(boneWeights.size() != 0 && boneWeights.size() != getBoneCount())
+        {
+            logWarning("AnimationController::setLayerBoneMask() - the mask must have a weight per bone. Ignoring the call.");
+            return;
+        }
+        mLayers[layerID].boneMask = boneWeights;
+    }
+
+    void AnimationController::playAnimation(uint32_t layerID, uint32_t animationID, float fadeDuration)
+    {
+        assert(layerID < mLayers.size());
+        for(const auto& layerAnimation : mLayers[layerID].animations)
+        {
+            if(layerAnimation.animationID != animationID)
+            {
+                setAnimationWeight(layerID, layerAnimation.animationID, 0, fadeDuration);
+            }
+        }
+        setAnimationWeight(layerID, animationID, 1, fadeDuration);
+    }
+
+    void AnimationController::setAnimationWeight(uint32_t layerID, uint32_t animationID, float weight, float fadeDuration)
+    {
+        assert(layerID < mLayers.size() && animationID < mAnimations.size());
+        auto& animations = mLayers[layerID].animations;
+        auto it = std::find_if(animations.begin(), animations.end(), [animationID](const LayerAnimation& a) { return a.animationID == animationID; });
+        if(it == animations.end())
         {
-            mAnimations[mActiveAnimation]->animate(currentTime, this);
+            if(weight <= 0) return;
+            LayerAnimation layerAnimation;
+            layerAnimation.animationID = animationID;
+            layerAnimation.startTime = mCurrentTime;
+            layerAnimation.weight = 0;
+            animations.push_back(layerAnimation);
+            it = animations.end() - 1;
         }
 
-        for(uint32_t i = 0; i < mBones.size(); i++)
+        it->startWeight = it->weight;
+        it->targetWeight = weight;
+        it->fadeStartTime = mCurrentTime;
+        it->fadeDuration = fadeDuration;
+        if(fadeDuration <= 0)
         {
-            mBones[i].globalTransform = mBones[i].localTransform;
-            if(mBones[i].parentID != kInvalidBoneID)
+            it->weight = weight;
+        }
+    }
+
+    float AnimationController::getAnimationWeight(uint32_t layerID, uint32_t animationID) const
+    {
+        assert(layerID < mLayers.size());
+        for(const auto& layerAnimation : mLayers[layerID].animations)
+        {
+            if(layerAnimation.animationID == animationID) return layerAnimation.weight;
+        }
+        return 0;
+    }
+
+    void AnimationController::evaluateLayers()
+    {
+        // Copying into buffers of the same size doesn't allocate
+        mBlend.pose.translations = mpSkeleton->bindPose.translations;
+        mBlend.pose.rotations = mpSkeleton->bindPose.rotations;
+        mBlend.pose.scalings = mpSkeleton->bindPose.scalings;
+
+        for(auto& layer : mLayers)
+        {
+            for(auto& layerAnimation : layer.animations)
+            {
+                const double fade = (layerAnimation.fadeDuration > 0) ? (mCurrentTime - layerAnimation.fadeStartTime) / layerAnimation.fadeDuration : 1.0;
+                layerAnimation.weight = layerAnimation.startWeight + (layerAnimation.targetWeight - layerAnimation.startWeight) * (float)glm::clamp(fade, 0.0, 1.0);
+            }
+
+            // Drop the animations which faded out
+            layer.animations.erase(std::remove_if(layer.animations.begin(), layer.animations.end(), [](const LayerAnimation& a) { return a.targetWeight <= 0 && a.weight <= 0; }), layer.animations.end());
+
+            if(layer.weight > 0 && layer.animations.size())
             {
-                mBones[i].globalTransform = mBones[mBones[i].parentID].globalTransform * mBones[i].localTransform;
+                blendLayer(layer);
+            }
+        }
+    }
+
+    void AnimationController::blendLayer(Layer& layer)
+    {
+        const uint32_t boneCount = getBoneCount();
+        const bool additive = (layer.mode == LayerBlendMode::Additive);
+        const PoseBuffer& bindPose = mpSkeleton->bindPose;
+        PoseBuffer& pose = mBlend.pose;
+        PoseBuffer& sample = mBlend.sample;
+        PoseBuffer& layerPose = mBlend.layerPose;
+
+        float totalWeight = 0;
+        for(const auto& layerAnimation : layer.animations)
+        {
+            totalWeight += layerAnimation.weight;
+        }
+        if(totalWeight <= 0) return;
+
+        // Bones which an animation doesn't drive keep the pose below for override layers, and don't change the pose for additive ones
+        const PoseBuffer& basePose = additive ? bindPose : pose;
+        bool first = true;
+        for(const auto& layerAnimation : layer.animations)
+        {
+            if(layerAnimation.weight <= 0) continue;
+
+            sample.translations = basePose.translations;
+            sample.rotations = basePose.rotations;
+            sample.scalings = basePose.scalings;
+            const double time = std::max(0.0, mCurrentTime - layerAnimation.startTime);
+            const uint32_t animationID = layerAnimation.animationID;
+            mAnimations[animationID]->samplePose(time, sample.translations.data(), sample.rotations.data(), sample.scalings.data(), &mCursors[animationID]);
+
+            if(additive)
+            {
+                // Additive animations are applied one after the other, relative to the bind pose
+                for(uint32_t b = 0; b < boneCount; b++)
+                {
+                    const float w = layerAnimation.weight * layer.weight * (layer.boneMask.size() ? layer.boneMask[b] : 1.0f);
+                    if(w <= 0) continue;
+
+                    const glm::vec3& bindScaling = bindPose.scalings[b];
+                    const glm::vec3 scaling(bindScaling.x != 0 ? sample.scalings[b].x / bindScaling.x : 1, bindScaling.y != 0 ? sample.scalings[b].y / bindScaling.y : 1, bindScaling.z != 0 ? sample.scalings[b].z / bindScaling.z : 1);
+                    pose.translations[b] += (sample.translations[b] - bindPose.translations[b]) * w;
+                    pose.rotations[b] = pose.rotations[b] * nlerp(glm::quat(1, 0, 0, 0), glm::conjugate(bindPose.rotations[b]) * sample.rotations[b], w);
+                    pose.scalings[b] *= glm::vec3(1) + (scaling - glm::vec3(1)) * w;
+                }
+            }
+            else
+            {
+                // Weighted sum of the layer's animations. Rotations are flipped into the hemisphere of the first one.
+                const float w = layerAnimation.weight / totalWeight;
+                for(uint32_t b = 0; b < boneCount; b++)
+                {
+                    if(first)
+                    {
+                        layerPose.translations[b] = sample.translations[b] * w;
+                        layerPose.rotations[b] = sample.rotations[b] * w;
+                        layerPose.scalings[b] = sample.scalings[b] * w;
+                    }
+                    else
+                    {
+                        const glm::quat& q = sample.rotations[b];
+                        layerPose.translations[b] += sample.translations[b] * w;
+                        layerPose.rotations[b] = layerPose.rotations[b] + ((glm::dot(layerPose.rotations[b], q) < 0) ? -q : q) * w;
+                        layerPose.scalings[b] += sample.scalings[b] * w;
+                    }
+                }
+                first = false;
+            }
+        }
+
+        if(additive == false)
+        {
+            // When the weights add up to less than 1, the rest comes from the pose below
+            const float layerWeight = layer.weight * std::min(totalWeight, 1.0f);
+            for(uint32_t b = 0; b < boneCount; b++)
+            {
+                const float w = layerWeight * (layer.boneMask.size() ? layer.boneMask[b] : 1.0f);
+                if(w <= 0) continue;
+
+                pose.translations[b] += (layerPose.translations[b] - pose.translations[b]) * w;
+                pose.rotations[b] = nlerp(pose.rotations[b], glm::normalize(layerPose.rotations[b]), w);
+                pose.scalings[b] += (layerPose.scalings[b] - pose.scalings[b]) * w;
             }
-            mBoneTransforms[i] = mBones[i].globalTransform * mBones[i].offset;
-            mBoneInvTransposeTransforms[i] = transpose(inverse(mBoneTransforms[i]));
         }
     }
 
@@ -117,9 +657,9 @@ namespace Falcor
         mActiveAnimation = id;
         if(id == kBindPoseAnimationId)
         {
-            for(auto& bone : mBones)
+            for(uint32_t i = 0; i < getBoneCount(); i++)
             {
-                bone.localTransform = bone.originalLocalTransform;
+                mPose.localTransforms[i] = mpSkeleton->bones[mpSkeleton->evalOrder[i]].originalLocalTransform;
             }
         }
         animate(0);
@@ -29,6 +29,7 @@
 #include <map>
 #include <vector>
 #include "glm/mat4x4.hpp"
+#include "glm/gtc/quaternion.hpp"
 #include "Animation.h"
 
 namespace Falcor
@@ -46,6 +47,7 @@ namespace Falcor
 
     class Model;
     class AssimpModelImporter;
+    class JobSystem;
 
     class AnimationController
     {
@@ -55,35 +57,182 @@ namespace Falcor
         static const uint32_t kInvalidBoneID = -1;
         static const uint32_t kBindPoseAnimationId = -1;
 
+        /** How a layer is combined with the pose of the layers below it
+        */
+        enum class LayerBlendMode
+        {
+            Override,   ///< Blend from the pose below towards the layer's pose
+            Additive,   ///< Add the difference between the layer's pose and the bind pose to the pose below
+        };
+
         static UniquePtr create(const std::vector<Bone>& bones);
+
+        /** Create a controller for another instance of the same rig. The bones and the animations are shared with the other controller, and only the pose is created for the new one.
+            The new controller plays the same animation as the other one. Layers are not copied.
+        */
         static UniquePtr create(const AnimationController& other);
         ~AnimationController();
 
+        /** Add an animation. Once added, the animation must not change, since it can be shared with other controllers.
+        */
         void addAnimation(Animation::UniquePtr pAnimation);
+        void addAnimation(const Animation::SharedConstPtr& pAnimation);
         void animate(double currentTime);
 
+        /** Animate many controllers. The controllers are independent, so they are split across the job system's threads.
+            \param[in] ppControllers The controllers to animate. Each controller should appear only once.
+            \param[in] count The number of controllers.
+            \param[in] currentTime The global time passed to animate().
+            \param[in] pJobSystem The job system to run on. If it is nullptr, the controllers are animated on the calling thread.
+        */
+        static void animateBatch(AnimationController* const* ppControllers, uint32_t count, double currentTime, JobSystem* pJobSystem);
+
         uint32_t getAnimationCount() const { return uint32_t(mAnimations.size()); }
         const std::string& getAnimationName(uint32_t ID) const;
+        const Animation* getAnimation(uint32_t ID) const { return mAnimations[ID].get(); }
+        const Animation::SharedConstPtr& getSharedAnimation(uint32_t ID) const { return mAnimations[ID]; }
         void setActiveAnimation(uint32_t id);
         uint32_t getActiveAnimation() const {return mActiveAnimation;}
 
+        /** Add an animation layer. Layers are applied in the order they were added, on top of the bind pose.
+            Once the controller has a layer, animate() evaluates the layers instead of the active animation, and the local transforms are overwritten by the blended pose.
+            \param[in] mode How the layer is combined with the layers below it.
+            \param[in] weight The weight of the layer, in [0, 1].
+            \return The ID of the new layer.
+        */
+        uint32_t addLayer(LayerBlendMode mode = LayerBlendMode::Override, float weight = 1);
+        uint32_t getLayerCount() const { return (uint32_t)mLayers.size(); }
+        void setLayerWeight(uint32_t layerID, float weight);
+
+        /** Limit a layer to some of the bones.
+            \param[in] boneWeights A weight per bone ID, in [0, 1], which scales the layer's weight. Pass an empty vector to apply the layer to all bones.
+        */
+        void setLayerBoneMask(uint32_t layerID, const std::vector<float>& boneWeights);
+
+        /** Cross-fade a layer to an animation. The other animations of the layer fade out over the same duration.
+            If the animation is already playing in the layer, it keeps playing from its current time. Otherwise it starts from the beginning.
+            \param[in] fadeDuration The duration of the cross-fade in seconds. 0 switches immediately.
+        */
+        void playAnimation(uint32_t layerID, uint32_t animationID, float fadeDuration = 0);
+
+        /** Change the weight of an animation in a layer, to blend several animations.
+            The weights of the animations in a layer are normalized if their sum is larger than 1. If it is smaller, override layers blend the rest from the pose below.
+            \param[in] weight The new weight. Animations which fade out to 0 are removed from the layer.
+            \param[in] fadeDuration The time in seconds it takes to reach the new weight.
+        */
+        void setAnimationWeight(uint32_t layerID, uint32_t animationID, float weight, float fadeDuration = 0);
+
+        /** Get the current weight of an animation in a layer. Returns 0 if the animation isn't playing in the layer.
+        */
+        float getAnimationWeight(uint32_t layerID, uint32_t animationID) const;
+
         const std::vector<mat4>& getBoneMatrices() const { return mBoneTransforms; }
         const std::vector<mat4>& getBoneInvTransposeMatrices() const { return mBoneInvTransposeTransforms; }
-        uint32_t getBoneCount() const { return uint32_t(mBones.size()); }
+        uint32_t getBoneCount() const { return uint32_t(mpSkeleton->bones.size()); }
+
+        /** Get the bones the controller was created with. The transforms of the current pose are returned by getBoneLocalTransform() and getBoneGlobalTransform().
+            Controllers created from each other return the same vector.
+        */
+        const std::vector<Bone>& getBones() const { return mpSkeleton->bones; }
 
         uint32_t getBoneIdFromName(const std::string& name) const;
+
+        /** Set the local transform of a bone. The transform must be affine.
+        */
         void setBoneLocalTransform(uint32_t boneID, const glm::mat4& transform);
 
+        /** Set the local transform of a bone from its translation, rotation and scale. This is the same as translate(t) * mat4_cast(r) * scale(s), but cheaper.
+        */
+        void setBoneLocalTransform(uint32_t boneID, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale);
+
+        /** Get the local transform of a bone in the current pose
+        */
+        const glm::mat4& getBoneLocalTransform(uint32_t boneID) const { return mPose.localTransforms[mpSkeleton->boneToEvalIndex[boneID]]; }
+
+        /** Get the global transform of a bone in the current pose, as calculated by the last call to animate()
+        */
+        const glm::mat4& getBoneGlobalTransform(uint32_t boneID) const { return mPose.globalTransforms[mpSkeleton->boneToEvalIndex[boneID]]; }
+
+        /** Get the memory used by this controller's pose, in bytes. The bones and the animations, which are shared between controllers, are not included.
+        */
+        size_t getInstanceMemorySize() const;
+
     private:
-        AnimationController(const std::vector<Bone>& bones);
+        // Per-bone translation, rotation and scaling, indexed by bone ID
+        struct PoseBuffer
+        {
+            std::vector<glm::vec3> translations;
+            std::vector<glm::quat> rotations;
+            std::vector<glm::vec3> scalings;
+            void resize(size_t count);
+        };
+
+        // The data which doesn't change once the controller is created. It is shared by all the controllers of the rig.
+        struct Skeleton
+        {
+            std::vector<Bone> bones;
+
+            // The hierarchy is evaluated in topological order, so a bone's parent is always evaluated before the bone itself.
+            // The arrays below are indexed by the position in that order.
+            std::vector<uint32_t> evalOrder;            // The bone ID of each entry
+            std::vector<uint32_t> evalParents;          // The entry of the bone's parent, or kInvalidBoneID for roots
+            std::vector<glm::mat4> evalOffsets;
+            std::vector<uint32_t> boneToEvalIndex;      // Indexed by bone ID
+
+            PoseBuffer bindPose;
+        };
+
+        AnimationController(const std::shared_ptr<const Skeleton>& pSkeleton);
 
-        std::vector<Bone> mBones;
-        std::vector<glm::mat4> mBoneTransforms;
-        std::vector<glm::mat4> mBoneInvTransposeTransforms;
-        std::vector<Animation::UniquePtr> mAnimations;
+        std::shared_ptr<const Skeleton> mpSkeleton;
+        std::vector<glm::mat4> mBoneTransforms;                 // Indexed by bone ID
+        std::vector<glm::mat4> mBoneInvTransposeTransforms;     // Indexed by bone ID
+        std::vector<Animation::SharedConstPtr> mAnimations;
+        std::vector<Animation::Cursor> mCursors;                // The playback position of each animation
 
         uint32_t mActiveAnimation = kBindPoseAnimationId;
 
+        // Indexed by the position in the evaluation order
+        struct
+        {
+            std::vector<glm::mat4> localTransforms;
+            std::vector<glm::mat4> globalTransforms;
+        } mPose;
+
+        struct LayerAnimation
+        {
+            uint32_t animationID;
+            double startTime;       // The controller time when the animation started playing
+            double fadeStartTime;
+            float fadeDuration;
+            float startWeight;
+            float targetWeight;
+            float weight;           // The weight at the last animate()
+        };
+
+        struct Layer
+        {
+            LayerBlendMode mode;
+            float weight;
+            std::vector<float> boneMask;
+            std::vector<LayerAnimation> animations;
+        };
+
+        std::vector<Layer> mLayers;
+        double mCurrentTime = 0;    // The time passed to the last animate()
+
+        // Buffers for evaluating layers. They are allocated when the first layer is added, so animate() doesn't allocate.
+        struct
+        {
+            PoseBuffer pose;        // The blended pose
+            PoseBuffer sample;      // The pose of a single animation
+            PoseBuffer layerPose;   // The weighted sum of a layer's animations
+        } mBlend;
+
+        static std::shared_ptr<const Skeleton> createSkeleton(const std::vector<Bone>& bones);
+        static void sortBones(Skeleton& skeleton);
         void calculateBoneTransforms();
+        void evaluateLayers();
+        void blendLayer(Layer& layer);
     };
 }
\ No newline at end of file
@@ -0,0 +1,308 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Framework.h"
+#include "InstanceStore.h"
+#include "Utils/Math/FalcorMath.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define FALCOR_INSTANCE_STORE_SIMD
+#include <immintrin.h>
+#endif
+
+namespace Falcor
+{
+    // Minimal number of dirty slots in a job system batch. Below this waking up the workers costs more than the update.
+    static const uint32_t kMinSlotsPerBatch = 1024;
+
+    // Minimal number of entries kept in the change log. The log is trimmed when it gets larger than this and a few times the slot count.
+    static const size_t kMinChangeLogSize = 16 * 1024;
+
+    static glm::mat4 calculateTransformMatrix(const InstanceStore::TransformParams& params)
+    {
+        glm::mat4 translationMtx = glm::translate(glm::mat4(), params.translation);
+        glm::mat4 rotationMtx = createMatrixFromLookAt(params.translation, params.target, params.up);
+        glm::mat4 scalingMtx = glm::scale(glm::mat4(), params.scale);
+
+        return translationMtx * rotationMtx * scalingMtx;
+    }
+
+#ifdef FALCOR_INSTANCE_STORE_SIMD
+    static __m128 crossSse(__m128 a, __m128 b)
+    {
+        __m128 aYzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 aZxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+        __m128 bYzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 bZxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+        return _mm_sub_ps(_mm_mul_ps(aYzx, bZxy), _mm_mul_ps(aZxy, bYzx));
+    }
+#endif
+
+    // The columns of the inverse transpose of a 3x3 matrix are the cross products of its other two columns, divided by the determinant
+    static void calculateNormalMatrix(const glm::mat4& matrix, glm::mat3x4& normalMatrix)
+    {
+#ifdef FALCOR_INSTANCE_STORE_SIMD
+        // The W components of the columns are ignored. The cross products have a W of 0.
+        __m128 c0 = _mm_loadu_ps(&matrix[0].x);
+        __m128 c1 = _mm_loadu_ps(&matrix[1].x);
+        __m128 c2 = _mm_loadu_ps(&matrix[2].x);
+        __m128 n0 = crossSse(c1, c2);
+        __m128 n1 = crossSse(c2, c0);
+        __m128 n2 = crossSse(c0, c1);
+
+        __m128 det = _mm_mul_ps(c0, n0);
+        det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(2, 3, 0, 1)));
+        det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(1, 0, 3, 2)));
+        __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+        _mm_storeu_ps(&normalMatrix[0].x, _mm_mul_ps(n0, invDet));
+        _mm_storeu_ps(&normalMatrix[1].x, _mm_mul_ps(n1, invDet));
+        _mm_storeu_ps(&normalMatrix[2].x, _mm_mul_ps(n2, invDet));
+#else
+        glm::vec3 c0(matrix[0]);
+        glm::vec3 c1(matrix[1]);
+        glm::vec3 c2(matrix[2]);
+        glm::vec3 n0 = glm::cross(c1, c2);
+        float invDet = 1.0f / glm::dot(c0, n0);
+        normalMatrix[0] = glm::vec4(n0 * invDet, 0.0f);
+        normalMatrix[1] = glm::vec4(glm::cross(c2, c0) * invDet, 0.0f);
+        normalMatrix[2] = glm::vec4(glm::cross(c0, c1) * invDet, 0.0f);
+#endif
+    }
+
+    InstanceStore::SharedPtr InstanceStore::create()
+    {
+        return SharedPtr(new InstanceStore);
+    }
+
+    uint32_t InstanceStore::allocateSlot(const BoundingBox& localBox)
+    {
+        std::lock_guard<std::mutex> lock(mAllocationMutex);
+        uint32_t slot;
+        if (mFreeSlots.empty())
+        {
+            slot = (uint32_t)mDirty.size();
+            mBaseParams.emplace_back();
+            mMovableParams.emplace_back();
+            mLocalBoxes.emplace_back();
+            mBaseMatrices.emplace_back();
+            mMovableMatrices.emplace_back();
+            mPrevMovableMatrices.emplace_back();
+            mWorldMatrices.emplace_back();
+            mPrevWorldMatrices.emplace_back();
+            mNormalMatrices.emplace_back();
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                mWorldCenter[i].push_back(0);
+                mWorldExtent[i].push_back(0);
+            }
+            mVisible.push_back(0);
+            mDirty.push_back(0);
+        }
+        else
+        {
+            slot = mFreeSlots.back();
+            mFreeSlots.pop_back();
+            mBaseParams[slot] = TransformParams();
+            mMovableParams[slot] = TransformParams();
+            mMovableMatrices[slot] = glm::mat4();
+        }
+
+        mLocalBoxes[slot] = localBox;
+        mVisible[slot] = 1;
+        markDirty(slot, kBaseDirty | kMovableDirty);
+        return slot;
+    }
+
+    void InstanceStore::releaseSlot(uint32_t slot)
+    {
+        std::lock_guard<std::mutex> lock(mAllocationMutex);
+        mVisible[slot] = 0;
+        // Keep the list flag, the slot may still be in the dirty list
+        mDirty[slot] &= kInDirtyList;
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            mWorldCenter[i][slot] = 0;
+            mWorldExtent[i][slot] = 0;
+        }
+        mFreeSlots.push_back(slot);
+    }
+
+    void InstanceStore::markDirty(uint32_t slot, uint8_t flags)
+    {
+        if ((mDirty[slot] & kInDirtyList) == 0)
+        {
+            mDirtySlots.push_back(slot);
+            flags |= kInDirtyList;
+        }
+        mDirty[slot] |= flags;
+    }
+
+    void InstanceStore::setBaseParams(uint32_t slot, const TransformParams& params)
+    {
+        mBaseParams[slot] = params;
+        markDirty(slot, kBaseDirty);
+    }
+
+    void InstanceStore::setBaseMatrix(uint32_t slot, const glm::mat4& matrix)
+    {
+        mBaseMatrices[slot] = matrix;
+        mDirty[slot] &= ~kBaseDirty;
+        markDirty(slot, kBoundsDirty);
+    }
+
+    void InstanceStore::setMovableParams(uint32_t slot, const TransformParams& params)
+    {
+        mMovableParams[slot] = params;
+        markDirty(slot, kMovableDirty);
+    }
+
+    void InstanceStore::setLocalBoundingBox(uint32_t slot, const BoundingBox& box)
+    {
+        mLocalBoxes[slot] = box;
+        markDirty(slot, kBoundsDirty);
+    }
+
+    void InstanceStore::updateSlot(uint32_t slot)
+    {
+        uint8_t flags = mDirty[slot];
+        if ((flags & kTransformDirtyMask) == 0) return;
+
+        if (flags & kBaseDirty)
+        {
+            mBaseMatrices[slot] = calculateTransformMatrix(mBaseParams[slot]);
+        }
+
+        if (flags & kMovableDirty)
+        {
+            mPrevMovableMatrices[slot] = mMovableMatrices[slot];
+            mMovableMatrices[slot] = calculateTransformMatrix(mMovableParams[slot]);
+        }
+
+        mWorldMatrices[slot] = mMovableMatrices[slot] * mBaseMatrices[slot];
+        mPrevWorldMatrices[slot] = mPrevMovableMatrices[slot] * mBaseMatrices[slot];
+        calculateNormalMatrix(mWorldMatrices[slot], mNormalMatrices[slot]);
+
+        BoundingBox box = mLocalBoxes[slot].transform(mWorldMatrices[slot]);
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            mWorldCenter[i][slot] = box.center[i];
+            mWorldExtent[i][slot] = box.extent[i];
+        }
+
+        mDirty[slot] = flags & kInDirtyList;
+    }
+
+    void InstanceStore::updateSlotRange(uint32_t first, uint32_t last)
+    {
+        for (uint32_t i = first; i < last; i++)
+        {
+            updateSlot(mDirtySlots[i]);
+        }
+    }
+
+    void InstanceStore::updateTransforms()
+    {
+        uint32_t dirtyCount = (uint32_t)mDirtySlots.size();
+        if (dirtyCount == 0) return;
+
+        if (dirtyCount < 2 * kMinSlotsPerBatch)
+        {
+            updateSlotRange(0, dirtyCount);
+        }
+        else
+        {
+            if (mpJobSystem == nullptr)
+            {
+                static const JobSystem::SharedPtr spSharedJobSystem = JobSystem::create();
+                mpJobSystem = spSharedJobSystem;
+            }
+
+            // Every slot appears once in the list, so the batches touch disjoint slots
+            const uint32_t threadCount = mpJobSystem->getThreadCount();
+            const uint32_t batchSize = std::max(kMinSlotsPerBatch, (dirtyCount + threadCount - 1) / threadCount);
+            mpJobSystem->parallelFor(dirtyCount, batchSize, [this](uint32_t first, uint32_t last) { updateSlotRange(first, last); });
+        }
+
+        for (uint32_t slot : mDirtySlots)
+        {
+            mDirty[slot] &= ~kInDirtyList;
+        }
+
+        // Slots updated on demand were kept in the list, so they are logged too
+        mChangeLog.insert(mChangeLog.end(), mDirtySlots.begin(), mDirtySlots.end());
+        mDirtySlots.clear();
+
+        const size_t maxLogSize = std::max(kMinChangeLogSize, (size_t)getSlotCount() * 4);
+        if (mChangeLog.size() > maxLogSize)
+        {
+            const size_t trimmed = mChangeLog.size() / 2;
+            mChangeLog.erase(mChangeLog.begin(), mChangeLog.begin() + trimmed);
+            mChangeLogBase += trimmed;
+        }
+    }
+
+    bool InstanceStore::getChangedSlots(uint64_t& cursor, std::vector<uint32_t>& slots) const
+    {
+        slots.clear();
+        const uint64_t end = getChangeLogEnd();
+        assert(cursor <= end);
+        if (cursor < mChangeLogBase)
+        {
+            cursor = end;
+            return false;
+        }
+
+        slots.assign(mChangeLog.begin() + (size_t)(cursor - mChangeLogBase), mChangeLog.end());
+        cursor = end;
+        return true;
+    }
+
+    BoundingBox InstanceStore::getBoundingBox(uint32_t slot) const
+    {
+        BoundingBox box;
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            box.center[i] = mWorldCenter[i][slot];
+            box.extent[i] = mWorldExtent[i][slot];
+        }
+        return box;
+    }
+
+    BoundingBoxStreams InstanceStore::getBoundingBoxStreams() const
+    {
+        BoundingBoxStreams streams;
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            streams.pCenter[i] = mWorldCenter[i].data();
+            streams.pExtent[i] = mWorldExtent[i].data();
+        }
+        streams.count = getSlotCount();
+        return streams;
+    }
+}
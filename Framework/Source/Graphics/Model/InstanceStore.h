@@ -0,0 +1,203 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <vector>
+#include <memory>
+#include <mutex>
+#include "glm/mat4x4.hpp"
+#include "glm/mat3x4.hpp"
+#include "Utils/AABB.h"
+#include "Utils/JobSystem.h"
+
+namespace Falcor
+{
+    /** Contiguous structure-of-arrays storage for the transforms, bounds and visibility of object instances.
+        Each ObjectInstance owns a slot in a store and reads its data through the slot index, so per-frame passes over many instances touch tightly packed arrays instead of individual heap objects.
+        Changing the transform of a slot only marks it as dirty. Dirty slots are recomputed either by updateTransforms(), which processes all of them in one batched pass split across threads, or on demand by updateSlot().
+        updateTransforms() also appends the slots which changed to a change log. Systems which derive data from the transforms keep a cursor in the log, and only process the slots which changed since they last read it.
+        Allocating and releasing slots is thread-safe. Setting data while another thread allocates slots or runs updateTransforms() is not.
+    */
+    class InstanceStore
+    {
+    public:
+        using SharedPtr = std::shared_ptr<InstanceStore>;
+        using SharedConstPtr = std::shared_ptr<const InstanceStore>;
+
+        /** The look-at parameters a transform matrix is computed from
+        */
+        struct TransformParams
+        {
+            glm::vec3 translation;
+            glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
+            glm::vec3 target = glm::vec3(0.0f, 0.0f, 1.0f);
+            glm::vec3 scale = glm::vec3(1.0f);
+        };
+
+        /** Create an empty store
+        */
+        static SharedPtr create();
+
+        /** Allocate a slot. The base and movable transforms start dirty, with default parameters.
+            \param[in] localBox The bounding box of the object in its own space
+            \return The slot index
+        */
+        uint32_t allocateSlot(const BoundingBox& localBox);
+
+        /** Release a slot. The index may be returned by a later allocateSlot() call.
+        */
+        void releaseSlot(uint32_t slot);
+
+        /** Set the parameters of the base transform. Marks the slot dirty.
+        */
+        void setBaseParams(uint32_t slot, const TransformParams& params);
+
+        /** Get the parameters of the base transform
+        */
+        const TransformParams& getBaseParams(uint32_t slot) const { return mBaseParams[slot]; }
+
+        /** Set the base transform matrix directly, ignoring the base parameters until they are set again
+        */
+        void setBaseMatrix(uint32_t slot, const glm::mat4& matrix);
+
+        /** Set the parameters of the movable transform, which is applied after the base transform. Marks the slot dirty.
+            The current movable matrix becomes the previous one when the slot is updated.
+        */
+        void setMovableParams(uint32_t slot, const TransformParams& params);
+
+        /** Set the object-space bounding box of a slot. Marks the slot dirty.
+        */
+        void setLocalBoundingBox(uint32_t slot, const BoundingBox& box);
+
+        /** Set the visibility flag of a slot
+        */
+        void setVisible(uint32_t slot, bool visible) { mVisible[slot] = visible ? 1 : 0; }
+
+        /** Get the visibility flag of a slot
+        */
+        bool isVisible(uint32_t slot) const { return mVisible[slot] != 0; }
+
+        /** Check if the matrices or bounds of a slot need to be recomputed
+        */
+        bool isDirty(uint32_t slot) const { return (mDirty[slot] & kTransformDirtyMask) != 0; }
+
+        /** Recompute the matrices and bounds of a single slot if it's dirty
+        */
+        void updateSlot(uint32_t slot);
+
+        /** Recompute the matrices and bounds of all the dirty slots. Large batches are split across the threads of the store's job system.
+        */
+        void updateTransforms();
+
+        /** Set the job system used by updateTransforms(). By default all the stores share one, created with a thread per hardware thread the first time a large batch is updated.
+            updateTransforms() must not be called from inside a batch of the same job system.
+        */
+        void setJobSystem(const JobSystem::SharedPtr& pJobSystem) { mpJobSystem = pJobSystem; }
+
+        /** Get the slots which changed since a position in the change log. A slot may appear more than once.
+            Changes made since the last updateTransforms() call are not in the log yet.
+            \param[in,out] cursor Position in the change log. Set to the end of the log.
+            \param[out] slots The slots which changed
+            \return false if the log was trimmed past the cursor, in which case the changes are lost and any slot may have changed. Otherwise true.
+        */
+        bool getChangedSlots(uint64_t& cursor, std::vector<uint32_t>& slots) const;
+
+        /** Get the position of the end of the change log, to start tracking changes from now
+        */
+        uint64_t getChangeLogEnd() const { return mChangeLogBase + mChangeLog.size(); }
+
+        /** Get the final transform of a slot. Only valid if the slot isn't dirty.
+        */
+        const glm::mat4& getTransformMatrix(uint32_t slot) const { return mWorldMatrices[slot]; }
+
+        /** Get the final transform of a slot before the last change of its movable transform. Only valid if the slot isn't dirty.
+        */
+        const glm::mat4& getPrevTransformMatrix(uint32_t slot) const { return mPrevWorldMatrices[slot]; }
+
+        /** Get the inverse transpose of the upper 3x3 of the final transform, for transforming normals. The fourth row is 0. Only valid if the slot isn't dirty.
+            It's only recomputed when the transform changes.
+        */
+        const glm::mat3x4& getNormalMatrix(uint32_t slot) const { return mNormalMatrices[slot]; }
+
+        /** Get the transformed bounding box of a slot. Only valid if the slot isn't dirty.
+        */
+        BoundingBox getBoundingBox(uint32_t slot) const;
+
+        /** Get the transformed bounding boxes of all the slots, for Camera::cullBoundingBoxes(). Released slots have empty boxes at the origin and should be filtered by their visibility flag.
+            The pointers are invalidated when a slot is allocated.
+        */
+        BoundingBoxStreams getBoundingBoxStreams() const;
+
+        /** Get the visibility flags of all the slots. Released slots are not visible.
+        */
+        const uint8_t* getVisibilityFlags() const { return mVisible.data(); }
+
+        /** Get the number of slots, including released ones
+        */
+        uint32_t getSlotCount() const { return (uint32_t)mDirty.size(); }
+
+        /** Get the number of slots in use
+        */
+        uint32_t getActiveSlotCount() const { return getSlotCount() - (uint32_t)mFreeSlots.size(); }
+
+    private:
+        InstanceStore() = default;
+
+        static const uint8_t kBaseDirty = 0x1;
+        static const uint8_t kMovableDirty = 0x2;
+        static const uint8_t kBoundsDirty = 0x4;
+        static const uint8_t kTransformDirtyMask = kBaseDirty | kMovableDirty | kBoundsDirty;
+        static const uint8_t kInDirtyList = 0x80;
+
+        void markDirty(uint32_t slot, uint8_t flags);
+        void updateSlotRange(uint32_t first, uint32_t last);
+
+        // Transform inputs
+        std::vector<TransformParams> mBaseParams;
+        std::vector<TransformParams> mMovableParams;
+        std::vector<BoundingBox> mLocalBoxes;
+
+        // Derived data
+        std::vector<glm::mat4> mBaseMatrices;
+        std::vector<glm::mat4> mMovableMatrices;
+        std::vector<glm::mat4> mPrevMovableMatrices;
+        std::vector<glm::mat4> mWorldMatrices;
+        std::vector<glm::mat4> mPrevWorldMatrices;
+        std::vector<glm::mat3x4> mNormalMatrices;
+        std::vector<float> mWorldCenter[3];
+        std::vector<float> mWorldExtent[3];
+
+        std::vector<uint8_t> mVisible;
+        std::vector<uint8_t> mDirty;
+        std::vector<uint32_t> mDirtySlots; // Slots with the kInDirtyList flag. A slot appears at most once.
+        std::vector<uint32_t> mFreeSlots;
+        std::vector<uint32_t> mChangeLog;   // The slots updated by updateTransforms(), in order
+        uint64_t mChangeLogBase = 0;        // Position of the first entry of the log. Old entries are trimmed to bound its size.
+        std::mutex mAllocationMutex;
+        JobSystem::SharedPtr mpJobSystem;
+    };
+}
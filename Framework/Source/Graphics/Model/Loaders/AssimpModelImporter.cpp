@@ -36,7 +36,9 @@
 #include "AssimpModelImporter.h"
 #include "Graphics/Model/Model.h"
 #include "Graphics/Model/Animation.h"
+#include "Graphics/Model/AnimationClip.h"
 #include "Graphics/Model/Mesh.h"
+#include "Graphics/Model/MeshLod.h"
 #include "Graphics/Model/AnimationController.h"
 #include "API/Texture.h"
 #include "API/Buffer.h"
@@ -46,6 +48,7 @@
 #include "Data/VertexAttrib.h"
 #include "Utils/StringUtils.h"
 #include "API/Device.h"
+#include "Utils/Bitmap.h"
 
 namespace Falcor
 {
@@ -260,6 +263,39 @@ namespace Falcor
         }
     }
 
+    static std::string getTextureFullpath(const std::string& folder, const std::string& texture)
+    {
+        std::string fullpath = folder + '/' + texture;
+        return replaceSubstring(fullpath, "\\", "/");
+    }
+
+    /** The CPU side of an ASSIMP import. Owns the parsed aiScene, with the tangent space already generated, and the decoded textures.
+    */
+    class AssimpModelImporter::PreloadedAssimpFile : public Model::PreloadedFile
+    {
+    public:
+        PreloadedAssimpFile(const std::string& filename, Model::LoadFlags flags) : Model::PreloadedFile(filename), flags(flags) {}
+        /** Parse the file and generate the CPU-side data
+            \param[in] decodeTextures Whether to decode the textures now. Only worth it when preloading on a worker thread, the importer decodes the missing ones while it creates the textures.
+            \return Whether the file was loaded
+        */
+        bool load(bool decodeTextures);
+
+        Model::LoadFlags flags;
+        std::string modelFolder;
+        Assimp::Importer importer;
+        const aiScene* pScene = nullptr;
+        std::map<std::string, Bitmap::UniqueConstPtr> bitmaps; // Decoded images, keyed by the texture name in the material. Released once their texture is created.
+        std::vector<std::vector<MeshLodData>> lods; // Generated LODs, indexed by the aiMesh ID. Empty unless LoadFlags::GenerateLods is set.
+
+    protected:
+        bool import(Model& model) override
+        {
+            AssimpModelImporter loader(model, flags);
+            return loader.initModel(*this);
+        }
+    };
+
     void AssimpModelImporter::loadTextures(const aiMaterial* pAiMaterial, const std::string& folder, BasicMaterial* pMaterial, bool isObjFile, bool useSrgb)
     {
         for (int i = 0; i < AI_TEXTURE_TYPE_MAX; ++i)
@@ -296,10 +332,19 @@ namespace Falcor
                 }
                 else
                 {
-                    // create a new texture
-                    std::string fullpath = folder + '/' + s;
-                    fullpath = replaceSubstring(fullpath, "\\", "/");
-                    pTex = createTextureFromFile(fullpath, true, isSrgbRequired(aiType, useSrgb));
+                    // create a new texture, from the image decoded during preloading if there is one
+                    std::string fullpath = getTextureFullpath(folder, s);
+                    auto decoded = mpPreloadedFile->bitmaps.find(s);
+                    if (decoded != mpPreloadedFile->bitmaps.end())
+                    {
+                        pTex = createTextureFromBitmap(decoded->second.get(), fullpath, true, isSrgbRequired(aiType, useSrgb));
+                        mpPreloadedFile->bitmaps.erase(decoded);
+                    }
+                    else
+                    {
+                        pTex = createTextureFromFile(fullpath, true, isSrgbRequired(aiType, useSrgb));
+                    }
+
                     if (pTex)
                     {
                         mTextureCache[s] = pTex;
@@ -469,6 +514,10 @@ namespace Falcor
                 {
                     // Cache mesh
                     aiToFalcorMesh[aiId] = createMesh(pScene->mMeshes[aiId]);
+                    if (aiId < mpPreloadedFile->lods.size())
+                    {
+                        createMeshLods(aiToFalcorMesh[aiId].get(), mpPreloadedFile->lods[aiId]);
+                    }
                 }
 
                 mModel.addMeshInstance(aiToFalcorMesh[aiId], aiMatToGLM(transform));
@@ -492,12 +541,12 @@ namespace Falcor
         return parseAiSceneNode(pRoot, pScene, aiToFalcorMeshId);
     }
 
-    bool AssimpModelImporter::initModel(const std::string& filename)
+    bool AssimpModelImporter::PreloadedAssimpFile::load(bool decodeTextures)
     {
         std::string fullpath;
-        if (findFileInDataDirectories(filename, fullpath) == false)
+        if (findFileInDataDirectories(getFilename(), fullpath) == false)
         {
-            logError(std::string("Can't find model file ") + filename, true);
+            logError(std::string("Can't find model file ") + getFilename(), true);
             return false;
         }
 
@@ -508,13 +557,13 @@ namespace Falcor
             0;
 
         // aiProcessPreset_TargetRealtime_MaxQuality enabled some optimizations the user might not want
-        if(is_set(mFlags, Model::LoadFlags::FindDegeneratePrimitives) == false)
+        if(is_set(flags, Model::LoadFlags::FindDegeneratePrimitives) == false)
         {
             AssimpFlags &= ~aiProcess_FindDegenerates;
         }
 
         // Avoid merging original meshes
-        if(is_set(mFlags, Model::LoadFlags::DontMergeMeshes))
+        if(is_set(flags, Model::LoadFlags::DontMergeMeshes))
         {
             AssimpFlags &= ~aiProcess_OptimizeMeshes;
         }
@@ -522,31 +571,92 @@ namespace Falcor
         // Never use Assimp's tangent gen code
         AssimpFlags &= ~(aiProcess_CalcTangentSpace);
 
-        Assimp::Importer importer;
-        const aiScene* pScene = importer.ReadFile(fullpath, AssimpFlags);
+        pScene = importer.ReadFile(fullpath, AssimpFlags);
 
         if((pScene == nullptr) || (verifyScene(pScene) == false))
         {
             std::string str("Can't open model file '");
-            str = str + std::string(filename) + "'\n" + importer.GetErrorString();
+            str = str + getFilename() + "'\n" + importer.GetErrorString();
             logError(str, true);
             return false;
         }
 
         // Extract the folder name
         auto last = fullpath.find_last_of("/\\");
-        std::string modelFolder = fullpath.substr(0, last);
+        modelFolder = fullpath.substr(0, last);
+
+        // Generate the tangent space. The bitangents are stored in the aiMesh, which owns them from here on.
+        if (is_set(flags, Model::LoadFlags::DontGenerateTangentSpace) == false)
+        {
+            for (uint32_t i = 0; i < pScene->mNumMeshes; i++)
+            {
+                const aiMesh* pAiMesh = pScene->mMeshes[i];
+                if (pAiMesh->HasTangentsAndBitangents() == false)
+                {
+                    genTangentSpace(pAiMesh);
+                }
+            }
+        }
+
+        // Generate the LOD chains. Simplification only works on triangles.
+        if (is_set(flags, Model::LoadFlags::GenerateLods))
+        {
+            lods.resize(pScene->mNumMeshes);
+            for (uint32_t i = 0; i < pScene->mNumMeshes; i++)
+            {
+                const aiMesh* pAiMesh = pScene->mMeshes[i];
+                if (pAiMesh->mFaces[0].mNumIndices == 3)
+                {
+                    std::vector<uint32_t> indices = createIndexBufferData(pAiMesh);
+                    MeshSimplifier::generateLodChain((const glm::vec3*)pAiMesh->mVertices, pAiMesh->mNumVertices, indices.data(), (uint32_t)indices.size(), MeshSimplifier::kDefaultLodCount, lods[i]);
+                }
+            }
+        }
+
+        // Decode the textures. DDS files are uploaded as-is, so there's nothing to decode for them.
+        for (uint32_t m = 0; decodeTextures && (m < pScene->mNumMaterials); m++)
+        {
+            const aiMaterial* pAiMaterial = pScene->mMaterials[m];
+            for (int i = 0; i < AI_TEXTURE_TYPE_MAX; ++i)
+            {
+                aiString path;
+                if (pAiMaterial->GetTextureCount((aiTextureType)i) != 1 || pAiMaterial->GetTexture((aiTextureType)i, 0, &path) != aiReturn_SUCCESS)
+                {
+                    continue;
+                }
+
+                std::string s(path.data);
+                if (s.empty() || hasSuffix(s, ".dds", false) || bitmaps.find(s) != bitmaps.end())
+                {
+                    continue;
+                }
+
+                Bitmap::UniqueConstPtr pBitmap = decodeTextureFile(getTextureFullpath(modelFolder, s));
+                if (pBitmap)
+                {
+                    bitmaps[s] = std::move(pBitmap);
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool AssimpModelImporter::initModel(PreloadedAssimpFile& file)
+    {
+        mpPreloadedFile = &file;
+        const std::string& filename = file.getFilename();
 
         // Order of initialization matters, materials, bones and animations need to loaded before mesh initialization
         bool isObjFile = hasSuffix(filename, ".obj", false);
         bool useSrgbTextures = !is_set(mFlags, Model::LoadFlags::AssumeLinearSpaceTextures);
-        if(createAllMaterials(pScene, modelFolder, isObjFile, useSrgbTextures) == false)
+        if(createAllMaterials(file.pScene, file.modelFolder, isObjFile, useSrgbTextures) == false)
         {
             logError(std::string("Can't create materials for model ") + filename, true);
             return false;
         }
 
-        if (createDrawList(pScene) == false)
+        if (createDrawList(file.pScene) == false)
         {
             logError(std::string("Can't create draw lists for model ") + filename, true);
             return false;
@@ -557,8 +667,21 @@ namespace Falcor
 
     bool AssimpModelImporter::import(Model& model, const std::string& filename, Model::LoadFlags flags)
     {
+        // Nothing runs in parallel with the import here, so decode each texture only when it's created
+        PreloadedAssimpFile file(filename, flags);
+        if (file.load(false) == false)
+        {
+            return false;
+        }
+
         AssimpModelImporter loader(model, flags);
-        return loader.initModel(filename);
+        return loader.initModel(file);
+    }
+
+    Model::PreloadedFile::SharedPtr AssimpModelImporter::preload(const std::string& filename, Model::LoadFlags flags)
+    {
+        auto pFile = std::make_shared<PreloadedAssimpFile>(filename, flags);
+        return pFile->load(true) ? pFile : nullptr;
     }
 
     bool AssimpModelImporter::isUsedNode(const aiNode* pNode) const
@@ -677,6 +800,10 @@ namespace Falcor
             for (uint32_t i = 0; i < pScene->mNumAnimations; i++)
             {
                 Animation::UniquePtr pAnimation = createAnimation(pScene->mAnimations[i]);
+                if (is_set(mFlags, Model::LoadFlags::CompressAnimations))
+                {
+                    pAnimation->compress(AnimationClip::kDefaultSampleRate);
+                }
                 pAnimCtrl->addAnimation(std::move(pAnimation));
             }
 
@@ -768,12 +895,6 @@ namespace Falcor
         auto pIB = createIndexBuffer(pAiMesh);
         BoundingBox boundingBox = createMeshBbox(pAiMesh);
 
-        const bool generateTangentSpace = (pAiMesh->HasTangentsAndBitangents() == false) && (is_set(mFlags, Model::LoadFlags::DontGenerateTangentSpace) == false);
-        if (generateTangentSpace)
-        {
-            genTangentSpace(pAiMesh);
-        }
-
         VertexLayout::SharedPtr pLayout = createVertexLayout(pAiMesh);
         if (pLayout == nullptr)
         {
@@ -819,19 +940,16 @@ namespace Falcor
         assert(pMaterial);
 
         Mesh::SharedPtr pMesh = Mesh::create(pVBs, vertexCount, pIB, indexCount, pLayout, topology, pMaterial, boundingBox, pAiMesh->HasBones());
-
-        if (generateTangentSpace)
-        {
-            aiMesh* pM = const_cast<aiMesh*>(pAiMesh);
-            safe_delete_array(pM->mBitangents);
-        }
-
         return pMesh;
     }
 
     Buffer::SharedPtr AssimpModelImporter::createIndexBuffer(const aiMesh* pAiMesh)
     {
-        std::vector<uint32_t> indices = createIndexBufferData(pAiMesh);
+        return createIndexBuffer(createIndexBufferData(pAiMesh));
+    }
+
+    Buffer::SharedPtr AssimpModelImporter::createIndexBuffer(const std::vector<uint32_t>& indices)
+    {
         const uint32_t size = (uint32_t)(sizeof(uint32_t) * indices.size());
         Buffer::BindFlags bindFlags = Buffer::BindFlags::Index;
         if (is_set(mFlags, Model::LoadFlags::BuffersAsShaderResource))
@@ -842,6 +960,14 @@ namespace Falcor
     }
 
 
+    void AssimpModelImporter::createMeshLods(Mesh* pMesh, const std::vector<MeshLodData>& lods)
+    {
+        for (const auto& lod : lods)
+        {
+            pMesh->addLod(createIndexBuffer(lod.indices), (uint32_t)lod.indices.size(), lod.screenSize, lod.error);
+        }
+    }
+
     bool isElementUsed(const aiMesh* pAiMesh, uint32_t location)
     {
         switch (location)
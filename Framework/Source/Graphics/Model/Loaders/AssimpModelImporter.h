@@ -61,7 +61,15 @@ namespace Falcor
         */
         static bool import(Model& model, const std::string& filename, Model::LoadFlags flags);
 
+        /** Read and parse a model file through ASSIMP, generate the tangent space and decode the textures, without creating any GPU resources. See Model::preloadFile().
+            \param[in] filename Model's filename. Can include a full path or a relative path from a data directory
+            \param[in] flags Flags controlling model creation
+            \return The preloaded file, or nullptr if the file couldn't be parsed
+        */
+        static Model::PreloadedFile::SharedPtr preload(const std::string& filename, Model::LoadFlags flags);
+
     private:
+        class PreloadedAssimpFile;
 
         using IdToMesh = std::unordered_map<uint32_t, Mesh::SharedPtr>;
 
@@ -69,7 +77,7 @@ namespace Falcor
         AssimpModelImporter(const AssimpModelImporter&) = delete;
         void operator=(const AssimpModelImporter&) = delete;
 
-        bool initModel(const std::string& filename);
+        bool initModel(PreloadedAssimpFile& file);
         bool createDrawList(const aiScene* pScene);
         bool parseAiSceneNode(const aiNode* pCurrent, const aiScene* pScene, IdToMesh& aiToFalcorMesh);
         bool createAllMaterials(const aiScene* pScene, const std::string& modelFolder, bool isObjFile, bool useSrgb);
@@ -84,6 +92,8 @@ namespace Falcor
         Mesh::SharedPtr createMesh(const aiMesh* pAiMesh);
         VertexLayout::SharedPtr createVertexLayout(const aiMesh* pAiMesh);
         Buffer::SharedPtr createIndexBuffer(const aiMesh* pAiMesh);
+        Buffer::SharedPtr createIndexBuffer(const std::vector<uint32_t>& indices);
+        void createMeshLods(Mesh* pMesh, const std::vector<MeshLodData>& lods);
         Buffer::SharedPtr createVertexBuffer(const aiMesh* pAiMesh, const VertexBufferLayout* pLayout, const uint8_t* pBoneIds, const vec4* pBoneWeights);
         void loadTextures(const aiMaterial* pAiMaterial, const std::string& folder, BasicMaterial* pMaterial, bool isObjFile, bool useSrgb);
         Material::SharedPtr createMaterial(const aiMaterial* pAiMaterial, const std::string& folder, bool isObjFile, bool useSrgb);
@@ -102,5 +112,6 @@ namespace Falcor
         std::vector<Bone> mBones;
         Model::LoadFlags mFlags;
         std::map<const std::string, Texture::SharedPtr> mTextureCache;
+        PreloadedAssimpFile* mpPreloadedFile = nullptr;
     };
 }
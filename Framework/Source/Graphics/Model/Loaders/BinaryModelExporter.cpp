@@ -29,132 +29,31 @@
 #include "BinaryModelExporter.h"
 #include "../Model.h"
 #include "../Mesh.h"
+#include "../AnimationClip.h"
 #include "API/VAO.h"
-#include "BinaryModelSpec.h"
 #include "API/Buffer.h"
 #include "API/Texture.h"
-#include "BinaryImage.hpp"
-#include "Data/VertexAttrib.h"
 #include "API/Device.h"
+#include "API/RenderContext.h"
+#include "Graphics/Material/Material.h"
 
 namespace Falcor
 {
-    static FW::ImageFormat::ID getBinaryFormatID(ResourceFormat format)
-    {
-        switch(format)
-        {
-        case ResourceFormat::RGBA8Unorm:
-        case ResourceFormat::RGBA8UnormSrgb:
-            return FW::ImageFormat::R8_G8_B8_A8;
-        case ResourceFormat::Alpha8Unorm:
-            return FW::ImageFormat::A8;
-        case ResourceFormat::R5G6B5Unorm:
-            return FW::ImageFormat::RGB_565;
-        case ResourceFormat::RGB5A1Unorm:
-            return FW::ImageFormat::RGBA_5551;
-        case ResourceFormat::RGB32Float:
-            return FW::ImageFormat::RGB_Vec3f;
-        case ResourceFormat::RGBA32Float:
-            return FW::ImageFormat::RGBA_Vec4f;
-        case ResourceFormat::Alpha32Float:
-            return FW::ImageFormat::A_F32;
-        
-        case ResourceFormat::BGRA8Unorm:
-        case ResourceFormat::BGRA8UnormSrgb:
-            return FW::ImageFormat::BGRA_8888;
-        case ResourceFormat::RG8Unorm:
-            return FW::ImageFormat::RG_88;
-        case ResourceFormat::R8Unorm:
-            return FW::ImageFormat::R8;
-
-        case ResourceFormat::BC1Unorm:
-        case ResourceFormat::BC1UnormSrgb:
-            return FW::ImageFormat::S3TC_DXT1;
-        case ResourceFormat::BC2Unorm:
-        case ResourceFormat::BC2UnormSrgb:
-            return FW::ImageFormat::S3TC_DXT3;
-        case ResourceFormat::BC3Unorm:
-        case ResourceFormat::BC3UnormSrgb:
-            return FW::ImageFormat::S3TC_DXT5;
-        case ResourceFormat::BC4Unorm:
-            return FW::ImageFormat::RGTC_R;
-        case ResourceFormat::BC5Unorm:
-            return FW::ImageFormat::RGTC_RG;
-        default:
-            should_not_get_here();
-            return FW::ImageFormat::ID_Max;
-        }
-    }
-
-    static BasicMaterial::MapType getFalcorMapType(TextureType map)
-    {
-        switch(map)
-        {
-        case TextureType_Diffuse:
-            return BasicMaterial::MapType::DiffuseMap;
-        case TextureType_Alpha:
-            return BasicMaterial::MapType::AlphaMap;
-        case TextureType_Normal:
-            return BasicMaterial::MapType::NormalMap;
-        case TextureType_Specular:
-            return BasicMaterial::MapType::SpecularMap;
-        case TextureType_Displacement:
-            return BasicMaterial::MapType::HeightMap;
-        default:
-            return BasicMaterial::MapType::Count;
-        }
-    }
-
-    static AttribType getBinaryAttribType(const std::string& name)
-    {
-        if(name == VERTEX_POSITION_NAME)
-            return AttribType_Position;
-        else if(name == VERTEX_NORMAL_NAME)
-            return AttribType_Normal;
-        else if(name == VERTEX_BITANGENT_NAME)
-            return AttribType_Bitangent;
-        else if(name == VERTEX_DIFFUSE_COLOR_NAME)
-            return AttribType_Color;
-        else if(name == VERTEX_TEXCOORD_NAME)
-            return AttribType_TexCoord;
-
-        should_not_get_here();
-        return AttribType_Max;
-    }
-
-    static AttribFormat GetBinaryAttribFormat(ResourceFormat format)
+    void writeString(BinaryFileStream& stream, const std::string& str)
     {
-        switch(format)
-        {
-        case ResourceFormat::R8Unorm:
-        case ResourceFormat::RG8Unorm:
-        case ResourceFormat::RGBA8Unorm:
-            return AttribFormat_U8;
-        case ResourceFormat::R32Int:
-        case ResourceFormat::RG32Int:
-        case ResourceFormat::RGB32Int:
-        case ResourceFormat::RGBA32Int:
-            return AttribFormat_S32;
-        case ResourceFormat::R32Float:
-        case ResourceFormat::RG32Float:
-        case ResourceFormat::RGB32Float:
-        case ResourceFormat::RGBA32Float:
-            return AttribFormat_F32;
-        default:
-            should_not_get_here(); // Format not supported by the binary file
-            return AttribFormat_Max;
-        }
+        stream << (int32_t)str.size();
+        stream.write(str.c_str(), str.size());
     }
 
-    void writeString(BinaryFileStream& stream, const std::string& str)
+    static void writeDataBlockDesc(BinaryFileStream& stream, const DataBlock& block)
     {
-        stream << (int32_t)str.size();
-        stream.write(str.c_str(), str.size());;
+        stream << block.offset << block.size;
     }
 
-    void BinaryModelExporter::exportToFile(const std::string& filename, const Model* pModel)
+    bool BinaryModelExporter::exportToFile(const std::string& filename, const Model* pModel, ExportFlags flags)
     {
-        BinaryModelExporter(filename, pModel);
+        BinaryModelExporter exporter(filename, pModel, flags);
+        return exporter.mSucceeded;
     }
 
     void BinaryModelExporter::error(const std::string& msg)
@@ -168,295 +67,466 @@ namespace Falcor
         logError("Warning when exporting model \"" + mFilename + "\".\n" + Msg);
     }
 
-    BinaryModelExporter::BinaryModelExporter(const std::string& filename, const Model* pModel) : mFilename(filename)
+    BinaryModelExporter::BinaryModelExporter(const std::string& filename, const Model* pModel, ExportFlags flags) : mFilename(filename), mFlags(flags)
     {
         mStream.open(filename.c_str(), BinaryFileStream::Mode::Write);
         mpModel = pModel;
 
-        if(mpModel->hasBones())
+        if(prepareModelData()       == false) return;
+        if(writeHeader()            == false) return;
+        if(writeData()              == false) return;
+        if(writeTextures()          == false) return;
+        if(writeMaterials()         == false) return;
+        if(writeMeshes()            == false) return;
+        if(writeBones()             == false) return;
+        if(writeInstances()         == false) return;
+        if(writeAnimations()        == false) return;
+        if(writeMeshLods()          == false) return;
+        if(writeTableOfContents()   == false) return;
+        mSucceeded = true;
+    }
+
+    int32_t BinaryModelExporter::getTextureID(const Texture* pTexture)
+    {
+        if(pTexture == nullptr)
         {
-            error("Binary format doesn't support model with bones");
-            return;
+            return -1;
         }
 
-        if(mpModel->hasAnimations())
+        auto it = mTextureHash.find(pTexture);
+        if(it != mTextureHash.end())
         {
-            error("Binary format doesn't support model with animations");
-            return;
+            return it->second;
         }
 
-        if(prepareSubmeshes() == false) return;
-        if(writeHeader()      == false) return;
-        if(writeTextures()    == false) return;
-        if(writeMeshes()      == false) return;
-        if(writeInstances()   == false) return;
+        int32_t id = (int32_t)mTextures.size();
+        mTextureHash[pTexture] = id;
+        mTextures.push_back(pTexture);
+        return id;
     }
 
-    bool BinaryModelExporter::prepareSubmeshes()
+    bool BinaryModelExporter::prepareModelData()
     {
-        // The binary format has a concept of submeshes, that share the same vertex buffer, but have different materials and index buffers.
-        // Model works in a similar way (meshes can share VB), but only stores the meshes vector. We need to process that vector to identify submeshes.
+        // Meshes can share a VAO. Each unique VAO becomes a vertex-set, so shared vertex buffers are only stored once.
+        mMeshVertexSet.resize(mpModel->getMeshCount());
         for(uint32_t i = 0; i < mpModel->getMeshCount(); i++)
         {
             const auto& pMesh = mpModel->getMesh(i);
-            if(pMesh->getVao()->getPrimitiveTopology() != Vao::Topology::TriangleList)
+            const Vao* pVao = pMesh->getVao().get();
+
+            auto it = mVertexSetIDs.find(pVao);
+            if(it == mVertexSetIDs.end())
             {
-                warning("Binary format doesn't support topologies other than triangles.");
-                continue;
+                VertexSet set;
+                set.pVao = pVao;
+                set.vertexCount = pMesh->getVertexCount();
+                it = mVertexSetIDs.insert(std::make_pair(pVao, (uint32_t)mVertexSets.size())).first;
+                mVertexSets.push_back(set);
             }
+            mMeshVertexSet[i] = it->second;
+
+            // Collect the unique materials and the textures they reference
+            const Material* pMaterial = pMesh->getMaterial().get();
+            if(mMaterialHash.find(pMaterial) == mMaterialHash.end())
+            {
+                mMaterialHash[pMaterial] = (int32_t)mMaterials.size();
+                mMaterials.push_back(pMaterial);
 
-            const auto& pVao = pMesh->getVao();
-            auto& submesh = mMeshes[pVao.get()];
-            submesh.push_back(i);
+                for(uint32_t l = 0; l < pMaterial->getNumLayers(); l++)
+                {
+                    getTextureID(pMaterial->getLayer(l).pTexture.get());
+                }
+                getTextureID(pMaterial->getNormalMap().get());
+                getTextureID(pMaterial->getAlphaMap().get());
+                getTextureID(pMaterial->getAmbientOcclusionMap().get());
+                getTextureID(pMaterial->getHeightMap().get());
+            }
         }
 
-        // Calculate the number of mesh instances
-        for(const auto& m : mMeshes)
+        for(const Texture* pTexture : mTextures)
         {
-            mInstanceCount += mpModel->getMeshInstanceCount(m.second[0]);
+            if(pTexture->getArraySize() > 1)
+            {
+                error("Binary file format doesn't support texture arrays.");
+                return false;
+            }
+
+            if(pTexture->getType() != Texture::Type::Texture2D)
+            {
+                error("Binary file format only supports 2D textures.");
+                return false;
+            }
+
+            if(is_set(mFlags, ExportFlags::ReferenceTextures) && pTexture->getSourceFilename().empty())
+            {
+                error("Can't reference a texture which wasn't loaded from a file.");
+                return false;
+            }
         }
 
         return true;
     }
 
-    bool BinaryModelExporter::writeHeader()
+    void BinaryModelExporter::alignStream()
     {
-        mStream.write("BinScene", 8);
-        mStream << (int32_t)8 << (int32_t)mpModel->getTextureCount() << (int32_t)mMeshes.size() << (int32_t)mInstanceCount;
-        return true;
+        static const uint8_t kPadding[kBinaryChunkAlignment] = {};
+        size_t offset = mStream.getPosition();
+        size_t aligned = align_to(kBinaryChunkAlignment, offset);
+        mStream.write(kPadding, aligned - offset);
     }
 
-    bool BinaryModelExporter::writeTextures()
+    void BinaryModelExporter::beginChunk(ChunkType type)
     {
-        mTextureHash[nullptr] = -1;
+        alignStream();
+        mChunks[type].type = type;
+        mChunks[type].offset = mStream.getPosition();
+    }
 
-        uint32_t texID = 0;
-        for (uint32_t meshID = 0; meshID < mpModel->getMeshCount(); meshID++)
-        {
-            bool succeeded = true;
+    void BinaryModelExporter::endChunk(ChunkType type)
+    {
+        mChunks[type].size = mStream.getPosition() - mChunks[type].offset;
+    }
 
-            // Write all material textures
-            const auto& pMaterial = mpModel->getMesh(meshID)->getMaterial();
-            for (uint32_t i = 0; i < pMaterial->getNumLayers(); i++)
-            {
-                succeeded &= writeMaterialTexture(texID, pMaterial->getLayer(i).pTexture);
-            }
+    DataBlock BinaryModelExporter::writeDataBlock(const void* pData, size_t size)
+    {
+        alignStream();
+        DataBlock block;
+        block.offset = mStream.getPosition();
+        block.size = size;
+        mStream.write(pData, size);
+        return block;
+    }
 
-            succeeded &= writeMaterialTexture(texID, pMaterial->getNormalMap());
-            succeeded &= writeMaterialTexture(texID, pMaterial->getAlphaMap());
-            succeeded &= writeMaterialTexture(texID, pMaterial->getAmbientOcclusionMap());
-            succeeded &= writeMaterialTexture(texID, pMaterial->getHeightMap());
+    bool BinaryModelExporter::writeHeader()
+    {
+        mStream.write("BinScene", 8);
+        mStream << (int32_t)9 << (int32_t)ChunkType_Max;
 
-            if (succeeded == false)
-            {
-                return false;
-            }
+        // Reserve space for the table of contents. It's filled once all the chunks are written.
+        for(uint32_t i = 0; i < ChunkType_Max; i++)
+        {
+            mStream << mChunks[i].type << mChunks[i].reserved << mChunks[i].offset << mChunks[i].size;
         }
-
         return true;
     }
 
-    bool BinaryModelExporter::writeCommonMeshData(const Mesh::SharedPtr& pMesh, uint32_t submeshCount)
+    bool BinaryModelExporter::writeData()
     {
-        auto pVao = pMesh->getVao();
-        const uint32_t vertexBufferCount = pMesh->getVao()->getVertexBuffersCount();
-        mStream << (int32_t)vertexBufferCount << (int32_t)pMesh->getVertexCount() << (int32_t)submeshCount;
+        beginChunk(ChunkType_Data);
 
-        struct vertexBufferInfo 
+        // Copy all the vertex and index buffers into temporary staging buffers, so that we only wait for the GPU once.
+        // Using Buffer::map() instead would flush the pipeline for each buffer and keep a staging copy alive for the lifetime of the model.
+        RenderContext* pContext = gpDevice->getRenderContext().get();
+        auto createReadback = [pContext](const Buffer* pBuffer)
         {
-            Buffer::SharedPtr pBuffer;
-            size_t            pData; //this had the p flag because it represents the pointer to the vertex buffers data
-            uint32_t          stride;
+            Buffer::SharedPtr pStaging = Buffer::create(pBuffer->getSize(), Buffer::BindFlags::None, Buffer::CpuAccess::Read, nullptr);
+            pContext->copyResource(pStaging.get(), pBuffer);
+            return pStaging;
         };
-            
-        std::vector<vertexBufferInfo> vbInfo(vertexBufferCount);
 
-        for (uint32_t i = 0; i < vertexBufferCount; i++)
+        std::vector<std::vector<Buffer::SharedPtr>> vbReadback(mVertexSets.size());
+        for(size_t s = 0; s < mVertexSets.size(); s++)
         {
-            const VertexBufferLayout* pLayout = pVao->getVertexLayout()->getBufferLayout(i).get();
-            assert(pLayout->getElementCount() == 1);
-            AttribType type = getBinaryAttribType(pLayout->getElementName(0));
-            AttribFormat format = GetBinaryAttribFormat(pLayout->getElementFormat(0));
-            uint32_t channels = getFormatChannelCount(pLayout->getElementFormat(0));
+            const Vao* pVao = mVertexSets[s].pVao;
+            for(uint32_t i = 0; i < pVao->getVertexBuffersCount(); i++)
+            {
+                vbReadback[s].push_back(createReadback(pVao->getVertexBuffer(i).get()));
+            }
+        }
 
-            if(type == AttribType_Max)
+        std::vector<Buffer::SharedPtr> ibReadback(mpModel->getMeshCount());
+        std::vector<std::vector<Buffer::SharedPtr>> lodReadback(mpModel->getMeshCount());
+        for(uint32_t i = 0; i < mpModel->getMeshCount(); i++)
+        {
+            const auto& pMesh = mpModel->getMesh(i);
+            const auto& pIB = pMesh->getVao()->getIndexBuffer();
+            if(pIB)
             {
-                error("Unsupported attribute Type");
-                return false;
+                ibReadback[i] = createReadback(pIB.get());
             }
 
-            if(format == AttribFormat_Max)
+            for(uint32_t lod = 1; lod < pMesh->getLodCount(); lod++)
             {
-                error("Unsupported attribute format");
-                return false;
+                lodReadback[i].push_back(createReadback(pMesh->getLod(lod).pVao->getIndexBuffer().get()));
             }
-            mStream << (int32_t)type << (int32_t)format << (int32_t)channels;
+        }
+        pContext->flush(true);
 
-            vbInfo[i].pBuffer = pVao->getVertexBuffer(i);
-            vbInfo[i].stride = pLayout->getStride();
-            vbInfo[i].pData = (size_t)vbInfo[i].pBuffer->map(Buffer::MapType::Read);
+        // Vertex buffers
+        for(size_t s = 0; s < mVertexSets.size(); s++)
+        {
+            auto& set = mVertexSets[s];
+            const uint32_t bufferCount = set.pVao->getVertexBuffersCount();
+            set.buffers.resize(bufferCount);
+            for(uint32_t i = 0; i < bufferCount; i++)
+            {
+                const size_t size = (size_t)set.pVao->getVertexLayout()->getBufferLayout(i)->getStride() * set.vertexCount;
+                set.buffers[i] = writeDataBlock(vbReadback[s][i]->map(Buffer::MapType::Read), size);
+                vbReadback[s][i]->unmap();
+            }
+        }
+
+        // Index buffers
+        mIndexBlocks.resize(mpModel->getMeshCount());
+        for(uint32_t i = 0; i < mpModel->getMeshCount(); i++)
+        {
+            if(ibReadback[i])
+            {
+                mIndexBlocks[i] = writeDataBlock(ibReadback[i]->map(Buffer::MapType::Read), mpModel->getMesh(i)->getIndexCount() * sizeof(uint32_t));
+                ibReadback[i]->unmap();
+            }
         }
 
-        // Write the vertex buffer
-        for (uint32_t i = 0; i < pMesh->getVertexCount(); ++i)
+        // LOD index buffers
+        mLodIndexBlocks.resize(mpModel->getMeshCount());
+        for(uint32_t i = 0; i < mpModel->getMeshCount(); i++)
         {
-            for (auto& a : vbInfo)
-            { 			
-                mStream.write((void*)a.pData, a.stride);
-                a.pData += a.stride;
+            const auto& pMesh = mpModel->getMesh(i);
+            for(uint32_t lod = 1; lod < pMesh->getLodCount(); lod++)
+            {
+                const auto& pReadback = lodReadback[i][lod - 1];
+                mLodIndexBlocks[i].push_back(writeDataBlock(pReadback->map(Buffer::MapType::Read), pMesh->getLod(lod).indexCount * sizeof(uint32_t)));
+                pReadback->unmap();
             }
         }
 
-        for (auto& a : vbInfo)
+        // Textures. Referenced textures are loaded from their source files, so they get an empty data block.
+        mTextureBlocks.resize(mTextures.size());
+        for(size_t i = 0; i < mTextures.size() && is_set(mFlags, ExportFlags::ReferenceTextures) == false; i++)
         {
-            a.pBuffer->unmap();
+            // The importer expects the first mip-level as tightly packed rows of blocks
+            const Texture* pTexture = mTextures[i];
+            const ResourceFormat format = pTexture->getFormat();
+            const size_t blocksX = (pTexture->getWidth() + getFormatWidthCompressionRatio(format) - 1) / getFormatWidthCompressionRatio(format);
+            const size_t blocksY = (pTexture->getHeight() + getFormatHeightCompressionRatio(format) - 1) / getFormatHeightCompressionRatio(format);
+            std::vector<uint8_t> data = gpDevice->getRenderContext()->readTextureSubresource(pTexture, 0);
+            if(data.size() != blocksX * blocksY * getFormatBytesPerBlock(format))
+            {
+                error("Unexpected size of the data read back from texture " + pTexture->getSourceFilename() + ".");
+                return false;
+            }
+            mTextureBlocks[i] = writeDataBlock(data.data(), data.size());
         }
 
+        endChunk(ChunkType_Data);
         return true;
     }
 
-    bool BinaryModelExporter::writeSubmesh(const Mesh::SharedPtr& pMesh)
+    bool BinaryModelExporter::writeTextures()
     {
-        const auto pMaterial = pMesh->getMaterial();
-
-        BasicMaterial basicMaterial;
-        basicMaterial.initializeFromMaterial(pMaterial.get());
+        beginChunk(ChunkType_Textures);
+        mStream << (int32_t)mTextures.size();
+        for(size_t i = 0; i < mTextures.size(); i++)
+        {
+            const Texture* pTexture = mTextures[i];
+            writeString(mStream, pTexture->getSourceFilename());
+            mStream << (int32_t)pTexture->getFormat() << (int32_t)pTexture->getWidth() << (int32_t)pTexture->getHeight();
+            writeDataBlockDesc(mStream, mTextureBlocks[i]);
+        }
+        endChunk(ChunkType_Textures);
+        return true;
+    }
 
-        glm::vec3 ambient(0,0,0);
-        glm::vec4 diffuse = glm::vec4(basicMaterial.diffuseColor, basicMaterial.opacity);
-        glm::vec3 specular = basicMaterial.specularColor;
-        float glossiness = basicMaterial.shininess;
+    bool BinaryModelExporter::writeMaterials()
+    {
+        beginChunk(ChunkType_Materials);
+        mStream << (int32_t)mMaterials.size();
+        for(const Material* pMaterial : mMaterials)
+        {
+            writeString(mStream, pMaterial->getName());
+            mStream << (int32_t)pMaterial->getNumLayers();
+            for(uint32_t i = 0; i < pMaterial->getNumLayers(); i++)
+            {
+                const Material::Layer layer = pMaterial->getLayer(i);
+                mStream << (int32_t)layer.type << (int32_t)layer.ndf << (int32_t)layer.blend;
+                mStream << layer.albedo << layer.roughness << layer.extraParam << layer.pmf;
+                mStream << getTextureID(layer.pTexture.get());
+            }
 
-        mStream << ambient << diffuse << specular << glossiness;
+            mStream << getTextureID(pMaterial->getNormalMap().get());
+            mStream << getTextureID(pMaterial->getAlphaMap().get());
+            mStream << getTextureID(pMaterial->getAmbientOcclusionMap().get());
+            mStream << getTextureID(pMaterial->getHeightMap().get());
+            mStream << pMaterial->getHeightModifiers() << pMaterial->getAlphaThreshold() << (int32_t)pMaterial->isDoubleSided();
+        }
+        endChunk(ChunkType_Materials);
+        return true;
+    }
 
-        float displacementCoeff = basicMaterial.bumpScale;
-        float displacementBias = basicMaterial.bumpOffset;
+    bool BinaryModelExporter::writeMeshes()
+    {
+        beginChunk(ChunkType_Meshes);
 
-        mStream << displacementCoeff << displacementBias;
-        
-        for(uint32_t i = 0; i < TextureType_Max; i++)
+        mStream << (int32_t)mVertexSets.size();
+        for(const auto& set : mVertexSets)
         {
-            BasicMaterial::MapType falcorType = getFalcorMapType(TextureType(i));
-            int32_t index = -1;
-            if(BasicMaterial::MapType::Count != falcorType)
+            const auto& pLayout = set.pVao->getVertexLayout();
+            mStream << (int32_t)set.vertexCount << (int32_t)set.buffers.size();
+            for(uint32_t i = 0; i < (uint32_t)set.buffers.size(); i++)
             {
-                index = mTextureHash[basicMaterial.pTextures[falcorType].get()];
+                const auto& pBufferLayout = pLayout->getBufferLayout(i);
+                mStream << (int32_t)pBufferLayout->getStride() << (int32_t)pBufferLayout->getElementCount();
+                for(uint32_t e = 0; e < pBufferLayout->getElementCount(); e++)
+                {
+                    writeString(mStream, pBufferLayout->getElementName(e));
+                    mStream << (int32_t)pBufferLayout->getElementOffset(e) << (int32_t)pBufferLayout->getElementFormat(e);
+                    mStream << (int32_t)pBufferLayout->getElementArraySize(e) << (int32_t)pBufferLayout->getElementShaderLocation(e);
+                }
+                writeDataBlockDesc(mStream, set.buffers[i]);
             }
+        }
 
-            mStream << index;
+        mStream << (int32_t)mpModel->getMeshCount();
+        for(uint32_t i = 0; i < mpModel->getMeshCount(); i++)
+        {
+            const auto& pMesh = mpModel->getMesh(i);
+            const BoundingBox& box = pMesh->getBoundingBox();
+            mStream << (int32_t)mMeshVertexSet[i] << mMaterialHash[pMesh->getMaterial().get()];
+            mStream << (int32_t)pMesh->getVao()->getPrimitiveTopology() << (int32_t)pMesh->getIndexCount() << (int32_t)pMesh->hasBones();
+            mStream << box.center << box.extent;
+            writeDataBlockDesc(mStream, mIndexBlocks[i]);
         }
 
-        uint32_t indexCount = pMesh->getIndexCount();
-        assert(indexCount % 3 == 0);
-        uint32_t primCount = indexCount / 3;
+        endChunk(ChunkType_Meshes);
+        return true;
+    }
 
-        mStream << (int32_t)primCount;
+    bool BinaryModelExporter::writeBones()
+    {
+        beginChunk(ChunkType_Bones);
 
-        // Output the index buffer
-        const void* pIndices = pMesh->getVao()->getIndexBuffer()->map(Buffer::MapType::Read);
-        mStream.write(pIndices, indexCount * sizeof(uint32_t));
-        pMesh->getVao()->getIndexBuffer()->unmap();
+        const AnimationController* pController = mpModel->getAnimationController();
+        const uint32_t boneCount = pController ? pController->getBoneCount() : 0;
+        mStream << (int32_t)boneCount;
+        for(uint32_t i = 0; i < boneCount; i++)
+        {
+            const Bone& bone = pController->getBones()[i];
+            mStream << bone.parentID << bone.boneID << bone.offset << bone.localTransform << bone.originalLocalTransform << bone.globalTransform;
+            writeString(mStream, bone.name);
+        }
 
+        endChunk(ChunkType_Bones);
         return true;
     }
 
-    bool BinaryModelExporter::writeMeshes()
+    bool BinaryModelExporter::writeInstances()
     {
-        uint32_t inst = 0;
-        for(const auto& mesh : mMeshes)
+        beginChunk(ChunkType_Instances);
+
+        uint32_t instanceCount = 0;
+        for(uint32_t meshID = 0; meshID < mpModel->getMeshCount(); meshID++)
         {
-            const auto& submeshes = mesh.second;
+            instanceCount += mpModel->getMeshInstanceCount(meshID);
+        }
 
-            for(uint32_t meshID : submeshes)
+        mStream << (int32_t)instanceCount;
+        for(uint32_t meshID = 0; meshID < mpModel->getMeshCount(); meshID++)
+        {
+            for(uint32_t i = 0; i < mpModel->getMeshInstanceCount(meshID); i++)
             {
-                const Mesh::SharedPtr& pMesh = mpModel->getMesh(meshID);
-
-                if(meshID == submeshes[0])
-                {
-                    // All submeshes share the same VB and same layout. We use the first submesh for that.
-                    if(writeCommonMeshData(pMesh, (uint32_t)submeshes.size()) == false)
-                    {
-                        return false;
-                    }
-                }
-
-                if(writeSubmesh(pMesh) == false)
-                {
-                    return false;
-                }
-                inst += mpModel->getMeshInstanceCount(meshID);
+                const auto& pInstance = mpModel->getMeshInstance(meshID, i);
+                mStream << (int32_t)meshID << pInstance->getTransformMatrix();
+                writeString(mStream, pInstance->getName());
             }
         }
 
+        endChunk(ChunkType_Instances);
         return true;
     }
 
-    bool BinaryModelExporter::writeInstances()
+    template<typename T>
+    static void writeAnimationKeys(BinaryFileStream& stream, const std::vector<Animation::AnimationKey<T>>& keys)
     {
-        int32_t meshIdx = 0;
-        int32_t enabled = 1;
-        for(const auto& mesh : mMeshes)
+        stream << (int32_t)keys.size();
+        for(const auto& key : keys)
         {
-            const uint32_t meshID = mesh.second[0];
+            stream << key.value << key.time;
+        }
+    }
 
-            for(uint32_t i = 0; i < mpModel->getMeshInstanceCount(meshID); i++)
+    static void writeAnimationKeys(BinaryFileStream& stream, const std::vector<Animation::AnimationKey<glm::quat>>& keys)
+    {
+        stream << (int32_t)keys.size();
+        for(const auto& key : keys)
+        {
+            stream << key.value.x << key.value.y << key.value.z << key.value.w << key.time;
+        }
+    }
+
+    bool BinaryModelExporter::writeAnimations()
+    {
+        beginChunk(ChunkType_Animations);
+
+        const AnimationController* pController = mpModel->getAnimationController();
+        const uint32_t animationCount = pController ? pController->getAnimationCount() : 0;
+        mStream << (int32_t)animationCount;
+        for(uint32_t i = 0; i < animationCount; i++)
+        {
+            const Animation* pAnimation = pController->getAnimation(i);
+            writeString(mStream, pAnimation->getName());
+            mStream << pAnimation->getDuration() << pAnimation->getTicksPerSecond();
+
+            // Compressed animations are exported as their samples
+            std::vector<Animation::AnimationSet> decompressedSets;
+            if(pAnimation->getClip())
             {
-                glm::mat4 transformation = mpModel->getMeshInstance(meshID, i)->getTransformMatrix();
-                mStream << meshIdx << enabled << transformation;
-                writeString(mStream, "");   // Name
-                writeString(mStream, "");   // Meta-data
+                pAnimation->getClip()->decompress(decompressedSets);
+            }
+            const auto& sets = pAnimation->getClip() ? decompressedSets : pAnimation->getAnimationSets();
+            mStream << (int32_t)sets.size();
+            for(const auto& set : sets)
+            {
+                mStream << (int32_t)set.boneID;
+                writeAnimationKeys(mStream, set.translation.keys);
+                writeAnimationKeys(mStream, set.scaling.keys);
+                writeAnimationKeys(mStream, set.rotation.keys);
             }
-
-            meshIdx++;
         }
+
+        endChunk(ChunkType_Animations);
         return true;
     }
 
-    bool BinaryModelExporter::writeMaterialTexture(uint32_t& texID, const Texture::SharedPtr& pTexture)
+    bool BinaryModelExporter::writeMeshLods()
     {
-        if (pTexture != nullptr)
+        beginChunk(ChunkType_MeshLods);
+
+        uint32_t lodCount = 0;
+        for(const auto& blocks : mLodIndexBlocks)
+        {
+            lodCount += (uint32_t)blocks.size();
+        }
+
+        mStream << (int32_t)lodCount;
+        for(uint32_t i = 0; i < mpModel->getMeshCount(); i++)
         {
-            // If not exported yet
-            if (mTextureHash.find(pTexture.get()) == mTextureHash.end())
+            const auto& pMesh = mpModel->getMesh(i);
+            for(uint32_t lod = 1; lod < pMesh->getLodCount(); lod++)
             {
-                mTextureHash[pTexture.get()] = texID++;
-                return exportBinaryImage(pTexture.get());
+                const Mesh::Lod& data = pMesh->getLod(lod);
+                mStream << (int32_t)i << (int32_t)data.indexCount << data.screenSize << data.error;
+                writeDataBlockDesc(mStream, mLodIndexBlocks[i][lod - 1]);
             }
         }
 
+        endChunk(ChunkType_MeshLods);
         return true;
     }
 
-    bool BinaryModelExporter::exportBinaryImage(const Texture* pTexture)
+    bool BinaryModelExporter::writeTableOfContents()
     {
-        if(pTexture->getArraySize() > 1)
+        // The table of contents follows the 16-byte file header
+        mStream.seek(16);
+        for(uint32_t i = 0; i < ChunkType_Max; i++)
         {
-            error("Binary file format doesn't support texture arrays.");
-            return false;
+            mStream << mChunks[i].type << mChunks[i].reserved << mChunks[i].offset << mChunks[i].size;
         }
 
-        if(pTexture->getType() != Texture::Type::Texture2D)
+        if(mStream.isFail())
         {
-            error("Binary file format only supports 2D textures.");
+            error("Failed to write the file.");
             return false;
         }
-
-        uint32_t width = pTexture->getWidth();
-        uint32_t height = pTexture->getHeight();
-        ResourceFormat format = pTexture->getFormat();
-        uint32_t bpp = getFormatBytesPerBlock(format);
-
-        int32_t formatID = getBinaryFormatID(pTexture->getFormat());
-
-        // Write the data
-        std::vector<uint8_t> data = gpDevice->getRenderContext()->readTextureSubresource(pTexture, 0);
-
-        writeString(mStream, pTexture->getSourceFilename());
-        mStream.write("BinImage", 8);
-        // Version, width, height, bytes-per-pixel, channel count, FormatID, DataSize
-        mStream << (int32_t)2 << (int32_t)width << (int32_t)height << bpp << (int32_t)0 << formatID << (int32_t)data.size();
-
-        mStream.write(data.data(), data.size());
         return true;
     }
 }
\ No newline at end of file
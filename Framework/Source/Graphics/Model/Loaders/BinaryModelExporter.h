@@ -31,6 +31,7 @@
 #include <map>
 #include <vector>
 #include "Graphics/Model/Mesh.h"
+#include "BinaryModelSpec.h"
 
 namespace Falcor
 {
@@ -38,39 +39,74 @@ namespace Falcor
     class Mesh;
     class Vao;
     class Texture;
+    class Material;
 
     class BinaryModelExporter
     {
     public:
-        /** Export a model into a binary file
+        enum class ExportFlags
+        {
+            None = 0,
+            ReferenceTextures = 1,  ///< Don't embed the texture data, store the textures' source filenames instead. The textures are loaded from their source files when the model is imported.
+        };
+
+        /** Export a model into a binary file. The file is written using the latest version of the format (v9).
             \param[in] filename Model's filename or full path
             \param[in] pModel The model to export
+            \param[in] flags Flags controlling the export
+            \return true if the file was written successfully, otherwise false
         */
-        static void exportToFile(const std::string& filename, const Model* pModel);
+        static bool exportToFile(const std::string& filename, const Model* pModel, ExportFlags flags = ExportFlags::None);
 
     private:
-        BinaryModelExporter(const std::string& filename, const Model* pModel);
+        BinaryModelExporter(const std::string& filename, const Model* pModel, ExportFlags flags);
         const Model* mpModel = nullptr;
         BinaryFileStream mStream;
         const std::string& mFilename;
+        ExportFlags mFlags;
+        bool mSucceeded = false;
 
+        bool prepareModelData();
         bool writeHeader();
+        bool writeData();
         bool writeTextures();
+        bool writeMaterials();
         bool writeMeshes();
-        bool writeCommonMeshData(const Mesh::SharedPtr& pMesh, uint32_t submeshCount);
-        bool writeSubmesh(const Mesh::SharedPtr& pMesh);
+        bool writeBones();
         bool writeInstances();
+        bool writeAnimations();
+        bool writeMeshLods();
+        bool writeTableOfContents();
 
-        bool writeMaterialTexture(uint32_t& texID, const Texture::SharedPtr& pTexture);
-        
-        bool exportBinaryImage(const Texture* pTexture);
+        void beginChunk(ChunkType type);
+        void endChunk(ChunkType type);
+        void alignStream();
+        DataBlock writeDataBlock(const void* pData, size_t size);
+        int32_t getTextureID(const Texture* pTexture);
 
         void error(const std::string& Msg);
         void warning(const std::string& Msg);
 
-        bool prepareSubmeshes();
-        std::map<const Vao*, std::vector<uint32_t>> mMeshes; // Maps to meshID in model
+        // A group of vertex buffers shared by one or more meshes
+        struct VertexSet
+        {
+            const Vao* pVao = nullptr;
+            uint32_t vertexCount = 0;
+            std::vector<DataBlock> buffers;
+        };
+
+        std::vector<VertexSet> mVertexSets;
+        std::map<const Vao*, uint32_t> mVertexSetIDs;
+        std::vector<uint32_t> mMeshVertexSet;       // Maps meshID in model to the vertex-set
+        std::vector<DataBlock> mIndexBlocks;        // Index data for each mesh in the model
+        std::vector<std::vector<DataBlock>> mLodIndexBlocks; // Index data for the LODs of each mesh, starting with LOD 1
+        std::vector<const Texture*> mTextures;
+        std::vector<DataBlock> mTextureBlocks;
         std::map<const Texture*, int32_t> mTextureHash;
-        uint32_t mInstanceCount = 0; // Not the same as Model::Instance count. Model keeps the total instance count, while the binary format has a concept of meshes and submeshes, and the instance count there is the mesh instance count.
+        std::vector<const Material*> mMaterials;
+        std::map<const Material*, int32_t> mMaterialHash;
+        ChunkDesc mChunks[ChunkType_Max];
     };
+
+    enum_class_operators(BinaryModelExporter::ExportFlags);
 }
@@ -30,6 +30,8 @@
 #include "BinaryModelSpec.h"
 #include "../Model.h"
 #include "../Mesh.h"
+#include "../MeshLod.h"
+#include "../AnimationClip.h"
 #include "Utils/Platform/OS.h"
 #include "API/VertexLayout.h"
 #include "Data/VertexAttrib.h"
@@ -41,7 +43,11 @@
 #include "Graphics/Material/Material.h"
 #include "glm/geometric.hpp"
 #include "API/Device.h"
+#include "Utils/BinaryMemoryStream.h"
+#include "Utils/Platform/MemoryMappedFile.h"
+#include "Graphics/TextureHelper.h"
 #include <numeric>
+#include <algorithm>
 #include <cstring>
 
 namespace Falcor
@@ -351,17 +357,43 @@ namespace Falcor
         }
     }
 
-    std::string readString(BinaryFileStream& stream)
+    // Moves the stream past its end, so that it reports a failure to the caller
+    template<typename StreamType>
+    static void failStream(StreamType& stream)
+    {
+        if(stream.isFail() == false)
+        {
+            char c;
+            stream.seek(stream.getPosition() + stream.getRemainingStreamSize());
+            stream.read(&c, 1);
+        }
+    }
+
+    // Checks a count read from the file against the data left in the stream, before allocating memory for it
+    template<typename StreamType>
+    static bool isCountValid(StreamType& stream, int32_t count, size_t minRecordSize)
+    {
+        return (stream.isFail() == false) && (count >= 0) && ((size_t)count <= stream.getRemainingStreamSize() / minRecordSize);
+    }
+
+    template<typename StreamType>
+    std::string readString(StreamType& stream)
     {
         int32_t length;
         stream >> length;
+        if(isCountValid(stream, length, 1) == false)
+        {
+            failStream(stream);
+            return std::string();
+        }
         std::vector<char> charVec(length + 1);
         stream.read(&charVec[0], length);
         charVec[length] = 0;
         return std::string(charVec.data());
     }
 
-    bool loadBinaryTextureData(BinaryFileStream& stream, const std::string& modelName, TextureData& data)
+    template<typename StreamType>
+    bool loadBinaryTextureData(StreamType& stream, const std::string& modelName, TextureData& data)
     {
         // ImageHeader.
         char tag[9];
@@ -469,7 +501,8 @@ namespace Falcor
         return true;
     }
 
-    bool importTextures(std::vector<TextureData>& textures, uint32_t textureCount, BinaryFileStream& stream, const std::string& modelName)
+    template<typename StreamType>
+    bool importTextures(std::vector<TextureData>& textures, uint32_t textureCount, StreamType& stream, const std::string& modelName)
     {
         textures.assign(textureCount, TextureData());
 
@@ -489,7 +522,108 @@ namespace Falcor
         return success;
     }
 
-    BinaryModelImporter::BinaryModelImporter(const std::string& fullpath) : mModelName(fullpath), mStream(fullpath.c_str(), BinaryFileStream::Mode::Read)
+    struct VertexBufferData
+    {
+        std::vector<uint8_t> vec;
+        bool shouldSkip = false;
+        uint32_t elementSize = 0;
+    };
+
+    // Stream path. Reads one attribute of one vertex at a time.
+    static void readVertices(BinaryFileStream& stream, std::vector<VertexBufferData>& buffers, uint32_t numAttribs, uint32_t numVertices)
+    {
+        for(uint32_t i = 0; i < numVertices; i++)
+        {
+            for (uint32_t attributes = 0; attributes < numAttribs; ++attributes)
+            {
+                if (buffers[attributes].shouldSkip)
+                {
+                    stream.skip(buffers[attributes].elementSize);
+                }
+                else
+                {
+                    uint32_t stride = buffers[attributes].elementSize;
+                    uint8_t* pDest = buffers[attributes].vec.data() + stride * i;
+                    stream.read(pDest, stride);
+                }
+            }
+        }
+    }
+
+    // Copies a single attribute out of the interleaved vertex stream. The element size is a compile-time constant, so the copy becomes a couple of vector loads/stores instead of a memcpy() call.
+    template<uint32_t kElementSize>
+    static void deinterleaveAttribute(const uint8_t* pSrc, uint32_t srcStride, uint8_t* pDst, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            std::memcpy(pDst, pSrc, kElementSize);
+            pSrc += srcStride;
+            pDst += kElementSize;
+        }
+    }
+
+    static void deinterleaveAttribute(const uint8_t* pSrc, uint32_t srcStride, uint32_t elementSize, uint8_t* pDst, uint32_t count)
+    {
+        switch(elementSize)
+        {
+        case 4:
+            deinterleaveAttribute<4>(pSrc, srcStride, pDst, count);
+            break;
+        case 8:
+            deinterleaveAttribute<8>(pSrc, srcStride, pDst, count);
+            break;
+        case 12:
+            deinterleaveAttribute<12>(pSrc, srcStride, pDst, count);
+            break;
+        case 16:
+            deinterleaveAttribute<16>(pSrc, srcStride, pDst, count);
+            break;
+        default:
+            for (uint32_t i = 0; i < count; i++)
+            {
+                std::memcpy(pDst + i * elementSize, pSrc + i * srcStride, elementSize);
+            }
+        }
+    }
+
+    // Memory-mapped path. The vertex block is scattered directly from the mapping into the per-attribute buffers.
+    static void readVertices(BinaryMemoryStream& stream, std::vector<VertexBufferData>& buffers, uint32_t numAttribs, uint32_t numVertices)
+    {
+        uint32_t vertexStride = 0;
+        for (uint32_t a = 0; a < numAttribs; a++)
+        {
+            vertexStride += buffers[a].elementSize;
+        }
+
+        const size_t blockSize = size_t(vertexStride) * numVertices;
+        if (blockSize > stream.getRemainingStreamSize())
+        {
+            // Mark the stream as failed, same as reading past the end of a file
+            stream.skip(blockSize);
+            return;
+        }
+
+        // Work on batches of vertices small enough to stay in the cache, so each source cache-line is fetched from memory only once for all attributes
+        const uint32_t kVerticesPerBatch = 4096;
+        const uint8_t* pVertices = stream.getCurrentPointer();
+        for (uint32_t first = 0; first < numVertices; first += kVerticesPerBatch)
+        {
+            const uint32_t count = std::min(kVerticesPerBatch, numVertices - first);
+            const uint8_t* pSrc = pVertices + size_t(first) * vertexStride;
+            for (uint32_t a = 0; a < numAttribs; a++)
+            {
+                const uint32_t elementSize = buffers[a].elementSize;
+                if (buffers[a].shouldSkip == false)
+                {
+                    deinterleaveAttribute(pSrc, vertexStride, elementSize, buffers[a].vec.data() + size_t(first) * elementSize, count);
+                }
+                pSrc += elementSize;
+            }
+        }
+        stream.skip(blockSize);
+    }
+
+    BinaryModelImporter::BinaryModelImporter(const std::string& fullpath) : mModelName(fullpath)
     {
     }
 
@@ -503,14 +637,92 @@ namespace Falcor
         }
 
         BinaryModelImporter loader(fullpath);
-        return loader.importModel(model, flags);
+        if(is_set(flags, Model::LoadFlags::MemoryMappedIO))
+        {
+            MemoryMappedFile::SharedPtr pFile = MemoryMappedFile::create(fullpath);
+            if(pFile)
+            {
+                BinaryMemoryStream stream(pFile->getData(), pFile->getSize());
+                return loader.importModel(stream, model, flags);
+            }
+            logWarning("Can't memory map model file " + fullpath + ". Falling back to stream I/O.");
+        }
+
+        BinaryFileStream stream(fullpath, BinaryFileStream::Mode::Read);
+        return loader.importModel(stream, model, flags);
+    }
+
+    class BinaryModelImporter::PreloadedBinaryFile : public Model::PreloadedFile
+    {
+    public:
+        PreloadedBinaryFile(const std::string& filename, const std::string& fullpath, Model::LoadFlags flags) : Model::PreloadedFile(filename), mFullpath(fullpath), mFlags(flags) {}
+
+        bool load()
+        {
+            if(is_set(mFlags, Model::LoadFlags::MemoryMappedIO))
+            {
+                mpMappedFile = MemoryMappedFile::create(mFullpath);
+                if(mpMappedFile)
+                {
+                    // Touch every page, so the page faults are taken on the preloading thread instead of the thread that creates the GPU resources
+                    const size_t kPageSize = 4096;
+                    const uint8_t* pData = mpMappedFile->getData();
+                    uint8_t sum = 0;
+                    for(size_t i = 0; i < mpMappedFile->getSize(); i += kPageSize)
+                    {
+                        sum += pData[i];
+                    }
+                    mPrefetchChecksum = sum;
+                    return true;
+                }
+                logWarning("Can't memory map model file " + mFullpath + ". Falling back to stream I/O.");
+            }
+
+            BinaryFileStream stream(mFullpath, BinaryFileStream::Mode::Read);
+            mFileData.resize(stream.getRemainingStreamSize());
+            stream.read(mFileData.data(), mFileData.size());
+            if(stream.isFail())
+            {
+                logError("Error when loading model " + mFullpath + ".\nCan't read the file.");
+                return false;
+            }
+            return true;
+        }
+
+    protected:
+        bool import(Model& model) override
+        {
+            BinaryModelImporter loader(mFullpath);
+            BinaryMemoryStream stream = mpMappedFile ? BinaryMemoryStream(mpMappedFile->getData(), mpMappedFile->getSize()) : BinaryMemoryStream(mFileData.data(), mFileData.size());
+            return loader.importModel(stream, model, mFlags);
+        }
+
+    private:
+        std::string mFullpath;
+        Model::LoadFlags mFlags;
+        MemoryMappedFile::SharedPtr mpMappedFile;
+        std::vector<uint8_t> mFileData;
+        uint8_t mPrefetchChecksum = 0;
+    };
+
+    Model::PreloadedFile::SharedPtr BinaryModelImporter::preload(const std::string& filename, Model::LoadFlags flags)
+    {
+        std::string fullpath;
+        if(findFileInDataDirectories(filename, fullpath) == false)
+        {
+            logError(std::string("Can't find model file ") + filename);
+            return nullptr;
+        }
+
+        auto pFile = std::make_shared<PreloadedBinaryFile>(filename, fullpath, flags);
+        return pFile->load() ? pFile : nullptr;
     }
 
     static bool checkVersion(const std::string& formatID, uint32_t version, const std::string& modelName)
     {
         if(std::string(formatID) == "BinScene")
         {
-            if(version < 6 || version > 8)
+            if(version < 6 || version > 9)
             {
                 std::string Msg = "Error when loading model " + modelName + ".\nUnsupported binary scene version " + std::to_string(version);
                 logError(Msg);
@@ -558,15 +770,672 @@ namespace Falcor
         }
     }
     
-    bool BinaryModelImporter::importModel(Model& model, Model::LoadFlags flags)
+    // Returns a pointer to the data of a v9 data block. The memory-mapped stream points directly into the mapping, so the data is uploaded without any intermediate copies.
+    static const void* readDataBlock(BinaryMemoryStream& stream, const DataBlock& block, std::vector<uint8_t>& scratch)
+    {
+        stream.seek((size_t)block.offset);
+        if(stream.isFail() || block.size > stream.getRemainingStreamSize())
+        {
+            return nullptr;
+        }
+        return stream.getCurrentPointer();
+    }
+
+    // The file stream reads the block into a scratch buffer, which is reused between blocks.
+    static const void* readDataBlock(BinaryFileStream& stream, const DataBlock& block, std::vector<uint8_t>& scratch)
+    {
+        // Don't trust the size before allocating the scratch buffer
+        const uint64_t streamSize = stream.getStreamSize();
+        if(block.offset > streamSize || block.size > streamSize - block.offset)
+        {
+            return nullptr;
+        }
+        scratch.resize((size_t)block.size);
+        stream.seek((size_t)block.offset);
+        stream.read(scratch.data(), scratch.size());
+        return stream.isFail() ? nullptr : scratch.data();
+    }
+
+    template<typename StreamType>
+    static DataBlock readDataBlockDesc(StreamType& stream)
+    {
+        DataBlock block;
+        stream >> block.offset >> block.size;
+        return block;
+    }
+
+    // Extracts the vertex positions of a v9 vertex set, for LOD generation
+    template<typename StreamType>
+    static bool readPositions(StreamType& stream, const VertexLayout* pLayout, const std::vector<DataBlock>& data, uint32_t numVertices, std::vector<uint8_t>& scratch, std::vector<glm::vec3>& positions)
+    {
+        for(uint32_t b = 0; b < (uint32_t)pLayout->getBufferCount(); b++)
+        {
+            const VertexBufferLayout* pBufferLayout = pLayout->getBufferLayout(b).get();
+            for(uint32_t e = 0; e < pBufferLayout->getElementCount(); e++)
+            {
+                if(pBufferLayout->getElementName(e) != VERTEX_POSITION_NAME || pBufferLayout->getElementFormat(e) != ResourceFormat::RGB32Float)
+                {
+                    continue;
+                }
+
+                const uint8_t* pData = (const uint8_t*)readDataBlock(stream, data[b], scratch);
+                if(pData == nullptr)
+                {
+                    return false;
+                }
+
+                positions.resize(numVertices);
+                uint32_t stride = pBufferLayout->getStride();
+                uint32_t offset = pBufferLayout->getElementOffset(e);
+                for(uint32_t v = 0; v < numVertices; v++)
+                {
+                    std::memcpy(&positions[v], pData + v * stride + offset, sizeof(glm::vec3));
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template<typename StreamType, typename T>
+    static bool readAnimationKeys(StreamType& stream, std::vector<Animation::AnimationKey<T>>& keys)
+    {
+        int32_t numKeys;
+        stream >> numKeys;
+        if(isCountValid(stream, numKeys, sizeof(glm::vec3) + sizeof(float)) == false)
+        {
+            return false;
+        }
+
+        keys.resize(numKeys);
+        for(auto& key : keys)
+        {
+            stream >> key.value >> key.time;
+        }
+        return stream.isFail() == false;
+    }
+
+    template<typename StreamType>
+    static bool readAnimationKeys(StreamType& stream, std::vector<Animation::AnimationKey<glm::quat>>& keys)
+    {
+        int32_t numKeys;
+        stream >> numKeys;
+        if(isCountValid(stream, numKeys, 5 * sizeof(float)) == false)
+        {
+            return false;
+        }
+
+        keys.resize(numKeys);
+        for(auto& key : keys)
+        {
+            stream >> key.value.x >> key.value.y >> key.value.z >> key.value.w >> key.time;
+        }
+        return stream.isFail() == false;
+    }
+
+    template<typename StreamType>
+    bool BinaryModelImporter::importModelV9(StreamType& stream, Model& model, Model::LoadFlags flags)
+    {
+        const std::string corruptMsg = "Error when loading model " + mModelName + ".\nFile is corrupted.";
+
+        // Table of contents
+        int32_t numChunks;
+        stream >> numChunks;
+        if(stream.isFail() || numChunks < 0)
+        {
+            logError(corruptMsg);
+            return false;
+        }
+
+        ChunkDesc chunks[ChunkType_Max];
+        for(int32_t i = 0; i < numChunks; i++)
+        {
+            ChunkDesc desc;
+            stream >> desc.type >> desc.reserved >> desc.offset >> desc.size;
+            // Skip chunk types we don't know, so newer files with additional chunks can still be loaded
+            if(desc.type < ChunkType_Max)
+            {
+                chunks[desc.type] = desc;
+            }
+        }
+
+        for(uint32_t i = 0; i < ChunkType_Max; i++)
+        {
+            // The animations and mesh LOD chunks are optional
+            if((i == ChunkType_Animations || i == ChunkType_MeshLods) && chunks[i].type == ChunkType_Max)
+            {
+                continue;
+            }
+
+            if(chunks[i].type != i || (chunks[i].offset % kBinaryChunkAlignment) != 0)
+            {
+                logError(corruptMsg);
+                return false;
+            }
+        }
+
+        std::vector<uint8_t> scratch;
+
+        // Textures. Each texture is stored once, in the format it should be created with.
+        stream.seek((size_t)chunks[ChunkType_Textures].offset);
+        // The counts are checked against the minimal size of their records in the file before anything is allocated
+        int32_t numTextures;
+        stream >> numTextures;
+        if(isCountValid(stream, numTextures, sizeof(int32_t) * 4 + sizeof(DataBlock)) == false)
+        {
+            logError(corruptMsg);
+            return false;
+        }
+
+        struct TextureDesc
+        {
+            std::string name;
+            int32_t format;
+            int32_t width;
+            int32_t height;
+            DataBlock data;
+        };
+        std::vector<TextureDesc> textureDescs(numTextures);
+        for(auto& t : textureDescs)
+        {
+            t.name = readString(stream);
+            stream >> t.format >> t.width >> t.height;
+            t.data = readDataBlockDesc(stream);
+        }
+
+        bool loadTexAsSrgb = !is_set(flags, Model::LoadFlags::AssumeLinearSpaceTextures);
+        std::vector<Texture::SharedPtr> textures(numTextures);
+        for(int32_t i = 0; i < numTextures; i++)
+        {
+            const TextureDesc& t = textureDescs[i];
+            if(t.format <= 0 || t.format > (int32_t)ResourceFormat::BC7UnormSrgb || t.width <= 0 || t.height <= 0)
+            {
+                logError(corruptMsg);
+                return false;
+            }
+
+            // An empty data block means the texture was referenced by filename
+            if(t.data.size == 0)
+            {
+                std::string fullpath;
+                if(findFileInDataDirectories(t.name, fullpath) == false)
+                {
+                    logError("Error when loading model " + mModelName + ".\nCan't find texture file " + t.name);
+                    return false;
+                }
+                textures[i] = createTextureFromFile(fullpath, true, loadTexAsSrgb && isSrgbFormat(ResourceFormat(t.format)));
+                if(textures[i] == nullptr)
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            // The block holds the tightly packed first mip-level
+            const ResourceFormat fileFormat = ResourceFormat(t.format);
+            const uint64_t blocksX = (t.width + getFormatWidthCompressionRatio(fileFormat) - 1) / getFormatWidthCompressionRatio(fileFormat);
+            const uint64_t blocksY = (t.height + getFormatHeightCompressionRatio(fileFormat) - 1) / getFormatHeightCompressionRatio(fileFormat);
+            if(t.data.size != blocksX * blocksY * getFormatBytesPerBlock(fileFormat))
+            {
+                logError(corruptMsg);
+                return false;
+            }
+
+            const void* pData = readDataBlock(stream, t.data, scratch);
+            if(pData == nullptr)
+            {
+                logError(corruptMsg);
+                return false;
+            }
+
+            // The other mip-levels are generated. Compressed formats can't be render targets, so they only get the first one.
+            ResourceFormat format = loadTexAsSrgb ? ResourceFormat(t.format) : srgbToLinearFormat(ResourceFormat(t.format));
+            const uint32_t mipLevels = isCompressedFormat(format) ? 1 : Texture::kMaxPossible;
+            textures[i] = Texture::create2D(t.width, t.height, format, 1, mipLevels, pData);
+            if(textures[i] == nullptr)
+            {
+                logError(corruptMsg);
+                return false;
+            }
+            textures[i]->setSourceFilename(t.name);
+        }
+
+        // Flush the upload heap so we don't accumulate a ton of memory usage when loading a model with a lot of textures
+        gpDevice->flushAndSync();
+
+        auto getTexture = [&textures](int32_t id, Texture::SharedPtr& pTexture)
+        {
+            if(id < -1 || id >= (int32_t)textures.size()) return false;
+            pTexture = (id == -1) ? nullptr : textures[id];
+            return true;
+        };
+
+        // Materials
+        stream.seek((size_t)chunks[ChunkType_Materials].offset);
+        int32_t numMaterials;
+        stream >> numMaterials;
+        if(isCountValid(stream, numMaterials, sizeof(int32_t) * 7 + sizeof(glm::vec2) + sizeof(float)) == false)
+        {
+            logError(corruptMsg);
+            return false;
+        }
+
+        std::vector<Material::SharedPtr> materials(numMaterials);
+        for(auto& pMaterial : materials)
+        {
+            pMaterial = Material::create(readString(stream));
+
+            int32_t numLayers;
+            stream >> numLayers;
+            if(numLayers < 0 || numLayers > MatMaxLayers)
+            {
+                logError(corruptMsg);
+                return false;
+            }
+
+            bool validTextures = true;
+            for(int32_t l = 0; l < numLayers; l++)
+            {
+                int32_t type, ndf, blend, texID;
+                Material::Layer layer;
+                stream >> type >> ndf >> blend;
+                stream >> layer.albedo >> layer.roughness >> layer.extraParam >> layer.pmf >> texID;
+                layer.type = Material::Layer::Type(type);
+                layer.ndf = Material::Layer::NDF(ndf);
+                layer.blend = Material::Layer::Blend(blend);
+                validTextures &= getTexture(texID, layer.pTexture);
+                pMaterial->addLayer(layer);
+            }
+
+            int32_t normalID, alphaID, aoID, heightID;
+            glm::vec2 heightModifiers;
+            float alphaThreshold;
+            int32_t doubleSided;
+            stream >> normalID >> alphaID >> aoID >> heightID >> heightModifiers >> alphaThreshold >> doubleSided;
+
+            Texture::SharedPtr pNormalMap, pAlphaMap, pAoMap, pHeightMap;
+            validTextures &= getTexture(normalID, pNormalMap) && getTexture(alphaID, pAlphaMap) && getTexture(aoID, pAoMap) && getTexture(heightID, pHeightMap);
+            if(validTextures == false)
+            {
+                logError(corruptMsg);
+                return false;
+            }
+
+            pMaterial->setNormalMap(pNormalMap);
+            pMaterial->setAlphaMap(pAlphaMap);
+            pMaterial->setAmbientOcclusionMap(pAoMap);
+            pMaterial->setHeightMap(pHeightMap);
+            pMaterial->setHeightModifiers(heightModifiers);
+            pMaterial->setAlphaThreshold(alphaThreshold);
+            pMaterial->setDoubleSided(doubleSided != 0);
+        }
+
+        // Meshes. Vertex-sets are stored in the Vao layout, one data block per vertex buffer.
+        stream.seek((size_t)chunks[ChunkType_Meshes].offset);
+        int32_t numVertexSets;
+        stream >> numVertexSets;
+        if(isCountValid(stream, numVertexSets, sizeof(int32_t) * 2) == false)
+        {
+            logError(corruptMsg);
+            return false;
+        }
+
+        struct VertexSet
+        {
+            int32_t numVertices;
+            VertexLayout::SharedPtr pLayout;
+            std::vector<DataBlock> data;
+            Vao::BufferVec pVBs;
+        };
+        std::vector<VertexSet> vertexSets(numVertexSets);
+        for(auto& set : vertexSets)
+        {
+            int32_t numBuffers;
+            stream >> set.numVertices >> numBuffers;
+            if(set.numVertices < 0 || isCountValid(stream, numBuffers, sizeof(int32_t) * 2 + sizeof(DataBlock)) == false)
+            {
+                logError(corruptMsg);
+                return false;
+            }
+
+            set.pLayout = VertexLayout::create();
+            set.data.resize(numBuffers);
+            for(int32_t i = 0; i < numBuffers; i++)
+            {
+                int32_t stride, numElements;
+                stream >> stride >> numElements;
+                if(numElements < 0)
+                {
+                    logError(corruptMsg);
+                    return false;
+                }
+
+                VertexBufferLayout::SharedPtr pBufferLayout = VertexBufferLayout::create();
+                for(int32_t e = 0; e < numElements; e++)
+                {
+                    std::string name = readString(stream);
+                    int32_t offset, format, arraySize, shaderLocation;
+                    stream >> offset >> format >> arraySize >> shaderLocation;
+                    if(format <= 0 || format > (int32_t)ResourceFormat::BC7UnormSrgb)
+                    {
+                        logError(corruptMsg);
+                        return false;
+                    }
+                    pBufferLayout->addElement(name, offset, ResourceFormat(format), arraySize, shaderLocation);
+                }
+                set.pLayout->addBufferLayout(i, pBufferLayout);
+                set.data[i] = readDataBlockDesc(stream);
+
+                if(pBufferLayout->getStride() != (uint32_t)stride || set.data[i].size != (uint64_t)stride * set.numVertices)
+                {
+                    logError(corruptMsg);
+                    return false;
+                }
+            }
+        }
+
+        struct MeshDesc
+        {
+            int32_t vertexSet;
+            int32_t material;
+            int32_t topology;
+            int32_t numIndices;
+            int32_t hasBones;
+            BoundingBox box;
+            DataBlock indices;
+        };
+
+        int32_t numMeshes;
+        stream >> numMeshes;
+        if(isCountValid(stream, numMeshes, sizeof(int32_t) * 5 + sizeof(glm::vec3) * 2 + sizeof(DataBlock)) == false)
+        {
+            logError(corruptMsg);
+            return false;
+        }
+
+        std::vector<MeshDesc> meshDescs(numMeshes);
+        for(auto& m : meshDescs)
+        {
+            stream >> m.vertexSet >> m.material >> m.topology >> m.numIndices >> m.hasBones >> m.box.center >> m.box.extent;
+            m.indices = readDataBlockDesc(stream);
+            if(m.vertexSet < 0 || m.vertexSet >= numVertexSets || m.material < 0 || m.material >= numMaterials || m.numIndices < 0 || m.indices.size != m.numIndices * sizeof(uint32_t) ||
+                m.topology < (int32_t)Vao::Topology::PointList || m.topology > (int32_t)Vao::Topology::TriangleStrip)
+            {
+                logError(corruptMsg);
+                return false;
+            }
+        }
+
+        if(stream.isFail())
+        {
+            logError(corruptMsg);
+            return false;
+        }
+
+        // The mesh metadata is parsed, now upload the vertex and index data straight out of the file
+        Buffer::BindFlags vbBindFlags = Buffer::BindFlags::Vertex;
+        Buffer::BindFlags ibBindFlags = Buffer::BindFlags::Index;
+        if(is_set(flags, Model::LoadFlags::BuffersAsShaderResource))
+        {
+            vbBindFlags |= Buffer::BindFlags::ShaderResource;
+            ibBindFlags |= Buffer::BindFlags::ShaderResource;
+        }
+
+        for(auto& set : vertexSets)
+        {
+            set.pVBs.resize(set.data.size());
+            for(size_t i = 0; i < set.data.size(); i++)
+            {
+                const void* pData = readDataBlock(stream, set.data[i], scratch);
+                if(pData == nullptr)
+                {
+                    logError("Error when loading model " + mModelName + ".\nUnexpected end of file while reading vertex data.");
+                    return false;
+                }
+                set.pVBs[i] = Buffer::create((size_t)set.data[i].size, vbBindFlags, Buffer::CpuAccess::None, pData);
+            }
+        }
+
+        std::vector<Mesh::SharedPtr> meshes(numMeshes);
+        for(int32_t i = 0; i < numMeshes; i++)
+        {
+            const MeshDesc& m = meshDescs[i];
+            Buffer::SharedPtr pIB;
+            if(m.numIndices > 0)
+            {
+                const void* pData = readDataBlock(stream, m.indices, scratch);
+                if(pData == nullptr)
+                {
+                    logError("Error when loading model " + mModelName + ".\nUnexpected end of file while reading index data.");
+                    return false;
+                }
+                pIB = Buffer::create((size_t)m.indices.size, ibBindFlags, Buffer::CpuAccess::None, pData);
+            }
+
+            const VertexSet& set = vertexSets[m.vertexSet];
+            meshes[i] = Mesh::create(set.pVBs, set.numVertices, pIB, m.numIndices, set.pLayout, Vao::Topology(m.topology), materials[m.material], m.box, m.hasBones != 0);
+        }
+
+        // Mesh LODs. They share the vertex sets of their meshes, only the index data is stored.
+        if(chunks[ChunkType_MeshLods].type == ChunkType_MeshLods)
+        {
+            stream.seek((size_t)chunks[ChunkType_MeshLods].offset);
+            int32_t numLods;
+            stream >> numLods;
+            if(isCountValid(stream, numLods, sizeof(int32_t) * 2 + sizeof(float) * 2 + sizeof(DataBlock)) == false)
+            {
+                logError(corruptMsg);
+                return false;
+            }
+
+            struct LodDesc
+            {
+                int32_t mesh;
+                int32_t numIndices;
+                float screenSize;
+                float error;
+                DataBlock indices;
+            };
+
+            std::vector<LodDesc> lodDescs(numLods);
+            for(auto& l : lodDescs)
+            {
+                stream >> l.mesh >> l.numIndices >> l.screenSize >> l.error;
+                l.indices = readDataBlockDesc(stream);
+                if(l.mesh < 0 || l.mesh >= numMeshes || l.numIndices <= 0 || l.indices.size != l.numIndices * sizeof(uint32_t))
+                {
+                    logError(corruptMsg);
+                    return false;
+                }
+            }
+
+            if(stream.isFail())
+            {
+                logError(corruptMsg);
+                return false;
+            }
+
+            for(const auto& l : lodDescs)
+            {
+                const void* pData = readDataBlock(stream, l.indices, scratch);
+                if(pData == nullptr)
+                {
+                    logError("Error when loading model " + mModelName + ".\nUnexpected end of file while reading index data.");
+                    return false;
+                }
+
+                // The LOD indices reference the vertex set of the mesh
+                const uint32_t* pIndices = (const uint32_t*)pData;
+                const uint32_t numVertices = (uint32_t)vertexSets[meshDescs[l.mesh].vertexSet].numVertices;
+                if(std::any_of(pIndices, pIndices + l.numIndices, [numVertices](uint32_t index) { return index >= numVertices; }))
+                {
+                    logError(corruptMsg);
+                    return false;
+                }
+                Buffer::SharedPtr pIB = Buffer::create((size_t)l.indices.size, ibBindFlags, Buffer::CpuAccess::None, pData);
+                if(meshes[l.mesh]->addLod(pIB, l.numIndices, l.screenSize, l.error) == false)
+                {
+                    logError(corruptMsg);
+                    return false;
+                }
+            }
+        }
+
+        // Generate the LODs which aren't stored in the file
+        if(is_set(flags, Model::LoadFlags::GenerateLods))
+        {
+            std::vector<std::vector<glm::vec3>> positions(numVertexSets);
+            for(int32_t i = 0; i < numMeshes; i++)
+            {
+                const MeshDesc& m = meshDescs[i];
+                if(meshes[i]->getLodCount() > 1 || Vao::Topology(m.topology) != Vao::Topology::TriangleList || m.numIndices == 0)
+                {
+                    continue;
+                }
+
+                const VertexSet& set = vertexSets[m.vertexSet];
+                if(positions[m.vertexSet].empty() && readPositions(stream, set.pLayout.get(), set.data, set.numVertices, scratch, positions[m.vertexSet]) == false)
+                {
+                    continue;
+                }
+
+                const void* pData = readDataBlock(stream, m.indices, scratch);
+                if(pData == nullptr)
+                {
+                    logError("Error when loading model " + mModelName + ".\nUnexpected end of file while reading index data.");
+                    return false;
+                }
+
+                std::vector<MeshLodData> lods;
+                MeshSimplifier::generateLodChain(positions[m.vertexSet].data(), set.numVertices, (const uint32_t*)pData, m.numIndices, MeshSimplifier::kDefaultLodCount, lods);
+                for(const auto& lod : lods)
+                {
+                    Buffer::SharedPtr pIB = Buffer::create(lod.indices.size() * sizeof(uint32_t), ibBindFlags, Buffer::CpuAccess::None, lod.indices.data());
+                    meshes[i]->addLod(pIB, (uint32_t)lod.indices.size(), lod.screenSize, lod.error);
+                }
+            }
+        }
+
+        // Bones
+        stream.seek((size_t)chunks[ChunkType_Bones].offset);
+        int32_t numBones;
+        stream >> numBones;
+        if(isCountValid(stream, numBones, sizeof(int32_t) * 3 + sizeof(glm::mat4) * 4) == false)
+        {
+            logError(corruptMsg);
+            return false;
+        }
+
+        AnimationController::UniquePtr pAnimationController;
+        if(numBones > 0)
+        {
+            std::vector<Bone> bones(numBones);
+            for(auto& bone : bones)
+            {
+                stream >> bone.parentID >> bone.boneID >> bone.offset >> bone.localTransform >> bone.originalLocalTransform >> bone.globalTransform;
+                bone.name = readString(stream);
+            }
+            pAnimationController = AnimationController::create(bones);
+        }
+
+        // Animations
+        if(chunks[ChunkType_Animations].type == ChunkType_Animations)
+        {
+            stream.seek((size_t)chunks[ChunkType_Animations].offset);
+            int32_t numAnimations;
+            stream >> numAnimations;
+            if(isCountValid(stream, numAnimations, sizeof(int32_t) * 2 + sizeof(float) * 2) == false || (numAnimations > 0 && pAnimationController == nullptr))
+            {
+                logError(corruptMsg);
+                return false;
+            }
+
+            for(int32_t i = 0; i < numAnimations; i++)
+            {
+                std::string name = readString(stream);
+                float duration, ticksPerSecond;
+                int32_t numSets;
+                stream >> duration >> ticksPerSecond >> numSets;
+                if(isCountValid(stream, numSets, sizeof(int32_t) * 4) == false)
+                {
+                    logError(corruptMsg);
+                    return false;
+                }
+
+                std::vector<Animation::AnimationSet> sets(numSets);
+                for(auto& set : sets)
+                {
+                    int32_t boneID;
+                    stream >> boneID;
+                    if(readAnimationKeys(stream, set.translation.keys) == false || readAnimationKeys(stream, set.scaling.keys) == false || readAnimationKeys(stream, set.rotation.keys) == false
+                        || boneID < 0 || boneID >= numBones)
+                    {
+                        logError(corruptMsg);
+                        return false;
+                    }
+                    set.boneID = boneID;
+                }
+                Animation::UniquePtr pAnimation = Animation::create(name, sets, duration, ticksPerSecond);
+                if(is_set(flags, Model::LoadFlags::CompressAnimations))
+                {
+                    pAnimation->compress(AnimationClip::kDefaultSampleRate);
+                }
+                pAnimationController->addAnimation(std::move(pAnimation));
+            }
+        }
+
+        // Instances
+        stream.seek((size_t)chunks[ChunkType_Instances].offset);
+        int32_t numInstances;
+        stream >> numInstances;
+        if(isCountValid(stream, numInstances, sizeof(int32_t) * 2 + sizeof(glm::mat4)) == false)
+        {
+            logError(corruptMsg);
+            return false;
+        }
+
+        std::vector<std::pair<int32_t, glm::mat4>> instances(numInstances);
+        for(auto& instance : instances)
+        {
+            stream >> instance.first >> instance.second;
+            readString(stream);   // Name
+            if(instance.first < 0 || instance.first >= numMeshes)
+            {
+                logError(corruptMsg);
+                return false;
+            }
+        }
+
+        if(stream.isFail())
+        {
+            logError(corruptMsg);
+            return false;
+        }
+
+        // The whole file was validated. The model is only modified once we know the import succeeded, so a failed import leaves it empty.
+        if(pAnimationController)
+        {
+            model.setAnimationController(std::move(pAnimationController));
+        }
+
+        for(const auto& instance : instances)
+        {
+            model.addMeshInstance(meshes[instance.first], instance.second);
+        }
+
+        return true;
+    }
+
+    template<typename StreamType>
+    bool BinaryModelImporter::importModel(StreamType& stream, Model& model, Model::LoadFlags flags)
     {
         // Format ID and version.
         char formatID[9];
-        mStream.read(formatID, 8);
+        stream.read(formatID, 8);
         formatID[8] = '\0';
 
         uint32_t version;
-        mStream >> version;
+        stream >> version;
 
         // Check if the version matches
         if(checkVersion(formatID, version, mModelName) == false)
@@ -574,6 +1443,12 @@ namespace Falcor
             return false;
         }
 
+        // v9 is a chunked format, which shares nothing with the legacy versions beyond the file header
+        if(version == 9)
+        {
+            return importModelV9(stream, model, flags);
+        }
+
         int numTextureSlots;
         int numAttributesType = AttribType_AORadius + 1;
 
@@ -603,16 +1478,16 @@ namespace Falcor
 
         if(version >= 6)
         {
-            mStream >> numTextures >> numMeshes >> numInstances;
+            stream >> numTextures >> numMeshes >> numInstances;
         }
         else
         {
             numMeshes = 1;
             numInstances = 1;
-            mStream >> numAttribs_v5 >> numVertices_v5 >> numSubmeshes_v5;
+            stream >> numAttribs_v5 >> numVertices_v5 >> numSubmeshes_v5;
             if(version >= 2)
             {
-                mStream >> numTextures;
+                stream >> numTextures;
             }
         }
 
@@ -630,7 +1505,7 @@ namespace Falcor
 
         if(version >= 6)
         {
-            importTextures(texData, numTextures, mStream, mModelName);
+            importTextures(texData, numTextures, stream, mModelName);
         }
 
         // This file format has a concept of sub-meshes, which Falcor model doesn't have - Falcor creates a new mesh for each sub-mesh
@@ -665,7 +1540,7 @@ namespace Falcor
 
             if(version >= 6)
             {
-                mStream >> numAttribs >> numVertices >> numSubmeshes;
+                stream >> numAttribs >> numVertices >> numSubmeshes;
             }
             else
             {
@@ -684,14 +1559,7 @@ namespace Falcor
             Vao::BufferVec pVBs;
             VertexLayout::SharedPtr pLayout = VertexLayout::create();
             
-            struct BufferData
-            {
-                std::vector<uint8_t> vec;
-                bool shouldSkip = false;
-                uint32_t elementSize = 0;
-            };
-
-            std::vector<BufferData> buffers;
+            std::vector<VertexBufferData> buffers;
             pVBs.resize(numAttribs);
             buffers.resize(numAttribs);
 
@@ -706,7 +1574,7 @@ namespace Falcor
                 VertexBufferLayout::SharedPtr pBufferLayout = VertexBufferLayout::create();
                 pLayout->addBufferLayout(i, pBufferLayout);
                 int32_t type, format, length;
-                mStream >> type >> format >> length;
+                stream >> type >> format >> length;
 
                 if(type < 0 || type >= numAttributesType || format < 0 || format >= AttribFormat::AttribFormat_Max || length < 1 || length > 4)
                 {
@@ -778,22 +1646,13 @@ namespace Falcor
             }
             
 
-            // Read the data, one vertex at a time
-            for(int32_t i = 0; i < numVertices; i++)
+            // Read the data
+            readVertices(stream, buffers, numAttribs, numVertices);
+            if(stream.isFail())
             {
-                for (int32_t attributes = 0; attributes < numAttribs; ++attributes)
-                {
-                    if (buffers[attributes].shouldSkip)
-                    {
-                        mStream.skip(buffers[attributes].elementSize);
-                    }
-                    else
-                    {
-                        uint32_t stride = pLayout->getBufferLayout(attributes)->getStride();
-                        uint8_t* pDest = buffers[attributes].vec.data() + stride * i;
-                        mStream.read(pDest, stride);
-                    }
-                }
+                std::string msg = "Error when loading model " + mModelName + ".\nUnexpected end of file while reading vertex data.";
+                logError(msg);
+                return false;
             }
 
             for (int32_t i = 0; i < numAttribs; ++i)
@@ -806,7 +1665,7 @@ namespace Falcor
 
             if(version <= 5)
             {
-                importTextures(texData, numTextures, mStream, mModelName);
+                importTextures(texData, numTextures, stream, mModelName);
                 textures.clear();
             }
 
@@ -822,7 +1681,7 @@ namespace Falcor
                 glm::vec3 specular;
                 float glossiness;
 
-                mStream >> ambient >> diffuse >> specular >> glossiness;
+                stream >> ambient >> diffuse >> specular >> glossiness;
                 basicMaterial.diffuseColor = glm::vec3(diffuse);
                 basicMaterial.opacity = 1 - diffuse.w;
                 basicMaterial.specularColor = specular;
@@ -832,7 +1691,7 @@ namespace Falcor
                 {
                     float displacementCoeff;
                     float displacementBias;
-                    mStream >> displacementCoeff >> displacementBias;
+                    stream >> displacementCoeff >> displacementBias;
                     basicMaterial.bumpScale = displacementCoeff;
                     basicMaterial.bumpOffset = displacementBias;
                 }
@@ -840,7 +1699,7 @@ namespace Falcor
                 for(int i = 0; i < numTextureSlots; i++)
                 {
                     int32_t texID;
-                    mStream >> texID;
+                    stream >> texID;
                     if(texID < -1 || texID >= numTextures)
                     {
                         std::string msg = "Error when loading model " + mModelName + ".\nCorrupt binary mesh data!";
@@ -880,7 +1739,7 @@ namespace Falcor
                 auto pMaterial = checkForExistingMaterial(basicMaterial.convertToMaterial());
 
                 int32_t numTriangles;
-                mStream >> numTriangles;
+                stream >> numTriangles;
                 if(numTriangles < 0)
                 {
                     std::string Msg = "Error when loading model " + mModelName + ".\nMesh has negative number of triangles!";
@@ -892,7 +1751,7 @@ namespace Falcor
                 uint32_t numIndices = numTriangles * 3;
                 std::vector<uint32_t> indices(numIndices);
                 uint32_t ibSize = 3 * numTriangles * sizeof(uint32_t);
-                mStream.read(&indices[0], ibSize);
+                stream.read(&indices[0], ibSize);
 
                 auto pIB = Buffer::create(ibSize, Buffer::BindFlags::Index, Buffer::CpuAccess::None, indices.data());
 
@@ -941,6 +1800,25 @@ namespace Falcor
                 // create the mesh
                 auto pMesh = Mesh::create(pVBs, numVertices, pIB, numIndices, pLayout, Vao::Topology::TriangleList, pMaterial, box, false);
 
+                // Generate the LOD chain
+                if(is_set(flags, Model::LoadFlags::GenerateLods) && numIndices > 0)
+                {
+                    uint32_t stride = pLayout->getBufferLayout(positionBufferIndex)->getStride();
+                    std::vector<glm::vec3> positions(numVertices);
+                    for(int32_t v = 0; v < numVertices; v++)
+                    {
+                        std::memcpy(&positions[v], buffers[positionBufferIndex].vec.data() + v * stride, sizeof(glm::vec3));
+                    }
+
+                    std::vector<MeshLodData> lods;
+                    MeshSimplifier::generateLodChain(positions.data(), numVertices, indices.data(), numIndices, MeshSimplifier::kDefaultLodCount, lods);
+                    for(const auto& lod : lods)
+                    {
+                        auto pLodIB = Buffer::create(lod.indices.size() * sizeof(uint32_t), Buffer::BindFlags::Index, Buffer::CpuAccess::None, lod.indices.data());
+                        pMesh->addLod(pLodIB, (uint32_t)lod.indices.size(), lod.screenSize, lod.error);
+                    }
+                }
+
                 if (version >= 6)
                 {
                     falcorMeshCache.push_back(pMesh);
@@ -961,10 +1839,10 @@ namespace Falcor
                 int32_t enabled = 1;
                 glm::mat4 transformation;
 
-                mStream >> meshIdx >> enabled >> transformation;
+                stream >> meshIdx >> enabled >> transformation;
                 //m_Stream >> inst.name >> inst.metadata;
-                readString(mStream);   // Name
-                readString(mStream);   // Meta-data
+                readString(stream);   // Name
+                readString(stream);   // Meta-data
 
                 if(enabled)
                 {
@@ -41,17 +41,33 @@ namespace Falcor
     public:
         /** import a new model from internal binary format
             \param[in] filename Model's filename. Loader will look for it in the data directories.
-            \param[in] flags Flags controlling model creation
+            \param[in] flags Flags controlling model creation. If Model::LoadFlags::MemoryMappedIO is set, the file is mapped into memory. v9 data blocks are then uploaded straight from the mapping, and legacy vertex data is de-interleaved in bulk instead of being read through a file stream.
             returns nullptr if loading failed, otherwise a new Model object
         */
         static bool import(Model& model, const std::string& filename, Model::LoadFlags flags);
 
+        /** Bring a binary model file into memory without creating any GPU resources. See Model::preloadFile().
+            \param[in] filename Model's filename. Loader will look for it in the data directories.
+            \param[in] flags Flags controlling model creation. If Model::LoadFlags::MemoryMappedIO is set, the file is mapped and its pages are prefetched. Otherwise, the file is read into memory.
+            \return The preloaded file, or nullptr if the file couldn't be read
+        */
+        static Model::PreloadedFile::SharedPtr preload(const std::string& filename, Model::LoadFlags flags);
+
     private:
+        class PreloadedBinaryFile;
         BinaryModelImporter(const std::string& fullpath);
-        bool importModel(Model& model, Model::LoadFlags flags);
+
+        /** Parse the model. StreamType is either BinaryFileStream or BinaryMemoryStream.
+        */
+        template<typename StreamType>
+        bool importModel(StreamType& stream, Model& model, Model::LoadFlags flags);
+
+        /** Parse a v9 model, after the format ID and version were read.
+        */
+        template<typename StreamType>
+        bool importModelV9(StreamType& stream, Model& model, Model::LoadFlags flags);
 
         std::string mModelName;
-        BinaryFileStream mStream;
 
         struct TangentSpace
         {
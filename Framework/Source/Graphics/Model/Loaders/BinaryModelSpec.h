@@ -30,6 +30,167 @@
 //------------------------------------------------------------------------
 /*
 
+Binary scene file format v9
+---------------------------
+
+- v9 is a chunked format. The header is followed by a table of contents, which points to the chunks by absolute file offset.
+- Every chunk and every data block starts at a 64-byte aligned offset. Padding bytes are zero.
+- Vertex, index and texture data is stored exactly the way Falcor uploads it - one block per vertex buffer in the Vao layout, 32-bit indices, mip 0 of each texture.
+  Loading a v9 file doesn't require de-interleaving, tangent generation or texture deduplication.
+- Fields are 32-bit, except for offsets and sizes which are 64-bit. Strings are stored as int length followed by the characters.
+- Each line describes: <ofs_bytes> <size_bytes> <Type> <name> (<comments>)
+
+File
+0       8       string8     formatID            ("BinScene")
+8       4       int         formatVersion       (9)
+12      4       int         numChunks
+16      n*24    array       ChunkDesc           (numChunks)
+
+ChunkDesc
+0       4       int         type                (see ChunkType)
+4       4       int         reserved
+8       8       uint64      offset              (absolute, 64-byte aligned)
+16      8       uint64      size
+
+DataBlock
+0       8       uint64      offset              (absolute, 64-byte aligned)
+8       8       uint64      size
+
+ChunkType_Data
+Raw data blocks, referenced from the other chunks through DataBlock fields.
+
+ChunkType_Textures
+0       4       int         numTextures
+4       n*?     array       Texture_v9          (numTextures)
+
+Texture_v9
+?       ?       string      name
+?       4       int         format              (Falcor ResourceFormat)
+?       4       int         width
+?       4       int         height
+?       16      DataBlock   data                (mip 0. An empty block means the texture is loaded from the file 'name' instead)
+
+ChunkType_Materials
+0       4       int         numMaterials
+4       n*?     array       Material_v9         (numMaterials)
+
+Material_v9
+?       ?       string      name
+?       4       int         numLayers
+?       n*68    array       Layer_v9            (numLayers)
+?       4       int         normalMap           (texture index, -1 if none)
+?       4       int         alphaMap            (texture index, -1 if none)
+?       4       int         ambientOcclusionMap (texture index, -1 if none)
+?       4       int         heightMap           (texture index, -1 if none)
+?       8       float       heightModifiers
+?       4       float       alphaThreshold
+?       4       int         doubleSided
+
+Layer_v9
+0       4       int         type                (Material::Layer::Type)
+4       4       int         ndf                 (Material::Layer::NDF)
+8       4       int         blend               (Material::Layer::Blend)
+12      16      float       albedo
+28      16      float       roughness
+44      16      float       extraParam
+60      4       float       pmf
+64      4       int         texture             (texture index, -1 if none)
+
+ChunkType_Meshes
+0       4       int         numVertexSets
+4       n*?     array       VertexSet_v9        (numVertexSets)
+?       4       int         numMeshes
+?       n*?     array       Mesh_v9             (numMeshes)
+
+VertexSet_v9 (a group of vertex buffers shared by one or more meshes)
+0       4       int         numVertices
+4       4       int         numBuffers
+8       n*?     array       VertexBuffer_v9     (numBuffers)
+
+VertexBuffer_v9
+0       4       int         stride
+4       4       int         numElements
+8       n*?     array       VertexElement_v9    (numElements)
+?       16      DataBlock   data
+
+VertexElement_v9
+?       ?       string      name
+?       4       int         offset
+?       4       int         format              (Falcor ResourceFormat)
+?       4       int         arraySize
+?       4       int         shaderLocation
+
+Mesh_v9
+0       4       int         vertexSet
+4       4       int         material
+8       4       int         topology            (Vao::Topology)
+12      4       int         numIndices
+16      4       int         hasBones
+20      24      float       boundingBox         (center, extent)
+44      16      DataBlock   indices             (32-bit, empty if numIndices is 0)
+
+ChunkType_Bones
+0       4       int         numBones
+4       n*?     array       Bone_v9             (numBones)
+
+Bone_v9
+0       4       int         parentID
+4       4       int         boneID
+8       64      float       offset              (column-major 4x4 matrix)
+72      64      float       localTransform
+136     64      float       originalLocalTransform
+200     64      float       globalTransform
+264     ?       string      name
+
+ChunkType_Instances
+0       4       int         numInstances
+4       n*?     array       Instance_v9         (numInstances)
+
+Instance_v9
+0       4       int         mesh
+4       64      float       meshToWorld         (column-major 4x4 matrix)
+68      ?       string      name
+
+ChunkType_Animations (optional)
+0       4       int         numAnimations
+4       n*?     array       Animation_v9        (numAnimations)
+
+Animation_v9
+?       ?       string      name
+?       4       float       duration            (ticks)
+?       4       float       ticksPerSecond
+?       4       int         numAnimationSets
+?       n*?     array       AnimationSet_v9     (numAnimationSets)
+
+AnimationSet_v9
+0       4       int         boneID
+4       4       int         numTranslationKeys
+8       n*16    array       Key3                (numTranslationKeys)
+?       4       int         numScalingKeys
+?       n*16    array       Key3                (numScalingKeys)
+?       4       int         numRotationKeys
+?       n*20    array       KeyQuat             (numRotationKeys)
+
+Key3
+0       12      float       value               (x, y, z)
+12      4       float       time
+
+KeyQuat
+0       16      float       value               (x, y, z, w)
+16      4       float       time
+
+ChunkType_MeshLods (optional)
+0       4       int         numLods
+4       n*36    array       MeshLod_v9          (numLods, sorted by mesh, then from the most detailed to the coarsest)
+
+MeshLod_v9 (a simplified index buffer, drawn with the vertex set of its mesh)
+0       4       int         mesh
+4       4       int         numIndices
+8       4       float       screenSize          (the LOD is used below this fraction of the screen height)
+12      4       float       error               (object space)
+16      16      DataBlock   indices             (32-bit)
+
+
 Binary scene file format v8
 ---------------------------
 
@@ -154,3 +315,32 @@ enum TextureType
     TextureType_Glossiness,     // Glossiness map.
     TextureType_Max
 };
+
+enum ChunkType
+{
+    ChunkType_Data = 0,
+    ChunkType_Textures,
+    ChunkType_Materials,
+    ChunkType_Meshes,
+    ChunkType_Bones,
+    ChunkType_Instances,
+    ChunkType_Animations,
+    ChunkType_MeshLods,
+    ChunkType_Max
+};
+
+static const uint32_t kBinaryChunkAlignment = 64;
+
+struct ChunkDesc
+{
+    uint32_t type = ChunkType_Max;
+    uint32_t reserved = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
+
+struct DataBlock
+{
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
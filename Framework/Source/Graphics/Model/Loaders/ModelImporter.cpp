@@ -34,16 +34,18 @@ namespace Falcor
     Material::SharedPtr ModelImporter::checkForExistingMaterial(const Material::SharedPtr& pMaterial)
     {
         // Check if the material already exists
-        for(const auto& pMat : mLoadedMaterials)
+        const uint64_t hash = pMaterial->getContentHash();
+        auto range = mLoadedMaterials.equal_range(hash);
+        for(auto it = range.first; it != range.second; it++)
         {
-            if(*pMaterial == *pMat)
+            if(*pMaterial == *it->second)
             {
-                return pMat;
+                return it->second;
             }
         }
 
         // New material
-        mLoadedMaterials.push_back(pMaterial);
+        mLoadedMaterials.emplace(hash, pMaterial);
         return pMaterial;
     }
 }
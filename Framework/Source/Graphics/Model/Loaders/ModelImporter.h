@@ -28,7 +28,7 @@
 
 #pragma once
 
-#include <vector>
+#include <unordered_map>
 #include "Graphics/Material/Material.h"
 
 namespace Falcor
@@ -47,6 +47,6 @@ namespace Falcor
         */
         Material::SharedPtr checkForExistingMaterial(const Material::SharedPtr& pMaterial);
 
-        std::vector<Material::SharedPtr> mLoadedMaterials; // vector because we make use of operator==, and it's only for the importers
+        std::unordered_multimap<uint64_t, Material::SharedPtr> mLoadedMaterials; // Indexed by Material::getContentHash(). Materials with the same hash are told apart with operator==.
     };
 }
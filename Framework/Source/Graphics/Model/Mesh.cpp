@@ -36,6 +36,7 @@
 #include "API/VertexLayout.h"
 #include "Graphics/Camera/Camera.h"
 #include "Data/VertexAttrib.h"
+#include <cfloat>
 
 namespace Falcor
 { 
@@ -90,6 +91,27 @@ namespace Falcor
         mPrimitiveCount = mIndexCount / VertsPerPrim;
 
         mpVao = Vao::create(topology, pLayout, vertexBuffers, pIndexBuffer, ResourceFormat::R32Uint);
+        mLods.push_back({ mpVao, mIndexCount, FLT_MAX, 0 });
+        mLodScreenSizes.push_back(FLT_MAX);
+    }
+
+    bool Mesh::addLod(const Buffer::SharedPtr& pIndexBuffer, uint32_t indexCount, float screenSize, float error)
+    {
+        if (screenSize >= mLodScreenSizes.back())
+        {
+            logError("Mesh::addLod() - LODs must be added with decreasing screen sizes.");
+            return false;
+        }
+
+        Vao::BufferVec vertexBuffers(mpVao->getVertexBuffersCount());
+        for (uint32_t i = 0; i < vertexBuffers.size(); i++)
+        {
+            vertexBuffers[i] = mpVao->getVertexBuffer(i);
+        }
+        Vao::SharedPtr pVao = Vao::create(mpVao->getPrimitiveTopology(), mpVao->getVertexLayout(), vertexBuffers, pIndexBuffer, ResourceFormat::R32Uint);
+        mLods.push_back({ pVao, indexCount, screenSize, error });
+        mLodScreenSizes.push_back(screenSize);
+        return true;
     }
 
     void Mesh::resetGlobalIdCounter()
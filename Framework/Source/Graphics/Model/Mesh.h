@@ -35,6 +35,7 @@
 #include "Utils/AABB.h"
 #include "Graphics/Material/Material.h"
 #include "Graphics/Paths/MovableObject.h"
+#include "MeshLod.h"
 
 namespace Falcor
 {
@@ -112,6 +113,38 @@ namespace Falcor
         */
         const Vao::SharedPtr& getVao() const { return mpVao; }
 
+        /** Level of detail of the mesh. All the LODs share the vertex buffers of the mesh, only the index buffer is different.
+        */
+        struct Lod
+        {
+            Vao::SharedPtr pVao;    ///< Vertex array object with the LOD's index buffer
+            uint32_t indexCount;    ///< Number of indices to draw
+            float screenSize;       ///< The LOD is used when the model instance covers less than this fraction of the screen height
+            float error;            ///< Geometric error of the LOD, in object space
+        };
+
+        /** Add a level of detail. LODs must be added from the most detailed to the coarsest.
+            \param[in] pIndexBuffer The LOD's index buffer. The indices reference the mesh's vertex buffers.
+            \param[in] indexCount Number of indices in the index buffer
+            \param[in] screenSize The LOD is used when the model instance covers less than this fraction of the screen height. Must be smaller than the previous LOD's.
+            \param[in] error Geometric error of the LOD, in object space
+            \return Whether the LOD was added
+        */
+        bool addLod(const Buffer::SharedPtr& pIndexBuffer, uint32_t indexCount, float screenSize, float error);
+
+        /** Get the number of levels of detail, including the full-resolution mesh
+        */
+        uint32_t getLodCount() const { return (uint32_t)mLods.size(); }
+
+        /** Get a level of detail. LOD 0 is the full-resolution mesh.
+        */
+        const Lod& getLod(uint32_t lod) const { assert(lod < mLods.size()); return mLods[lod]; }
+
+        /** Select the level of detail for a model instance
+            \param[in] screenSize The fraction of the screen height covered by the model instance
+        */
+        uint32_t selectLod(float screenSize) const { return LodSelector::selectLod(mLodScreenSizes.data(), (uint32_t)mLodScreenSizes.size(), screenSize); }
+
         /** Get global mesh ID
         */
         const uint32_t getId() const { return mId; }
@@ -148,5 +181,7 @@ namespace Falcor
         Material::SharedPtr mpMaterial;
         BoundingBox mBoundingBox;
         Vao::SharedPtr mpVao;
+        std::vector<Lod> mLods;
+        std::vector<float> mLodScreenSizes;
     };
 }
\ No newline at end of file
@@ -0,0 +1,546 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Framework.h"
+#include "MeshLod.h"
+#include "glm/geometric.hpp"
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <cfloat>
+
+namespace Falcor
+{
+    namespace
+    {
+        const float kMaxFlipCos = 0.2f;         // A collapse is rejected if it rotates a triangle's normal by more than ~78 degrees
+        const double kBorderWeight = 10;        // Weight of the planes constraining the border edges, relative to the triangle planes
+        const float kMinLodReduction = 0.9f;    // A LOD must have at most 90% of the previous LOD's triangles
+        const uint32_t kMinLodTriangleCount = 8;
+        const float kLodPixelError = 1.0f / 1080.0f;
+
+        struct Quadric
+        {
+            // Symmetric 4x4 matrix, upper triangle: a2 ab ac ad b2 bc bd c2 cd d2
+            double m[10] = {};
+
+            void addPlane(const glm::vec3& n, double d, double w)
+            {
+                double a = n.x, b = n.y, c = n.z;
+                m[0] += w * a * a; m[1] += w * a * b; m[2] += w * a * c; m[3] += w * a * d;
+                m[4] += w * b * b; m[5] += w * b * c; m[6] += w * b * d;
+                m[7] += w * c * c; m[8] += w * c * d;
+                m[9] += w * d * d;
+            }
+
+            void add(const Quadric& q)
+            {
+                for (uint32_t i = 0; i < 10; i++)
+                {
+                    m[i] += q.m[i];
+                }
+            }
+
+            // Weighted sum of the squared distances to the planes. It bounds the squared distance to each of them, so the error derived from it is conservative.
+            double evaluate(const glm::vec3& p) const
+            {
+                double x = p.x, y = p.y, z = p.z;
+                double e = m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x
+                    + m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y
+                    + m[7] * z * z + 2 * m[8] * z
+                    + m[9];
+                return std::max(e, 0.0);
+            }
+        };
+
+        struct Collapse
+        {
+            double cost;
+            uint32_t from;
+            uint32_t to;
+            uint32_t fromVersion;
+            uint32_t toVersion;
+
+            bool operator>(const Collapse& other) const { return cost > other.cost; }
+        };
+
+        struct PositionHash
+        {
+            size_t operator()(const glm::vec3& p) const
+            {
+                const uint32_t* pBits = reinterpret_cast<const uint32_t*>(&p.x);
+                size_t h = pBits[0];
+                h = h * 0x9E3779B1u + pBits[1];
+                h = h * 0x9E3779B1u + pBits[2];
+                return h;
+            }
+        };
+
+        struct PositionEqual
+        {
+            bool operator()(const glm::vec3& a, const glm::vec3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+        };
+
+        class Simplifier
+        {
+        public:
+            Simplifier(const glm::vec3* pPositions, uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount) : mpPositions(pPositions), mVertexCount(vertexCount)
+            {
+                mTriangles.reserve(indexCount);
+                for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+                {
+                    uint32_t a = pIndices[i], b = pIndices[i + 1], c = pIndices[i + 2];
+                    if (a == b || b == c || a == c || a >= vertexCount || b >= vertexCount || c >= vertexCount)
+                    {
+                        continue;
+                    }
+                    mTriangles.push_back(a);
+                    mTriangles.push_back(b);
+                    mTriangles.push_back(c);
+                }
+                mTriangleCount = (uint32_t)mTriangles.size() / 3;
+                mTriangleAlive.assign(mTriangleCount, true);
+                mVertexTriangles.resize(vertexCount);
+                mQuadrics.resize(vertexCount);
+                mVersions.assign(vertexCount, 0);
+                mAlive.assign(vertexCount, true);
+                mLocked.assign(vertexCount, false);
+
+                for (uint32_t t = 0; t < mTriangleCount; t++)
+                {
+                    for (uint32_t i = 0; i < 3; i++)
+                    {
+                        mVertexTriangles[mTriangles[t * 3 + i]].push_back(t);
+                    }
+                }
+
+                lockSeams();
+                initQuadrics();
+            }
+
+            float run(uint32_t targetIndexCount, float maxError, std::vector<uint32_t>& indices)
+            {
+                for (uint32_t v = 0; v < mVertexCount; v++)
+                {
+                    pushCollapses(v);
+                }
+
+                double maxCost = double(maxError) * double(maxError);
+                double appliedCost = 0;
+                while (mTriangleCount * 3 > targetIndexCount && mHeap.empty() == false)
+                {
+                    Collapse c = mHeap.top();
+                    mHeap.pop();
+                    if (mAlive[c.from] == false || mAlive[c.to] == false || mVersions[c.from] != c.fromVersion || mVersions[c.to] != c.toVersion)
+                    {
+                        continue;
+                    }
+                    if (c.cost > maxCost)
+                    {
+                        break;
+                    }
+                    if (isValid(c.from, c.to))
+                    {
+                        apply(c.from, c.to);
+                        appliedCost = std::max(appliedCost, c.cost);
+                    }
+                }
+
+                indices.clear();
+                indices.reserve(mTriangleCount * 3);
+                for (uint32_t t = 0; t < mTriangleAlive.size(); t++)
+                {
+                    if (mTriangleAlive[t])
+                    {
+                        indices.insert(indices.end(), &mTriangles[t * 3], &mTriangles[t * 3] + 3);
+                    }
+                }
+                return (float)std::sqrt(appliedCost);
+            }
+
+        private:
+            void lockSeams()
+            {
+                std::unordered_map<glm::vec3, uint32_t, PositionHash, PositionEqual> firstVertex;
+                for (uint32_t v = 0; v < mVertexCount; v++)
+                {
+                    if (mVertexTriangles[v].empty())
+                    {
+                        continue;
+                    }
+                    auto it = firstVertex.find(mpPositions[v]);
+                    if (it == firstVertex.end())
+                    {
+                        firstVertex[mpPositions[v]] = v;
+                    }
+                    else
+                    {
+                        mLocked[v] = true;
+                        mLocked[it->second] = true;
+                    }
+                }
+            }
+
+            void initQuadrics()
+            {
+                // Directed edge counts, to find the border edges
+                std::unordered_map<uint64_t, uint32_t> edges;
+                auto edgeKey = [](uint32_t a, uint32_t b) { return (uint64_t(std::min(a, b)) << 32) | std::max(a, b); };
+                for (uint32_t t = 0; t < mTriangleCount; t++)
+                {
+                    const uint32_t* pTri = &mTriangles[t * 3];
+                    const glm::vec3& p0 = mpPositions[pTri[0]];
+                    glm::vec3 n = glm::cross(mpPositions[pTri[1]] - p0, mpPositions[pTri[2]] - p0);
+                    float len = glm::length(n);
+                    for (uint32_t i = 0; i < 3; i++)
+                    {
+                        edges[edgeKey(pTri[i], pTri[(i + 1) % 3])]++;
+                    }
+                    if (len <= 0)
+                    {
+                        continue;
+                    }
+                    n = n * (1.0f / len);
+                    Quadric q;
+                    q.addPlane(n, -double(glm::dot(n, p0)), 1);
+                    for (uint32_t i = 0; i < 3; i++)
+                    {
+                        mQuadrics[pTri[i]].add(q);
+                    }
+                }
+
+                // Constrain the border edges with planes perpendicular to the triangle
+                for (uint32_t t = 0; t < mTriangleCount; t++)
+                {
+                    const uint32_t* pTri = &mTriangles[t * 3];
+                    const glm::vec3& p0 = mpPositions[pTri[0]];
+                    glm::vec3 n = glm::cross(mpPositions[pTri[1]] - p0, mpPositions[pTri[2]] - p0);
+                    if (glm::length(n) <= 0)
+                    {
+                        continue;
+                    }
+                    for (uint32_t i = 0; i < 3; i++)
+                    {
+                        uint32_t a = pTri[i], b = pTri[(i + 1) % 3];
+                        if (edges[edgeKey(a, b)] != 1)
+                        {
+                            continue;
+                        }
+                        glm::vec3 e = mpPositions[b] - mpPositions[a];
+                        glm::vec3 borderN = glm::cross(e, n);
+                        float len = glm::length(borderN);
+                        if (len <= 0)
+                        {
+                            continue;
+                        }
+                        borderN = borderN * (1.0f / len);
+                        Quadric q;
+                        q.addPlane(borderN, -double(glm::dot(borderN, mpPositions[a])), kBorderWeight);
+                        mQuadrics[a].add(q);
+                        mQuadrics[b].add(q);
+                    }
+                }
+            }
+
+            void pushCollapses(uint32_t v)
+            {
+                for (uint32_t t : mVertexTriangles[v])
+                {
+                    if (mTriangleAlive[t] == false)
+                    {
+                        continue;
+                    }
+                    for (uint32_t i = 0; i < 3; i++)
+                    {
+                        uint32_t n = mTriangles[t * 3 + i];
+                        if (n == v)
+                        {
+                            continue;
+                        }
+                        // Push both directions, each edge is visited through both its vertices
+                        if (mLocked[v] == false)
+                        {
+                            Quadric q = mQuadrics[v];
+                            q.add(mQuadrics[n]);
+                            mHeap.push({ q.evaluate(mpPositions[n]), v, n, mVersions[v], mVersions[n] });
+                        }
+                    }
+                }
+            }
+
+            bool isValid(uint32_t from, uint32_t to)
+            {
+                uint32_t sharedTriangles = 0;
+                mNeighbors.clear();
+                for (uint32_t t : mVertexTriangles[from])
+                {
+                    if (mTriangleAlive[t] == false)
+                    {
+                        continue;
+                    }
+                    const uint32_t* pTri = &mTriangles[t * 3];
+                    bool hasTo = (pTri[0] == to || pTri[1] == to || pTri[2] == to);
+                    sharedTriangles += hasTo ? 1 : 0;
+                    for (uint32_t i = 0; i < 3; i++)
+                    {
+                        if (pTri[i] != from && pTri[i] != to)
+                        {
+                            mNeighbors.push_back(pTri[i]);
+                        }
+                    }
+
+                    // Reject collapses which flip or degenerate the remaining triangles
+                    if (hasTo == false)
+                    {
+                        glm::vec3 p[3];
+                        glm::vec3 q[3];
+                        for (uint32_t i = 0; i < 3; i++)
+                        {
+                            p[i] = mpPositions[pTri[i]];
+                            q[i] = (pTri[i] == from) ? mpPositions[to] : p[i];
+                        }
+                        glm::vec3 n0 = glm::cross(p[1] - p[0], p[2] - p[0]);
+                        glm::vec3 n1 = glm::cross(q[1] - q[0], q[2] - q[0]);
+                        float l0 = glm::length(n0);
+                        float l1 = glm::length(n1);
+                        if (l1 <= 0 || glm::dot(n0, n1) <= kMaxFlipCos * l0 * l1)
+                        {
+                            return false;
+                        }
+                    }
+                }
+                if (sharedTriangles == 0)
+                {
+                    return false;
+                }
+
+                mToNeighbors.clear();
+                for (uint32_t t : mVertexTriangles[to])
+                {
+                    if (mTriangleAlive[t] == false)
+                    {
+                        continue;
+                    }
+                    const uint32_t* pTri = &mTriangles[t * 3];
+                    for (uint32_t i = 0; i < 3; i++)
+                    {
+                        if (pTri[i] != from && pTri[i] != to)
+                        {
+                            mToNeighbors.push_back(pTri[i]);
+                        }
+                    }
+                }
+
+                // The opposite vertices of the removed triangles are the only neighbors both vertices may share, otherwise the collapse creates non-manifold edges
+                std::sort(mNeighbors.begin(), mNeighbors.end());
+                mNeighbors.erase(std::unique(mNeighbors.begin(), mNeighbors.end()), mNeighbors.end());
+                std::sort(mToNeighbors.begin(), mToNeighbors.end());
+                mToNeighbors.erase(std::unique(mToNeighbors.begin(), mToNeighbors.end()), mToNeighbors.end());
+                uint32_t commonNeighbors = 0;
+                for (uint32_t i = 0, j = 0; i < mNeighbors.size() && j < mToNeighbors.size();)
+                {
+                    if (mNeighbors[i] < mToNeighbors[j])
+                    {
+                        i++;
+                    }
+                    else if (mToNeighbors[j] < mNeighbors[i])
+                    {
+                        j++;
+                    }
+                    else
+                    {
+                        commonNeighbors++;
+                        i++;
+                        j++;
+                    }
+                }
+                return commonNeighbors == sharedTriangles;
+            }
+
+            void apply(uint32_t from, uint32_t to)
+            {
+                for (uint32_t t : mVertexTriangles[from])
+                {
+                    if (mTriangleAlive[t] == false)
+                    {
+                        continue;
+                    }
+                    uint32_t* pTri = &mTriangles[t * 3];
+                    if (pTri[0] == to || pTri[1] == to || pTri[2] == to)
+                    {
+                        mTriangleAlive[t] = false;
+                        mTriangleCount--;
+                        continue;
+                    }
+                    for (uint32_t i = 0; i < 3; i++)
+                    {
+                        if (pTri[i] == from)
+                        {
+                            pTri[i] = to;
+                        }
+                    }
+                    mVertexTriangles[to].push_back(t);
+                }
+                mVertexTriangles[from].clear();
+                mAlive[from] = false;
+
+                // Drop the removed triangles from the adjacency of the remaining vertex
+                auto& toTriangles = mVertexTriangles[to];
+                toTriangles.erase(std::remove_if(toTriangles.begin(), toTriangles.end(), [this](uint32_t t) { return mTriangleAlive[t] == false; }), toTriangles.end());
+
+                mQuadrics[to].add(mQuadrics[from]);
+                mVersions[to]++;
+                pushCollapses(to);
+
+                // The collapses from the neighbors into the remaining vertex changed cost
+                mNeighbors.clear();
+                for (uint32_t t : toTriangles)
+                {
+                    for (uint32_t i = 0; i < 3; i++)
+                    {
+                        mNeighbors.push_back(mTriangles[t * 3 + i]);
+                    }
+                }
+                std::sort(mNeighbors.begin(), mNeighbors.end());
+                mNeighbors.erase(std::unique(mNeighbors.begin(), mNeighbors.end()), mNeighbors.end());
+                for (uint32_t n : mNeighbors)
+                {
+                    if (n != to && mLocked[n] == false)
+                    {
+                        Quadric q = mQuadrics[n];
+                        q.add(mQuadrics[to]);
+                        mHeap.push({ q.evaluate(mpPositions[to]), n, to, mVersions[n], mVersions[to] });
+                    }
+                }
+            }
+
+            const glm::vec3* mpPositions;
+            uint32_t mVertexCount;
+            std::vector<uint32_t> mTriangles;
+            std::vector<bool> mTriangleAlive;
+            uint32_t mTriangleCount = 0;
+            std::vector<std::vector<uint32_t>> mVertexTriangles;
+            std::vector<Quadric> mQuadrics;
+            std::vector<uint32_t> mVersions;
+            std::vector<bool> mAlive;
+            std::vector<bool> mLocked;
+            std::vector<uint32_t> mNeighbors;
+            std::vector<uint32_t> mToNeighbors;
+            std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> mHeap;
+        };
+    }
+
+    float MeshSimplifier::simplify(const glm::vec3* pPositions, uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount, uint32_t targetIndexCount, float maxError, std::vector<uint32_t>& indices)
+    {
+        Simplifier simplifier(pPositions, vertexCount, pIndices, indexCount);
+        return simplifier.run(targetIndexCount, maxError, indices);
+    }
+
+    void MeshSimplifier::generateLodChain(const glm::vec3* pPositions, uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount, uint32_t maxLodCount, std::vector<MeshLodData>& lods)
+    {
+        lods.clear();
+        if (vertexCount == 0 || indexCount == 0)
+        {
+            return;
+        }
+
+        glm::vec3 minPos(FLT_MAX);
+        glm::vec3 maxPos(-FLT_MAX);
+        for (uint32_t i = 0; i < indexCount; i++)
+        {
+            // Like the simplifier, skip indices which are out of range
+            if (pIndices[i] >= vertexCount) continue;
+            minPos = glm::min(minPos, pPositions[pIndices[i]]);
+            maxPos = glm::max(maxPos, pPositions[pIndices[i]]);
+        }
+        if (minPos.x > maxPos.x)
+        {
+            return;
+        }
+        float diagonal = glm::length(maxPos - minPos);
+
+        uint32_t prevIndexCount = indexCount;
+        float screenSize = 0.25f;
+        for (uint32_t lod = 1; lod < maxLodCount; lod++)
+        {
+            uint32_t targetIndexCount = (prevIndexCount / 6) * 3;
+            if (targetIndexCount < kMinLodTriangleCount * 3)
+            {
+                break;
+            }
+
+            MeshLodData data;
+            data.screenSize = screenSize;
+            data.error = simplify(pPositions, vertexCount, pIndices, indexCount, targetIndexCount, diagonal * kLodPixelError / screenSize, data.indices);
+            if (data.indices.size() > prevIndexCount * kMinLodReduction)
+            {
+                break;
+            }
+
+            prevIndexCount = (uint32_t)data.indices.size();
+            lods.push_back(std::move(data));
+            screenSize *= 0.5f;
+        }
+    }
+
+    float LodSelector::calcScreenSize(const glm::vec3& center, float radius, const glm::mat4& viewMat, const glm::mat4& projMat)
+    {
+        // Orthographic projections don't depend on the distance
+        if (projMat[3][3] == 1)
+        {
+            return radius * projMat[1][1];
+        }
+
+        // Use the distance rather than the depth, so that the selection doesn't change when the camera rotates
+        glm::vec3 viewPos = glm::vec3(viewMat * glm::vec4(center, 1));
+        float distance = glm::length(viewPos);
+        if (distance <= radius)
+        {
+            return FLT_MAX;
+        }
+        return radius * projMat[1][1] / distance;
+    }
+
+    float LodSelector::applyHysteresis(float screenSize, float selectionSize, float hysteresis)
+    {
+        if (selectionSize <= 0 || std::abs(screenSize - selectionSize) > hysteresis * selectionSize)
+        {
+            return screenSize;
+        }
+        return selectionSize;
+    }
+
+    uint32_t LodSelector::selectLod(const float* pScreenSizes, uint32_t lodCount, float screenSize)
+    {
+        uint32_t lod = 0;
+        for (uint32_t i = 1; i < lodCount && screenSize < pScreenSizes[i]; i++)
+        {
+            lod = i;
+        }
+        return lod;
+    }
+}
@@ -0,0 +1,108 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "glm/vec3.hpp"
+#include "glm/mat4x4.hpp"
+
+namespace Falcor
+{
+    /** CPU-side data of a mesh level of detail. The indices reference the vertices of the full-resolution mesh.
+    */
+    struct MeshLodData
+    {
+        std::vector<uint32_t> indices;  ///< Triangle list
+        float screenSize = 0;           ///< The LOD is used when the model instance covers less than this fraction of the screen height
+        float error = 0;                ///< Geometric error of the simplified mesh, in object space
+    };
+
+    /** Quadric error metric simplifier for indexed triangle lists.
+        Edges are collapsed into one of their vertices, so the simplified index buffer can be drawn with the vertex buffers of the original mesh. Collapses which would flip a triangle are rejected.
+        Border edges are preserved by additional quadrics, and vertices which share their position with another vertex (UV or normal seams) are never moved, so the attribute seams don't open.
+    */
+    class MeshSimplifier
+    {
+    public:
+        static const uint32_t kDefaultLodCount = 4; ///< Number of LODs the model importers generate, including the full-resolution mesh
+
+        /** Simplify a triangle list
+            \param[in] pPositions The vertex positions
+            \param[in] vertexCount The number of vertices
+            \param[in] pIndices Three indices per triangle
+            \param[in] indexCount The number of indices
+            \param[in] targetIndexCount Stop once the simplified mesh has no more than this many indices
+            \param[in] maxError Stop before the error exceeds this distance
+            \param[out] indices The simplified triangle list
+            \return The error of the simplified mesh. It bounds the distance of the remaining vertices to the planes of the triangles they replaced.
+        */
+        static float simplify(const glm::vec3* pPositions, uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount, uint32_t targetIndexCount, float maxError, std::vector<uint32_t>& indices);
+
+        /** Generate a LOD chain. Each LOD has about half the triangles of the previous one, and is used when the model instance is half as large on screen.
+            The error of a LOD is bounded, so it stays below a pixel at 1080p when the LOD is first used. The chain ends early when a LOD can't remove enough triangles within that bound.
+            \param[in] pPositions The vertex positions
+            \param[in] vertexCount The number of vertices
+            \param[in] pIndices Three indices per triangle
+            \param[in] indexCount The number of indices
+            \param[in] maxLodCount Maximal number of LODs, including the full-resolution mesh
+            \param[out] lods The generated LODs, from the most detailed to the coarsest. The full-resolution mesh isn't included.
+        */
+        static void generateLodChain(const glm::vec3* pPositions, uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount, uint32_t maxLodCount, std::vector<MeshLodData>& lods);
+    };
+
+    /** Helpers to select a level of detail from the screen-space size of an object
+    */
+    class LodSelector
+    {
+    public:
+        /** Calculate the fraction of the screen height covered by a bounding sphere
+            \param[in] center The sphere's center, in world space
+            \param[in] radius The sphere's radius
+            \param[in] viewMat The camera's view matrix
+            \param[in] projMat The camera's projection matrix
+            \return The screen size. Spheres which contain the camera get a very large size.
+        */
+        static float calcScreenSize(const glm::vec3& center, float radius, const glm::mat4& viewMat, const glm::mat4& projMat);
+
+        /** Update the screen size an object's LOD is selected with. It only follows the actual size once the difference exceeds the hysteresis, so an object near a LOD switch doesn't alternate between two LODs.
+            \param[in] screenSize The current screen size
+            \param[in] selectionSize The screen size the LOD was last selected with, or a negative value if there is none
+            \param[in] hysteresis Relative change of the screen size which updates the selection size
+            \return The new selection size
+        */
+        static float applyHysteresis(float screenSize, float selectionSize, float hysteresis);
+
+        /** Select a LOD
+            \param[in] pScreenSizes The switch size of each LOD, decreasing. LOD i is used below pScreenSizes[i]. The first LOD is used above all the switch sizes.
+            \param[in] lodCount The number of LODs
+            \param[in] screenSize The selection size
+            \return The LOD index
+        */
+        static uint32_t selectLod(const float* pScreenSizes, uint32_t lodCount, float screenSize);
+    };
+}
@@ -30,6 +30,7 @@
 #include "Loaders/AssimpModelImporter.h"
 #include "Loaders/BinaryModelImporter.h"
 #include "Loaders/BinaryModelExporter.h"
+#include "ModelCache.h"
 #include "Utils/Platform/OS.h"
 #include "Mesh.h"
 #include "glm/geometric.hpp"
@@ -86,6 +87,11 @@ namespace Falcor
 
     Model::~Model() = default;
 
+    static bool useModelCache(Model::LoadFlags flags)
+    {
+        return ModelCache::isEnabled() && is_set(flags, Model::LoadFlags::DontUseCache) == false;
+    }
+
     Model::SharedPtr Model::createFromFile(const char* filename, LoadFlags flags)
     {
         SharedPtr pModel = SharedPtr(new Model());
@@ -94,26 +100,60 @@ namespace Falcor
         {
             res = BinaryModelImporter::import(*pModel, filename, flags);
         }
+        else if(useModelCache(flags))
+        {
+            res = ModelCache::import(*pModel, filename, flags);
+        }
         else
         {
             res = AssimpModelImporter::import(*pModel, filename, flags);
         }
 
-        if(res)
-        {
-            pModel->calculateModelProperties();
-            pModel->setFilename(filename);
+        return finalizeImport(pModel, res, filename);
+    }
 
-            std::string name = getFilenameFromPath(filename);
-            size_t extPos = name.find_last_of('.');
-            name = (extPos == std::string::npos) ? name : name.substr(0, extPos);
-            pModel->setName(name);
+    Model::PreloadedFile::SharedPtr Model::preloadFile(const char* filename, LoadFlags flags)
+    {
+        if(hasSuffix(filename, ".bin", false))
+        {
+            return BinaryModelImporter::preload(filename, flags);
+        }
+        else if(useModelCache(flags))
+        {
+            return ModelCache::preload(filename, flags);
         }
         else
         {
-            pModel = nullptr;
+            return AssimpModelImporter::preload(filename, flags);
         }
+    }
+
+    Model::SharedPtr Model::createFromPreloadedFile(const PreloadedFile::SharedPtr& pFile)
+    {
+        if(pFile == nullptr)
+        {
+            return nullptr;
+        }
+
+        SharedPtr pModel = SharedPtr(new Model());
+        bool res = pFile->import(*pModel);
+        return finalizeImport(pModel, res, pFile->getFilename());
+    }
+
+    Model::SharedPtr Model::finalizeImport(SharedPtr pModel, bool importSucceeded, const std::string& filename)
+    {
+        if(importSucceeded == false)
+        {
+            return nullptr;
+        }
+
+        pModel->calculateModelProperties();
+        pModel->setFilename(filename);
 
+        std::string name = getFilenameFromPath(filename);
+        size_t extPos = name.find_last_of('.');
+        name = (extPos == std::string::npos) ? name : name.substr(0, extPos);
+        pModel->setName(name);
         return pModel;
     }
 
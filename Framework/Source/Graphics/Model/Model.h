@@ -65,12 +65,54 @@ namespace Falcor
             AssumeLinearSpaceTextures   = 0x4,    ///< By default, textures representing colors (diffuse/specular) are interpreted as sRGB data. Use this flag to force linear space for color textures.
             DontMergeMeshes             = 0x8,    ///< Preserve the original list of meshes in the scene, don't merge meshes with the same material
             BuffersAsShaderResource     = 0x10,   ///< Generate the VBs and IB with the shader-resource-view bind flag
+            MemoryMappedIO              = 0x20,   ///< Binary models only. Map the file into memory instead of reading it through a file stream. v9 data blocks are uploaded directly from the mapping
+            DontUseCache                = 0x40,   ///< Don't load the model from the persistent model cache and don't add it to the cache. See ModelCache
+            GenerateLods                = 0x80,   ///< Generate a LOD chain for triangle meshes which don't have one, using MeshSimplifier. See Mesh::getLod()
+            CompressAnimations          = 0x100,  ///< Resample and quantize the animations into AnimationClip objects. See Animation::compress()
+        };
+
+        /** CPU-side state of a model file which was read and decoded by Model::preloadFile(). It doesn't reference any GPU resources.
+            Each importer derives its own type, holding whatever it needs to finish the import.
+        */
+        class PreloadedFile
+        {
+        public:
+            using SharedPtr = std::shared_ptr<PreloadedFile>;
+            virtual ~PreloadedFile() = default;
+
+            /** Get the filename the data was loaded from, as it was passed to Model::preloadFile()
+            */
+            const std::string& getFilename() const { return mFilename; }
+
+        protected:
+            friend class Model;
+            friend class ModelCache;
+            PreloadedFile(const std::string& filename) : mFilename(filename) {}
+
+            /** Create the model's GPU resources from the preloaded data
+            */
+            virtual bool import(Model& model) = 0;
+
+            std::string mFilename;
         };
 
         /** Create a new model from file
         */
         static SharedPtr createFromFile(const char* filename, LoadFlags flags = LoadFlags::None);
 
+        /** Read and decode a model file without creating any GPU resources. This covers the file I/O, parsing, tangent-space generation and texture decoding.
+            This function is thread-safe, so multiple files can be preloaded concurrently. Pass the result to createFromPreloadedFile() to finish loading.
+            \param[in] filename Model's filename. Can include a full path or a relative path from a data directory
+            \param[in] flags Flags controlling model creation
+            \return The preloaded data, or nullptr if the file couldn't be loaded
+        */
+        static PreloadedFile::SharedPtr preloadFile(const char* filename, LoadFlags flags = LoadFlags::None);
+
+        /** Create a new model from data returned by preloadFile(). This creates the GPU resources, so it has to be called from the thread that owns the device.
+            \return A new model, or nullptr if creation failed
+        */
+        static SharedPtr createFromPreloadedFile(const PreloadedFile::SharedPtr& pFile);
+
         static SharedPtr create();
 
         static const char* kSupportedFileFormatsStr;
@@ -183,6 +225,12 @@ namespace Falcor
         */
         void setAnimationController(AnimationController::UniquePtr pAnimController);
 
+        /** Get the animation controller for the model.
+            \return The animation controller if the model has one, otherwise nullptr.
+        */
+        const AnimationController* getAnimationController() const { return mpAnimationController.get(); }
+        AnimationController* getAnimationController() { return mpAnimationController.get(); }
+
         /** Check if the model has bones.
         */
         bool hasBones() const;
@@ -266,6 +314,7 @@ namespace Falcor
         static uint32_t sModelCounter;
 
         void calculateModelProperties();
+        static SharedPtr finalizeImport(SharedPtr pModel, bool importSucceeded, const std::string& filename);
     };
 
     enum_class_operators(Model::LoadFlags);
@@ -0,0 +1,515 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Framework.h"
+#include "ModelCache.h"
+#include "Loaders/AssimpModelImporter.h"
+#include "Loaders/BinaryModelImporter.h"
+#include "Loaders/BinaryModelExporter.h"
+#include "Utils/Platform/OS.h"
+#include "Utils/Platform/MemoryMappedFile.h"
+#include "Utils/HashUtils.h"
+#include "API/Texture.h"
+#include "Graphics/Material/Material.h"
+#include <mutex>
+#include <map>
+#include <fstream>
+#include <algorithm>
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+
+namespace Falcor
+{
+    // Bump this when the importers change in a way that makes existing entries stale
+    static const uint32_t kCacheVersion = 2;
+    static const char* kIndexFilename = "index.txt";
+
+    // Flags which don't affect the imported model, so they are not part of the key
+    static const Model::LoadFlags kIgnoredFlags = Model::LoadFlags::MemoryMappedIO | Model::LoadFlags::DontUseCache;
+
+    struct CacheEntry
+    {
+        uint64_t size = 0;
+        uint64_t lastUse = 0;   // Value of CacheState::useCounter when the entry was last used
+    };
+
+    struct CacheState
+    {
+        std::mutex mutex;
+        bool enabled = true;
+        std::string directory;
+        uint64_t maxSize = 2ull * 1024 * 1024 * 1024;
+        bool indexLoaded = false;
+        bool indexDirty = false;    // Hits changed the use order since the index was written
+        uint64_t useCounter = 0;
+        std::map<std::string, CacheEntry> entries;
+        ModelCache::Statistics stats;
+
+        ~CacheState();
+    };
+
+    static CacheState& getState()
+    {
+        static CacheState state;
+        return state;
+    }
+
+    // All the functions below expect the state's mutex to be locked
+
+    static const std::string& getCacheDirectory(CacheState& state)
+    {
+        if(state.directory.empty())
+        {
+            state.directory = getExecutableDirectory() + "/ModelCache";
+        }
+        return state.directory;
+    }
+
+    static std::string getEntryPath(CacheState& state, const std::string& key)
+    {
+        return getCacheDirectory(state) + "/" + key + ".bin";
+    }
+
+    static void updateSize(CacheState& state)
+    {
+        state.stats.cacheSize = 0;
+        for(const auto& e : state.entries)
+        {
+            state.stats.cacheSize += e.second.size;
+        }
+        state.stats.entryCount = (uint32_t)state.entries.size();
+    }
+
+    static void loadIndex(CacheState& state)
+    {
+        if(state.indexLoaded)
+        {
+            return;
+        }
+        state.indexLoaded = true;
+        state.entries.clear();
+        state.useCounter = 0;
+
+        // Each line holds '<key> <size> <lastUse>'. Entries whose file was deleted are dropped.
+        std::ifstream index(getCacheDirectory(state) + "/" + kIndexFilename);
+        std::string key;
+        CacheEntry entry;
+        while(index >> key >> entry.size >> entry.lastUse)
+        {
+            std::error_code err;
+            if(fs::exists(getEntryPath(state, key), err))
+            {
+                state.entries[key] = entry;
+                state.useCounter = std::max(state.useCounter, entry.lastUse);
+            }
+        }
+        updateSize(state);
+    }
+
+    static void saveIndex(CacheState& state)
+    {
+        std::error_code err;
+        fs::create_directories(getCacheDirectory(state), err);
+        std::ofstream index(getCacheDirectory(state) + "/" + kIndexFilename, std::ios::trunc);
+        for(const auto& e : state.entries)
+        {
+            index << e.first << ' ' << e.second.size << ' ' << e.second.lastUse << '\n';
+        }
+        state.indexDirty = false;
+    }
+
+    // Writes the use order recorded by the hits since the index was last saved
+    static void flushIndex(CacheState& state)
+    {
+        if(state.indexDirty)
+        {
+            saveIndex(state);
+        }
+    }
+
+    CacheState::~CacheState()
+    {
+        flushIndex(*this);
+    }
+
+    static void removeEntry(CacheState& state, const std::string& key)
+    {
+        std::error_code err;
+        fs::remove(getEntryPath(state, key), err);
+        state.entries.erase(key);
+        updateSize(state);
+    }
+
+    static void evictEntries(CacheState& state, const std::string& keepKey)
+    {
+        while(state.stats.cacheSize > state.maxSize)
+        {
+            auto lru = state.entries.end();
+            for(auto it = state.entries.begin(); it != state.entries.end(); it++)
+            {
+                if(it->first != keepKey && (lru == state.entries.end() || it->second.lastUse < lru->second.lastUse))
+                {
+                    lru = it;
+                }
+            }
+
+            if(lru == state.entries.end())
+            {
+                break;
+            }
+            removeEntry(state, lru->first);
+            state.stats.evictions++;
+        }
+    }
+
+    static std::string computeKey(const std::string& fullpath, Model::LoadFlags flags)
+    {
+        MemoryMappedFile::SharedPtr pFile = MemoryMappedFile::create(fullpath);
+        if(pFile == nullptr)
+        {
+            return "";
+        }
+
+        char key[64];
+        snprintf(key, arraysize(key), "%016llx-%llx-%x-v%u", (unsigned long long)hashBytes(pFile->getData(), pFile->getSize()), (unsigned long long)pFile->getSize(), (uint32_t)(flags & ~kIgnoredFlags), kCacheVersion);
+        return key;
+    }
+
+    static bool findEntry(const std::string& key, std::string& entryPath)
+    {
+        CacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        loadIndex(state);
+        if(state.entries.find(key) == state.entries.end())
+        {
+            return false;
+        }
+        entryPath = getEntryPath(state, key);
+        return true;
+    }
+
+    static void recordHit(const std::string& key)
+    {
+        CacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.stats.hits++;
+        auto it = state.entries.find(key);
+        if(it != state.entries.end())
+        {
+            state.stats.bytesRead += it->second.size;
+            // Only the in-memory order is updated. The index is written with the next insertion or eviction, or on shutdown.
+            it->second.lastUse = ++state.useCounter;
+            state.indexDirty = true;
+        }
+    }
+
+    static void recordMiss()
+    {
+        CacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.stats.misses++;
+    }
+
+    static void discardEntry(const std::string& key)
+    {
+        logWarning("Model cache entry " + key + " is invalid. Re-importing the model from its source file.");
+        CacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        removeEntry(state, key);
+        saveIndex(state);
+    }
+
+    static bool loadEntry(Model& model, const std::string& key, Model::LoadFlags flags)
+    {
+        std::string entryPath;
+        if(findEntry(key, entryPath) == false)
+        {
+            return false;
+        }
+
+        if(BinaryModelImporter::import(model, entryPath, flags | Model::LoadFlags::MemoryMappedIO) == false)
+        {
+            discardEntry(key);
+            return false;
+        }
+        recordHit(key);
+        return true;
+    }
+
+    static bool isTextureCacheable(const Texture* pTexture)
+    {
+        return pTexture == nullptr || (pTexture->getType() == Texture::Type::Texture2D && pTexture->getArraySize() == 1 && pTexture->getSourceFilename().size());
+    }
+
+    static bool isCacheable(const Model& model)
+    {
+        // Entries reference textures by filename, so all textures must come from files
+        for(uint32_t i = 0; i < model.getMeshCount(); i++)
+        {
+            const Material* pMaterial = model.getMesh(i)->getMaterial().get();
+            for(uint32_t l = 0; l < pMaterial->getNumLayers(); l++)
+            {
+                if(isTextureCacheable(pMaterial->getLayer(l).pTexture.get()) == false) return false;
+            }
+
+            if(isTextureCacheable(pMaterial->getNormalMap().get()) == false) return false;
+            if(isTextureCacheable(pMaterial->getAlphaMap().get()) == false) return false;
+            if(isTextureCacheable(pMaterial->getAmbientOcclusionMap().get()) == false) return false;
+            if(isTextureCacheable(pMaterial->getHeightMap().get()) == false) return false;
+        }
+        return true;
+    }
+
+    static void storeEntry(const Model& model, const std::string& key)
+    {
+        if(isCacheable(model) == false)
+        {
+            logInfo("Model cache: model uses textures which were not loaded from files, it will not be cached.");
+            return;
+        }
+
+        CacheState& state = getState();
+        std::string entryPath;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            std::error_code err;
+            fs::create_directories(getCacheDirectory(state), err);
+            entryPath = getEntryPath(state, key);
+        }
+
+        // Write to a temporary file first, so other processes never see a partially written entry
+        std::string tempPath = entryPath + ".tmp";
+        if(BinaryModelExporter::exportToFile(tempPath, &model, BinaryModelExporter::ExportFlags::ReferenceTextures) == false)
+        {
+            return;
+        }
+
+        std::error_code err;
+        fs::rename(tempPath, entryPath, err);
+        uint64_t size = err ? 0 : (uint64_t)fs::file_size(entryPath, err);
+        if(err)
+        {
+            logWarning("Model cache: can't create entry " + entryPath);
+            fs::remove(tempPath, err);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(state.mutex);
+        loadIndex(state);
+        CacheEntry& entry = state.entries[key];
+        entry.size = size;
+        entry.lastUse = ++state.useCounter;
+        state.stats.bytesWritten += size;
+        updateSize(state);
+        evictEntries(state, key);
+        saveIndex(state);
+    }
+
+    class ModelCache::PreloadedCachedFile : public Model::PreloadedFile
+    {
+    public:
+        PreloadedCachedFile(const std::string& filename, Model::LoadFlags flags, const std::string& key, const Model::PreloadedFile::SharedPtr& pEntry, const Model::PreloadedFile::SharedPtr& pSource)
+            : Model::PreloadedFile(filename), mFlags(flags), mKey(key), mpEntry(pEntry), mpSource(pSource) {}
+
+    protected:
+        bool import(Model& model) override
+        {
+            if(mpEntry)
+            {
+                if(importPreloaded(mpEntry.get(), model))
+                {
+                    recordHit(mKey);
+                    return true;
+                }
+
+                // A failed import leaves the model empty, so we can fall back to the source file
+                discardEntry(mKey);
+                mpSource = AssimpModelImporter::preload(mFilename, mFlags);
+                if(mpSource == nullptr)
+                {
+                    return false;
+                }
+            }
+
+            recordMiss();
+            if(importPreloaded(mpSource.get(), model) == false)
+            {
+                return false;
+            }
+
+            if(mKey.size())
+            {
+                storeEntry(model, mKey);
+            }
+            return true;
+        }
+
+    private:
+        Model::LoadFlags mFlags;
+        std::string mKey;
+        Model::PreloadedFile::SharedPtr mpEntry;    // The preloaded cache entry, if the model is in the cache
+        Model::PreloadedFile::SharedPtr mpSource;   // The preloaded source file, otherwise
+    };
+
+    bool ModelCache::import(Model& model, const std::string& filename, Model::LoadFlags flags)
+    {
+        std::string fullpath;
+        std::string key;
+        if(findFileInDataDirectories(filename, fullpath))
+        {
+            key = computeKey(fullpath, flags);
+        }
+
+        if(key.size() && loadEntry(model, key, flags))
+        {
+            return true;
+        }
+
+        recordMiss();
+        if(AssimpModelImporter::import(model, filename, flags) == false)
+        {
+            return false;
+        }
+
+        if(key.size())
+        {
+            storeEntry(model, key);
+        }
+        return true;
+    }
+
+    Model::PreloadedFile::SharedPtr ModelCache::preload(const std::string& filename, Model::LoadFlags flags)
+    {
+        std::string fullpath;
+        std::string key;
+        if(findFileInDataDirectories(filename, fullpath))
+        {
+            key = computeKey(fullpath, flags);
+        }
+
+        Model::PreloadedFile::SharedPtr pEntry;
+        Model::PreloadedFile::SharedPtr pSource;
+        std::string entryPath;
+        if(key.size() && findEntry(key, entryPath))
+        {
+            pEntry = BinaryModelImporter::preload(entryPath, flags | Model::LoadFlags::MemoryMappedIO);
+        }
+
+        if(pEntry == nullptr)
+        {
+            pSource = AssimpModelImporter::preload(filename, flags);
+            if(pSource == nullptr)
+            {
+                return nullptr;
+            }
+        }
+
+        return std::make_shared<PreloadedCachedFile>(filename, flags, key, pEntry, pSource);
+    }
+
+    void ModelCache::setEnabled(bool enabled)
+    {
+        CacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.enabled = enabled;
+    }
+
+    bool ModelCache::isEnabled()
+    {
+        CacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        return state.enabled;
+    }
+
+    void ModelCache::setDirectory(const std::string& directory)
+    {
+        CacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        flushIndex(state);
+        state.directory = directory;
+        state.indexLoaded = false;
+        state.entries.clear();
+        updateSize(state);
+    }
+
+    std::string ModelCache::getDirectory()
+    {
+        CacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        return getCacheDirectory(state);
+    }
+
+    void ModelCache::setMaxSize(uint64_t bytes)
+    {
+        CacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.maxSize = bytes;
+        loadIndex(state);
+        if(state.stats.cacheSize > state.maxSize)
+        {
+            evictEntries(state, "");
+            saveIndex(state);
+        }
+    }
+
+    uint64_t ModelCache::getMaxSize()
+    {
+        CacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        return state.maxSize;
+    }
+
+    ModelCache::Statistics ModelCache::getStatistics()
+    {
+        CacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        loadIndex(state);
+        return state.stats;
+    }
+
+    void ModelCache::resetStatistics()
+    {
+        CacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        Statistics stats;
+        stats.cacheSize = state.stats.cacheSize;
+        stats.entryCount = state.stats.entryCount;
+        state.stats = stats;
+    }
+
+    void ModelCache::clear()
+    {
+        CacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        loadIndex(state);
+        while(state.entries.size())
+        {
+            removeEntry(state, state.entries.begin()->first);
+        }
+        saveIndex(state);
+    }
+}
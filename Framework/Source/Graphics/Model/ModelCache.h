@@ -0,0 +1,106 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <string>
+#include "Model.h"
+
+namespace Falcor
+{
+    /** Persistent on-disk cache of models imported through ASSIMP.
+        Importing a model through ASSIMP requires parsing the source file, generating tangents and de-duplicating vertices, which can take a long time for large models.
+        The first time a model is loaded, the processed model is written to the cache directory in the binary model format (v9). Subsequent loads of the same file upload the cached data directly.
+        Entries are content-addressed - the key is a hash of the source file's bytes combined with the Model::LoadFlags that affect the import. Renaming or moving a file doesn't invalidate its entry, modifying it does.
+        Textures are referenced by filename and not stored in the cache, so changes to texture files are picked up. Changes to other side-car files (for example, OBJ material libraries) are not detected; use clear() after editing them.
+        When the total size of the entries exceeds the size limit, the least-recently-used entries are evicted.
+        All the functions are thread-safe.
+    */
+    class ModelCache
+    {
+    public:
+        struct Statistics
+        {
+            uint64_t hits = 0;          ///< Number of models loaded from the cache
+            uint64_t misses = 0;        ///< Number of models which were imported from their source file
+            uint64_t bytesRead = 0;     ///< Total size of the entries loaded from the cache
+            uint64_t bytesWritten = 0;  ///< Total size of the entries added to the cache
+            uint64_t evictions = 0;     ///< Number of entries removed to respect the size limit
+            uint64_t cacheSize = 0;     ///< Current size of all the entries in the cache directory
+            uint32_t entryCount = 0;    ///< Current number of entries in the cache directory
+        };
+
+        /** Enable or disable the cache. The cache is enabled by default. Use Model::LoadFlags::DontUseCache to bypass it for a specific model.
+        */
+        static void setEnabled(bool enabled);
+
+        /** Check if the cache is enabled
+        */
+        static bool isEnabled();
+
+        /** Set the directory where the cache entries are stored. By default, this is the 'ModelCache' folder in the executable directory.
+        */
+        static void setDirectory(const std::string& directory);
+
+        /** Get the directory where the cache entries are stored
+        */
+        static std::string getDirectory();
+
+        /** Set the maximum total size of the cache entries, in bytes. Least-recently-used entries are evicted when the size is exceeded. The default is 2GB.
+        */
+        static void setMaxSize(uint64_t bytes);
+
+        /** Get the maximum total size of the cache entries, in bytes
+        */
+        static uint64_t getMaxSize();
+
+        /** Get the cache statistics
+        */
+        static Statistics getStatistics();
+
+        /** Reset the hit, miss, byte and eviction counters. The size and entry count reflect the cache directory and are not affected.
+        */
+        static void resetStatistics();
+
+        /** Remove all the entries from the cache directory
+        */
+        static void clear();
+
+    private:
+        friend class Model;
+        class PreloadedCachedFile;
+
+        /** Import a model, using the cache if possible. Called by Model::createFromFile().
+        */
+        static bool import(Model& model, const std::string& filename, Model::LoadFlags flags);
+
+        /** Preload a model, using the cache if possible. Called by Model::preloadFile().
+        */
+        static Model::PreloadedFile::SharedPtr preload(const std::string& filename, Model::LoadFlags flags);
+
+        static bool importPreloaded(Model::PreloadedFile* pFile, Model& model) { return pFile->import(model); }
+    };
+}
@@ -34,6 +34,7 @@
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtx/euler_angles.hpp"
 #include "Utils/Math/FalcorMath.h"
+#include "Graphics/Model/InstanceStore.h"
 
 namespace Falcor
 {
@@ -42,6 +43,7 @@ namespace Falcor
 
     /** Handles transformations for Mesh and Model instances. Primary transform is stored in the "Base" transform. An additional "Movable"
         transform is applied after the Base transform can be set through the IMovableObject interface. This is currently used by paths.
+        The transforms, bounds and visibility live in a slot of the InstanceStore shared by all the instances of the same object type. Call getInstanceStore()->updateTransforms() once per frame to update all the changed instances in one pass.
     */
     template<typename ObjectType>
     class ObjectInstance : public IMovableObject, public inherit_shared_from_this<IMovableObject, ObjectInstance<ObjectType>>
@@ -97,12 +99,12 @@ namespace Falcor
         /** Sets visibility of this instance
             \param[in] visible Visibility of this instance
         */
-        void setVisible(bool visible) { mVisible = visible; };
+        void setVisible(bool visible) { mpStore->setVisible(mSlot, visible); };
 
         /** Gets whether this instance is visible
             \return Whether this instance is visible
         */
-        bool isVisible() const { return mVisible; };
+        bool isVisible() const { return mpStore->isVisible(mSlot); };
 
         /** Gets instance name
             \return Instance name
@@ -120,30 +122,36 @@ namespace Falcor
         */
         void setTranslation(const glm::vec3& translation, bool updateLookAt)
         {
+            InstanceStore::TransformParams base = getBase();
             if (updateLookAt)
             {
-                glm::vec3 toLookAt = mBase.target - mBase.translation;
-                mBase.target = translation + toLookAt;
+                glm::vec3 toLookAt = base.target - base.translation;
+                base.target = translation + toLookAt;
             }
 
-            mBase.translation = translation;
-            mBase.matrixDirty = true;
+            base.translation = translation;
+            mpStore->setBaseParams(mSlot, base);
         };
 
         /** Gets the position/translation of the instance
             \return Translation of the instance
         */
-        const glm::vec3& getTranslation() const { return mBase.translation; };
+        glm::vec3 getTranslation() const { return getBase().translation; };
 
         /** Sets scale of the instance
             \param[in] scaling Instance scale
         */
-        void setScaling(const glm::vec3& scaling) { mBase.scale = scaling; mBase.matrixDirty = true; }
+        void setScaling(const glm::vec3& scaling)
+        {
+            InstanceStore::TransformParams base = getBase();
+            base.scale = scaling;
+            mpStore->setBaseParams(mSlot, base);
+        }
 
         /** Gets scale of the instance
             \return Scale of the instance
         */
-        const glm::vec3& getScaling() const { return mBase.scale; }
+        glm::vec3 getScaling() const { return getBase().scale; }
 
         /** Sets orientation of the instance
             \param[in] yawPitchRoll Yaw-Pitch-Roll rotation in radians
@@ -154,10 +162,11 @@ namespace Falcor
             const glm::mat3 rotMtx(glm::yawPitchRoll(yawPitchRoll[0], yawPitchRoll[1], yawPitchRoll[2]));
 
             // Get look-at info
-            mBase.up = rotMtx[1];
-            mBase.target = mBase.translation + rotMtx[2]; // position + forward
+            InstanceStore::TransformParams base = getBase();
+            base.up = rotMtx[1];
+            base.target = base.translation + rotMtx[2]; // position + forward
 
-            mBase.matrixDirty = true;
+            mpStore->setBaseParams(mSlot, base);
         }
 
         /** Gets rotation for the instance
@@ -167,7 +176,8 @@ namespace Falcor
         {
             glm::vec3 result;
 
-            glm::mat4 rotationMtx = createMatrixFromLookAt(mBase.translation, mBase.target, mBase.up);
+            const InstanceStore::TransformParams& base = getBase();
+            glm::mat4 rotationMtx = createMatrixFromLookAt(base.translation, base.target, base.up);
             glm::extractEulerAngleXYZ(rotationMtx, result[1], result[0], result[2]); // YawPitchRoll is YXZ
 
             return result;
@@ -175,55 +185,90 @@ namespace Falcor
 
         /** Sets the up vector orientation
         */
-        void setUpVector(const glm::vec3& up) { mBase.up = glm::normalize(up); mBase.matrixDirty = true; }
+        void setUpVector(const glm::vec3& up)
+        {
+            InstanceStore::TransformParams base = getBase();
+            base.up = glm::normalize(up);
+            mpStore->setBaseParams(mSlot, base);
+        }
 
         /** Sets the look-at target
         */
-        void setTarget(const glm::vec3& target) { mBase.target = target; mBase.matrixDirty = true; }
+        void setTarget(const glm::vec3& target)
+        {
+            InstanceStore::TransformParams base = getBase();
+            base.target = target;
+            mpStore->setBaseParams(mSlot, base);
+        }
 
         /** Gets the up vector of the instance
             \return Up vector
         */
-        const glm::vec3& getUpVector() const { return mBase.up; }
+        glm::vec3 getUpVector() const { return getBase().up; }
 
         /** Gets look-at target of the instance's orientation
             \return Look-at target position
         */
-        const glm::vec3& getTarget() const { return mBase.target; }
+        glm::vec3 getTarget() const { return getBase().target; }
 
         /** Gets the transform matrix
             \return Transform matrix
         */
-        const glm::mat4& getTransformMatrix() const
+        glm::mat4 getTransformMatrix() const
         {
-            updateInstanceProperties();
-            return mFinalTransformMatrix;
+            mpStore->updateSlot(mSlot);
+            return mpStore->getTransformMatrix(mSlot);
         }
 
-        const glm::mat4& getPrevTransformMatrix() const
+        glm::mat4 getPrevTransformMatrix() const
+        {
+            mpStore->updateSlot(mSlot);
+            return mpStore->getPrevTransformMatrix(mSlot);
+        }
+
+        /** Gets the inverse transpose of the transform matrix, for transforming normals
+        */
+        glm::mat3x4 getNormalMatrix() const
         {
-            updateInstanceProperties();
-            return mPrevFinalTransformMatrix;
+            mpStore->updateSlot(mSlot);
+            return mpStore->getNormalMatrix(mSlot);
         }
 
         /** Gets the bounding box
             \return Bounding box
         */
-        const BoundingBox& getBoundingBox() const
+        BoundingBox getBoundingBox() const
+        {
+            mpStore->updateSlot(mSlot);
+            return mpStore->getBoundingBox(mSlot);
+        }
+
+        /** Gets the index of the instance's slot in the instance store
+        */
+        uint32_t getInstanceSlot() const { return mSlot; }
+
+        /** Gets the store holding the transforms of all the instances of this object type
+        */
+        static const InstanceStore::SharedPtr& getInstanceStore()
+        {
+            static const InstanceStore::SharedPtr spStore = InstanceStore::create();
+            return spStore;
+        }
+
+        ~ObjectInstance()
         {
-            updateInstanceProperties();
-            return mBoundingBox;
+            mpStore->releaseSlot(mSlot);
         }
 
         /** IMovableObject interface
         */
         virtual void move(const glm::vec3& position, const glm::vec3& target, const glm::vec3& up) override
         {
-            mMovable.translation = position;
-            mMovable.target = target;
-            mMovable.up = up;
-            mMovable.scale = glm::vec3(1.0f);
-            mMovable.matrixDirty = true;
+            InstanceStore::TransformParams movable;
+            movable.translation = position;
+            movable.target = target;
+            movable.up = up;
+            mpStore->setMovableParams(mSlot, movable);
         }
 
         SharedPtr shared_from_this()
@@ -236,103 +281,53 @@ namespace Falcor
             return inherit_shared_from_this < IMovableObject, ObjectInstance>::shared_from_this();
         }
     private:
+        const InstanceStore::TransformParams& getBase() const { return mpStore->getBaseParams(mSlot); }
 
-        void updateInstanceProperties() const
-        {
-            if (mBase.matrixDirty || mMovable.matrixDirty)
-            {
-                if (mBase.matrixDirty)
-                {
-                    mBase.matrix = calculateTransformMatrix(mBase.translation, mBase.target, mBase.up, mBase.scale);
-                    mBase.matrixDirty = false;
-                }
-
-                if (mMovable.matrixDirty)
-                {
-                    mPrevMovable = mMovable;
-                    mMovable.matrix = calculateTransformMatrix(mMovable.translation, mMovable.target, mMovable.up, mMovable.scale);
-                    mMovable.matrixDirty = false;
-                }
-
-                mFinalTransformMatrix = mMovable.matrix * mBase.matrix;
-                mPrevFinalTransformMatrix = mPrevMovable.matrix * mBase.matrix;
-
-                mBoundingBox = mpObject->getBoundingBox().transform(mFinalTransformMatrix);
-            }
-        }
-
-        static glm::mat4 calculateTransformMatrix(const glm::vec3& translation, const glm::vec3& target, const glm::vec3& up, const glm::vec3& scale)
+        ObjectInstance(const typename ObjectType::SharedPtr& pObject, const std::string& name)
+            : mpObject(pObject), mName(name), mpStore(getInstanceStore())
         {
-            glm::mat4 translationMtx = glm::translate(glm::mat4(), translation);
-            glm::mat4 rotationMtx = createMatrixFromLookAt(translation, target, up);
-            glm::mat4 scalingMtx = glm::scale(glm::mat4(), scale);
-
-            return translationMtx * rotationMtx * scalingMtx;
+            mSlot = mpStore->allocateSlot(pObject->getBoundingBox());
         }
 
-        static glm::mat4 calculateTransformMatrix(const glm::vec3& translation, const glm::vec3& yawPitchRoll, const glm::vec3& scale)
-        {
-            glm::mat4 translationMtx = glm::translate(glm::mat4(), translation);
-            glm::mat4 rotationMtx = glm::yawPitchRoll(yawPitchRoll[0], yawPitchRoll[1], yawPitchRoll[2]);
-            glm::mat4 scalingMtx = glm::scale(glm::mat4(), scale);
-
-            return translationMtx * rotationMtx * scalingMtx;
-        }
-
-        ObjectInstance(const typename ObjectType::SharedPtr& pObject, const std::string& name)
-            : mpObject(pObject), mName(name) { }
+        ObjectInstance(const ObjectInstance&) = delete;
+        ObjectInstance& operator=(const ObjectInstance&) = delete;
 
         ObjectInstance(const typename ObjectType::SharedPtr& pObject, const glm::mat4& baseTransform, const std::string& name)
             : ObjectInstance(pObject, name)
         {
             // #TODO Decompose matrix
 
-            mBase.matrix = baseTransform;
-            mBase.matrixDirty = false;
+            mpStore->setBaseMatrix(mSlot, baseTransform);
         }
 
         ObjectInstance(const typename ObjectType::SharedPtr& pObject, const glm::vec3& translation, const glm::vec3& target, const glm::vec3& up, const glm::vec3& scale, const std::string& name = "")
             : ObjectInstance(pObject, name)
         {
-            mBase.translation = translation;
-            mBase.target = target;
-            mBase.up = up;
-            mBase.scale = scale;
+            InstanceStore::TransformParams base;
+            base.translation = translation;
+            base.target = target;
+            base.up = up;
+            base.scale = scale;
+            mpStore->setBaseParams(mSlot, base);
         }
 
         ObjectInstance(const typename ObjectType::SharedPtr& pObject, const glm::vec3& translation, const glm::vec3& yawPitchRoll, const glm::vec3& scale, const std::string& name = "")
             : ObjectInstance(pObject, name)
         {
-            mBase.translation = translation;
+            InstanceStore::TransformParams base;
+            base.translation = translation;
+            base.scale = scale;
+            mpStore->setBaseParams(mSlot, base);
             setRotation(yawPitchRoll);
-            mBase.scale = scale;
         }
 
         friend class Model;
 
-        std::string mName;
-        bool mVisible = true;
-
         typename ObjectType::SharedPtr mpObject;
+        std::string mName;
 
-        struct Transform
-        {
-            glm::vec3 translation;
-            glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
-            glm::vec3 target = glm::vec3(0.0f, 0.0f, 1.0f);
-            glm::vec3 scale = glm::vec3(1.0f);
-
-            // Matrix containing the above transforms
-            glm::mat4 matrix;
-            bool matrixDirty = true;
-        };
-
-        mutable Transform mBase;
-        mutable Transform mMovable;
-        mutable Transform mPrevMovable;
-
-        mutable glm::mat4 mFinalTransformMatrix;
-        mutable glm::mat4 mPrevFinalTransformMatrix;
-        mutable BoundingBox mBoundingBox;
+        // Keeps the store alive until the last instance is released
+        InstanceStore::SharedPtr mpStore;
+        uint32_t mSlot;
     };
 }
@@ -34,10 +34,14 @@
 #include "Utils/Platform/OS.h"
 #include "API/Shader.h"
 #include "Graphics/Program/ProgramVersion.h"
+#include "Graphics/Program/ProgramCache.h"
 #include "API/Texture.h"
 #include "API/Sampler.h"
 #include "API/RenderContext.h"
 #include "Utils/StringUtils.h"
+#include <thread>
+#include <condition_variable>
+#include <deque>
 
 namespace Falcor
 {
@@ -48,6 +52,101 @@ namespace Falcor
         return pShader;
     }
 
+    /** Pool of threads which compile program versions in the background
+    */
+    class AsyncCompiler
+    {
+    public:
+        using Job = std::function<void()>;
+
+        static AsyncCompiler& get()
+        {
+            static AsyncCompiler compiler;
+            return compiler;
+        }
+
+        void queue(const Job& job)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if(mThreads.empty())
+            {
+                // Leave one core for the rendering thread
+                uint32_t threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+                for(uint32_t i = 0; i < threadCount; i++)
+                {
+                    mThreads.push_back(std::thread(&AsyncCompiler::workerThread, this));
+                }
+            }
+            mJobs.push_back(job);
+            mPendingCount++;
+            mJobAvailable.notify_one();
+        }
+
+        uint32_t getPendingCount()
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            return mPendingCount;
+        }
+
+        void waitForAll()
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mAllDone.wait(lock, [this] { return mPendingCount == 0; });
+        }
+
+        ~AsyncCompiler()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mJobs.clear();
+                mTerminate = true;
+            }
+            mJobAvailable.notify_all();
+            for(auto& t : mThreads)
+            {
+                t.join();
+            }
+        }
+
+    private:
+        AsyncCompiler() = default;
+
+        void workerThread()
+        {
+            while(true)
+            {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(mMutex);
+                    mJobAvailable.wait(lock, [this] { return mTerminate || mJobs.size(); });
+                    if(mTerminate)
+                    {
+                        return;
+                    }
+                    job = mJobs.front();
+                    mJobs.pop_front();
+                }
+
+                job();
+
+                std::lock_guard<std::mutex> lock(mMutex);
+                mPendingCount--;
+                if(mPendingCount == 0)
+                {
+                    mAllDone.notify_all();
+                }
+            }
+        }
+
+        std::mutex mMutex;
+        std::condition_variable mJobAvailable;
+        std::condition_variable mAllDone;
+        std::deque<Job> mJobs;
+        std::vector<std::thread> mThreads;
+        uint32_t mPendingCount = 0;     // Queued and running jobs
+        bool mTerminate = false;
+    };
+
     Program::Desc::Desc()
     {}
 
@@ -181,31 +280,24 @@ namespace Falcor
 
     void Program::addDefine(const std::string& name, const std::string& value)
     {
-        // Make sure that it doesn't exist already
-        if(mDefineList.find(name) != mDefineList.end())
+        if(mDefineList.add(name, value))
         {
-            if(mDefineList[name] == value)
-            {
-                // Same define
-                return;
-            }
+            mLinkRequired = true;
         }
-        mLinkRequired = true;
-        mDefineList[name] = value;
     }
 
     void Program::removeDefine(const std::string& name)
     {
-        if(mDefineList.find(name) != mDefineList.end())
+        if(mDefineList.remove(name))
         {
             mLinkRequired = true;
-            mDefineList.erase(name);
         }
     }
 
     bool Program::checkIfFilesChanged()
     {
-        if(mpActiveProgram == nullptr)
+        std::lock_guard<std::mutex> lock(mVersionsMutex);
+        if(mProgramVersions.empty())
         {
             // We never linked, so nothing really changed
             return false;
@@ -229,28 +321,137 @@ namespace Falcor
     {
         if(mLinkRequired)
         {
+            std::unique_lock<std::mutex> lock(mVersionsMutex);
             const auto& it = mProgramVersions.find(mDefineList);
-            ProgramVersion::SharedConstPtr pVersion = nullptr;
-            if(it == mProgramVersions.end())
+            if(it != mProgramVersions.end())
+            {
+                mpActiveProgram = it->second;
+                mLinkRequired = false;
+            }
+            else if(mCompileMode == CompileMode::Sync)
             {
+                // Don't block the compilation threads while compiling
+                lock.unlock();
                 if(link() == false)
                 {
                     return nullptr;
                 }
-                else
-                {
-                    mProgramVersions[mDefineList] = mpActiveProgram;
-                }
+                lock.lock();
+                mProgramVersions[mDefineList] = mpActiveProgram;
+                mPendingVersions.erase(mDefineList);
+                mLinkRequired = false;
             }
             else
             {
-                mpActiveProgram = mProgramVersions[mDefineList];
+                queueCompilation(mDefineList);
+                return (mCompileMode == CompileMode::AsyncFallback) ? getFallbackVersion() : nullptr;
             }
         }
 
         return mpActiveProgram;
     }
 
+    bool Program::isActiveVersionReady() const
+    {
+        std::lock_guard<std::mutex> lock(mVersionsMutex);
+        return mProgramVersions.find(mDefineList) != mProgramVersions.end();
+    }
+
+    void Program::setFallbackDefines(const DefineList& defines)
+    {
+        std::lock_guard<std::mutex> lock(mVersionsMutex);
+        mFallbackDefines = defines;
+        mHasFallbackDefines = true;
+    }
+
+    void Program::setCompilationCallback(const CompilationCallback& callback)
+    {
+        std::lock_guard<std::mutex> lock(mVersionsMutex);
+        mCompilationCallback = callback;
+    }
+
+    void Program::prewarm(const std::vector<DefineList>& defineLists) const
+    {
+        std::lock_guard<std::mutex> lock(mVersionsMutex);
+        for(const auto& defines : defineLists)
+        {
+            queueCompilation(defines);
+        }
+    }
+
+    uint32_t Program::getPendingCompilationCount()
+    {
+        return AsyncCompiler::get().getPendingCount();
+    }
+
+    void Program::waitForPendingCompilations()
+    {
+        AsyncCompiler::get().waitForAll();
+    }
+
+    ProgramVersion::SharedConstPtr Program::getFallbackVersion() const
+    {
+        if(mHasFallbackDefines)
+        {
+            const auto& it = mProgramVersions.find(mFallbackDefines);
+            if(it != mProgramVersions.end())
+            {
+                return it->second;
+            }
+            queueCompilation(mFallbackDefines);
+        }
+        return mpActiveProgram;
+    }
+
+    void Program::queueCompilation(const DefineList& defines) const
+    {
+        if(mProgramVersions.find(defines) != mProgramVersions.end() || mPendingVersions.find(defines) != mPendingVersions.end() || mFailedVersions.find(defines) != mFailedVersions.end())
+        {
+            return;
+        }
+        mPendingVersions.insert(defines);
+
+        // The job keeps the program alive until it's done
+        std::shared_ptr<const Program> pThis = shared_from_this();
+        uint64_t generation = mGeneration;
+        AsyncCompiler::get().queue([pThis, defines, generation]() { pThis->compileAsync(defines, generation); });
+    }
+
+    void Program::compileAsync(const DefineList& defines, uint64_t generation) const
+    {
+        std::string log;
+        string_time_map fileTimes;
+        ProgramVersion::SharedConstPtr pVersion = preprocessAndCreateProgramVersion(defines, log, fileTimes);
+
+        CompilationCallback callback;
+        {
+            std::lock_guard<std::mutex> lock(mVersionsMutex);
+            if(generation != mGeneration)
+            {
+                // The program was reloaded while we were compiling
+                return;
+            }
+
+            mPendingVersions.erase(defines);
+            if(pVersion)
+            {
+                mProgramVersions[defines] = pVersion;
+                mFileTimeMap.insert(fileTimes.begin(), fileTimes.end());
+            }
+            else
+            {
+                mFailedVersions.insert(defines);
+                logError("Program Linkage failed.\n\n" + getProgramDescString() + "\n" + log);
+            }
+            callback = mCompilationCallback;
+        }
+
+        if(callback)
+        {
+            callback(defines, pVersion != nullptr);
+        }
+    }
+
     SlangSession* getSlangSession()
     {
         // TODO: figure out a strategy for finalizing the Slang session, if desired
@@ -264,7 +465,7 @@ namespace Falcor
         spAddBuiltins(getSlangSession(), name, text);
     }
 
-    static const char* getSlangTargetString(ShaderType type)
+    const char* Program::getSlangProfile(ShaderType type)
     {
         // TODO: either pick these based on target API,
         // or invent some API-neutral target names
@@ -288,9 +489,33 @@ namespace Falcor
         }
     }
 
-    ProgramVersion::SharedPtr Program::preprocessAndCreateProgramVersion(std::string& log) const
+    ProgramVersion::SharedPtr Program::preprocessAndCreateProgramVersion(const DefineList& defines, std::string& log, string_time_map& fileTimes) const
     {
-        mFileTimeMap.clear();
+        // Look for the compiled program in the persistent cache. Intermediates are produced by the compiler, so dumping them bypasses the cache.
+        bool useCache = ProgramCache::isEnabled() && (is_set(mDesc.getCompilerFlags(), Shader::CompilerFlags::DumpIntermediates) == false);
+        std::string cacheKey = useCache ? ProgramCache::computeKey(mDesc, defines) : "";
+        if (cacheKey.size())
+        {
+            Shader::Blob cachedBlob[kShaderCount];
+            std::vector<std::string> dependencies;
+            ProgramReflection::SharedPtr pReflector = ProgramCache::load(cacheKey, cachedBlob, dependencies);
+            if (pReflector)
+            {
+                std::string cacheLog;
+                ProgramVersion::SharedPtr pVersion = createProgramVersion(cacheLog, cachedBlob, pReflector);
+                if (pVersion)
+                {
+                    for (const auto& depFilePath : dependencies)
+                    {
+                        fileTimes[depFilePath] = getFileModifiedTime(depFilePath);
+                    }
+                    ProgramCache::recordHit();
+                    return pVersion;
+                }
+                ProgramCache::discard(cacheKey);
+            }
+            ProgramCache::recordMiss();
+        }
 
         // Run all of the shaders through Slang, so that we can get final code,
         // reflection data, etc.
@@ -298,6 +523,10 @@ namespace Falcor
         // Note that we provide all the shaders at once, so that automatically
         // generated bindings can be made consistent across the stages.
 
+        // Slang sessions are not thread-safe, so only one program is run through Slang at a time.
+        // The downstream compilation in createProgramVersion() is done outside the lock.
+        static std::mutex slangMutex;
+        std::unique_lock<std::mutex> slangLock(slangMutex);
         SlangSession* slangSession = getSlangSession();
 
         // Start building a request for compilation
@@ -318,7 +547,7 @@ namespace Falcor
 
         // Pass any `#define` flags along to Slang, since we aren't doing our
         // own preprocessing any more.
-        for(auto shaderDefine : mDefineList)
+        for(auto shaderDefine : defines)
         {
             spAddPreprocessorDefine(slangRequest, shaderDefine.first.c_str(), shaderDefine.second.c_str());
         }
@@ -415,7 +644,7 @@ namespace Falcor
                 slangRequest,
                 entryPoint.sourceIndex,
                 entryPoint.name.c_str(),
-                spFindProfile(slangSession, getSlangTargetString(ShaderType(i))));
+                spFindProfile(slangSession, getSlangProfile(ShaderType(i))));
         }
 
         int anySlangErrors = spCompile(slangRequest);
@@ -453,24 +682,45 @@ namespace Falcor
         }
 
         // Extract the reflection data
-        mPreprocessedReflector = ProgramReflection::create(slang::ShaderReflection::get(slangRequest), log);
+        ProgramReflection::SharedPtr pReflector = ProgramReflection::create(slang::ShaderReflection::get(slangRequest), log);
 
         // Extract list of files referenced, for dependency-tracking purposes
+        std::vector<std::string> dependencies;
         int depFileCount = spGetDependencyFileCount(slangRequest);
         for(int ii = 0; ii < depFileCount; ++ii)
         {
             std::string depFilePath = spGetDependencyFilePath(slangRequest, ii);
-            mFileTimeMap[depFilePath] = getFileModifiedTime(depFilePath);
+            fileTimes[depFilePath] = getFileModifiedTime(depFilePath);
+            dependencies.push_back(depFilePath);
         }
 
         spDestroyCompileRequest(slangRequest);
+        slangLock.unlock();
 
         // Now that we've preprocessed things, dispatch to the actual program creation logic,
         // which may vary in subclasses of `Program`
-        return createProgramVersion(log, shaderBlob);
+        ProgramVersion::SharedPtr pVersion = createProgramVersion(log, shaderBlob, pReflector);
+
+        if (pVersion && cacheKey.size())
+        {
+#ifdef FALCOR_D3D
+            // Store the DXBC rather than the HLSL, so that loading from the cache skips the HLSL compiler as well
+            for (uint32_t i = 0; i < kShaderCount; i++)
+            {
+                const Shader* pShader = pVersion->getShader(ShaderType(i));
+                if (pShader == nullptr) continue;
+                ID3DBlobPtr pBlob = pShader->getD3DBlob();
+                const uint8_t* pCode = (const uint8_t*)pBlob->GetBufferPointer();
+                shaderBlob[i].data.assign(pCode, pCode + pBlob->GetBufferSize());
+                shaderBlob[i].type = Shader::Blob::Type::Bytecode;
+            }
+#endif
+            ProgramCache::store(cacheKey, shaderBlob, dependencies, pReflector.get());
+        }
+        return pVersion;
     }
 
-    ProgramVersion::SharedPtr Program::createProgramVersion(std::string& log, const Shader::Blob shaderBlob[kShaderCount]) const
+    ProgramVersion::SharedPtr Program::createProgramVersion(std::string& log, const Shader::Blob shaderBlob[kShaderCount], const ProgramReflection::SharedPtr& pReflector) const
     {
         // create the shaders
         Shader::SharedPtr shaders[kShaderCount] = {};
@@ -486,13 +736,13 @@ namespace Falcor
         if (shaders[(uint32_t)ShaderType::Compute])
         {
             return ProgramVersion::create(
-                mPreprocessedReflector,
+                pReflector,
                 shaders[(uint32_t)ShaderType::Compute], log, getProgramDescString());
         }
         else
         {
             return ProgramVersion::create(
-                mPreprocessedReflector,
+                pReflector,
                 shaders[(uint32_t)ShaderType::Vertex],
                 shaders[(uint32_t)ShaderType::Pixel],
                 shaders[(uint32_t)ShaderType::Geometry],
@@ -510,7 +760,8 @@ namespace Falcor
         {
             // create the program
             std::string log;
-            ProgramVersion::SharedConstPtr pProgram = preprocessAndCreateProgramVersion(log);
+            string_time_map fileTimes;
+            ProgramVersion::SharedConstPtr pProgram = preprocessAndCreateProgramVersion(mDefineList, log, fileTimes);
 
             if(pProgram == nullptr)
             {
@@ -526,6 +777,8 @@ namespace Falcor
             }
             else
             {
+                std::lock_guard<std::mutex> lock(mVersionsMutex);
+                mFileTimeMap.insert(fileTimes.begin(), fileTimes.end());
                 mpActiveProgram = pProgram;
                 return true;
             }
@@ -534,9 +787,13 @@ namespace Falcor
 
     void Program::reset()
     {
+        std::lock_guard<std::mutex> lock(mVersionsMutex);
         mpActiveProgram = nullptr;
         mProgramVersions.clear();
+        mPendingVersions.clear();
+        mFailedVersions.clear();
         mFileTimeMap.clear();
+        mGeneration++;
         mLinkRequired = true;
     }
 
@@ -29,6 +29,10 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <functional>
 #include "Graphics/Program//ProgramVersion.h"
 
 namespace Falcor
@@ -50,6 +54,21 @@ namespace Falcor
 
         using DefineList = Shader::DefineList;
 
+        /** Controls what getActiveVersion() does when the version for the current define list wasn't compiled yet
+        */
+        enum class CompileMode
+        {
+            Sync,           ///< Compile the version on the calling thread. This is the default.
+            AsyncFallback,  ///< Queue the version for compilation on a worker thread. Until it's ready, return the fallback version (see setFallbackDefines()).
+            AsyncSkip,      ///< Queue the version for compilation on a worker thread. Until it's ready, return nullptr. Callers should skip the draw or dispatch.
+        };
+
+        /** Callback invoked when an asynchronous compilation finishes. It's called from the compilation thread, after the version was made available.
+            \param[in] defines The define list of the version
+            \param[in] succeeded Whether the compilation succeeded. Failed versions are not queued again until the program is reloaded.
+        */
+        using CompilationCallback = std::function<void(const DefineList& defines, bool succeeded)>;
+
         /** Description of a program to be created.
         */
         class Desc
@@ -128,6 +147,7 @@ namespace Falcor
         private:
             friend class Program;
             friend class GraphicsProgram;
+            friend class ProgramCache;
 
             /** A chunk of course code, either from a file or a string
             */
@@ -203,7 +223,7 @@ namespace Falcor
 
         /** Clear the macro definition list
         */
-        void clearDefines() { mDefineList.clear(); }
+        void clearDefines() { mDefineList.clear(); mLinkRequired = true; }
     
         /** Get the macro definition string of the active program version
         */
@@ -215,36 +235,87 @@ namespace Falcor
 
         /** Update define list
         */
-        void replaceAllDefines(const DefineList& dl) { mDefineList = dl; }
+        void replaceAllDefines(const DefineList& dl) { mDefineList = dl; mLinkRequired = true; }
+
+        /** Set how missing versions are compiled
+        */
+        void setCompileMode(CompileMode mode) { mCompileMode = mode; }
+
+        /** Get how missing versions are compiled
+        */
+        CompileMode getCompileMode() const { return mCompileMode; }
+
+        /** Set the define list of the version getActiveVersion() returns in CompileMode::AsyncFallback while the requested version is compiling.
+            The fallback version is queued for compilation if it's missing. If it's not ready either, the last version which was active is returned.
+        */
+        void setFallbackDefines(const DefineList& defines);
+
+        /** Set a callback to invoke when asynchronous compilations of this program finish
+        */
+        void setCompilationCallback(const CompilationCallback& callback);
+
+        /** Queue versions for compilation on the worker threads, regardless of the compile mode. Use this at startup to compile the permutations which will be needed later on.
+            Versions which were already compiled or queued are ignored.
+        */
+        void prewarm(const std::vector<DefineList>& defineLists) const;
+
+        /** Check if the version for the current define list was compiled
+        */
+        bool isActiveVersionReady() const;
+
+        /** Get the number of versions, across all programs, which are queued or being compiled on the worker threads
+        */
+        static uint32_t getPendingCompilationCount();
+
+        /** Block until all the queued compilations are finished
+        */
+        static void waitForPendingCompilations();
+
+        /** Get the Slang profile a shader stage is compiled with (for example "vs_5_0")
+        */
+        static const char* getSlangProfile(ShaderType type);
 
     protected:
         Program();
 
         void init(Desc const& desc, DefineList const& programDefines);
 
+        using string_time_map = std::unordered_map<std::string, time_t>;
+
         bool link() const;
-        ProgramVersion::SharedPtr preprocessAndCreateProgramVersion(std::string& log) const;
-        virtual ProgramVersion::SharedPtr createProgramVersion(std::string& log, const Shader::Blob shaderBlob[kShaderCount]) const;
+        ProgramVersion::SharedPtr preprocessAndCreateProgramVersion(const DefineList& defines, std::string& log, string_time_map& fileTimes) const;
+        virtual ProgramVersion::SharedPtr createProgramVersion(std::string& log, const Shader::Blob shaderBlob[kShaderCount], const ProgramReflection::SharedPtr& pReflector) const;
+
+        // Asynchronous compilation. These expect mVersionsMutex to be locked.
+        void queueCompilation(const DefineList& defines) const;
+        ProgramVersion::SharedConstPtr getFallbackVersion() const;
+        void compileAsync(const DefineList& defines, uint64_t generation) const;
 
         // The description used to create this program
         Desc mDesc;
 
-        // Shader strings after being preprocessed for a particular version
-
-        // Reflector for a particular version
-        mutable ProgramReflection::SharedPtr mPreprocessedReflector;
-
         DefineList mDefineList;
 
         // We are doing lazy compilation, so these are mutable
-        mutable bool mLinkRequired = true;
-        mutable std::map<const DefineList, ProgramVersion::SharedConstPtr> mProgramVersions;
+        using VersionMap = std::unordered_map<DefineList, ProgramVersion::SharedConstPtr, DefineList::HashFunc>;
+        using DefineListSet = std::unordered_set<DefineList, DefineList::HashFunc>;
+        mutable bool mLinkRequired = true;  // Set when the define list changed since the active version was looked up
+        mutable VersionMap mProgramVersions;
         mutable ProgramVersion::SharedConstPtr mpActiveProgram = nullptr;
 
+        // Versions are published by the compilation threads, so the version map, the file-time map and the asynchronous compilation state are protected by this mutex
+        mutable std::mutex mVersionsMutex;
+        CompileMode mCompileMode = CompileMode::Sync;
+        DefineList mFallbackDefines;
+        bool mHasFallbackDefines = false;
+        CompilationCallback mCompilationCallback;
+        mutable DefineListSet mPendingVersions;
+        mutable DefineListSet mFailedVersions;
+        mutable uint64_t mGeneration = 0;   // Incremented by reset(), so that compilations queued before it are discarded
+
         std::string getProgramDescString() const;
         static std::vector<Program*> sPrograms;
 
-        using string_time_map = std::unordered_map<std::string, time_t>;
         mutable string_time_map mFileTimeMap;
 
         bool checkIfFilesChanged();
@@ -0,0 +1,407 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Framework.h"
+#include "ProgramCache.h"
+#include "Utils/Platform/OS.h"
+#include "Utils/BinaryFileStream.h"
+#include "Utils/HashUtils.h"
+#include "Externals/Slang/slang.h"
+#include <mutex>
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+
+namespace Falcor
+{
+    // Bump this when the compilation pipeline or the reflection layout changes in a way that makes existing entries stale
+    static const uint32_t kCacheVersion = 2;
+    static const char kEntryMagic[8] = { 'F', 'a', 'l', 'c', 'o', 'r', 'P', 'C' };
+
+    struct FileHash
+    {
+        time_t modifiedTime = 0;
+        uint64_t size = 0;
+        uint64_t hash = 0;
+    };
+
+    struct ProgramCacheState
+    {
+        std::mutex mutex;
+        bool enabled = true;
+        std::string directory;
+        ProgramCache::Statistics stats;
+
+        // Hashes of the files we already read, so that shared headers are only hashed once per modification
+        std::unordered_map<std::string, FileHash> fileHashes;
+    };
+
+    static ProgramCacheState& getState()
+    {
+        static ProgramCacheState state;
+        return state;
+    }
+
+    // Expects the state's mutex to be locked
+    static const std::string& getCacheDirectory(ProgramCacheState& state)
+    {
+        if(state.directory.empty())
+        {
+            state.directory = getExecutableDirectory() + "/ProgramCache";
+        }
+        return state.directory;
+    }
+
+    static std::string getEntryPath(const std::string& key)
+    {
+        ProgramCacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        return getCacheDirectory(state) + "/" + key + ".bin";
+    }
+
+    static bool hashFile(const std::string& path, uint64_t& hash)
+    {
+        ProgramCacheState& state = getState();
+        // The modification time has a coarse resolution, so check the size as well to catch quick successive edits
+        std::error_code err;
+        time_t modifiedTime = getFileModifiedTime(path);
+        uint64_t size = (uint64_t)fs::file_size(path, err);
+        if(err)
+        {
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            auto it = state.fileHashes.find(path);
+            if(it != state.fileHashes.end() && it->second.modifiedTime == modifiedTime && it->second.size == size)
+            {
+                hash = it->second.hash;
+                return true;
+            }
+        }
+
+        std::ifstream file(path, std::ios::binary);
+        if(file.fail())
+        {
+            return false;
+        }
+        std::stringstream content;
+        content << file.rdbuf();
+        hash = hashString(content.str());
+
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.fileHashes[path] = { modifiedTime, size, hash };
+        return true;
+    }
+
+    std::string ProgramCache::computeKey(const Program::Desc& desc, const Program::DefineList& defines)
+    {
+        uint64_t hash = kHashSeed;
+        uint32_t header[] = { kCacheVersion, (uint32_t)desc.getCompilerFlags(), (uint32_t)desc.mSources.size() };
+        hash = hashBytes(header, sizeof(header), hash);
+
+        // The compiler build. A different Slang version can generate different code from the same sources.
+        const char* slangBuildTag = spGetBuildTagString();
+        hash = hashString(slangBuildTag ? slangBuildTag : "", hash);
+
+        // The compilation target and configuration
+#ifdef FALCOR_VK
+        hash = hashString("SPIRV", hash);
+#elif defined FALCOR_D3D
+        hash = hashString("DXBC", hash);
+#endif
+#ifdef _DEBUG
+        hash = hashString("Debug", hash);
+#endif
+
+        // The search paths determine which files are included
+        for(const auto& dir : getDataDirectoriesList())
+        {
+            hash = hashString(dir, hash);
+        }
+
+        for(const auto& source : desc.mSources)
+        {
+            if(source.kind == Program::Desc::Source::Kind::File)
+            {
+                std::string fullpath;
+                uint64_t fileHash;
+                if(findFileInDataDirectories(source.value, fullpath) == false || hashFile(fullpath, fileHash) == false)
+                {
+                    return "";
+                }
+                // The extension selects the source language
+                hash = hashString(fs::path(fullpath).extension().string(), hash);
+                hash = hashBytes(&fileHash, sizeof(fileHash), hash);
+            }
+            else
+            {
+                hash = hashString(source.value, hash);
+            }
+        }
+
+        for(uint32_t i = 0; i < kShaderCount; i++)
+        {
+            const auto& entryPoint = desc.mEntryPoints[i];
+            hash = hashBytes(&entryPoint.sourceIndex, sizeof(entryPoint.sourceIndex), hash);
+            hash = hashString(entryPoint.name, hash);
+
+            // The shader model of each stage
+            hash = hashString(Program::getSlangProfile(ShaderType(i)), hash);
+#ifdef FALCOR_D3D
+            hash = hashString(Shader::getTargetProfile(ShaderType(i)), hash);
+#endif
+        }
+
+        for(const auto& define : defines)
+        {
+            hash = hashString(define.first, hash);
+            hash = hashString(define.second, hash);
+        }
+
+        char key[32];
+        snprintf(key, arraysize(key), "%016llx", (unsigned long long)hash);
+        return key;
+    }
+
+    static bool readString(BinaryFileStream& stream, std::string& str)
+    {
+        uint32_t size = 0;
+        stream >> size;
+        if(stream.isFail() || size > stream.getRemainingStreamSize()) return false;
+        str.resize(size);
+        stream.read(&str[0], size);
+        return stream.isFail() == false;
+    }
+
+    static void writeString(BinaryFileStream& stream, const std::string& str)
+    {
+        stream << (uint32_t)str.size();
+        stream.write(str.data(), str.size());
+    }
+
+    ProgramReflection::SharedPtr ProgramCache::load(const std::string& key, Shader::Blob shaderBlob[kShaderCount], std::vector<std::string>& dependencies)
+    {
+        std::string entryPath = getEntryPath(key);
+        std::error_code err;
+        if(fs::exists(entryPath, err) == false)
+        {
+            return nullptr;
+        }
+
+        BinaryFileStream stream(entryPath, BinaryFileStream::Mode::Read);
+        size_t entrySize = stream.getRemainingStreamSize();
+        char magic[arraysize(kEntryMagic)];
+        uint32_t version = 0;
+        stream.read(magic, sizeof(magic));
+        stream >> version;
+        if(stream.isFail() || memcmp(magic, kEntryMagic, sizeof(magic)) || version != kCacheVersion)
+        {
+            discard(key);
+            return nullptr;
+        }
+
+        // If an included file changed, the entry is stale. It will be overwritten once the program is recompiled.
+        uint32_t dependencyCount = 0;
+        stream >> dependencyCount;
+        dependencies.clear();
+        for(uint32_t i = 0; i < dependencyCount; i++)
+        {
+            std::string path;
+            uint64_t storedHash = 0;
+            uint64_t currentHash = 0;
+            if(readString(stream, path) == false)
+            {
+                discard(key);
+                return nullptr;
+            }
+            stream >> storedHash;
+            if(hashFile(path, currentHash) == false || currentHash != storedHash)
+            {
+                return nullptr;
+            }
+            dependencies.push_back(path);
+        }
+
+        for(uint32_t i = 0; i < kShaderCount && stream.isFail() == false; i++)
+        {
+            uint64_t size = 0;
+            stream >> shaderBlob[i].type >> size;
+            if(stream.isFail() || size > stream.getRemainingStreamSize()) break;
+            shaderBlob[i].data.resize((size_t)size);
+            stream.read(shaderBlob[i].data.data(), (size_t)size);
+        }
+
+        ProgramReflection::SharedPtr pReflection = stream.isFail() ? nullptr : ProgramReflection::deserialize(stream);
+        if(pReflection == nullptr)
+        {
+            discard(key);
+            return nullptr;
+        }
+
+        ProgramCacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.stats.bytesRead += entrySize;
+        return pReflection;
+    }
+
+    void ProgramCache::store(const std::string& key, const Shader::Blob shaderBlob[kShaderCount], const std::vector<std::string>& dependencies, const ProgramReflection* pReflection)
+    {
+        std::string entryPath = getEntryPath(key);
+        std::error_code err;
+        fs::create_directories(fs::path(entryPath).parent_path(), err);
+
+        // Write to a temporary file first, so other processes never see a partially written entry
+        std::string tempPath = entryPath + ".tmp";
+        {
+            BinaryFileStream stream(tempPath, BinaryFileStream::Mode::Write);
+            stream.write(kEntryMagic, sizeof(kEntryMagic));
+            stream << kCacheVersion;
+
+            stream << (uint32_t)dependencies.size();
+            for(const auto& path : dependencies)
+            {
+                uint64_t hash = 0;
+                if(hashFile(path, hash) == false)
+                {
+                    // Can't validate the entry later on
+                    stream.remove();
+                    return;
+                }
+                writeString(stream, path);
+                stream << hash;
+            }
+
+            for(uint32_t i = 0; i < kShaderCount; i++)
+            {
+                stream << shaderBlob[i].type << (uint64_t)shaderBlob[i].data.size();
+                stream.write(shaderBlob[i].data.data(), shaderBlob[i].data.size());
+            }
+
+            pReflection->serialize(stream);
+            if(stream.isFail())
+            {
+                logWarning("Program cache: can't write entry " + tempPath);
+                stream.remove();
+                return;
+            }
+        }
+
+        fs::rename(tempPath, entryPath, err);
+        uint64_t size = err ? 0 : (uint64_t)fs::file_size(entryPath, err);
+        if(err)
+        {
+            logWarning("Program cache: can't create entry " + entryPath);
+            fs::remove(tempPath, err);
+            return;
+        }
+
+        ProgramCacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.stats.bytesWritten += size;
+    }
+
+    void ProgramCache::discard(const std::string& key)
+    {
+        logWarning("Program cache entry " + key + " is invalid. Recompiling the program.");
+        std::error_code err;
+        fs::remove(getEntryPath(key), err);
+    }
+
+    void ProgramCache::recordHit()
+    {
+        ProgramCacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.stats.hits++;
+    }
+
+    void ProgramCache::recordMiss()
+    {
+        ProgramCacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.stats.misses++;
+    }
+
+    void ProgramCache::setEnabled(bool enabled)
+    {
+        ProgramCacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.enabled = enabled;
+    }
+
+    bool ProgramCache::isEnabled()
+    {
+        ProgramCacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        return state.enabled;
+    }
+
+    void ProgramCache::setDirectory(const std::string& directory)
+    {
+        ProgramCacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.directory = directory;
+    }
+
+    std::string ProgramCache::getDirectory()
+    {
+        ProgramCacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        return getCacheDirectory(state);
+    }
+
+    ProgramCache::Statistics ProgramCache::getStatistics()
+    {
+        ProgramCacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        return state.stats;
+    }
+
+    void ProgramCache::resetStatistics()
+    {
+        ProgramCacheState& state = getState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.stats = Statistics();
+    }
+
+    void ProgramCache::clear()
+    {
+        std::string directory = getDirectory();
+        std::error_code err;
+        for(fs::directory_iterator it(directory, err), end; err.value() == 0 && it != end; it.increment(err))
+        {
+            if(it->path().extension() == ".bin")
+            {
+                std::error_code removeErr;
+                fs::remove(it->path(), removeErr);
+            }
+        }
+    }
+}
@@ -0,0 +1,107 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <string>
+#include <vector>
+#include "Program.h"
+
+namespace Falcor
+{
+    /** Persistent on-disk cache of compiled program versions.
+        Running a program through Slang (and on D3D, through the HLSL compiler) is the most expensive part of creating a program version. The first time a version is compiled, the per-stage shader code and the reflection data are written to the cache directory. Subsequent runs load them directly and skip the compilers.
+        The key is a hash of the program's sources (the contents of the source files, not their names), entry points, compiler flags, define list, the compilation target with the shader model of each stage, and the Slang build. Each entry also records the files included during compilation with the hash of their contents; the entry is only used if none of them changed.
+        Programs that request intermediate dumps bypass the cache, since dumps are produced by the compiler.
+        All the functions are thread-safe.
+    */
+    class ProgramCache
+    {
+    public:
+        struct Statistics
+        {
+            uint64_t hits = 0;          ///< Number of program versions loaded from the cache
+            uint64_t misses = 0;        ///< Number of program versions which were compiled
+            uint64_t bytesRead = 0;     ///< Total size of the entries loaded from the cache
+            uint64_t bytesWritten = 0;  ///< Total size of the entries added to the cache
+        };
+
+        /** Enable or disable the cache. The cache is enabled by default.
+        */
+        static void setEnabled(bool enabled);
+
+        /** Check if the cache is enabled
+        */
+        static bool isEnabled();
+
+        /** Set the directory where the cache entries are stored. By default, this is the 'ProgramCache' folder in the executable directory.
+        */
+        static void setDirectory(const std::string& directory);
+
+        /** Get the directory where the cache entries are stored
+        */
+        static std::string getDirectory();
+
+        /** Get the cache statistics
+        */
+        static Statistics getStatistics();
+
+        /** Reset the cache statistics
+        */
+        static void resetStatistics();
+
+        /** Remove all the entries from the cache directory
+        */
+        static void clear();
+
+    private:
+        friend class Program;
+        static const uint32_t kShaderCount = (uint32_t)ShaderType::Count;
+
+        /** Compute the key of a program version. Returns an empty string if one of the source files can't be read.
+        */
+        static std::string computeKey(const Program::Desc& desc, const Program::DefineList& defines);
+
+        /** Load an entry. Fails if the entry doesn't exist, is invalid, or if one of the files it depends on changed.
+            \param[in] key The entry key
+            \param[out] shaderBlob The code for each shader stage
+            \param[out] dependencies The files which were included when compiling the program
+            \return The program reflection, or nullptr if the entry can't be used
+        */
+        static ProgramReflection::SharedPtr load(const std::string& key, Shader::Blob shaderBlob[kShaderCount], std::vector<std::string>& dependencies);
+
+        /** Write an entry, replacing any existing entry with the same key
+        */
+        static void store(const std::string& key, const Shader::Blob shaderBlob[kShaderCount], const std::vector<std::string>& dependencies, const ProgramReflection* pReflection);
+
+        /** Remove an entry which was loaded but couldn't be used
+        */
+        static void discard(const std::string& key);
+
+        static void recordHit();
+        static void recordMiss();
+    };
+}
@@ -28,6 +28,7 @@
 #include "Framework.h"
 #include "ProgramReflection.h"
 #include "Utils/StringUtils.h"
+#include "Utils/BinaryFileStream.h"
 using namespace slang;
 
 namespace Falcor
@@ -629,7 +630,6 @@ namespace Falcor
 
     ProgramReflection::ProgramReflection(slang::ShaderReflection* pSlangReflector, std::string& log)
     {
-        ParameterBlockReflection::SharedPtr pDefaultBlock = ParameterBlockReflection::create("");
         for (uint32_t i = 0; i < pSlangReflector->getParameterCount(); i++)
         {
             VariableLayoutReflection* pSlangLayout = pSlangReflector->getParameterByIndex(i);
@@ -638,36 +638,13 @@ namespace Falcor
             // In GLSL, the varying (in/out) variables are reflected as globals. Ignore them, we will reflect them later
             if (pVar->getType()->unwrapArray()->asResourceType() == nullptr) continue;
 
-            if (pSlangLayout->getType()->unwrapArray()->getKind() == TypeReflection::Kind::ParameterBlock)
-            {
-                std::string name = std::string(pSlangLayout->getName());
-                ParameterBlockReflection::SharedPtr pBlock = ParameterBlockReflection::create(name);
-                pBlock->addResource(pVar);
-                pBlock->finalize();
-                addParameterBlock(pBlock);
-            }
-            else
-            {
-                pDefaultBlock->addResource(pVar);
-            }
+            GlobalResource res;
+            res.pVar = pVar;
+            res.isParameterBlock = (pSlangLayout->getType()->unwrapArray()->getKind() == TypeReflection::Kind::ParameterBlock);
+            mGlobalResources.push_back(res);
         }
 
-        pDefaultBlock->finalize();
-        addParameterBlock(pDefaultBlock);
-
-        if (pDefaultBlock->isEmpty() == false)
-        {            
-            // Initialize the map from the default-block resources to the global resources
-            for (const auto& res : mpDefaultBlock->getResourceVec())
-            {
-                const auto& loc = mpDefaultBlock->getResourceBinding(res.name);
-                ResourceBinding bind;
-                bind.regIndex = res.regIndex;
-                bind.regSpace = res.regSpace;
-                bind.type = getBindTypeFromSetType(res.setType);
-                mResourceBindMap[bind] = loc;
-            }
-        }
+        createParameterBlocks();
 
         // Reflect per-stage parameters
         SlangUInt entryPointCount = pSlangReflector->getEntryPointCount();
@@ -703,6 +680,42 @@ namespace Falcor
         }
     }
 
+    void ProgramReflection::createParameterBlocks()
+    {
+        ParameterBlockReflection::SharedPtr pDefaultBlock = ParameterBlockReflection::create("");
+        for (const auto& res : mGlobalResources)
+        {
+            if (res.isParameterBlock)
+            {
+                ParameterBlockReflection::SharedPtr pBlock = ParameterBlockReflection::create(res.pVar->getName());
+                pBlock->addResource(res.pVar);
+                pBlock->finalize();
+                addParameterBlock(pBlock);
+            }
+            else
+            {
+                pDefaultBlock->addResource(res.pVar);
+            }
+        }
+
+        pDefaultBlock->finalize();
+        addParameterBlock(pDefaultBlock);
+
+        if (pDefaultBlock->isEmpty() == false)
+        {            
+            // Initialize the map from the default-block resources to the global resources
+            for (const auto& res : mpDefaultBlock->getResourceVec())
+            {
+                const auto& loc = mpDefaultBlock->getResourceBinding(res.name);
+                ResourceBinding bind;
+                bind.regIndex = res.regIndex;
+                bind.regSpace = res.regSpace;
+                bind.type = getBindTypeFromSetType(res.setType);
+                mResourceBindMap[bind] = loc;
+            }
+        }
+    }
+
     void ProgramReflection::addParameterBlock(const ParameterBlockReflection::SharedConstPtr& pBlock)
     {
         assert(mParameterBlocksIndices.find(pBlock->getName()) == mParameterBlocksIndices.end());
@@ -1354,4 +1367,230 @@ namespace Falcor
         const auto& offsetIt = mOffsetDescMap.find(offset);
         return (offsetIt == mOffsetDescMap.end()) ? empty : offsetIt->second;
     }
+
+    // Serialization. Types are written recursively, each one prefixed with its kind.
+    enum class SerializedTypeKind : int32_t
+    {
+        Basic,
+        Struct,
+        Array,
+        Resource,
+    };
+
+    // Guards against corrupted data sending the deserializer into unbounded recursion
+    static const uint32_t kMaxSerializedTypeDepth = 64;
+
+    static void writeString(BinaryFileStream& stream, const std::string& str)
+    {
+        stream << (uint32_t)str.size();
+        stream.write(str.data(), str.size());
+    }
+
+    static bool readString(BinaryFileStream& stream, std::string& str)
+    {
+        uint32_t size = 0;
+        stream >> size;
+        if (stream.isFail() || size > stream.getRemainingStreamSize()) return false;
+        str.resize(size);
+        stream.read(&str[0], size);
+        return stream.isFail() == false;
+    }
+
+    static void writeVar(BinaryFileStream& stream, const ReflectionVar* pVar);
+
+    static void writeType(BinaryFileStream& stream, const ReflectionType* pType)
+    {
+        if (pType->asResourceType())
+        {
+            const ReflectionResourceType* pResource = pType->asResourceType();
+            stream << SerializedTypeKind::Resource << pResource->getType() << pResource->getDimensions() << pResource->getStructuredBufferType() << pResource->getReturnType() << pResource->getShaderAccess();
+            stream << (uint32_t)(pResource->getStructType() != nullptr);
+            if (pResource->getStructType()) writeType(stream, pResource->getStructType().get());
+        }
+        else if (pType->asStructType())
+        {
+            const ReflectionStructType* pStruct = pType->asStructType();
+            stream << SerializedTypeKind::Struct << (uint64_t)pStruct->getOffset() << (uint64_t)pStruct->getSize();
+            writeString(stream, pStruct->getName());
+            stream << pStruct->getMemberCount();
+            for (const auto& pMember : *pStruct) writeVar(stream, pMember.get());
+        }
+        else if (pType->asArrayType())
+        {
+            const ReflectionArrayType* pArray = pType->asArrayType();
+            stream << SerializedTypeKind::Array << (uint64_t)pArray->getOffset() << pArray->getArraySize() << pArray->getArrayStride();
+            writeType(stream, pArray->getType().get());
+        }
+        else
+        {
+            const ReflectionBasicType* pBasic = pType->asBasicType();
+            assert(pBasic);
+            stream << SerializedTypeKind::Basic << (uint64_t)pBasic->getOffset() << pBasic->getType() << (uint32_t)pBasic->isRowMajor() << (uint64_t)pBasic->getSize();
+        }
+    }
+
+    static void writeVar(BinaryFileStream& stream, const ReflectionVar* pVar)
+    {
+        writeString(stream, pVar->getName());
+        stream << (uint64_t)pVar->getOffset() << pVar->getDescOffset() << pVar->getRegisterSpace();
+        writeType(stream, pVar->getType().get());
+    }
+
+    static ReflectionVar::SharedPtr readVar(BinaryFileStream& stream, uint32_t depth);
+
+    static ReflectionType::SharedPtr readType(BinaryFileStream& stream, uint32_t depth)
+    {
+        SerializedTypeKind kind;
+        stream >> kind;
+        if (stream.isFail() || depth > kMaxSerializedTypeDepth) return nullptr;
+
+        switch (kind)
+        {
+        case SerializedTypeKind::Resource:
+        {
+            ReflectionResourceType::Type type;
+            ReflectionResourceType::Dimensions dims;
+            ReflectionResourceType::StructuredType structuredType;
+            ReflectionResourceType::ReturnType retType;
+            ReflectionResourceType::ShaderAccess access;
+            uint32_t hasStructType;
+            stream >> type >> dims >> structuredType >> retType >> access >> hasStructType;
+            if (stream.isFail()) return nullptr;
+
+            ReflectionResourceType::SharedPtr pType = ReflectionResourceType::create(type, dims, structuredType, retType, access);
+            if (hasStructType)
+            {
+                ReflectionType::SharedPtr pStructType = readType(stream, depth + 1);
+                if (pStructType == nullptr) return nullptr;
+                pType->setStructType(pStructType);
+            }
+            return pType;
+        }
+        case SerializedTypeKind::Struct:
+        {
+            uint64_t offset, size;
+            std::string name;
+            uint32_t memberCount;
+            stream >> offset >> size;
+            if (readString(stream, name) == false) return nullptr;
+            stream >> memberCount;
+            if (stream.isFail()) return nullptr;
+
+            ReflectionStructType::SharedPtr pType = ReflectionStructType::create((size_t)offset, (size_t)size, name);
+            for (uint32_t i = 0; i < memberCount; i++)
+            {
+                ReflectionVar::SharedPtr pMember = readVar(stream, depth + 1);
+                if (pMember == nullptr) return nullptr;
+                pType->addMember(pMember);
+            }
+            return pType;
+        }
+        case SerializedTypeKind::Array:
+        {
+            uint64_t offset;
+            uint32_t arraySize, arrayStride;
+            stream >> offset >> arraySize >> arrayStride;
+            if (stream.isFail()) return nullptr;
+
+            ReflectionType::SharedPtr pElementType = readType(stream, depth + 1);
+            if (pElementType == nullptr) return nullptr;
+            return ReflectionArrayType::create((size_t)offset, arraySize, arrayStride, pElementType);
+        }
+        case SerializedTypeKind::Basic:
+        {
+            uint64_t offset, size;
+            ReflectionBasicType::Type type;
+            uint32_t isRowMajor;
+            stream >> offset >> type >> isRowMajor >> size;
+            if (stream.isFail()) return nullptr;
+            return ReflectionBasicType::create((size_t)offset, type, isRowMajor != 0, (size_t)size);
+        }
+        default:
+            return nullptr;
+        }
+    }
+
+    static ReflectionVar::SharedPtr readVar(BinaryFileStream& stream, uint32_t depth)
+    {
+        std::string name;
+        uint64_t offset;
+        uint32_t descOffset, regSpace;
+        if (readString(stream, name) == false) return nullptr;
+        stream >> offset >> descOffset >> regSpace;
+        if (stream.isFail()) return nullptr;
+
+        ReflectionType::SharedPtr pType = readType(stream, depth + 1);
+        return pType ? ReflectionVar::create(name, pType, (size_t)offset, descOffset, regSpace) : nullptr;
+    }
+
+    static void writeVariableMap(BinaryFileStream& stream, const ProgramReflection::VariableMap& varMap)
+    {
+        stream << (uint32_t)varMap.size();
+        for (const auto& v : varMap)
+        {
+            writeString(stream, v.first);
+            writeString(stream, v.second.semanticName);
+            stream << v.second.bindLocation << v.second.type;
+        }
+    }
+
+    static bool readVariableMap(BinaryFileStream& stream, ProgramReflection::VariableMap& varMap)
+    {
+        uint32_t count = 0;
+        stream >> count;
+        for (uint32_t i = 0; i < count && stream.isFail() == false; i++)
+        {
+            std::string name;
+            ProgramReflection::ShaderVariable var;
+            if (readString(stream, name) == false || readString(stream, var.semanticName) == false) return false;
+            stream >> var.bindLocation >> var.type;
+            varMap[name] = var;
+        }
+        return stream.isFail() == false;
+    }
+
+    void ProgramReflection::serialize(BinaryFileStream& stream) const
+    {
+        stream << (uint32_t)mGlobalResources.size();
+        for (const auto& res : mGlobalResources)
+        {
+            stream << (uint32_t)res.isParameterBlock;
+            writeVar(stream, res.pVar.get());
+        }
+
+        stream << mThreadGroupSize << (uint32_t)mIsSampleFrequency;
+        writeVariableMap(stream, mPsOut);
+        writeVariableMap(stream, mVertAttr);
+        writeVariableMap(stream, mVertAttrBySemantic);
+    }
+
+    ProgramReflection::SharedPtr ProgramReflection::deserialize(BinaryFileStream& stream)
+    {
+        SharedPtr pReflection = SharedPtr(new ProgramReflection());
+
+        uint32_t resourceCount = 0;
+        stream >> resourceCount;
+        for (uint32_t i = 0; i < resourceCount; i++)
+        {
+            uint32_t isParameterBlock = 0;
+            stream >> isParameterBlock;
+            if (stream.isFail()) return nullptr;
+
+            GlobalResource res;
+            res.pVar = readVar(stream, 0);
+            res.isParameterBlock = (isParameterBlock != 0);
+            if (res.pVar == nullptr || res.pVar->getType()->unwrapArray()->asResourceType() == nullptr) return nullptr;
+            pReflection->mGlobalResources.push_back(res);
+        }
+
+        uint32_t isSampleFrequency = 0;
+        stream >> pReflection->mThreadGroupSize >> isSampleFrequency;
+        pReflection->mIsSampleFrequency = (isSampleFrequency != 0);
+        if (readVariableMap(stream, pReflection->mPsOut) == false) return nullptr;
+        if (readVariableMap(stream, pReflection->mVertAttr) == false) return nullptr;
+        if (readVariableMap(stream, pReflection->mVertAttrBySemantic) == false) return nullptr;
+
+        pReflection->createParameterBlocks();
+        return pReflection;
+    }
 }
@@ -34,6 +34,7 @@
 
 namespace Falcor
 {
+    class BinaryFileStream;
     class ReflectionVar;
     class ReflectionResourceType;
     class ReflectionBasicType;
@@ -82,6 +83,10 @@ namespace Falcor
         */
         virtual size_t getSize() const = 0;
 
+        /** Get the offset of the object relative to the parent variable
+        */
+        size_t getOffset() const { return mOffset; }
+
         // Helper functions
         virtual std::shared_ptr<const ReflectionVar> findMemberInternal(const std::string& name, size_t strPos, size_t offset, uint32_t regIndex, uint32_t regSpace, uint32_t descOffset) const = 0;
 
@@ -621,9 +626,28 @@ namespace Falcor
         */
         const ParameterBlockReflection::BindLocation translateRegisterIndicesToBindLocation(uint32_t regSpace, uint32_t baseRegIndex, BindType type) const { return mResourceBindMap.at({regSpace, baseRegIndex, type}); }
 
+        /** Write the reflection data into a stream, so that it can be restored without running Slang. Used by ProgramCache.
+        */
+        void serialize(BinaryFileStream& stream) const;
+
+        /** Restore reflection data written by serialize()
+            \return A new object, or nullptr if the data is invalid
+        */
+        static SharedPtr deserialize(BinaryFileStream& stream);
+
     private:
+        ProgramReflection() = default;
         ProgramReflection(slang::ShaderReflection* pSlangReflector, std::string& log);
         void addParameterBlock(const ParameterBlockReflection::SharedConstPtr& pBlock);
+        void createParameterBlocks();
+
+        // The top-level resources, in the order Slang reported them. The parameter blocks are created from these.
+        struct GlobalResource
+        {
+            ReflectionVar::SharedConstPtr pVar;
+            bool isParameterBlock = false;
+        };
+        std::vector<GlobalResource> mGlobalResources;
 
         std::vector<ParameterBlockReflection::SharedConstPtr> mpParameterBlocks;
         std::unordered_map<std::string, size_t> mParameterBlocksIndices;
@@ -0,0 +1,183 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Framework.h"
+#include "BoundingVolumeHierarchy.h"
+#include "Graphics/Camera/Camera.h"
+#include <algorithm>
+
+namespace Falcor
+{
+    static const uint32_t kNoParent = (uint32_t)-1;
+
+    BoundingVolumeHierarchy::SharedPtr BoundingVolumeHierarchy::create()
+    {
+        return SharedPtr(new BoundingVolumeHierarchy);
+    }
+
+    void BoundingVolumeHierarchy::build(const std::vector<BoundingBox>& boxes)
+    {
+        mBoxes = boxes;
+        mNodes.clear();
+        mOrderedIds.resize(boxes.size());
+        mBoxLeaf.resize(boxes.size());
+        if (boxes.empty()) return;
+
+        std::vector<glm::vec3> centers(boxes.size());
+        for (uint32_t i = 0; i < (uint32_t)boxes.size(); i++)
+        {
+            mOrderedIds[i] = i;
+            centers[i] = boxes[i].center;
+        }
+
+        // A tree with leaves of up to kMaxLeafSize boxes has less than 2 * count / (kMaxLeafSize / 2) nodes
+        mNodes.reserve(4 * boxes.size() / kMaxLeafSize + 1);
+        buildNode(kNoParent, 0, (uint32_t)boxes.size(), centers);
+    }
+
+    uint32_t BoundingVolumeHierarchy::buildNode(uint32_t parent, uint32_t first, uint32_t count, std::vector<glm::vec3>& centers)
+    {
+        uint32_t index = (uint32_t)mNodes.size();
+        mNodes.push_back(Node());
+        mNodes[index].firstBox = first;
+        mNodes[index].boxCount = count;
+        mNodes[index].rightChild = 0;
+        mNodes[index].parent = parent;
+
+        if (count <= kMaxLeafSize)
+        {
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                mBoxLeaf[mOrderedIds[i]] = index;
+            }
+            mNodes[index].box = calcLeafBounds(mNodes[index]);
+            return index;
+        }
+
+        // Split at the median of the axis along which the centers are spread the most
+        glm::vec3 minCenter = centers[mOrderedIds[first]];
+        glm::vec3 maxCenter = minCenter;
+        for (uint32_t i = first + 1; i < first + count; i++)
+        {
+            minCenter = glm::min(minCenter, centers[mOrderedIds[i]]);
+            maxCenter = glm::max(maxCenter, centers[mOrderedIds[i]]);
+        }
+        glm::vec3 spread = maxCenter - minCenter;
+        int axis = (spread.x > spread.y) ? ((spread.x > spread.z) ? 0 : 2) : ((spread.y > spread.z) ? 1 : 2);
+
+        uint32_t leftCount = count / 2;
+        auto begin = mOrderedIds.begin() + first;
+        std::nth_element(begin, begin + leftCount, begin + count, [&centers, axis](uint32_t a, uint32_t b) { return centers[a][axis] < centers[b][axis]; });
+
+        buildNode(index, first, leftCount, centers);
+        uint32_t rightChild = buildNode(index, first + leftCount, count - leftCount, centers);
+
+        // The vector might have been reallocated by the children
+        Node& node = mNodes[index];
+        node.rightChild = rightChild;
+        node.box = BoundingBox::fromUnion(mNodes[index + 1].box, mNodes[rightChild].box);
+        return index;
+    }
+
+    BoundingBox BoundingVolumeHierarchy::calcLeafBounds(const Node& node) const
+    {
+        BoundingBox box = mBoxes[mOrderedIds[node.firstBox]];
+        for (uint32_t i = node.firstBox + 1; i < node.firstBox + node.boxCount; i++)
+        {
+            box = BoundingBox::fromUnion(box, mBoxes[mOrderedIds[i]]);
+        }
+        return box;
+    }
+
+    void BoundingVolumeHierarchy::update(uint32_t id, const BoundingBox& box)
+    {
+        assert(id < mBoxes.size());
+        mBoxes[id] = box;
+
+        uint32_t index = mBoxLeaf[id];
+        mNodes[index].box = calcLeafBounds(mNodes[index]);
+
+        // Refit the ancestors. Stop as soon as a node's bounds don't change, since the nodes above it won't change either.
+        for (uint32_t parent = mNodes[index].parent; parent != kNoParent; parent = mNodes[parent].parent)
+        {
+            Node& node = mNodes[parent];
+            BoundingBox newBox = BoundingBox::fromUnion(mNodes[parent + 1].box, mNodes[node.rightChild].box);
+            if (node.box == newBox) break;
+            node.box = newBox;
+        }
+    }
+
+    void BoundingVolumeHierarchy::cull(const Camera* pCamera, std::vector<uint32_t>& visibleIds) const
+    {
+        visibleIds.clear();
+        if (mNodes.empty()) return;
+
+        struct StackEntry
+        {
+            uint32_t node;
+            uint32_t planeMask;
+        };
+        StackEntry stack[64];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = { 0, Camera::kAllFrustumPlanes };
+
+        while (stackSize)
+        {
+            StackEntry entry = stack[--stackSize];
+            const Node& node = mNodes[entry.node];
+
+            Camera::FrustumTestResult result = pCamera->testBoundingBox(node.box, entry.planeMask);
+            if (result == Camera::FrustumTestResult::Outside)
+            {
+                continue;
+            }
+
+            if (result == Camera::FrustumTestResult::Inside)
+            {
+                // Accept the whole subtree
+                visibleIds.insert(visibleIds.end(), mOrderedIds.begin() + node.firstBox, mOrderedIds.begin() + node.firstBox + node.boxCount);
+            }
+            else if (node.rightChild == 0)
+            {
+                for (uint32_t i = node.firstBox; i < node.firstBox + node.boxCount; i++)
+                {
+                    uint32_t planeMask = entry.planeMask;
+                    if (pCamera->testBoundingBox(mBoxes[mOrderedIds[i]], planeMask) != Camera::FrustumTestResult::Outside)
+                    {
+                        visibleIds.push_back(mOrderedIds[i]);
+                    }
+                }
+            }
+            else
+            {
+                // Median splits keep the tree balanced, so the depth is at most log2(count) and the stack can't overflow
+                stack[stackSize++] = { node.rightChild, entry.planeMask };
+                stack[stackSize++] = { entry.node + 1, entry.planeMask };
+            }
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <vector>
+#include <memory>
+#include "Utils/AABB.h"
+
+namespace Falcor
+{
+    class Camera;
+
+    /** Bounding volume hierarchy over a set of bounding boxes, used for hierarchical frustum culling.
+        Each box is identified by its index in the array passed to build(). Moving a box refits the nodes above it, without changing the tree topology. After many large moves the tree becomes loose and build() should be called again.
+        Every node references a contiguous range of boxes, so a subtree which is fully inside the frustum is accepted without visiting its children.
+    */
+    class BoundingVolumeHierarchy
+    {
+    public:
+        using SharedPtr = std::shared_ptr<BoundingVolumeHierarchy>;
+        using SharedConstPtr = std::shared_ptr<const BoundingVolumeHierarchy>;
+
+        static const uint32_t kMaxLeafSize = 4;
+
+        /** Create an empty hierarchy
+        */
+        static SharedPtr create();
+
+        /** Build the hierarchy, replacing the previous one.
+            \param[in] boxes The bounding boxes. Box i gets ID i.
+        */
+        void build(const std::vector<BoundingBox>& boxes);
+
+        /** Set a new bounding box for a box and refit its ancestors.
+            \param[in] id The box ID.
+            \param[in] box The new bounding box.
+        */
+        void update(uint32_t id, const BoundingBox& box);
+
+        /** Find the boxes which are not culled by the camera's frustum.
+            \param[in] pCamera The camera.
+            \param[out] visibleIds The IDs of the visible boxes. The vector is cleared first. The order follows the tree, not the IDs.
+        */
+        void cull(const Camera* pCamera, std::vector<uint32_t>& visibleIds) const;
+
+        /** Get a box by ID
+        */
+        const BoundingBox& getBox(uint32_t id) const { return mBoxes[id]; }
+
+        /** Get the number of boxes
+        */
+        uint32_t getBoxCount() const { return (uint32_t)mBoxes.size(); }
+
+        /** Get the number of nodes
+        */
+        uint32_t getNodeCount() const { return (uint32_t)mNodes.size(); }
+
+        /** Get the bounding box of all the boxes. Only valid if the hierarchy isn't empty.
+        */
+        const BoundingBox& getBounds() const { return mNodes[0].box; }
+
+    private:
+        BoundingVolumeHierarchy() = default;
+
+        struct Node
+        {
+            BoundingBox box;
+            uint32_t firstBox;      // Index into mOrderedIds of the first box of the subtree
+            uint32_t boxCount;      // Number of boxes in the subtree
+            uint32_t rightChild;    // The left child directly follows the node. 0 for leaves.
+            uint32_t parent;
+        };
+
+        uint32_t buildNode(uint32_t parent, uint32_t first, uint32_t count, std::vector<glm::vec3>& centers);
+        BoundingBox calcLeafBounds(const Node& node) const;
+
+        std::vector<Node> mNodes;
+        std::vector<BoundingBox> mBoxes;
+        std::vector<uint32_t> mOrderedIds;  // Box IDs in the order of the leaves
+        std::vector<uint32_t> mBoxLeaf;     // The leaf node of each box
+    };
+}
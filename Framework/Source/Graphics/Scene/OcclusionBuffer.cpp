@@ -0,0 +1,289 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Framework.h"
+#include "OcclusionBuffer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define FALCOR_OCCLUSION_SIMD
+#include <immintrin.h>
+#endif
+
+namespace Falcor
+{
+    // Vertices with a smaller clip-space w are considered behind the camera
+    static const float kMinW = 1e-5f;
+    static const float kFarDepth = FLT_MAX;
+
+    struct EdgeFunction
+    {
+        // Positive on the inner side of the edge a->b of a counter-clockwise triangle
+        EdgeFunction(const glm::vec3& a, const glm::vec3& b)
+        {
+            dx = a.y - b.y;
+            dy = b.x - a.x;
+            c = -(dx * a.x + dy * a.y);
+        }
+        float dx, dy, c;
+    };
+
+    OcclusionBuffer::SharedPtr OcclusionBuffer::create(uint32_t width, uint32_t height)
+    {
+        if (width == 0 || height == 0)
+        {
+            logError("Can't create an occlusion buffer with a zero width or height");
+            return nullptr;
+        }
+        return SharedPtr(new OcclusionBuffer(width, height));
+    }
+
+    OcclusionBuffer::OcclusionBuffer(uint32_t width, uint32_t height)
+    {
+        mTilesX = (width + kTileWidth - 1) / kTileWidth;
+        mTilesY = (height + kTileHeight - 1) / kTileHeight;
+        mWidth = mTilesX * kTileWidth;
+        mHeight = mTilesY * kTileHeight;
+        mDepth.assign(mWidth * mHeight, kFarDepth);
+        mTileMaxDepth.assign(mTilesX * mTilesY, kFarDepth);
+    }
+
+    void OcclusionBuffer::clear(const glm::mat4& viewProjMat)
+    {
+        mViewProjMat = viewProjMat;
+        std::fill(mDepth.begin(), mDepth.end(), kFarDepth);
+        std::fill(mTileMaxDepth.begin(), mTileMaxDepth.end(), kFarDepth);
+        mHierarchyDirty = false;
+    }
+
+    void OcclusionBuffer::rasterizeTriangles(const glm::vec3* pPositions, uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount, const glm::mat4& worldMat)
+    {
+        const glm::mat4 mat = mViewProjMat * worldMat;
+        mClipPositions.resize(vertexCount);
+        for (uint32_t i = 0; i < vertexCount; i++)
+        {
+            mClipPositions[i] = mat * glm::vec4(pPositions[i], 1.f);
+        }
+
+        for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            assert(pIndices[i] < vertexCount && pIndices[i + 1] < vertexCount && pIndices[i + 2] < vertexCount);
+            rasterizeTriangle(mClipPositions[pIndices[i]], mClipPositions[pIndices[i + 1]], mClipPositions[pIndices[i + 2]]);
+        }
+        mHierarchyDirty = true;
+    }
+
+    void OcclusionBuffer::rasterizeBox(const BoundingBox& box, const glm::mat4& worldMat)
+    {
+        // Bit 0, 1 and 2 of a corner's index select the max X, Y and Z
+        static const uint32_t kIndices[] =
+        {
+            0, 2, 6, 0, 6, 4,   // -X
+            1, 5, 7, 1, 7, 3,   // +X
+            0, 4, 5, 0, 5, 1,   // -Y
+            2, 3, 7, 2, 7, 6,   // +Y
+            0, 1, 3, 0, 3, 2,   // -Z
+            4, 6, 7, 4, 7, 5,   // +Z
+        };
+
+        glm::vec3 corners[8];
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            glm::vec3 sign((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f);
+            corners[i] = box.center + box.extent * sign;
+        }
+        rasterizeTriangles(corners, 8, kIndices, arraysize(kIndices), worldMat);
+    }
+
+    void OcclusionBuffer::rasterizeTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2)
+    {
+        // Occluders are optional, so skip the triangles which would need clipping
+        if (c0.w < kMinW || c1.w < kMinW || c2.w < kMinW) return;
+
+        glm::vec3 v[3];
+        const glm::vec4* pClip[3] = { &c0, &c1, &c2 };
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            const float invW = 1.f / pClip[i]->w;
+            v[i].x = (pClip[i]->x * invW * 0.5f + 0.5f) * mWidth;
+            v[i].y = (0.5f - pClip[i]->y * invW * 0.5f) * mHeight;
+            v[i].z = pClip[i]->z * invW;
+        }
+
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+        if (std::abs(area) < 1e-8f) return;
+        if (area < 0)
+        {
+            std::swap(v[1], v[2]);
+            area = -area;
+        }
+
+        // Range of the pixels whose center may be inside the triangle
+        const float minX = std::max(std::min(v[0].x, std::min(v[1].x, v[2].x)), 0.f);
+        const float maxX = std::min(std::max(v[0].x, std::max(v[1].x, v[2].x)), (float)mWidth);
+        const float minY = std::max(std::min(v[0].y, std::min(v[1].y, v[2].y)), 0.f);
+        const float maxY = std::min(std::max(v[0].y, std::max(v[1].y, v[2].y)), (float)mHeight);
+        const int32_t x0 = (int32_t)std::ceil(minX - 0.5f);
+        const int32_t x1 = std::min((int32_t)std::floor(maxX - 0.5f), (int32_t)mWidth - 1);
+        const int32_t y0 = (int32_t)std::ceil(minY - 0.5f);
+        const int32_t y1 = std::min((int32_t)std::floor(maxY - 0.5f), (int32_t)mHeight - 1);
+        if (x0 > x1 || y0 > y1) return;
+
+        // The edge function of the edge facing a vertex is proportional to the vertex's barycentric coordinate
+        const EdgeFunction e0(v[1], v[2]);
+        const EdgeFunction e1(v[2], v[0]);
+        const EdgeFunction e2(v[0], v[1]);
+
+        // NDC depth is linear in screen space
+        const float invArea = 1.f / area;
+        const float zdx = (v[0].z * e0.dx + v[1].z * e1.dx + v[2].z * e2.dx) * invArea;
+        const float zdy = (v[0].z * e0.dy + v[1].z * e1.dy + v[2].z * e2.dy) * invArea;
+        const float zc = (v[0].z * e0.c + v[1].z * e1.c + v[2].z * e2.c) * invArea;
+
+        for (uint32_t ty = y0 / kTileHeight; ty <= y1 / kTileHeight; ty++)
+        {
+            const uint32_t rowBegin = std::max((uint32_t)y0, ty * kTileHeight);
+            const uint32_t rowEnd = std::min((uint32_t)y1 + 1, (ty + 1) * kTileHeight);
+            for (uint32_t tx = x0 / kTileWidth; tx <= x1 / kTileWidth; tx++)
+            {
+                float* pTile = &mDepth[(ty * mTilesX + tx) * kTileWidth * kTileHeight];
+                for (uint32_t y = rowBegin; y < rowEnd; y++)
+                {
+                    const float py = y + 0.5f;
+                    float* pRow = pTile + (y % kTileHeight) * kTileWidth;
+#ifdef FALCOR_OCCLUSION_SIMD
+                    // The whole row of the tile is processed. The pixels outside the triangle's bounds fail the edge tests.
+                    const __m128 zero = _mm_setzero_ps();
+                    const __m128 e0Row = _mm_set1_ps(e0.dy * py + e0.c);
+                    const __m128 e1Row = _mm_set1_ps(e1.dy * py + e1.c);
+                    const __m128 e2Row = _mm_set1_ps(e2.dy * py + e2.c);
+                    const __m128 zRow = _mm_set1_ps(zdy * py + zc);
+                    for (uint32_t x = 0; x < kTileWidth; x += 4)
+                    {
+                        const __m128 px = _mm_add_ps(_mm_set1_ps((float)(tx * kTileWidth + x) + 0.5f), _mm_setr_ps(0, 1, 2, 3));
+                        __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e0.dx), px), e0Row), zero);
+                        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e1.dx), px), e1Row), zero));
+                        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e2.dx), px), e2Row), zero));
+                        const __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zdx), px), zRow);
+                        const __m128 depth = _mm_loadu_ps(pRow + x);
+                        const __m128 closest = _mm_min_ps(depth, z);
+                        _mm_storeu_ps(pRow + x, _mm_or_ps(_mm_and_ps(inside, closest), _mm_andnot_ps(inside, depth)));
+                    }
+#else
+                    const uint32_t columnBegin = std::max((uint32_t)x0, tx * kTileWidth);
+                    const uint32_t columnEnd = std::min((uint32_t)x1 + 1, (tx + 1) * kTileWidth);
+                    for (uint32_t x = columnBegin; x < columnEnd; x++)
+                    {
+                        const float px = x + 0.5f;
+                        if (e0.dx * px + e0.dy * py + e0.c < 0 || e1.dx * px + e1.dy * py + e1.c < 0 || e2.dx * px + e2.dy * py + e2.c < 0) continue;
+                        float& depth = pRow[x % kTileWidth];
+                        depth = std::min(depth, zdx * px + zdy * py + zc);
+                    }
+#endif
+                }
+            }
+        }
+    }
+
+    void OcclusionBuffer::updateHierarchy()
+    {
+        if (mHierarchyDirty == false) return;
+
+        const uint32_t tileSize = kTileWidth * kTileHeight;
+        for (uint32_t tile = 0; tile < (uint32_t)mTileMaxDepth.size(); tile++)
+        {
+            const float* pTile = &mDepth[tile * tileSize];
+#ifdef FALCOR_OCCLUSION_SIMD
+            __m128 maxDepth = _mm_loadu_ps(pTile);
+            for (uint32_t i = 4; i < tileSize; i += 4)
+            {
+                maxDepth = _mm_max_ps(maxDepth, _mm_loadu_ps(pTile + i));
+            }
+            maxDepth = _mm_max_ps(maxDepth, _mm_shuffle_ps(maxDepth, maxDepth, _MM_SHUFFLE(1, 0, 3, 2)));
+            maxDepth = _mm_max_ps(maxDepth, _mm_shuffle_ps(maxDepth, maxDepth, _MM_SHUFFLE(2, 3, 0, 1)));
+            mTileMaxDepth[tile] = _mm_cvtss_f32(maxDepth);
+#else
+            mTileMaxDepth[tile] = *std::max_element(pTile, pTile + tileSize);
+#endif
+        }
+        mHierarchyDirty = false;
+    }
+
+    bool OcclusionBuffer::isVisible(const BoundingBox& box) const
+    {
+        assert(mHierarchyDirty == false);
+
+        float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+        float maxX = -FLT_MAX, maxY = -FLT_MAX;
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            glm::vec3 sign((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f);
+            glm::vec4 clip = mViewProjMat * glm::vec4(box.center + box.extent * sign, 1.f);
+
+            // Boxes which cross the camera plane cover the whole screen
+            if (clip.w < kMinW) return true;
+
+            const float invW = 1.f / clip.w;
+            const float x = (clip.x * invW * 0.5f + 0.5f) * mWidth;
+            const float y = (0.5f - clip.y * invW * 0.5f) * mHeight;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            minZ = std::min(minZ, clip.z * invW);
+        }
+
+        // Only the part of the box which is on the screen can be occluded. Boxes outside of it are left to frustum culling.
+        if (maxX < 0 || maxY < 0 || minX >= mWidth || minY >= mHeight) return true;
+
+        // The box is occluded if all the pixels it touches are closer than its closest point
+        const uint32_t x0 = (uint32_t)std::max(minX, 0.f);
+        const uint32_t x1 = (uint32_t)std::min(maxX, (float)(mWidth - 1));
+        const uint32_t y0 = (uint32_t)std::max(minY, 0.f);
+        const uint32_t y1 = (uint32_t)std::min(maxY, (float)(mHeight - 1));
+        for (uint32_t ty = y0 / kTileHeight; ty <= y1 / kTileHeight; ty++)
+        {
+            for (uint32_t tx = x0 / kTileWidth; tx <= x1 / kTileWidth; tx++)
+            {
+                if (minZ > mTileMaxDepth[ty * mTilesX + tx]) continue;
+
+                const uint32_t rowEnd = std::min(y1 + 1, (ty + 1) * kTileHeight);
+                const uint32_t columnEnd = std::min(x1 + 1, (tx + 1) * kTileWidth);
+                for (uint32_t y = std::max(y0, ty * kTileHeight); y < rowEnd; y++)
+                {
+                    for (uint32_t x = std::max(x0, tx * kTileWidth); x < columnEnd; x++)
+                    {
+                        if (minZ <= getDepth(x, y)) return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+}
@@ -0,0 +1,112 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <vector>
+#include <memory>
+#include "glm/mat4x4.hpp"
+#include "Utils/AABB.h"
+
+namespace Falcor
+{
+    /** Low-resolution depth buffer rasterized on the CPU, used to cull bounding boxes hidden behind large occluders.
+        The buffer is split into tiles of kTileWidth x kTileHeight pixels, stored contiguously, and keeps the farthest depth of each tile. A box is tested against the tiles it covers first, and only the tiles which can't reject it are tested per pixel.
+        Occluders are rasterized at pixel centers, with the depth interpolated across each triangle. Triangles which cross the camera plane are skipped and boxes which cross it are always visible, so the results stay conservative up to the sub-pixel coverage of the occluders' edges.
+        Depth values are the NDC z, and larger values are farther from the camera. Nothing here depends on the GPU, so the buffer can be used and benchmarked without a device.
+    */
+    class OcclusionBuffer
+    {
+    public:
+        using SharedPtr = std::shared_ptr<OcclusionBuffer>;
+        using SharedConstPtr = std::shared_ptr<const OcclusionBuffer>;
+
+        static const uint32_t kTileWidth = 8;
+        static const uint32_t kTileHeight = 8;
+
+        /** Create an occlusion buffer
+            \param[in] width Width in pixels. Rounded up to a multiple of kTileWidth.
+            \param[in] height Height in pixels. Rounded up to a multiple of kTileHeight.
+        */
+        static SharedPtr create(uint32_t width = 256, uint32_t height = 128);
+
+        /** Clear the buffer to the far plane and set the view-projection matrix used by the next calls
+        */
+        void clear(const glm::mat4& viewProjMat);
+
+        /** Rasterize an indexed triangle list. Both faces of the triangles occlude.
+            \param[in] pPositions The vertex positions
+            \param[in] vertexCount The number of vertices
+            \param[in] pIndices Three indices per triangle
+            \param[in] indexCount The number of indices
+            \param[in] worldMat Transform from the positions' space to world space
+        */
+        void rasterizeTriangles(const glm::vec3* pPositions, uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount, const glm::mat4& worldMat);
+
+        /** Rasterize a solid box
+            \param[in] box The box
+            \param[in] worldMat Transform from the box's space to world space
+        */
+        void rasterizeBox(const BoundingBox& box, const glm::mat4& worldMat);
+
+        /** Update the per-tile depth. Call after rasterizing the occluders and before testing boxes.
+        */
+        void updateHierarchy();
+
+        /** Check whether a world-space bounding box may be visible
+            \return false if the box is hidden behind the occluders, otherwise true
+        */
+        bool isVisible(const BoundingBox& box) const;
+
+        /** Get the depth of a pixel
+        */
+        float getDepth(uint32_t x, uint32_t y) const { return mDepth[getPixelIndex(x, y)]; }
+
+        uint32_t getWidth() const { return mWidth; }
+        uint32_t getHeight() const { return mHeight; }
+
+    private:
+        OcclusionBuffer(uint32_t width, uint32_t height);
+
+        uint32_t getPixelIndex(uint32_t x, uint32_t y) const
+        {
+            uint32_t tile = (y / kTileHeight) * mTilesX + x / kTileWidth;
+            return tile * kTileWidth * kTileHeight + (y % kTileHeight) * kTileWidth + x % kTileWidth;
+        }
+
+        void rasterizeTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2);
+
+        uint32_t mWidth;
+        uint32_t mHeight;
+        uint32_t mTilesX;
+        uint32_t mTilesY;
+        glm::mat4 mViewProjMat;
+        std::vector<float> mDepth;          // Tiled, tiles are stored in row-major order and the pixels of a tile too
+        std::vector<float> mTileMaxDepth;   // Farthest depth of each tile
+        std::vector<glm::vec4> mClipPositions;
+        bool mHierarchyDirty = false;
+    };
+}
@@ -30,6 +30,7 @@
 #include "SceneImporter.h"
 #include "glm/gtx/euler_angles.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+#include <algorithm>
 
 namespace Falcor
 {
@@ -65,54 +66,126 @@ namespace Falcor
 
     Scene::~Scene() = default;
 
+    static void calcInstanceExtents(const Scene::ModelInstance* pInstance, vec3& center, float& radius)
+    {
+        const Model* pModel = pInstance->getObject().get();
+        center = vec3(vec4(pModel->getCenter(), 1.f) * pInstance->getTransformMatrix());
+        const vec3 scaling = pInstance->getScaling();
+        radius = pModel->getRadius() * max(scaling.x, max(scaling.y, scaling.z));
+    }
+
+    void Scene::mergeExtents(const vec3& center, float radius)
+    {
+        vec3 dir = center - mCenter;
+        if (length(dir) > 1e-6f)
+            dir = normalize(dir);
+        vec3 a = mCenter - dir * mRadius;
+        vec3 b = center + dir * radius;
+
+        mCenter = (a + b) * 0.5f;
+        mRadius = length(a - b);
+    }
+
+    void Scene::refitExtents()
+    {
+        bool first = true;
+        mCenter = vec3(0, 0, 0);
+        mRadius = 0.f;
+        for (size_t slot = 0; slot < mSlotInstances.size(); slot++)
+        {
+            if (mSlotInstances[slot] == nullptr) continue;
+
+            const vec4& sphere = mSlotSpheres[slot];
+            if (first)
+            {
+                mCenter = vec3(sphere);
+                mRadius = sphere.w;
+                first = false;
+            }
+            else
+            {
+                mergeExtents(vec3(sphere), sphere.w);
+            }
+        }
+    }
+
     void Scene::updateExtents()
     {
+        // Flush the pending transform changes into the store's change log
+        const InstanceStore::SharedPtr& pStore = ModelInstance::getInstanceStore();
+        pStore->updateTransforms();
+
+        bool changed = mExtentsDirty;
+        if (mExtentsDirty == false)
+        {
+            if (pStore->getChangedSlots(mExtentsChangeCursor, mChangedSlots))
+            {
+                // Only the spheres of the instances which moved are recomputed. The merge depends on the order and on every sphere, so
+                // the extents are then refit from the cached spheres, which gives the same tight result as a full update.
+                const vec3 prevCenter = mCenter;
+                const float prevRadius = mRadius;
+                bool moved = false;
+                for (uint32_t slot : mChangedSlots)
+                {
+                    const ModelInstance* pInstance = (slot < mSlotInstances.size()) ? mSlotInstances[slot] : nullptr;
+                    if (pInstance == nullptr) continue;
+
+                    vec3 instC;
+                    float instR;
+                    calcInstanceExtents(pInstance, instC, instR);
+                    if (vec4(instC, instR) != mSlotSpheres[slot])
+                    {
+                        mSlotSpheres[slot] = vec4(instC, instR);
+                        moved = true;
+                    }
+                }
+
+                if (moved)
+                {
+                    refitExtents();
+                }
+                changed = (mCenter != prevCenter) || (mRadius != prevRadius);
+            }
+            else
+            {
+                // The log was trimmed before we read it
+                mExtentsDirty = true;
+            }
+        }
+
         if (mExtentsDirty)
         {
             mExtentsDirty = false;
+            mExtentsChangeCursor = pStore->getChangeLogEnd();
+            mSlotInstances.assign(pStore->getSlotCount(), nullptr);
+            mSlotSpheres.assign(pStore->getSlotCount(), vec4(0));
 
-            mRadius = 0.f;
-            float k = 0.f;
-            mCenter = vec3(0, 0, 0);
             for (uint32_t i = 0; i < getModelCount(); ++i)
             {
-                const auto& model = getModel(i);
-                const float r = model->getRadius();
-                const vec3 c = model->getCenter();
                 for (uint32_t j = 0; j < getModelInstanceCount(i); ++j)
                 {
                     const auto& inst = getModelInstance(i, j);
-                    const vec3 instC = vec3(vec4(c, 1.f) * inst->getTransformMatrix());
-                    const vec3 scaling = inst->getScaling();
-                    const float instR = r * max(scaling.x, max(scaling.y, scaling.z));
+                    const uint32_t slot = inst->getInstanceSlot();
+                    mSlotInstances[slot] = inst.get();
 
-                    if (k == 0.f)
-                    {
-                        mCenter = instC;
-                        mRadius = instR;
-                    }
-                    else
-                    {
-                        vec3 dir = instC - mCenter;
-                        if (length(dir) > 1e-6f)
-                            dir = normalize(dir);
-                        vec3 a = mCenter - dir * mRadius;
-                        vec3 b = instC + dir * instR;
-
-                        mCenter = (a + b) * 0.5f;
-                        mRadius = length(a - b);
-                    }
-                    k++;
+                    vec3 instC;
+                    float instR;
+                    calcInstanceExtents(inst.get(), instC, instR);
+                    mSlotSpheres[slot] = vec4(instC, instR);
                 }
             }
+            refitExtents();
+        }
 
+        if (changed)
+        {
             // Update light extents
             for (auto& light : mpLights)
             {
                 if (light->getType() == LightDirectional)
                 {
                     auto pDirLight = std::dynamic_pointer_cast<DirectionalLight>(light);
-                    pDirLight->setWorldParams(getCenter(), getRadius());
+                    pDirLight->setWorldParams(mCenter, mRadius);
                 }
             }
         }
@@ -129,12 +202,24 @@ namespace Falcor
             }
         }
 
+        // A model can be shared between instance lists, so the list is de-duplicated before the controllers are animated in parallel
+        mAnimationControllers.clear();
         for (uint32_t i = 0; i < mModels.size(); i++)
         {
-            mModels[i][0]->getObject()->animate(currentTime);
+            AnimationController* pController = mModels[i][0]->getObject()->getAnimationController();
+            if (pController)
+            {
+                mAnimationControllers.push_back(pController);
+            }
         }
+        std::sort(mAnimationControllers.begin(), mAnimationControllers.end());
+        mAnimationControllers.erase(std::unique(mAnimationControllers.begin(), mAnimationControllers.end()), mAnimationControllers.end());
 
-        mExtentsDirty = mExtentsDirty || changed;
+        if (mpJobSystem == nullptr && mAnimationControllers.size() > 1)
+        {
+            mpJobSystem = JobSystem::create();
+        }
+        AnimationController::animateBatch(mAnimationControllers.data(), (uint32_t)mAnimationControllers.size(), currentTime, mpJobSystem.get());
 
         // Ignore the elapsed time we got from the user. This will allow camera movement in cases where the time is frozen
         if (cameraController)
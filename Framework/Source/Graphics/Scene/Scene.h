@@ -37,6 +37,7 @@
 #include "Graphics/Paths/ObjectPath.h"
 #include "Graphics/Model/ObjectInstance.h"
 #include "Graphics/Material/MaterialHistory.h"
+#include "Utils/JobSystem.h"
 
 namespace Falcor
 {
@@ -99,7 +100,8 @@ namespace Falcor
         {
 			None                =   0x0,
 			GenerateAreaLights  =   0x1,    ///< Create area light(s) for meshes that have emissive material
-            StoreMaterialHistory =  0x2     ///< Store history of overridden mesh materials
+            StoreMaterialHistory =  0x2,    ///< Store history of overridden mesh materials
+            SerialModelLoading  =   0x4     ///< Load the models one after the other on the calling thread, instead of decoding the model files on worker threads
         };
 
         static Scene::SharedPtr loadFromFile(const std::string& filename, Model::LoadFlags modelLoadFlags = Model::LoadFlags::None, Scene::LoadFlags sceneLoadFlags = LoadFlags::None);
@@ -166,6 +168,10 @@ namespace Falcor
         // Camera update
         virtual bool update(double currentTime, CameraController* cameraController = nullptr);
 
+        /** Set the job system used to animate the models. By default the scene creates one with a thread per hardware thread once it has more than one animated model.
+        */
+        void setJobSystem(const JobSystem::SharedPtr& pJobSystem) { mpJobSystem = pJobSystem; }
+
         // User variables
         uint32_t getVersion() const { return mVersion; }
         void setVersion(uint32_t version) { mVersion = version; }
@@ -183,11 +189,16 @@ namespace Falcor
         void merge(const Scene* pFrom);
 
         /**
-            Return scene extents
+            Return scene extents. Only the instances which moved since the last query are transformed again, the extents are then refit from the cached instance spheres.
         */
         const vec3& getCenter() { updateExtents(); return mCenter; }
         const float getRadius() { updateExtents(); return mRadius; }
 
+        /**
+            Recompute the extents from all the instances on the next query
+        */
+        void invalidateExtents() { mExtentsDirty = true; }
+
         /**
             This routine creates area light(s) in the scene. All meshes that
             have emissive material are treated as area lights.
@@ -213,6 +224,16 @@ namespace Falcor
             Update changed scene extents (radius and center).
         */
         void updateExtents();
+
+        /**
+            Grow the extents to enclose a sphere
+        */
+        void mergeExtents(const vec3& center, float radius);
+
+        /**
+            Recompute the extents from the cached bounding spheres of the instances
+        */
+        void refitExtents();
         
         static uint32_t sSceneCounter;
 
@@ -235,7 +256,14 @@ namespace Falcor
         float mRadius = -1.f;
         vec3 mCenter = vec3(0, 0, 0);
 
-        bool mExtentsDirty = true;
+        bool mExtentsDirty = true;                          // Instances were added or removed, recompute the extents from scratch
+        uint64_t mExtentsChangeCursor = 0;                  // Position in the instance store change log the extents are up to date with
+        std::vector<const ModelInstance*> mSlotInstances;   // The scene's model instances, indexed by instance store slot
+        std::vector<vec4> mSlotSpheres;                     // World bounding sphere (center, radius) of each slot's instance, as of the last extents update
+        std::vector<uint32_t> mChangedSlots;
+
+        JobSystem::SharedPtr mpJobSystem;
+        std::vector<AnimationController*> mAnimationControllers;   // Scratch list of the controllers to animate
 
         using string_uservar_map = std::map<const std::string, UserVariable>;
         string_uservar_map mUserVars;
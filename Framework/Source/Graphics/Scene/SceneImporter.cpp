@@ -36,6 +36,10 @@
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include "Graphics/TextureHelper.h"
 
 #define SCENE_IMPORTER
@@ -106,6 +110,87 @@ namespace Falcor
         return importer.load(filename, modelLoadFlags, sceneLoadFlags);
     }
 
+    /** Preloads model files on a pool of worker threads.
+        Files are handed out in scene order and get() blocks until the requested file is ready. Workers stay at most a few files ahead of the consumer, to bound the memory held by decoded files.
+    */
+    class ModelPreloader
+    {
+    public:
+        ModelPreloader(const std::vector<std::string>& files, Model::LoadFlags flags, uint32_t threadCount) : mFiles(files), mFlags(flags), mResults(files.size()), mReady(files.size(), false)
+        {
+            mMaxFilesAhead = threadCount * 2;
+            for(uint32_t i = 0; i < threadCount; i++)
+            {
+                mThreads.emplace_back(&ModelPreloader::worker, this);
+            }
+        }
+
+        ~ModelPreloader()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mAbort = true;
+            }
+            mCondition.notify_all();
+            for(auto& t : mThreads)
+            {
+                t.join();
+            }
+        }
+
+        /** Wait for a file to be preloaded and take ownership of it. Each file can only be retrieved once.
+        */
+        Model::PreloadedFile::SharedPtr get(size_t index)
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondition.wait(lock, [this, index]() { return mReady[index]; });
+            mConsumed = std::max(mConsumed, index + 1);
+            Model::PreloadedFile::SharedPtr pFile = std::move(mResults[index]);
+            lock.unlock();
+            mCondition.notify_all();
+            return pFile;
+        }
+
+    private:
+        void worker()
+        {
+            while(true)
+            {
+                size_t index;
+                {
+                    std::unique_lock<std::mutex> lock(mMutex);
+                    mCondition.wait(lock, [this]() { return mAbort || mNextFile >= mFiles.size() || mNextFile < mConsumed + mMaxFilesAhead; });
+                    if(mAbort || mNextFile >= mFiles.size())
+                    {
+                        return;
+                    }
+                    index = mNextFile++;
+                }
+
+                Model::PreloadedFile::SharedPtr pFile = Model::preloadFile(mFiles[index].c_str(), mFlags);
+
+                {
+                    std::lock_guard<std::mutex> lock(mMutex);
+                    mResults[index] = pFile;
+                    mReady[index] = true;
+                }
+                mCondition.notify_all();
+            }
+        }
+
+        const std::vector<std::string>& mFiles;
+        Model::LoadFlags mFlags;
+        std::vector<Model::PreloadedFile::SharedPtr> mResults;
+        std::vector<bool> mReady;
+        std::vector<std::thread> mThreads;
+        std::mutex mMutex;
+        std::condition_variable mCondition;
+        size_t mNextFile = 0;
+        size_t mConsumed = 0;
+        size_t mMaxFilesAhead = 0;
+        bool mAbort = false;
+    };
+
     bool SceneImporter::createModelInstances(const rapidjson::Value& jsonVal, const Model::SharedPtr& pModel)
     {
         if(jsonVal.IsArray() == false)
@@ -176,7 +261,7 @@ namespace Falcor
         return true;
     }
 
-    bool SceneImporter::createModel(const rapidjson::Value& jsonModel)
+    bool SceneImporter::getModelFilename(const rapidjson::Value& jsonModel, std::string& file)
     {
         // Model must have at least a filename
         if(jsonModel.HasMember(SceneKeys::kFilename) == false)
@@ -189,19 +274,17 @@ namespace Falcor
             return error("Model filename must be a string");
         }
 
-        // Load the model
-        std::string file =  mDirectory + '/' + modelFile.GetString();
+        file =  mDirectory + '/' + modelFile.GetString();
         if (doesFileExist(file) == false)
         {
             file = modelFile.GetString();
         }
-        auto pModel = Model::createFromFile(file.c_str(), mModelLoadFlags);
-        if(pModel == nullptr)
-        {
-            return error("Could not load model: " + file);
-        }
+        return true;
+    }
 
-        pModel->setFilename(modelFile.GetString());
+    bool SceneImporter::createModel(const rapidjson::Value& jsonModel, const Model::SharedPtr& pModel)
+    {
+        pModel->setFilename(jsonModel[SceneKeys::kFilename].GetString());
 
         bool instanceAdded = false;
 
@@ -324,10 +407,34 @@ namespace Falcor
             return error("models section should be an array of objects.");
         }
 
-        // Loop over the array
+        std::vector<std::string> files(jsonVal.Size());
         for(uint32_t i = 0; i < jsonVal.Size(); i++)
         {
-            if(createModel(jsonVal[i]) == false)
+            if(getModelFilename(jsonVal[i], files[i]) == false)
+            {
+                return false;
+            }
+        }
+
+        // The model files are decoded on worker threads, but the models are created here, in the order they appear in the scene file.
+        // GPU resources are only created by this thread, and the model and instance order doesn't depend on which file finishes decoding first.
+        std::unique_ptr<ModelPreloader> pPreloader;
+        if(is_set(mSceneLoadFlags, Scene::LoadFlags::SerialModelLoading) == false && files.size() > 1)
+        {
+            uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+            threadCount = std::min(threadCount, (uint32_t)files.size());
+            pPreloader = std::make_unique<ModelPreloader>(files, mModelLoadFlags, threadCount);
+        }
+
+        for(uint32_t i = 0; i < jsonVal.Size(); i++)
+        {
+            Model::SharedPtr pModel = pPreloader ? Model::createFromPreloadedFile(pPreloader->get(i)) : Model::createFromFile(files[i].c_str(), mModelLoadFlags);
+            if(pModel == nullptr)
+            {
+                return error("Could not load model: " + files[i]);
+            }
+
+            if(createModel(jsonVal[i], pModel) == false)
             {
                 return false;
             }
@@ -64,7 +64,8 @@ namespace Falcor
 
         bool loadIncludeFile(const std::string& Include);
 
-        bool createModel(const rapidjson::Value& jsonModel);
+        bool getModelFilename(const rapidjson::Value& jsonModel, std::string& file);
+        bool createModel(const rapidjson::Value& jsonModel, const Model::SharedPtr& pModel);
         bool setMaterialOverrides(const rapidjson::Value& jsonVal, const Model::SharedPtr& pModel);
         bool createModelInstances(const rapidjson::Value& jsonVal, const Model::SharedPtr& pModel);
         bool createPointLight(const rapidjson::Value& jsonLight);
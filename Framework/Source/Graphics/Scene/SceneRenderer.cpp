@@ -36,7 +36,10 @@
 #include "VR/OpenVR/VRSystem.h"
 #include "API/Device.h"
 #include "glm/matrix.hpp"
+#include <algorithm>
+#include <cstring>
 #include "Graphics/Material/MaterialSystem.h"
+#include "Utils/RadixSort.h"
 
 namespace Falcor
 {
@@ -49,6 +52,7 @@ namespace Falcor
     size_t SceneRenderer::sWorldInvTransposeMatOffset = ConstantBuffer::kInvalidOffset;
     size_t SceneRenderer::sMeshIdOffset = ConstantBuffer::kInvalidOffset;
     size_t SceneRenderer::sDrawIDOffset = ConstantBuffer::kInvalidOffset;
+    size_t SceneRenderer::sFirstInstanceOffset = ConstantBuffer::kInvalidOffset;
     size_t SceneRenderer::sLightCountOffset = ConstantBuffer::kInvalidOffset;
     size_t SceneRenderer::sLightArrayOffset = ConstantBuffer::kInvalidOffset;
     size_t SceneRenderer::sAmbientLightOffset = ConstantBuffer::kInvalidOffset;
@@ -57,6 +61,7 @@ namespace Falcor
     const char* SceneRenderer::kPerFrameCbName = "InternalPerFrameCB";
     const char* SceneRenderer::kPerMeshCbName = "InternalPerMeshCB";
     const char* SceneRenderer::kBoneCbName = "InternalBoneCB";
+    const char* SceneRenderer::kInstanceBufferName = "gInstanceData";
 
     SceneRenderer::SharedPtr SceneRenderer::create(const Scene::SharedPtr& pScene)
     {
@@ -90,6 +95,8 @@ namespace Falcor
                 sMeshIdOffset = pType->findMember("gMeshId")->getOffset();
                 sDrawIDOffset = pType->findMember("gDrawId[0]")->getOffset();
                 sPrevWorldMatOffset = pType->findMember("gPrevWorldMat[0]")->getOffset();
+                const auto& pFirstInstanceOffset = pType->findMember("gFirstInstance");
+                sFirstInstanceOffset = pFirstInstanceOffset ? pFirstInstanceOffset->getOffset() : ConstantBuffer::kInvalidOffset;
             }
         }
 
@@ -186,16 +193,19 @@ namespace Falcor
 
             assert(drawInstanceID == 0); // We don't support instanced skinned models
 
-            glm::mat4 worldMat = pModelInstance->getTransformMatrix();
-            glm::mat4 prevWorldMat = pModelInstance->getPrevTransformMatrix();
-
-            if (pMesh->hasBones() == false)
+            glm::mat4 worldMat;
+            glm::mat4 prevWorldMat;
+            glm::mat3x4 worldInvTransposeMat;
+            if (currentData.pDrawInstance)
             {
-                worldMat = worldMat * pMeshInstance->getTransformMatrix();
-                prevWorldMat = prevWorldMat * pMeshInstance->getPrevTransformMatrix();
+                worldMat = currentData.pDrawInstance->worldMat;
+                prevWorldMat = currentData.pDrawInstance->prevWorldMat;
+                worldInvTransposeMat = currentData.pDrawInstance->normalMat;
+            }
+            else
+            {
+                calcMeshInstanceTransforms(pModelInstance, pMeshInstance, worldMat, prevWorldMat, worldInvTransposeMat);
             }
-
-            glm::mat3x4 worldInvTransposeMat = transpose(inverse(glm::mat3(worldMat)));
 
             assert(drawInstanceID < sWorldMatArraySize);
             pCB->setBlob(&worldMat, sWorldMatOffset + drawInstanceID * sizeof(glm::mat4), sizeof(glm::mat4));
@@ -209,6 +219,22 @@ namespace Falcor
         return true;
     }
 
+    void SceneRenderer::calcMeshInstanceTransforms(const Scene::ModelInstance* pModelInstance, const Model::MeshInstance* pMeshInstance, glm::mat4& worldMat, glm::mat4& prevWorldMat, glm::mat3x4& normalMat)
+    {
+        worldMat = pModelInstance->getTransformMatrix();
+        prevWorldMat = pModelInstance->getPrevTransformMatrix();
+        normalMat = pModelInstance->getNormalMatrix();
+
+        // Skinned meshes are transformed by their bones
+        if (pMeshInstance->getObject()->hasBones() == false)
+        {
+            worldMat = worldMat * pMeshInstance->getTransformMatrix();
+            prevWorldMat = prevWorldMat * pMeshInstance->getPrevTransformMatrix();
+            // The inverse transpose of a product is the product of the inverse transposes. The instance store only recomputes them when the transforms change.
+            normalMat = glm::mat3x4(glm::mat3(normalMat) * glm::mat3(pMeshInstance->getNormalMatrix()));
+        }
+    }
+
     bool SceneRenderer::setPerMaterialData(const CurrentWorkingData& currentData, const Material* pMaterial)
     {
         if (auto cb = currentData.pVars->getConstantBuffer(kPerMaterialCbName))
@@ -237,13 +263,23 @@ namespace Falcor
             gEventCounter.numMaterialChanges++;
             if(mCompileMaterialWithProgram)
             {
-                MaterialSystem::patchProgram(currentData.pState->getProgram().get(), mpLastMaterial);
+                // The define stays set for the following draws of the material. It's removed once the scene was rendered.
+                Program* pProgram = currentData.pState->getProgram().get();
+                const uint64_t definesHash = pProgram->getActiveDefinesList().getHash();
+                MaterialSystem::patchProgram(pProgram, mpLastMaterial);
+                if(pProgram->getActiveDefinesList().getHash() != definesHash)
+                {
+                    gEventCounter.numProgramVariantChanges++;
+                }
             }
         }
 
-        executeDraw(currentData, pMesh->getIndexCount(), instanceCount);
-        postFlushDraw(currentData);
-        currentData.pState->getProgram()->removeDefine("_MS_STATIC_MATERIAL_DESC");
+        // With Program::CompileMode::AsyncSkip, there's no version until the variant finished compiling
+        if(currentData.pState->getProgram()->getActiveVersion())
+        {
+            executeDraw(currentData, pMesh->getLod(currentData.lod).indexCount, instanceCount);
+            postFlushDraw(currentData);
+        }
     }
 
     void SceneRenderer::postFlushDraw(const CurrentWorkingData& currentData)
@@ -262,10 +298,13 @@ namespace Falcor
             if (pMesh->hasBones())
             {
                 pProgram->addDefine("_VERTEX_BLENDING");
+                gEventCounter.numProgramVariantChanges++;
             }
 
             // Bind VAO and set topology
-            currentData.pState->setVao(pMesh->getVao());
+            currentData.lod = pMesh->selectLod(currentData.lodScreenSize);
+            currentData.pState->setVao(pMesh->getLod(currentData.lod).pVao);
+            gEventCounter.numVaoChanges++;
 
             uint32_t activeInstances = 0;
 
@@ -273,9 +312,8 @@ namespace Falcor
             for (uint32_t instanceID = 0; instanceID < instanceCount; instanceID++)
             {
                 const Model::MeshInstance* pMeshInstance = pModel->getMeshInstance(meshID, instanceID).get();
-                BoundingBox box = pMeshInstance->getBoundingBox().transform(pModelInstance->getTransformMatrix());
 
-                if ((mCullEnabled == false) || (currentData.pCamera->isObjectCulled(box) == false))
+                if ((mCullActive == false) || mCulling.boxVisible[currentData.firstCullingBox + mCulling.meshBoxOffsets[currentData.modelID][meshID] + instanceID])
                 {
                     if (pMeshInstance->isVisible())
                     {
@@ -304,6 +342,7 @@ namespace Falcor
             if (pMesh->hasBones())
             {
                 pProgram->removeDefine("_VERTEX_BLENDING");
+                gEventCounter.numProgramVariantChanges++;
             }
         }
     }
@@ -329,19 +368,276 @@ namespace Falcor
         renderScene(pContext, mpScene->getActiveCamera().get());
     }
 
+    BoundingBox SceneRenderer::calcMeshInstanceBox(const Scene::ModelInstance* pModelInstance, uint32_t meshID, uint32_t instanceID) const
+    {
+        const Model* pModel = pModelInstance->getObject().get();
+        return pModel->getMeshInstance(meshID, instanceID)->getBoundingBox().transform(pModelInstance->getTransformMatrix());
+    }
+
+    bool SceneRenderer::isCullingHierarchyValid() const
+    {
+        if (mCulling.dirty || mCulling.meshBoxOffsets.size() != mpScene->getModelCount())
+        {
+            return false;
+        }
+
+        uint32_t index = 0;
+        for (uint32_t modelID = 0; modelID < mpScene->getModelCount(); modelID++)
+        {
+            // The number of mesh instances of a model is checked through the box count of its instances
+            const Model* pModel = mpScene->getModel(modelID).get();
+            const std::vector<uint32_t>& meshOffsets = mCulling.meshBoxOffsets[modelID];
+            if (meshOffsets.size() != pModel->getMeshCount() + 1) return false;
+            uint32_t boxCount = 0;
+            for (uint32_t meshID = 0; meshID < pModel->getMeshCount(); meshID++)
+            {
+                if (meshOffsets[meshID] != boxCount) return false;
+                boxCount += pModel->getMeshInstanceCount(meshID);
+            }
+            if (meshOffsets.back() != boxCount) return false;
+
+            for (uint32_t instanceID = 0; instanceID < mpScene->getModelInstanceCount(modelID); instanceID++, index++)
+            {
+                if (index >= mCulling.instances.size() || mCulling.instances[index] != mpScene->getModelInstance(modelID, instanceID).get()) return false;
+            }
+        }
+        return index == mCulling.instances.size();
+    }
+
+    void SceneRenderer::buildCullingHierarchy()
+    {
+        const InstanceStore::SharedPtr& pStore = Scene::ModelInstance::getInstanceStore();
+        mCulling.instances.clear();
+        mCulling.firstBox.clear();
+        mCulling.slotToInstance.assign(pStore->getSlotCount(), CullingData::kInvalidIndex);
+        mCulling.changeCursor = pStore->getChangeLogEnd();
+        mCulling.meshBoxOffsets.resize(mpScene->getModelCount());
+
+        std::vector<BoundingBox> boxes;
+        for (uint32_t modelID = 0; modelID < mpScene->getModelCount(); modelID++)
+        {
+            const Model* pModel = mpScene->getModel(modelID).get();
+            std::vector<uint32_t>& meshOffsets = mCulling.meshBoxOffsets[modelID];
+            meshOffsets.resize(pModel->getMeshCount() + 1);
+            uint32_t boxCount = 0;
+            for (uint32_t meshID = 0; meshID < pModel->getMeshCount(); meshID++)
+            {
+                meshOffsets[meshID] = boxCount;
+                boxCount += pModel->getMeshInstanceCount(meshID);
+            }
+            meshOffsets.back() = boxCount;
+
+            for (uint32_t instanceID = 0; instanceID < mpScene->getModelInstanceCount(modelID); instanceID++)
+            {
+                const Scene::ModelInstance* pInstance = mpScene->getModelInstance(modelID, instanceID).get();
+                mCulling.slotToInstance[pInstance->getInstanceSlot()] = (uint32_t)mCulling.instances.size();
+                mCulling.instances.push_back(pInstance);
+                mCulling.firstBox.push_back((uint32_t)boxes.size());
+                for (uint32_t meshID = 0; meshID < pModel->getMeshCount(); meshID++)
+                {
+                    for (uint32_t meshInstanceID = 0; meshInstanceID < pModel->getMeshInstanceCount(meshID); meshInstanceID++)
+                    {
+                        boxes.push_back(calcMeshInstanceBox(pInstance, meshID, meshInstanceID));
+                    }
+                }
+            }
+        }
+
+        if (mCulling.pBvh == nullptr)
+        {
+            mCulling.pBvh = BoundingVolumeHierarchy::create();
+        }
+        mCulling.pBvh->build(boxes);
+        mCulling.visibleIds.clear();
+        mCulling.boxVisible.assign(boxes.size(), 0);
+        mCulling.instanceVisibleCount.resize(mCulling.instances.size());
+        mCulling.dirty = false;
+    }
+
+    void SceneRenderer::cullMeshInstances(const Camera* pCamera)
+    {
+        if (isCullingHierarchyValid() == false)
+        {
+            buildCullingHierarchy();
+        }
+        else
+        {
+            // Refit the boxes of the model instances which moved. The instance store logs the slots it updated, so the unchanged instances aren't touched.
+            const InstanceStore::SharedPtr& pStore = Scene::ModelInstance::getInstanceStore();
+            if (pStore->getChangedSlots(mCulling.changeCursor, mCulling.changedSlots) == false)
+            {
+                // The log was trimmed before we read it, refit everything
+                mCulling.changedSlots.clear();
+                for (const Scene::ModelInstance* pInstance : mCulling.instances)
+                {
+                    mCulling.changedSlots.push_back(pInstance->getInstanceSlot());
+                }
+            }
+
+            for (uint32_t slot : mCulling.changedSlots)
+            {
+                uint32_t index = (slot < mCulling.slotToInstance.size()) ? mCulling.slotToInstance[slot] : CullingData::kInvalidIndex;
+                if (index == CullingData::kInvalidIndex) continue;
+
+                const Scene::ModelInstance* pInstance = mCulling.instances[index];
+                const Model* pModel = pInstance->getObject().get();
+                uint32_t boxID = mCulling.firstBox[index];
+                for (uint32_t meshID = 0; meshID < pModel->getMeshCount(); meshID++)
+                {
+                    for (uint32_t meshInstanceID = 0; meshInstanceID < pModel->getMeshInstanceCount(meshID); meshInstanceID++, boxID++)
+                    {
+                        mCulling.pBvh->update(boxID, calcMeshInstanceBox(pInstance, meshID, meshInstanceID));
+                    }
+                }
+            }
+        }
+
+        // Clear the results of the previous cull. Only the boxes which were visible need to be reset.
+        for (uint32_t id : mCulling.visibleIds)
+        {
+            if (id < mCulling.boxVisible.size()) mCulling.boxVisible[id] = 0;
+        }
+        std::fill(mCulling.instanceVisibleCount.begin(), mCulling.instanceVisibleCount.end(), 0);
+
+        mCulling.pBvh->cull(pCamera, mCulling.visibleIds);
+        if (mOcclusionCullEnabled && mOccluders.empty() == false)
+        {
+            cullOccludedMeshInstances(pCamera);
+        }
+
+        for (uint32_t id : mCulling.visibleIds)
+        {
+            mCulling.boxVisible[id] = 1;
+            // The boxes of an instance are contiguous
+            uint32_t instance = (uint32_t)(std::upper_bound(mCulling.firstBox.begin(), mCulling.firstBox.end(), id) - mCulling.firstBox.begin()) - 1;
+            mCulling.instanceVisibleCount[instance]++;
+        }
+    }
+
+    void SceneRenderer::cullOccludedMeshInstances(const Camera* pCamera)
+    {
+        if (mpOcclusionBuffer == nullptr)
+        {
+            mpOcclusionBuffer = OcclusionBuffer::create();
+        }
+
+        mpOcclusionBuffer->clear(pCamera->getViewProjMatrix());
+        for (const Occluder& occluder : mOccluders)
+        {
+            if (occluder.modelID >= mpScene->getModelCount() || occluder.instanceID >= mpScene->getModelInstanceCount(occluder.modelID)) continue;
+            const Scene::ModelInstance* pInstance = mpScene->getModelInstance(occluder.modelID, occluder.instanceID).get();
+            if (pInstance->isVisible() == false) continue;
+
+            if (occluder.positions.empty())
+            {
+                mpOcclusionBuffer->rasterizeBox(occluder.box, pInstance->getTransformMatrix());
+            }
+            else
+            {
+                mpOcclusionBuffer->rasterizeTriangles(occluder.positions.data(), (uint32_t)occluder.positions.size(), occluder.indices.data(), (uint32_t)occluder.indices.size(), pInstance->getTransformMatrix());
+            }
+        }
+        mpOcclusionBuffer->updateHierarchy();
+
+        // Compact the boxes which passed frustum culling
+        uint32_t visibleCount = 0;
+        for (uint32_t id : mCulling.visibleIds)
+        {
+            if (mpOcclusionBuffer->isVisible(mCulling.pBvh->getBox(id)))
+            {
+                mCulling.visibleIds[visibleCount++] = id;
+            }
+        }
+        gEventCounter.numOcclusionTests += (int)mCulling.visibleIds.size();
+        gEventCounter.numOcclusionCulled += (int)mCulling.visibleIds.size() - (int)visibleCount;
+        mCulling.visibleIds.resize(visibleCount);
+    }
+
+    void SceneRenderer::selectLods(const Camera* pCamera)
+    {
+        const glm::mat4& viewMat = pCamera->getViewMatrix();
+        const glm::mat4& projMat = pCamera->getProjMatrix();
+
+        uint32_t index = 0;
+        for (uint32_t modelID = 0; modelID < mpScene->getModelCount(); modelID++)
+        {
+            for (uint32_t instanceID = 0; instanceID < mpScene->getModelInstanceCount(modelID); instanceID++, index++)
+            {
+                const Scene::ModelInstance* pInstance = mpScene->getModelInstance(modelID, instanceID).get();
+                if (index >= mLod.instances.size())
+                {
+                    mLod.instances.push_back(pInstance);
+                    mLod.selectionSizes.push_back(-1);
+                }
+                else if (mLod.instances[index] != pInstance)
+                {
+                    mLod.instances[index] = pInstance;
+                    mLod.selectionSizes[index] = -1;
+                }
+
+                BoundingBox box = pInstance->getBoundingBox();
+                float screenSize = LodSelector::calcScreenSize(box.center, glm::length(box.extent), viewMat, projMat);
+                mLod.selectionSizes[index] = LodSelector::applyHysteresis(screenSize, mLod.selectionSizes[index], mLod.hysteresis);
+            }
+        }
+        mLod.instances.resize(index);
+        mLod.selectionSizes.resize(index);
+    }
+
     void SceneRenderer::renderScene(CurrentWorkingData& currentData)
     {
         setPerFrameData(currentData);
 
+        if (mDrawListMode)
+        {
+            buildDrawList(currentData.pCamera, mDrawList);
+            submitDrawList(currentData, mDrawList);
+        }
+        else
+        {
+            renderSceneDirect(currentData);
+        }
+
+        // Restore the program state patched by draw()
+        currentData.pState->getProgram()->removeDefine("_MS_STATIC_MATERIAL_DESC");
+    }
+
+    void SceneRenderer::renderSceneDirect(CurrentWorkingData& currentData)
+    {
+
+        updateInstanceTransforms();
+
+        mCullActive = mCullEnabled && (currentData.pCamera != nullptr);
+        if (mCullActive)
+        {
+            cullMeshInstances(currentData.pCamera);
+        }
+
+        mLodActive = mLodEnabled && (currentData.pCamera != nullptr);
+        if (mLodActive)
+        {
+            selectLods(currentData.pCamera);
+        }
+
+        uint32_t instanceIndex = 0;
         for (uint32_t modelID = 0; modelID < mpScene->getModelCount(); modelID++)
         {
             currentData.pModel = mpScene->getModel(modelID).get();
+            currentData.modelID = modelID;
 
             if (setPerModelData(currentData))
             {
                 for (uint32_t instanceID = 0; instanceID < mpScene->getModelInstanceCount(modelID); instanceID++)
                 {
                     const auto pInstance = mpScene->getModelInstance(modelID, instanceID).get();
+                    uint32_t index = instanceIndex + instanceID;
+                    if (mCullActive && mCulling.instanceVisibleCount[index] == 0)
+                    {
+                        continue;
+                    }
+                    currentData.firstCullingBox = mCullActive ? mCulling.firstBox[index] : 0;
+                    currentData.lodScreenSize = mLodActive ? mLod.selectionSizes[index] : FLT_MAX;
+
                     if (pInstance->isVisible())
                     {
                         if (setPerModelInstanceData(currentData, pInstance, instanceID))
@@ -351,6 +647,424 @@ namespace Falcor
                     }
                 }
             }
+            instanceIndex += mpScene->getModelInstanceCount(modelID);
+        }
+    }
+
+    void SceneRenderer::updateInstanceTransforms()
+    {
+        // Recompute the transforms and bounds of all the instances which moved since the last frame in one batched pass
+        Scene::ModelInstance::getInstanceStore()->updateTransforms();
+        Model::MeshInstance::getInstanceStore()->updateTransforms();
+    }
+
+    void SceneRenderer::buildModelInstanceDraws(uint32_t modelID, uint32_t instanceID, uint32_t instanceIndex, DrawList& drawList) const
+    {
+        const Scene::ModelInstance* pModelInstance = mpScene->getModelInstance(modelID, instanceID).get();
+        if (pModelInstance->isVisible() == false) return;
+        if (mCullActive && mCulling.instanceVisibleCount[instanceIndex] == 0) return;
+
+        const Model* pModel = pModelInstance->getObject().get();
+        for (uint32_t meshID = 0; meshID < pModel->getMeshCount(); meshID++)
+        {
+            const Mesh* pMesh = pModel->getMesh(meshID).get();
+            DrawList::Packet packet;
+            packet.modelID = modelID;
+            packet.modelInstanceID = instanceID;
+            packet.pModelInstance = pModelInstance;
+            packet.meshID = meshID;
+            packet.pMesh = pMesh;
+            packet.lod = mLodActive ? pMesh->selectLod(mLod.selectionSizes[instanceIndex]) : 0;
+            packet.pMaterial = pMesh->getMaterial().get();
+            packet.firstInstance = (uint32_t)drawList.instances.size();
+            packet.sortKey = 0;
+
+            const uint32_t firstBox = mCullActive ? mCulling.firstBox[instanceIndex] + mCulling.meshBoxOffsets[modelID][meshID] : 0;
+            for (uint32_t meshInstanceID = 0; meshInstanceID < pModel->getMeshInstanceCount(meshID); meshInstanceID++)
+            {
+                if (mCullActive && mCulling.boxVisible[firstBox + meshInstanceID] == 0) continue;
+
+                const Model::MeshInstance* pMeshInstance = pModel->getMeshInstance(meshID, meshInstanceID).get();
+                if (pMeshInstance->isVisible() == false) continue;
+
+                DrawList::Instance instance;
+                instance.pMeshInstance = pMeshInstance;
+                calcMeshInstanceTransforms(pModelInstance, pMeshInstance, instance.worldMat, instance.prevWorldMat, instance.normalMat);
+                drawList.instances.push_back(instance);
+            }
+
+            packet.instanceCount = (uint32_t)drawList.instances.size() - packet.firstInstance;
+            if (packet.instanceCount)
+            {
+                drawList.packets.push_back(packet);
+            }
+        }
+    }
+
+    void SceneRenderer::buildDrawList(const Camera* pCamera, DrawList& drawList)
+    {
+        // Model instances per batch. Each batch writes to its own list, and the lists are concatenated in order.
+        static const uint32_t kModelInstancesPerBatch = 64;
+
+        updateInstanceTransforms();
+
+        mCullActive = mCullEnabled && (pCamera != nullptr);
+        if (mCullActive)
+        {
+            cullMeshInstances(pCamera);
+        }
+
+        mLodActive = mLodEnabled && (pCamera != nullptr);
+        if (mLodActive)
+        {
+            selectLods(pCamera);
+        }
+
+        auto& modelInstances = mDrawListBuild.modelInstances;
+        modelInstances.clear();
+        for (uint32_t modelID = 0; modelID < mpScene->getModelCount(); modelID++)
+        {
+            for (uint32_t instanceID = 0; instanceID < mpScene->getModelInstanceCount(modelID); instanceID++)
+            {
+                modelInstances.push_back(std::make_pair(modelID, instanceID));
+            }
+        }
+
+        if (mpJobSystem == nullptr)
+        {
+            mpJobSystem = JobSystem::create();
+        }
+
+        const uint32_t instanceCount = (uint32_t)modelInstances.size();
+        auto& batchLists = mDrawListBuild.batchLists;
+        batchLists.resize((instanceCount + kModelInstancesPerBatch - 1) / kModelInstancesPerBatch);
+
+        // The transforms are up to date and the culling results are final, so the batches only read shared data
+        mpJobSystem->parallelFor(instanceCount, kModelInstancesPerBatch, [&](uint32_t first, uint32_t last)
+        {
+            DrawList& batchList = batchLists[first / kModelInstancesPerBatch];
+            batchList.clear();
+            for (uint32_t i = first; i < last; i++)
+            {
+                buildModelInstanceDraws(modelInstances[i].first, modelInstances[i].second, i, batchList);
+            }
+        });
+
+        drawList.clear();
+        for (const DrawList& batchList : batchLists)
+        {
+            const uint32_t instanceOffset = (uint32_t)drawList.instances.size();
+            for (DrawList::Packet packet : batchList.packets)
+            {
+                packet.firstInstance += instanceOffset;
+                drawList.packets.push_back(packet);
+            }
+            drawList.instances.insert(drawList.instances.end(), batchList.instances.begin(), batchList.instances.end());
+        }
+
+        if (mSortDrawList)
+        {
+            sortDrawList(pCamera, drawList);
+        }
+
+        batchDrawList(drawList);
+    }
+
+    bool SceneRenderer::canBatch(const DrawList::Packet& first, const DrawList::Packet& packet)
+    {
+        if (first.pMaterial != packet.pMaterial) return false;
+
+        // Different meshes can share their geometry
+        const Mesh* pFirstMesh = first.pMesh;
+        const Mesh* pMesh = packet.pMesh;
+        if (pFirstMesh != pMesh || first.lod != packet.lod)
+        {
+            const Mesh::Lod& firstLod = pFirstMesh->getLod(first.lod);
+            const Mesh::Lod& lod = pMesh->getLod(packet.lod);
+            if (firstLod.pVao == nullptr || firstLod.pVao != lod.pVao || firstLod.indexCount != lod.indexCount) return false;
+            if (pFirstMesh->hasBones() != pMesh->hasBones()) return false;
+        }
+
+        // The bone matrices are per model
+        return (pMesh->hasBones() == false) || (first.modelID == packet.modelID);
+    }
+
+    void SceneRenderer::batchDrawList(DrawList& drawList)
+    {
+        drawList.batches.clear();
+        auto& batchedInstances = mDrawListBuild.batchedInstances;
+        batchedInstances.clear();
+
+        const uint32_t packetCount = (uint32_t)drawList.packets.size();
+        for (uint32_t i = 0; i < packetCount; i++)
+        {
+            const DrawList::Packet& packet = drawList.packets[i];
+            if (drawList.batches.empty() || mInstanceBatching == false || canBatch(drawList.packets[drawList.batches.back().firstPacket], packet) == false)
+            {
+                DrawList::Batch batch;
+                batch.firstPacket = i;
+                batch.packetCount = 0;
+                batch.firstInstance = (uint32_t)batchedInstances.size();
+                batch.instanceCount = 0;
+                drawList.batches.push_back(batch);
+            }
+
+            DrawList::Batch& batch = drawList.batches.back();
+            batch.packetCount++;
+            batch.instanceCount += packet.instanceCount;
+            for (uint32_t j = packet.firstInstance; j < packet.firstInstance + packet.instanceCount; j++)
+            {
+                batchedInstances.push_back(j);
+            }
+        }
+
+        // The draw IDs follow the submission order, like the unbatched path
+        const uint32_t instanceCount = (uint32_t)batchedInstances.size();
+        drawList.instanceData.resize(instanceCount);
+        static const uint32_t kInstancesPerBatch = 1024;
+        mpJobSystem->parallelFor(instanceCount, kInstancesPerBatch, [&](uint32_t first, uint32_t last)
+        {
+            for (uint32_t i = first; i < last; i++)
+            {
+                const DrawList::Instance& instance = drawList.instances[batchedInstances[i]];
+                PerInstanceData& data = drawList.instanceData[i];
+                data.worldMat = instance.worldMat;
+                data.prevWorldMat = instance.prevWorldMat;
+                data.worldInvTransposeMat = glm::mat4(glm::mat3(instance.normalMat));
+                data.drawId = i;
+            }
+        });
+    }
+
+    // Draw sort key layout, see SceneRenderer::DrawList
+    static const uint32_t kDepthBits = 13;
+    static const uint32_t kLodBits = 2;
+    static const uint32_t kMeshBits = 16;
+    static const uint32_t kMaterialBits = 16;
+    static const uint32_t kMaterialDescBits = 15;
+    static const uint64_t kTransparentBit = (uint64_t)1 << 63;
+
+    static uint64_t packSortField(uint64_t key, uint64_t value, uint32_t bits)
+    {
+        return (key << bits) | (value & (((uint64_t)1 << bits) - 1));
+    }
+
+    void SceneRenderer::sortDrawList(const Camera* pCamera, DrawList& drawList)
+    {
+        const uint32_t packetCount = (uint32_t)drawList.packets.size();
+        auto& keys = mDrawListBuild.sortKeys;
+        auto& order = mDrawListBuild.sortedPackets;
+        keys.resize(packetCount);
+        order.resize(packetCount);
+
+        const float maxDepth = pCamera ? pCamera->getFarPlane() : 1.0f;
+        const uint32_t maxDepthBucket = (1 << kDepthBits) - 1;
+        for (uint32_t i = 0; i < packetCount; i++)
+        {
+            DrawList::Packet& packet = drawList.packets[i];
+
+            // The depth of a packet is the distance to its first instance
+            uint32_t depth = 0;
+            if (pCamera)
+            {
+                glm::vec3 position(drawList.instances[packet.firstInstance].worldMat[3]);
+                float distance = glm::length(position - pCamera->getPosition());
+                depth = (uint32_t)(std::min(distance / maxDepth, 1.0f) * maxDepthBucket);
+            }
+
+            uint64_t state = packet.pMesh->hasBones() ? 1 : 0;
+            state = packSortField(state, packet.pMaterial->getDescIdentifier(), kMaterialDescBits);
+            state = packSortField(state, (uint64_t)packet.pMaterial->getId(), kMaterialBits);
+            state = packSortField(state, packet.pMesh->getId(), kMeshBits);
+            state = packSortField(state, packet.lod, kLodBits);
+
+            uint64_t key;
+            if (isTransparent(packet.pMesh))
+            {
+                key = kTransparentBit | packSortField(maxDepthBucket - depth, state, 63 - kDepthBits);
+            }
+            else
+            {
+                key = packSortField(state, depth, kDepthBits);
+            }
+            packet.sortKey = key;
+            keys[i] = key;
+            order[i] = i;
+        }
+
+        radixSort(keys, order);
+
+        auto& sorted = mDrawListBuild.packets;
+        sorted.resize(packetCount);
+        for (uint32_t i = 0; i < packetCount; i++)
+        {
+            sorted[i] = drawList.packets[order[i]];
+        }
+        drawList.packets.swap(sorted);
+    }
+
+    void SceneRenderer::submitPacket(CurrentWorkingData& currentData, const DrawList& drawList, const DrawList::Packet& packet)
+    {
+        uint32_t activeInstances = 0;
+        for (uint32_t i = packet.firstInstance; i < packet.firstInstance + packet.instanceCount; i++)
+        {
+            const DrawList::Instance& instance = drawList.instances[i];
+            currentData.pDrawInstance = &instance;
+            if (setPerMeshInstanceData(currentData, packet.pModelInstance, instance.pMeshInstance, activeInstances))
+            {
+                currentData.drawID++;
+                activeInstances++;
+
+                if (activeInstances == mMaxInstanceCount)
+                {
+                    draw(currentData, packet.pMesh, activeInstances);
+                    activeInstances = 0;
+                }
+            }
+        }
+        currentData.pDrawInstance = nullptr;
+
+        if (activeInstances != 0)
+        {
+            draw(currentData, packet.pMesh, activeInstances);
+        }
+    }
+
+    bool SceneRenderer::setInstanceBuffer(const CurrentWorkingData& currentData, const DrawList& drawList)
+    {
+        if (sFirstInstanceOffset == ConstantBuffer::kInvalidOffset) return false;
+
+        const auto& pBlock = currentData.pVars->getReflection()->getDefaultParameterBlock();
+        const ReflectionVar* pVar = pBlock ? pBlock->getResource(kInstanceBufferName).get() : nullptr;
+        if (pVar == nullptr) return false;
+
+        // Grow the buffer geometrically, so it's only reallocated a few times while the scene grows
+        const size_t instanceCount = drawList.instanceData.size();
+        if (mpInstanceBuffer == nullptr || mpInstanceBuffer->getElementCount() < instanceCount)
+        {
+            size_t capacity = mpInstanceBuffer ? mpInstanceBuffer->getElementCount() : 1024;
+            while (capacity < instanceCount) capacity *= 2;
+
+            ReflectionResourceType::SharedConstPtr pType = pVar->getType()->unwrapArray()->asResourceType()->inherit_shared_from_this::shared_from_this();
+            mpInstanceBuffer = StructuredBuffer::create(kInstanceBufferName, pType, capacity, Resource::BindFlags::ShaderResource);
+            assert(mpInstanceBuffer->getElementSize() == sizeof(PerInstanceData));
+            // The content is written with copies from the upload arena. Clear the CPU copy's dirty flag, so binding the buffer doesn't overwrite it.
+            mpInstanceBuffer->uploadToGPU();
+        }
+
+        if (mpUploadArena == nullptr)
+        {
+            mpUploadArena = UploadArena::create();
+        }
+        mpUploadArena->reset();
+
+        // Stage the data in the arena's pages and copy it into the buffer. A copy never straddles two pages.
+        const uint8_t* pSrc = (const uint8_t*)drawList.instanceData.data();
+        const size_t size = instanceCount * sizeof(PerInstanceData);
+        const size_t maxCopySize = std::max<size_t>(1, mpUploadArena->getPageSize() / sizeof(PerInstanceData)) * sizeof(PerInstanceData);
+        for (size_t offset = 0; offset < size; offset += maxCopySize)
+        {
+            const size_t copySize = std::min(maxCopySize, size - offset);
+            UploadArena::Allocation allocation = mpUploadArena->allocate(copySize, sizeof(glm::vec4));
+            std::memcpy(allocation.pData, pSrc + offset, copySize);
+            currentData.pContext->copyBufferRegion(mpInstanceBuffer.get(), offset, allocation.pBuffer, allocation.offset, copySize);
+        }
+
+        currentData.pVars->setStructuredBuffer(kInstanceBufferName, mpInstanceBuffer);
+        return true;
+    }
+
+    void SceneRenderer::submitBatch(CurrentWorkingData& currentData, const DrawList::Batch& batch, const DrawList::Packet& packet)
+    {
+        ConstantBuffer* pCB = currentData.pVars->getConstantBuffer(kPerMeshCbName).get();
+        if (pCB)
+        {
+            pCB->setVariable(sMeshIdOffset, packet.pMesh->getId());
+            pCB->setVariable(sFirstInstanceOffset, batch.firstInstance);
+        }
+        currentData.drawID += batch.instanceCount;
+        draw(currentData, packet.pMesh, batch.instanceCount);
+    }
+
+    void SceneRenderer::submitDrawList(CurrentWorkingData& currentData, const DrawList& drawList)
+    {
+        const Scene::ModelInstance* pCurrentInstance = nullptr;
+        const Vao* pCurrentVao = nullptr;
+        bool modelValid = false;
+        bool instanceValid = false;
+        bool vertexBlending = false;
+        currentData.pModel = nullptr;
+        mpLastMaterial = nullptr;
+        Program* pProgram = currentData.pState->getProgram().get();
+
+        const bool batched = (drawList.batches.empty() == false) && setInstanceBuffer(currentData, drawList);
+        if (batched)
+        {
+            pProgram->addDefine("_INSTANCE_BUFFER");
+            gEventCounter.numProgramVariantChanges++;
+        }
+
+        // When batching, the state of a batch is the state of its first packet
+        const uint32_t drawCount = (uint32_t)(batched ? drawList.batches.size() : drawList.packets.size());
+        for (uint32_t drawIndex = 0; drawIndex < drawCount; drawIndex++)
+        {
+            const DrawList::Packet& packet = drawList.packets[batched ? drawList.batches[drawIndex].firstPacket : drawIndex];
+            const Model* pModel = mpScene->getModel(packet.modelID).get();
+            if (pModel != currentData.pModel)
+            {
+                currentData.pModel = pModel;
+                currentData.modelID = packet.modelID;
+                modelValid = setPerModelData(currentData);
+                pCurrentInstance = nullptr;
+            }
+            if (modelValid == false) continue;
+
+            if (packet.pModelInstance != pCurrentInstance)
+            {
+                pCurrentInstance = packet.pModelInstance;
+                // Packets of a model instance are contiguous when the list isn't sorted. Match the single-threaded path, which rebinds the material for every model instance.
+                if (mSortDrawList == false) mpLastMaterial = nullptr;
+                instanceValid = setPerModelInstanceData(currentData, pCurrentInstance, packet.modelInstanceID);
+            }
+            if (instanceValid == false) continue;
+
+            const Mesh* pMesh = packet.pMesh;
+            if (setPerMeshData(currentData, pMesh) == false) continue;
+
+            if (pMesh->hasBones() != vertexBlending)
+            {
+                vertexBlending = pMesh->hasBones();
+                if (vertexBlending) pProgram->addDefine("_VERTEX_BLENDING");
+                else pProgram->removeDefine("_VERTEX_BLENDING");
+                gEventCounter.numProgramVariantChanges++;
+            }
+
+            const Vao::SharedPtr& pVao = pMesh->getLod(packet.lod).pVao;
+            if (pVao.get() != pCurrentVao)
+            {
+                pCurrentVao = pVao.get();
+                currentData.pState->setVao(pVao);
+                gEventCounter.numVaoChanges++;
+            }
+            currentData.lod = packet.lod;
+
+            if (batched)
+            {
+                submitBatch(currentData, drawList.batches[drawIndex], packet);
+            }
+            else
+            {
+                submitPacket(currentData, drawList, packet);
+            }
+        }
+
+        if (vertexBlending)
+        {
+            pProgram->removeDefine("_VERTEX_BLENDING");
+        }
+        if (batched)
+        {
+            pProgram->removeDefine("_INSTANCE_BUFFER");
         }
     }
 
@@ -27,12 +27,18 @@
 ***************************************************************************/
 #pragma once
 #include <vector>
+#include <cfloat>
 #include "Utils/Gui.h"
 #include "Graphics/Camera/CameraController.h"
 #include "Graphics/Scene/Scene.h"
 #include "Utils/CpuTimer.h"
 #include "API/ConstantBuffer.h"
+#include "API/StructuredBuffer.h"
+#include "API/UploadArena.h"
 #include "Utils/DebugDrawer.h"
+#include "Graphics/Scene/BoundingVolumeHierarchy.h"
+#include "Graphics/Scene/OcclusionBuffer.h"
+#include "Utils/JobSystem.h"
 
 namespace Falcor
 {
@@ -74,9 +80,54 @@ namespace Falcor
         bool onMouseEvent(const MouseEvent& mouseEvent);
 
         /** Enable/disable mesh culling. Culling does not always result in performance gain, especially when there are a lot of meshes to process with low rejection rate.
+            Mesh instances are culled by traversing a bounding volume hierarchy. It is rebuilt when model instances are added or removed, and refit when they move.
         */
         void setObjectCullState(bool enable) { mCullEnabled = enable; }
 
+        /** Rebuild the culling hierarchy before the next frame.
+            Changes to model and model instance transforms are detected automatically. Call this after changing the transform of a mesh instance inside a model.
+        */
+        void invalidateCullingHierarchy() { mCulling.dirty = true; }
+
+        /** An occluder used by occlusion culling. It moves with a model instance.
+            An occluder must be inside the geometry it stands for, otherwise meshes which are visible through the geometry get culled.
+        */
+        struct Occluder
+        {
+            uint32_t modelID = 0;
+            uint32_t instanceID = 0;            ///< The model instance the occluder is attached to
+            std::vector<glm::vec3> positions;   ///< Simplified geometry in the model's space. If empty, the box is used instead.
+            std::vector<uint32_t> indices;      ///< Triangle list indexing the positions
+            BoundingBox box;                    ///< Solid box in the model's space
+        };
+
+        /** Enable/disable occlusion culling. Only has an effect when object culling is enabled.
+            The occluders are rasterized on the CPU into a low-resolution depth buffer, and the mesh instances which passed frustum culling are tested against it. The number of tested and culled mesh instances is added to gEventCounter.
+        */
+        void setOcclusionCullState(bool enable) { mOcclusionCullEnabled = enable; }
+
+        /** Set the occluders. Occluders whose model instance doesn't exist or isn't visible are ignored.
+        */
+        void setOccluders(const std::vector<Occluder>& occluders) { mOccluders = occluders; }
+
+        /** Get the depth buffer of the last occlusion culling pass. nullptr if occlusion culling was never used.
+        */
+        const OcclusionBuffer::SharedPtr& getOcclusionBuffer() const { return mpOcclusionBuffer; }
+
+        /** Enable/disable LOD selection. Disabled by default.
+            When enabled, each model instance draws its meshes with the level of detail matching its size on screen, see Mesh::getLod(). The size is computed from the model instance's bounding sphere.
+            Meshes smaller than their model switch later than their LOD chain allows, but never earlier.
+        */
+        void setLodSelection(bool enable) { mLodEnabled = enable; }
+
+        /** Check if LOD selection is enabled
+        */
+        bool isLodSelectionEnabled() const { return mLodEnabled; }
+
+        /** Set the LOD hysteresis. A model instance only re-selects its LODs once its screen size changed by more than this fraction since the last selection, so instances near a switch distance don't alternate between two LODs. Defaults to 0.1.
+        */
+        void setLodHysteresis(float hysteresis) { mLod.hysteresis = hysteresis; }
+
         /** Set the maximal number of mesh instance to dispatch in a single draw call.
         */
         void setMaxInstanceCount(uint32_t instanceCount) { mMaxInstanceCount = instanceCount; }
@@ -96,6 +147,108 @@ namespace Falcor
 
         void toggleStaticMaterialCompilation(bool on) { mCompileMaterialWithProgram = on; }
 
+        /** The draws of a frame, generated by buildDrawList().
+            Without sorting, packets are ordered like the draws of the single-threaded path: by model, then model instance, then mesh.
+            With sorting, they are ordered by their sort key. The key of an opaque packet is, from the most significant bits:
+            - the transparency bit (0)
+            - the program variant (vertex blending)
+            - the material descriptor identifier
+            - the material ID
+            - the mesh ID and the LOD, which select the VAO
+            - a depth bucket, so the closest packets are drawn first
+            Transparent packets have the transparency bit set, and the inverted depth bucket comes right after it, so they are drawn back-to-front after all the opaque ones.
+            IDs are truncated to the width of their field. A collision only costs a redundant state change.
+        */
+        struct DrawList
+        {
+            struct Instance
+            {
+                const Model::MeshInstance* pMeshInstance;
+                glm::mat4 worldMat;
+                glm::mat4 prevWorldMat;
+                glm::mat3x4 normalMat;  // Inverse transpose of the world matrix
+            };
+
+            /** The visible instances of a mesh inside a model instance
+            */
+            struct Packet
+            {
+                uint32_t modelID;
+                uint32_t modelInstanceID;
+                const Scene::ModelInstance* pModelInstance;
+                uint32_t meshID;
+                const Mesh* pMesh;
+                uint32_t lod;           // The mesh LOD to draw
+                const Material* pMaterial;
+                uint32_t firstInstance; // Index of the packet's first instance in the instances array
+                uint32_t instanceCount;
+                uint64_t sortKey;
+            };
+
+            /** Packets drawn with a single instanced draw call. Without instance batching, each packet is a batch of its own.
+            */
+            struct Batch
+            {
+                uint32_t firstPacket;
+                uint32_t packetCount;
+                uint32_t firstInstance; // Index of the batch's first instance in the instanceData array
+                uint32_t instanceCount;
+            };
+
+            std::vector<Packet> packets;
+            std::vector<Instance> instances;
+            std::vector<Batch> batches;
+            std::vector<PerInstanceData> instanceData;  // The shader data of the instances, in batch order
+
+            void clear() { packets.clear(); instances.clear(); batches.clear(); instanceData.clear(); }
+        };
+
+        /** Enable/disable two-phase rendering. When enabled, renderScene() first builds a draw list on the job system, then submits it on the calling thread.
+            The per-model and per-model-instance hooks are only called for models and instances which have something to draw.
+            The per-instance data of the whole frame is uploaded at once into the gInstanceData structured buffer, and each draw references its first instance with gFirstInstance. The program is compiled with _INSTANCE_BUFFER defined, so DefaultVS reads the transforms from the buffer. setPerMeshInstanceData() isn't called.
+            gInstanceData is declared by DefaultVS. If the program's vertex shader doesn't import DefaultVS or declare gInstanceData itself, the instances are set one by one into InternalPerMeshCB instead.
+        */
+        void setDrawListMode(bool enable) { mDrawListMode = enable; }
+
+        /** Check if two-phase rendering is enabled
+        */
+        bool isDrawListModeEnabled() const { return mDrawListMode; }
+
+        /** Enable/disable sorting the draw list to minimize state changes. Enabled by default.
+        */
+        void setDrawListSorting(bool enable) { mSortDrawList = enable; }
+
+        /** Check if draw list sorting is enabled
+        */
+        bool isDrawListSortingEnabled() const { return mSortDrawList; }
+
+        /** Enable/disable instance batching in two-phase rendering. Disabled by default.
+            When enabled, consecutive packets which draw the same geometry (VAO) with the same material are merged into a single instanced draw, even across models and model instances.
+            Sorting the draw list makes those packets consecutive, so batching should be used together with it.
+            setPerModelData() and setPerModelInstanceData() are called for the first packet of each batch only.
+            Batching requires the program's vertex shader to declare gInstanceData (DefaultVS does), otherwise the packets are drawn one by one.
+        */
+        void setInstanceBatching(bool enable) { mInstanceBatching = enable; }
+
+        /** Check if instance batching is enabled
+        */
+        bool isInstanceBatchingEnabled() const { return mInstanceBatching; }
+
+        /** Set the job system used to build draw lists. By default the renderer creates one with a thread per hardware thread.
+        */
+        void setJobSystem(const JobSystem::SharedPtr& pJobSystem) { mpJobSystem = pJobSystem; }
+
+        /** Update the instance transforms, cull the scene and generate the draws of a frame. Model instances are split across the job system's threads.
+            This doesn't touch the GPU, so it can run ahead of submission.
+            \param[in] pCamera The camera to cull against. Can be nullptr, in which case nothing is culled.
+            \param[out] drawList The draws. Its previous content is replaced.
+        */
+        void buildDrawList(const Camera* pCamera, DrawList& drawList);
+
+        /** Get the draw list of the last frame rendered in two-phase mode
+        */
+        const DrawList& getDrawList() const { return mDrawList; }
+
     protected:
 
         struct CurrentWorkingData
@@ -108,6 +261,11 @@ namespace Falcor
             const Material* pMaterial = nullptr;
 
             uint32_t drawID; // Zero-based mesh instance draw order/ID. Resets at the beginning of renderScene, and increments per mesh instance drawn.
+            uint32_t modelID = 0;
+            uint32_t firstCullingBox = 0; // ID of the bounding box of the current model instance's first mesh instance in the culling hierarchy
+            float lodScreenSize = FLT_MAX; // Screen size the current model instance selects the mesh LODs with. FLT_MAX selects the full-resolution meshes.
+            uint32_t lod = 0; // The LOD of the mesh being drawn
+            const DrawList::Instance* pDrawInstance = nullptr; // When submitting a draw list, the instance being drawn. Its transforms are precomputed.
         };
 
         SceneRenderer(const Scene::SharedPtr& pScene);
@@ -117,6 +275,7 @@ namespace Falcor
         static const char* kPerFrameCbName;
         static const char* kPerMeshCbName;
         static const char* kBoneCbName;
+        static const char* kInstanceBufferName;
 
         static size_t sBonesOffset;
         static size_t sBonesInvTransposeOffset;
@@ -130,6 +289,7 @@ namespace Falcor
         static size_t sWorldInvTransposeMatOffset;
         static size_t sMeshIdOffset;
         static size_t sDrawIDOffset;
+        static size_t sFirstInstanceOffset;
 
         static void updateVariableOffsets(const ProgramReflection* pReflector);
 
@@ -148,12 +308,110 @@ namespace Falcor
 
         void renderScene(CurrentWorkingData& currentData);
 
+        /** Render the scene model instance by model instance, without building a draw list
+        */
+        void renderSceneDirect(CurrentWorkingData& currentData);
+
+        /** Replay a draw list. Calls the same set*Data() hooks as the single-threaded path.
+        */
+        void submitDrawList(CurrentWorkingData& currentData, const DrawList& drawList);
+        void submitPacket(CurrentWorkingData& currentData, const DrawList& drawList, const DrawList::Packet& packet);
+        void submitBatch(CurrentWorkingData& currentData, const DrawList::Batch& batch, const DrawList::Packet& packet);
+
+        /** Group the packets of a draw list into batches, and compute the shader data of their instances. Consecutive packets are merged if instance batching is enabled.
+        */
+        void batchDrawList(DrawList& drawList);
+        static bool canBatch(const DrawList::Packet& first, const DrawList::Packet& packet);
+
+        /** Upload the instance data of a draw list and bind it to the program vars
+            \return false if the program doesn't declare the instance buffer, otherwise true
+        */
+        bool setInstanceBuffer(const CurrentWorkingData& currentData, const DrawList& drawList);
+
+        /** Compute the sort keys of a draw list and sort its packets
+        */
+        void sortDrawList(const Camera* pCamera, DrawList& drawList);
+
+        /** Check if a mesh is drawn with blending, which requires back-to-front ordering. Falcor's materials are opaque or alpha-tested, so the default returns false.
+        */
+        virtual bool isTransparent(const Mesh* pMesh) const { return false; }
+
+        /** Append the draws of a model instance to a draw list
+        */
+        void buildModelInstanceDraws(uint32_t modelID, uint32_t instanceID, uint32_t instanceIndex, DrawList& drawList) const;
+
+        /** Recompute the transforms of the instances which moved since the last frame
+        */
+        static void updateInstanceTransforms();
+        static void calcMeshInstanceTransforms(const Scene::ModelInstance* pModelInstance, const Model::MeshInstance* pMeshInstance, glm::mat4& worldMat, glm::mat4& prevWorldMat, glm::mat3x4& normalMat);
+
+        /** Rebuild or refit the culling hierarchy if the scene changed, and cull the mesh instances against the camera's frustum.
+        */
+        void cullMeshInstances(const Camera* pCamera);
+        void cullOccludedMeshInstances(const Camera* pCamera);
+        void buildCullingHierarchy();
+
+        /** Update the screen size each model instance selects its mesh LODs with
+        */
+        void selectLods(const Camera* pCamera);
+        bool isCullingHierarchyValid() const;
+        BoundingBox calcMeshInstanceBox(const Scene::ModelInstance* pModelInstance, uint32_t meshID, uint32_t instanceID) const;
+
+        struct CullingData
+        {
+            BoundingVolumeHierarchy::SharedPtr pBvh;
+            std::vector<const Scene::ModelInstance*> instances;    // The model instances in draw order
+            std::vector<uint32_t> slotToInstance;                   // Index in instances of each model instance store slot, or kInvalidIndex if the slot isn't in the scene
+            uint64_t changeCursor = 0;                              // Position in the model instance store change log the boxes are up to date with
+            std::vector<uint32_t> changedSlots;
+            std::vector<uint32_t> firstBox;                         // The ID of each instance's first box. The boxes of an instance are ordered by mesh, then by mesh instance.
+            std::vector<std::vector<uint32_t>> meshBoxOffsets;      // For each model, the offset of each mesh's first box relative to the instance's first box
+            std::vector<uint32_t> visibleIds;
+            std::vector<uint8_t> boxVisible;                        // Result of the last cull, per box
+            std::vector<uint32_t> instanceVisibleCount;             // Number of visible boxes per model instance
+            bool dirty = true;
+            static const uint32_t kInvalidIndex = (uint32_t)-1;
+        };
+        CullingData mCulling;
+
+        struct LodData
+        {
+            std::vector<const Scene::ModelInstance*> instances;    // The model instances in draw order. A model instance which changes position restarts without hysteresis.
+            std::vector<float> selectionSizes;                      // The screen size each model instance selects its LODs with
+            float hysteresis = 0.1f;
+        };
+        LodData mLod;
+
+        struct DrawListBuildData
+        {
+            std::vector<std::pair<uint32_t, uint32_t>> modelInstances;     // (model, instance) for each model instance, in draw order
+            std::vector<DrawList> batchLists;                             // The draws of each batch of model instances
+            std::vector<uint64_t> sortKeys;
+            std::vector<uint32_t> sortedPackets;
+            std::vector<DrawList::Packet> packets;
+            std::vector<uint32_t> batchedInstances;                         // For each entry of the instance data, the index of the instance in the draw list
+        };
+        DrawListBuildData mDrawListBuild;
+        DrawList mDrawList;
+        JobSystem::SharedPtr mpJobSystem;
+        bool mDrawListMode = false;
+        bool mSortDrawList = true;
+        bool mInstanceBatching = false;
+        StructuredBuffer::SharedPtr mpInstanceBuffer;
+        UploadArena::SharedPtr mpUploadArena;
+
         CameraControllerType mCamControllerType = CameraControllerType::SixDof;
         CameraController::SharedPtr mpCameraController;
 
         uint32_t mMaxInstanceCount = 64;
         const Material* mpLastMaterial = nullptr;
         bool mCullEnabled = true;
+        bool mCullActive = false;   // Culling is enabled and a camera is available for the current frame
+        bool mOcclusionCullEnabled = false;
+        bool mLodEnabled = false;
+        bool mLodActive = false;    // LOD selection is enabled and a camera is available for the current frame
+        std::vector<Occluder> mOccluders;
+        OcclusionBuffer::SharedPtr mpOcclusionBuffer;
         bool mCompileMaterialWithProgram = true;
     };
 }
@@ -574,7 +574,7 @@ namespace Falcor
             ddsData.hasDX10Header = false;
         }
 
-        uint32_t dataSize = stream.getRemainingStreamSize();
+        uint32_t dataSize = (uint32_t)stream.getRemainingStreamSize();
         ddsData.data.resize(dataSize);
         stream.read(ddsData.data.data(), dataSize);
     }
@@ -710,21 +710,26 @@ namespace Falcor
             return createTextureFromDDSFile(filename, generateMipLevels, loadAsSrgb, bindFlags);
         }
 
-        Bitmap::UniqueConstPtr pBitmap = Bitmap::createFromFile(filename, kTopDown);
-        Texture::SharedPtr pTex;
+        Bitmap::UniqueConstPtr pBitmap = decodeTextureFile(filename);
+        return pBitmap ? createTextureFromBitmap(pBitmap.get(), filename, generateMipLevels, loadAsSrgb, bindFlags) : nullptr;
+    }
+#undef no_srgb
 
-        if(pBitmap)
-        {
-            ResourceFormat texFormat = pBitmap->getFormat();
-            if(loadAsSrgb)
-            {
-                texFormat = linearToSrgbFormat(texFormat);
-            }
+    Bitmap::UniqueConstPtr decodeTextureFile(const std::string& filename)
+    {
+        return Bitmap::createFromFile(filename, kTopDown);
+    }
 
-            pTex = Texture::create2D(pBitmap->getWidth(), pBitmap->getHeight(), texFormat, 1, generateMipLevels ? Texture::kMaxPossible : 1, pBitmap->getData(), bindFlags);
-            pTex->setSourceFilename(stripDataDirectories(filename));
+    Texture::SharedPtr createTextureFromBitmap(const Bitmap* pBitmap, const std::string& filename, bool generateMipLevels, bool loadAsSrgb, Texture::BindFlags bindFlags)
+    {
+        ResourceFormat texFormat = pBitmap->getFormat();
+        if(loadAsSrgb)
+        {
+            texFormat = linearToSrgbFormat(texFormat);
         }
+
+        Texture::SharedPtr pTex = Texture::create2D(pBitmap->getWidth(), pBitmap->getHeight(), texFormat, 1, generateMipLevels ? Texture::kMaxPossible : 1, pBitmap->getData(), bindFlags);
+        pTex->setSourceFilename(stripDataDirectories(filename));
         return pTex;
     }
-#undef no_srgb
 }
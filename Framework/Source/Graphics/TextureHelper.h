@@ -30,6 +30,8 @@
 #include "API/Texture.h"
 namespace Falcor
 {
+    class Bitmap;
+
     /*!
     *  \addtogroup Falcor
     *  @{
@@ -43,5 +45,21 @@ namespace Falcor
     */
     Texture::SharedPtr createTextureFromFile(const std::string& filename, bool generateMipLevels, bool loadAsSrgb, Texture::BindFlags bindFlags = Texture::BindFlags::ShaderResource);
 
+    /** Decode an image file into a bitmap, in the memory layout createTextureFromBitmap() expects. Doesn't create any GPU resources, so it can be called from any thread.
+        DDS files are not supported, they are loaded directly by createTextureFromFile().
+        \param[in] filename Filename of the image. Can also include a full path or relative path from a data directory
+        \return The decoded bitmap, or nullptr if the file couldn't be loaded
+    */
+    std::unique_ptr<const Bitmap> decodeTextureFile(const std::string& filename);
+
+    /** Create a new texture object from a bitmap returned by decodeTextureFile().
+        \param[in] pBitmap The decoded image
+        \param[in] filename The image's filename. Stored as the texture's source filename
+        \param[in] generateMipLevels Whether the mip-chain should be generated
+        \param[in] loadAsSrgb Load the texture using sRGB format. Only valid for 3 or 4 component textures.
+        \param[in] bindFlags The bind flags to create the texture with
+    */
+    Texture::SharedPtr createTextureFromBitmap(const Bitmap* pBitmap, const std::string& filename, bool generateMipLevels, bool loadAsSrgb, Texture::BindFlags bindFlags = Texture::BindFlags::ShaderResource);
+
     /*! @} */
 }
\ No newline at end of file
@@ -246,6 +246,18 @@ namespace Falcor
         {
             mArgList.parseCommandLine(concatCommandLine(argc, argv));
         }
+
+#if _PROFILING_ENABLED
+        // Stream the profiler events to a trace file
+        if (mArgList.argExists("profiletrace"))
+        {
+            std::vector<ArgList::Arg> traceArgs = mArgList.getValues("profiletrace");
+            if (!traceArgs.empty() && Profiler::startTrace(traceArgs[0].asString()))
+            {
+                gProfileEnabled = true;
+            }
+        }
+#endif
         mpRenderContext->enableStablePowerState();
         mGpuTimer = GpuTimer::create();
         // Load and run
@@ -256,6 +268,9 @@ namespace Falcor
         mpWindow->msgLoop();
 
         onShutdown();
+#if _PROFILING_ENABLED
+        Profiler::stopTrace();
+#endif
         Logger::shutdown();
     }
 
@@ -486,11 +501,13 @@ namespace Falcor
 
             strstr << " descHeapAlloc: " << gEventCounter.numDescriptorHeapAllocations <<
                 " drawCalls: " << gEventCounter.numDrawCalls << " materialChanges: " << gEventCounter.numMaterialChanges
+                << " variantChanges: " << gEventCounter.numProgramVariantChanges << " vaoChanges: " << gEventCounter.numVaoChanges
                 << " rootSigChanges: " << gEventCounter.numRootSignatureChanges << " numFlushes: " << gEventCounter.numFlushes
                 << " paramUpd: " << gEventCounter.numParamBlockUpdates
                 << " dscTbls: " << gEventCounter.numDescriptorTables << " dscs: " << gEventCounter.numDescriptors
                 << "\nSetGraphicsRootDescriptorTable calls: " << gEventCounter.numSetRootDescriptorTableCalls
-                << " chunkSwitch: " << gEventCounter.numDescriptorChunkSwitches << " outOfChunks: " << gEventCounter.numOutOfChunks;
+                << " chunkSwitch: " << gEventCounter.numDescriptorChunkSwitches << " outOfChunks: " << gEventCounter.numOutOfChunks
+                << " occlusionCulled: " << gEventCounter.numOcclusionCulled << "/" << gEventCounter.numOcclusionTests;
         }
         return strstr.str();
     }
@@ -237,6 +237,9 @@ namespace Falcor
 
         // Write the Screen Capture Results.
         writeScreenCaptureResults(jsonTestResults);
+
+        // Write the Frame Time and Profiler Statistics.
+        writeTimingStatisticsResults(jsonTestResults);
     }
 
     // Write Load Time.
@@ -351,6 +354,59 @@ namespace Falcor
         jsonTestResults.AddMember("Time Screen Captures", sctArray, jsonAllocator);
     }
 
+    // Write the Histogram Statistics.
+    void SampleTest::writeJsonHistogram(rapidjson::Value& jval, rapidjson::Document::AllocatorType& jallocator, const std::string& key, const StreamingHistogram& histogram)
+    {
+        rapidjson::Value jhistogram;
+        jhistogram.SetObject();
+
+        const StreamingHistogram::Statistics stats[] = { histogram.getWindowStatistics(), histogram.getRunStatistics() };
+        const char* names[] = { "Window", "Run" };
+        for (uint32_t i = 0; i < arraysize(stats); i++)
+        {
+            rapidjson::Value jstats;
+            jstats.SetObject();
+            writeJsonLiteral(jstats, jallocator, "Count", stats[i].count);
+            writeJsonLiteral(jstats, jallocator, "Min", stats[i].min);
+            writeJsonLiteral(jstats, jallocator, "Mean", stats[i].mean);
+            writeJsonLiteral(jstats, jallocator, "P50", stats[i].p50);
+            writeJsonLiteral(jstats, jallocator, "P95", stats[i].p95);
+            writeJsonLiteral(jstats, jallocator, "P99", stats[i].p99);
+            writeJsonLiteral(jstats, jallocator, "Max", stats[i].max);
+            writeJsonValue(jhistogram, jallocator, names[i], jstats);
+        }
+
+        writeJsonValue(jval, jallocator, key, jhistogram);
+    }
+
+    // Write the Frame Time and Profiler Statistics.
+    void SampleTest::writeTimingStatisticsResults(rapidjson::Document & jsonTestResults)
+    {
+        rapidjson::Value & jsonVal = jsonTestResults;
+        auto & jsonAllocator = jsonTestResults.GetAllocator();
+
+        // Frame times in ms.
+        writeJsonHistogram(jsonVal, jsonAllocator, "Frame Time Statistics", frameRate().getFrameTimeHistogram());
+
+        // Per-event CPU and GPU times in ms. Only recorded while profiling is enabled.
+        rapidjson::Value eventArray(rapidjson::kArrayType);
+        for (const Profiler::EventData* pEvent : Profiler::getEvents())
+        {
+            if (pEvent->cpuHistogram.getSampleCount() == 0 && pEvent->gpuHistogram.getSampleCount() == 0)
+            {
+                continue;
+            }
+
+            rapidjson::Value jevent;
+            jevent.SetObject();
+            writeJsonString(jevent, jsonAllocator, "Name", pEvent->name);
+            writeJsonHistogram(jevent, jsonAllocator, "CPU", pEvent->cpuHistogram);
+            writeJsonHistogram(jevent, jsonAllocator, "GPU", pEvent->gpuHistogram);
+            eventArray.PushBack(jevent, jsonAllocator);
+        }
+        jsonTestResults.AddMember("Profiler Event Statistics", eventArray, jsonAllocator);
+    }
+
     // Initialize the Tests.
     void SampleTest::initializeTests()
     {
@@ -332,6 +332,14 @@ namespace Falcor
         */
         void writeScreenCaptureResults(rapidjson::Document & jsonTestResults);
 
+        /** Write the frame time and profiler event statistics.
+        */
+        void writeTimingStatisticsResults(rapidjson::Document & jsonTestResults);
+
+        /** Write the sliding window and the whole run statistics of a histogram.
+        */
+        void writeJsonHistogram(rapidjson::Value& jval, rapidjson::Document::AllocatorType& jallocator, const std::string& key, const StreamingHistogram& histogram);
+
         /** Initialize the Tests.
         */
         void initializeTests();
@@ -29,6 +29,7 @@
 #include "glm/vec3.hpp"
 #include "glm/mat4x4.hpp"
 #include "glm/common.hpp"
+#include <cstdint>
 
 namespace Falcor
 {
@@ -124,4 +125,13 @@ namespace Falcor
             return BoundingBox::fromMinMax(min(bb0.getMinPos(), bb1.getMinPos()), max(bb0.getMaxPos(), bb1.getMaxPos()));
         }
     };
+
+    /** Structure-of-arrays view of a set of bounding boxes, for batch operations
+    */
+    struct BoundingBoxStreams
+    {
+        const float* pCenter[3] = {};   ///< X, Y and Z coordinates of the centers
+        const float* pExtent[3] = {};   ///< X, Y and Z half lengths of the sides
+        uint32_t count = 0;             ///< Number of boxes
+    };
 }
\ No newline at end of file
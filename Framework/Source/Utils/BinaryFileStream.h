@@ -76,6 +76,7 @@ namespace Falcor
             iosMode |= ((mode == Mode::Write) || (mode == Mode::ReadWrite))? std::ios::out : (std::ios::openmode)0;
             mStream.open(filename.c_str(), iosMode);
             mFilename = filename;
+            mMode = mode;
         }
 
         /** Close the file stream.
@@ -93,6 +94,23 @@ namespace Falcor
             mStream.ignore(count);
         }
 
+        /** Get the current position in the stream.
+            \return Offset in bytes from the beginning of the file
+        */
+        size_t getPosition()
+        {
+            return (size_t)((mMode == Mode::Write) ? mStream.tellp() : mStream.tellg());
+        }
+
+        /** Move the stream to an absolute position.
+            \param[in] offset Offset in bytes from the beginning of the file
+        */
+        void seek(size_t offset)
+        {
+            if(mMode != Mode::Write) mStream.seekg(offset);
+            if(mMode != Mode::Read) mStream.seekp(offset);
+        }
+
         /** Deletes the managed file.
         */
         void remove()
@@ -107,13 +125,25 @@ namespace Falcor
         /** Calculates amount of remaining data in the file.
             \return Number of bytes remaining in the stream
         */
-        uint32_t getRemainingStreamSize()
+        size_t getRemainingStreamSize()
         {	
             std::streamoff currentPos = mStream.tellg();
             mStream.seekg(0, mStream.end);
             std::streamoff length = mStream.tellg();
             mStream.seekg(currentPos);
-            return (uint32_t)(length - currentPos); 
+            return (size_t)(length - currentPos); 
+        }
+
+        /** Get the size of the file.
+            \return The size of the file in bytes
+        */
+        size_t getStreamSize()
+        {
+            std::streamoff currentPos = mStream.tellg();
+            mStream.seekg(0, mStream.end);
+            std::streamoff length = mStream.tellg();
+            mStream.seekg(currentPos);
+            return (size_t)length;
         }
 
         /** Checks for validity of the stream
@@ -165,5 +195,6 @@ namespace Falcor
     private:
         std::fstream mStream;
         std::string mFilename;
+        Mode mMode = Mode::ReadWrite;
     };
 }
\ No newline at end of file
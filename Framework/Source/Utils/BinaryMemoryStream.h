@@ -0,0 +1,135 @@
+/***************************************************************************
+# Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <cstring>
+
+namespace Falcor
+{
+    /** Read-only stream over a block of memory, usually a MemoryMappedFile.
+        Exposes the same reading interface as BinaryFileStream, so loaders can be written once for both.
+        Unlike a file stream, the data at the current read position can be accessed directly with getCurrentPointer().
+    */
+    class BinaryMemoryStream
+    {
+    public:
+        /** Constructor
+            \param[in] pData Pointer to the start of the data. The memory has to stay valid for the lifetime of the stream.
+            \param[in] size Size of the data in bytes
+        */
+        BinaryMemoryStream(const void* pData, size_t size) : mpData((const uint8_t*)pData), mSize(size) {}
+
+        /** Skip data in the stream.
+            \param[in] count Bytes to skip
+        */
+        void skip(size_t count)
+        {
+            if (count > getRemainingStreamSize())
+            {
+                mOffset = mSize;
+                mFail = true;
+                return;
+            }
+            mOffset += count;
+        }
+
+        /** Get the current position in the stream.
+            \return Offset in bytes from the beginning of the data
+        */
+        size_t getPosition() const { return mOffset; }
+
+        /** Move the stream to an absolute position. Seeking past the end marks the stream as failed.
+            \param[in] offset Offset in bytes from the beginning of the data
+        */
+        void seek(size_t offset)
+        {
+            if (offset > mSize)
+            {
+                mOffset = mSize;
+                mFail = true;
+                return;
+            }
+            mOffset = offset;
+        }
+
+        /** Calculates amount of remaining data in the stream.
+            \return Number of bytes remaining in the stream
+        */
+        size_t getRemainingStreamSize() const { return mSize - mOffset; }
+
+        /** Get a pointer to the data at the current read position.
+        */
+        const uint8_t* getCurrentPointer() const { return mpData + mOffset; }
+
+        /** Checks for validity of the stream
+            \return Returns true if no errors have been encountered and the end of the stream has not been reached
+        */
+        bool isGood() const { return (mFail == false) && (mOffset < mSize); }
+
+        /** Checks for stream errors. There is no underlying device that can fail, so this is never true.
+        */
+        bool isBad() const { return false; }
+
+        /** Checks for stream errors.
+            \return Returns true if a read or skip went past the end of the stream.
+        */
+        bool isFail() const { return mFail; }
+
+        /** Checks if the end of the stream has been reached.
+        */
+        bool isEof() const { return mOffset == mSize; }
+
+        /** Reads data from the stream. If there isn't enough data left, copies what's available and marks the stream as failed.
+            \param[out] pData Pointer to a buffer to copy data into
+            \param[in] count Number of bytes to read
+        */
+        BinaryMemoryStream& read(void* pData, size_t count)
+        {
+            size_t available = getRemainingStreamSize();
+            if (count > available)
+            {
+                mFail = true;
+                count = available;
+            }
+            std::memcpy(pData, mpData + mOffset, count);
+            mOffset += count;
+            return *this;
+        }
+
+        /** Extracts a single value from the stream
+            \param[out] val Reference of value to extract into
+        */
+        template<typename T>
+        BinaryMemoryStream& operator>>(T& val) { return read(&val, sizeof(T)); }
+
+    private:
+        const uint8_t* mpData;
+        size_t mSize;
+        size_t mOffset = 0;
+        bool mFail = false;
+    };
+}
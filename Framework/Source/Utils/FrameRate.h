@@ -29,6 +29,7 @@
 #include <chrono>
 #include <vector>
 #include "CpuTimer.h"
+#include "StreamingHistogram.h"
 
 namespace Falcor
 {
@@ -50,6 +51,7 @@ namespace Falcor
         {
             newFrame();
             mFrameCount = 0;
+            mFrameTimeHistogram.reset();
         }
 
         /** Tick the timer.
@@ -60,6 +62,7 @@ namespace Falcor
             mFrameCount++;
             mTimer.update();
             mFrameTimes[mFrameCount % sFrameWindow] = mTimer.getElapsedTime();
+            mFrameTimeHistogram.addSample(mTimer.getElapsedTime() * 1000);
         }
 
         /** Get the time in ms it took to render a frame
@@ -84,6 +87,13 @@ namespace Falcor
             return mFrameTimes[mFrameCount % sFrameWindow];
         }
 
+        /** Get the histogram of the frame times in ms since the last resetClock() call, to query percentiles.
+        */
+        const StreamingHistogram& getFrameTimeHistogram() const
+        {
+            return mFrameTimeHistogram;
+        }
+
         /** Get the numer of frames passed from the last resetClock() call.
         */
         uint32_t getFrameCount() const
@@ -94,6 +104,7 @@ namespace Falcor
 
         CpuTimer mTimer;
         std::vector<float> mFrameTimes;
+        StreamingHistogram mFrameTimeHistogram;
         uint32_t mFrameCount;
         static const uint32_t sFrameWindow = 60;
     };
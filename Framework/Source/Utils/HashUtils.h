@@ -0,0 +1,84 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <cstring>
+#include <string>
+
+namespace Falcor
+{
+    static const uint64_t kHashSeed = 14695981039346656037ull;
+
+    /** Finalizer of the 64-bit MurmurHash3. Every input bit affects every output bit.
+    */
+    inline uint64_t mixHash(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    /** Hash a block of memory, consuming 8 bytes per step. Used to build keys for the persistent caches.
+        Each step mixes the whole state, so differences in the high bits of a word can't cancel each other out.
+        \param[in] pData The data to hash
+        \param[in] size Size of the data in bytes
+        \param[in] hash The value to start from. Pass the result of a previous call to hash multiple blocks.
+        \return The hash value
+    */
+    inline uint64_t hashBytes(const void* pData, size_t size, uint64_t hash = kHashSeed)
+    {
+        const uint8_t* pBytes = (const uint8_t*)pData;
+        size_t i = 0;
+        for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, pBytes + i, sizeof(word));
+            hash = mixHash(hash ^ word);
+        }
+
+        // The tail is zero-padded. Hashing the size keeps blocks which only differ by trailing zeros apart.
+        if(i < size)
+        {
+            uint64_t tail = 0;
+            std::memcpy(&tail, pBytes + i, size - i);
+            hash = mixHash(hash ^ tail);
+        }
+        return mixHash(hash ^ (uint64_t)size);
+    }
+
+    /** Hash a string, including its length, so that consecutive strings can't alias each other
+    */
+    inline uint64_t hashString(const std::string& str, uint64_t hash = kHashSeed)
+    {
+        uint64_t size = str.size();
+        hash = hashBytes(&size, sizeof(size), hash);
+        return hashBytes(str.data(), str.size(), hash);
+    }
+}
@@ -0,0 +1,140 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Framework.h"
+#include "JobSystem.h"
+#include <algorithm>
+
+namespace Falcor
+{
+    JobSystem::SharedPtr JobSystem::create(uint32_t threadCount)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        return SharedPtr(new JobSystem(threadCount - 1));
+    }
+
+    JobSystem::JobSystem(uint32_t workerCount) : mNextBatch(0), mCompletedBatches(0)
+    {
+        mWorkers.reserve(workerCount);
+        for (uint32_t i = 0; i < workerCount; i++)
+        {
+            mWorkers.emplace_back(&JobSystem::workerMain, this);
+        }
+    }
+
+    JobSystem::~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mQuit = true;
+        }
+        mWorkCV.notify_all();
+        for (auto& t : mWorkers)
+        {
+            t.join();
+        }
+    }
+
+    void JobSystem::workerMain()
+    {
+        uint32_t lastJob = 0;
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true)
+        {
+            mWorkCV.wait(lock, [this, lastJob]() { return mQuit || mJob.id != lastJob; });
+            if (mQuit) return;
+
+            Job job = mJob;
+            lastJob = job.id;
+            lock.unlock();
+            executeBatches(job);
+            lock.lock();
+        }
+    }
+
+    void JobSystem::executeBatches(const Job& job)
+    {
+        uint32_t completed = 0;
+        uint64_t next = mNextBatch.load();
+        while (true)
+        {
+            uint32_t batch = (uint32_t)next;
+            if ((uint32_t)(next >> 32) != job.id || batch >= job.batchCount) break;
+            if (mNextBatch.compare_exchange_weak(next, next + 1) == false) continue;
+
+            uint32_t first = batch * job.batchSize;
+            (*job.pFunc)(first, std::min(job.count, first + job.batchSize));
+            completed++;
+            next = mNextBatch.load();
+        }
+
+        if (completed && mCompletedBatches.fetch_add(completed) + completed == job.batchCount)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mDoneCV.notify_all();
+        }
+    }
+
+    void JobSystem::parallelFor(uint32_t count, uint32_t batchSize, const RangeFunc& func)
+    {
+        if (count == 0) return;
+        batchSize = std::max(1u, batchSize);
+        uint32_t batchCount = (count + batchSize - 1) / batchSize;
+
+        if (mWorkers.empty() || batchCount == 1)
+        {
+            for (uint32_t first = 0; first < count; first += batchSize)
+            {
+                func(first, std::min(count, first + batchSize));
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> submitLock(mSubmitMutex);
+        Job job;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mJob.pFunc = &func;
+            mJob.id = (mJob.id == UINT32_MAX) ? 1 : mJob.id + 1; // 0 means no job
+            mJob.count = count;
+            mJob.batchSize = batchSize;
+            mJob.batchCount = batchCount;
+            mCompletedBatches = 0;
+            mNextBatch = (uint64_t)mJob.id << 32;
+            job = mJob;
+        }
+        mWorkCV.notify_all();
+
+        executeBatches(job);
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDoneCV.wait(lock, [this, batchCount]() { return mCompletedBatches.load() == batchCount; });
+    }
+}
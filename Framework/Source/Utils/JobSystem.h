@@ -0,0 +1,98 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+namespace Falcor
+{
+    /** A pool of worker threads which execute data-parallel loops.
+        parallelFor() splits an index range into batches. The workers and the calling thread take batches until the range is exhausted, and the call returns once all of them completed.
+        Calls to parallelFor() from different threads are serialized. Calling it from inside a batch deadlocks.
+    */
+    class JobSystem
+    {
+    public:
+        using SharedPtr = std::shared_ptr<JobSystem>;
+        using RangeFunc = std::function<void(uint32_t first, uint32_t last)>;
+
+        /** Create a new object and start the workers.
+            \param[in] threadCount The number of threads executing the batches, including the thread calling parallelFor(). 0 uses one thread per hardware thread.
+        */
+        static SharedPtr create(uint32_t threadCount = 0);
+
+        /** Waits for the workers to exit
+        */
+        ~JobSystem();
+
+        /** Execute a function over [0, count) in batches, in parallel. Batches are contiguous and are not executed in order.
+            \param[in] count The number of items.
+            \param[in] batchSize The maximal number of items passed to a single call of func.
+            \param[in] func Called with the [first, last) range of each batch.
+        */
+        void parallelFor(uint32_t count, uint32_t batchSize, const RangeFunc& func);
+
+        /** Get the number of threads executing batches, including the thread calling parallelFor()
+        */
+        uint32_t getThreadCount() const { return (uint32_t)mWorkers.size() + 1; }
+
+    private:
+        JobSystem(uint32_t workerCount);
+        void workerMain();
+
+        struct Job
+        {
+            const RangeFunc* pFunc = nullptr;
+            uint32_t id = 0;
+            uint32_t count = 0;
+            uint32_t batchSize = 0;
+            uint32_t batchCount = 0;
+        };
+
+        /** Execute batches of a job until there are none left.
+        */
+        void executeBatches(const Job& job);
+
+        std::vector<std::thread> mWorkers;
+        std::mutex mSubmitMutex;
+        std::mutex mMutex;
+        std::condition_variable mWorkCV;
+        std::condition_variable mDoneCV;
+        Job mJob;               // Protected by mMutex. Workers copy it when they wake up.
+        bool mQuit = false;
+
+        // The ID of the job in the high 32 bits, the next batch in the low ones. Workers which woke up late can't take batches of a newer job.
+        std::atomic<uint64_t> mNextBatch;
+        std::atomic<uint32_t> mCompletedBatches;
+    };
+}
@@ -399,4 +399,11 @@ namespace Falcor
         return (uint32_t)__builtin_popcount(a);
     }
 
+    bool isAvx2Supported()
+    {
+        // Also checks that the OS saves the YMM registers
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }
+
 }
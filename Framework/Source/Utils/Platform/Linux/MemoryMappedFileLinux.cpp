@@ -0,0 +1,90 @@
+/***************************************************************************
+# Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Framework.h"
+#include "Utils/Platform/MemoryMappedFile.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace Falcor
+{
+    struct MemoryMappedFileData
+    {
+        void* pMapping = MAP_FAILED;
+        size_t size = 0;
+    };
+
+    bool MemoryMappedFile::platformMap()
+    {
+        mpPlatformData = new MemoryMappedFileData;
+
+        int fd = open(mFilename.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            logError("Can't open file '" + mFilename + "' for memory mapping");
+            return false;
+        }
+
+        struct stat s;
+        if (fstat(fd, &s) != 0 || s.st_size == 0)
+        {
+            logError("Can't memory map file '" + mFilename + "'. File is empty or its size can't be queried");
+            close(fd);
+            return false;
+        }
+
+        // The mapping keeps its own reference to the file, so the descriptor can be closed right away
+        mpPlatformData->pMapping = mmap(nullptr, (size_t)s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mpPlatformData->pMapping == MAP_FAILED)
+        {
+            logError("mmap() failed for file '" + mFilename + "'");
+            return false;
+        }
+
+        // The loaders walk the file front to back, ask the kernel for aggressive read-ahead
+        madvise(mpPlatformData->pMapping, (size_t)s.st_size, MADV_SEQUENTIAL);
+
+        mpPlatformData->size = (size_t)s.st_size;
+        mpData = (const uint8_t*)mpPlatformData->pMapping;
+        mSize = mpPlatformData->size;
+        return true;
+    }
+
+    void MemoryMappedFile::platformUnmap()
+    {
+        if (mpPlatformData && mpPlatformData->pMapping != MAP_FAILED)
+        {
+            munmap(mpPlatformData->pMapping, mpPlatformData->size);
+        }
+        safe_delete(mpPlatformData);
+        mpData = nullptr;
+        mSize = 0;
+    }
+}
@@ -0,0 +1,75 @@
+/***************************************************************************
+# Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <string>
+#include <memory>
+
+namespace Falcor
+{
+    struct MemoryMappedFileData;
+
+    /** Read-only view of a file mapped into the process address space.
+        The OS pages the file in on demand, so reading from the mapping doesn't go through the C++ stream layer.
+    */
+    class MemoryMappedFile
+    {
+    public:
+        using SharedPtr = std::shared_ptr<MemoryMappedFile>;
+        using SharedConstPtr = std::shared_ptr<const MemoryMappedFile>;
+
+        /** Map a file for reading.
+            \param[in] filename Full path to the file. This function doesn't look in the data directories.
+            \return A new object if the file was mapped successfully, otherwise nullptr.
+        */
+        static SharedPtr create(const std::string& filename);
+
+        ~MemoryMappedFile();
+
+        /** Get a pointer to the start of the mapped file.
+        */
+        const uint8_t* getData() const { return mpData; }
+
+        /** Get the size of the mapped file in bytes.
+        */
+        size_t getSize() const { return mSize; }
+
+        /** Get the name of the mapped file.
+        */
+        const std::string& getFilename() const { return mFilename; }
+
+    private:
+        MemoryMappedFile(const std::string& filename) : mFilename(filename) {}
+        bool platformMap();
+        void platformUnmap();
+
+        MemoryMappedFileData* mpPlatformData = nullptr;
+        const uint8_t* mpData = nullptr;
+        size_t mSize = 0;
+        std::string mFilename;
+    };
+}
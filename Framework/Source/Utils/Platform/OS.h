@@ -266,5 +266,9 @@ namespace Falcor
     */
     uint32_t popcount(uint32_t a);
 
+    /** Check if the CPU and the OS support AVX2 instructions.
+    */
+    bool isAvx2Supported();
+
     /*! @} */
 };
\ No newline at end of file
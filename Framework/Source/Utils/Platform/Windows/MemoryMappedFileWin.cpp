@@ -0,0 +1,91 @@
+/***************************************************************************
+# Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Framework.h"
+#include "Utils/Platform/MemoryMappedFile.h"
+
+namespace Falcor
+{
+    struct MemoryMappedFileData
+    {
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+    };
+
+    bool MemoryMappedFile::platformMap()
+    {
+        mpPlatformData = new MemoryMappedFileData;
+        // The loaders walk the file front to back, let the cache manager know
+        mpPlatformData->file = CreateFileA(mFilename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (mpPlatformData->file == INVALID_HANDLE_VALUE)
+        {
+            logError("Can't open file '" + mFilename + "' for memory mapping");
+            return false;
+        }
+
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(mpPlatformData->file, &size) == FALSE || size.QuadPart == 0)
+        {
+            logError("Can't memory map file '" + mFilename + "'. File is empty or its size can't be queried");
+            return false;
+        }
+
+        mpPlatformData->mapping = CreateFileMappingA(mpPlatformData->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mpPlatformData->mapping == nullptr)
+        {
+            logError("CreateFileMapping() failed for file '" + mFilename + "'");
+            return false;
+        }
+
+        mpData = (const uint8_t*)MapViewOfFile(mpPlatformData->mapping, FILE_MAP_READ, 0, 0, 0);
+        if (mpData == nullptr)
+        {
+            logError("MapViewOfFile() failed for file '" + mFilename + "'");
+            return false;
+        }
+
+        mSize = (size_t)size.QuadPart;
+        return true;
+    }
+
+    void MemoryMappedFile::platformUnmap()
+    {
+        if (mpData)
+        {
+            UnmapViewOfFile(mpData);
+        }
+
+        if (mpPlatformData)
+        {
+            if (mpPlatformData->mapping) CloseHandle(mpPlatformData->mapping);
+            if (mpPlatformData->file != INVALID_HANDLE_VALUE) CloseHandle(mpPlatformData->file);
+        }
+        safe_delete(mpPlatformData);
+        mpData = nullptr;
+        mSize = 0;
+    }
+}
@@ -36,6 +36,7 @@
 #include <sys/types.h>
 #include "API/Window.h"
 #include "psapi.h"
+#include <intrin.h>
 
 // Always run in Optimus mode on laptops
 extern "C"
@@ -351,4 +352,20 @@ namespace Falcor
     {
         return __popcnt(a);
     }
+
+    bool isAvx2Supported()
+    {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) return false;
+
+        // The OS must save the YMM registers on context switches
+        __cpuid(info, 1);
+        const int osxsaveAndAvx = (1 << 27) | (1 << 28);
+        if ((info[2] & osxsaveAndAvx) != osxsaveAndAvx) return false;
+        if ((_xgetbv(0) & 0x6) != 0x6) return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }
 }
@@ -29,161 +29,554 @@
 #include "Profiler.h"
 #include "API/GpuTimer.h"
 #include "API/LowLevel/FencedPool.h"
+#include "Utils/TraceWriter.h"
 
-#include <iostream>
-#include <fstream>
-#include <sstream>
 #include <cstdio>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
 
 namespace Falcor
 {
     bool gProfileEnabled = false;
     EventCounter gEventCounter;
-    std::map<size_t, Profiler::EventData*> Profiler::sProfilerEvents;
-    uint32_t Profiler::sCurrentLevel = 0;
-    uint32_t Profiler::sGpuTimerIndex = 0;
-    std::vector<Profiler::EventData*> Profiler::sProfilerVector;
-    
+
     std::hash<std::string> HashedString::hashFunc;
 
-	void Profiler::initNewEvent(EventData *pEvent, const HashedString& name)
+    // Globals are initialized by the thread which runs main()
+    static const std::thread::id sMainThreadId = std::this_thread::get_id();
+
+    struct EventRecord
+    {
+        CpuTimer::TimePoint time;
+        uint32_t eventId;
+        uint32_t depth;     // Depth of the scope in the thread's call stack, used to resynchronize after dropped records
+        bool isEnd;
+    };
+
+    /** A node in a thread's event hierarchy. The same event can appear under different parents.
+    */
+    struct HierarchyNode
+    {
+        static const uint32_t kNoParent = (uint32_t)-1;
+        uint32_t eventId;
+        uint32_t parent;
+        uint32_t level;
+        float cpuTime = 0;          // Accumulated during the current frame
+        std::vector<uint32_t> children;
+    };
+
+    struct OpenScope
+    {
+        uint32_t eventId;
+        uint32_t node;
+        CpuTimer::TimePoint start;
+    };
+
+    /** Single-producer, single-consumer ring buffer of event records.
+        The owning thread appends records, endFrame() consumes them. The hierarchy is only accessed by endFrame().
+    */
+    class ThreadEventBuffer
+    {
+    public:
+        static const uint32_t kCapacity = 8192;     // Must be a power of 2
+
+        ThreadEventBuffer(uint32_t index, bool isMainThread) : mRecords(kCapacity), index(index), isMainThread(isMainThread) {}
+
+        // Called by the owning thread only
+        void push(uint32_t eventId, bool isEnd, const CpuTimer::TimePoint& time)
+        {
+            if(isEnd && mDepth == 0)
+            {
+                // The scope started before profiling was enabled
+                return;
+            }
+            uint32_t depth = isEnd ? --mDepth : mDepth++;
+
+            uint64_t head = mHead.load(std::memory_order_relaxed);
+            if(head - mTail.load(std::memory_order_acquire) >= kCapacity)
+            {
+                mDropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            EventRecord& record = mRecords[head & (kCapacity - 1)];
+            record.time = time;
+            record.eventId = eventId;
+            record.depth = depth;
+            record.isEnd = isEnd;
+            mHead.store(head + 1, std::memory_order_release);
+        }
+
+        // Called by endFrame() only
+        template<typename Func>
+        void drain(Func func)
+        {
+            uint64_t tail = mTail.load(std::memory_order_relaxed);
+            uint64_t head = mHead.load(std::memory_order_acquire);
+            for(; tail < head; tail++)
+            {
+                func(mRecords[tail & (kCapacity - 1)]);
+            }
+            mTail.store(head, std::memory_order_release);
+        }
+
+        uint64_t takeDroppedCount() { return mDropped.exchange(0, std::memory_order_relaxed); }
+
+        const uint32_t index;
+        const bool isMainThread;
+        std::atomic<bool> threadExited{ false };
+
+        // The thread's hierarchy, built by endFrame()
+        std::vector<HierarchyNode> nodes;
+        std::vector<uint32_t> roots;
+        std::vector<OpenScope> openScopes;
+        bool traceNamed = false;
+
+    private:
+        std::vector<EventRecord> mRecords;
+        std::atomic<uint64_t> mHead{ 0 };
+        std::atomic<uint64_t> mTail{ 0 };
+        std::atomic<uint64_t> mDropped{ 0 };
+        uint32_t mDepth = 0;        // Producer-side call-stack depth
+    };
+
+    struct ProfilerState
+    {
+        static const uint32_t kMaxEvents = 4096;
+
+        // Events are only appended, so they can be read without locking as long as the index is below eventCount
+        std::mutex eventsMutex;
+        std::unordered_map<size_t, uint32_t> eventIds;
+        Profiler::EventData* events[kMaxEvents] = {};
+        std::atomic<uint32_t> eventCount{ 0 };
+
+        std::mutex threadsMutex;
+        std::vector<std::shared_ptr<ThreadEventBuffer>> threads;
+        uint32_t nextThreadIndex = 0;
+
+        uint32_t gpuTimerIndex = 0;
+        uint64_t droppedLastFrame = 0;
+
+        TraceWriter::SharedPtr pTrace;
+        CpuTimer::TimePoint traceStart;
+        uint64_t traceFrame = 0;
+    };
+
+    static ProfilerState& getState()
+    {
+        static ProfilerState state;
+        return state;
+    }
+
+    /** Registers the thread's buffer on first use, and marks it when the thread exits so endFrame() can release it
+    */
+    struct ThreadBufferHolder
+    {
+        ThreadBufferHolder()
+        {
+            ProfilerState& state = getState();
+            std::lock_guard<std::mutex> lock(state.threadsMutex);
+            pBuffer = std::make_shared<ThreadEventBuffer>(state.nextThreadIndex++, std::this_thread::get_id() == sMainThreadId);
+            state.threads.push_back(pBuffer);
+        }
+
+        ~ThreadBufferHolder()
+        {
+            pBuffer->threadExited.store(true, std::memory_order_release);
+        }
+
+        std::shared_ptr<ThreadEventBuffer> pBuffer;
+    };
+
+    static ThreadEventBuffer* getThreadBuffer()
     {
-	    pEvent->name = name.str;
-        pEvent->level = sCurrentLevel;
-		sProfilerEvents[name.hash] = pEvent;
-        sProfilerVector.push_back(pEvent);
-	}
+        thread_local ThreadBufferHolder holder;
+        return holder.pBuffer.get();
+    }
+
+    static Profiler::EventData* registerEvent(Profiler::EventData* pEvent, const HashedString& name)
+    {
+        ProfilerState& state = getState();
+        std::lock_guard<std::mutex> lock(state.eventsMutex);
+        auto it = state.eventIds.find(name.hash);
+        if(it != state.eventIds.end())
+        {
+            if(pEvent && pEvent != state.events[it->second])
+            {
+                logWarning("Profiler event '" + name.str + "' is already registered");
+            }
+            name.id.store(it->second, std::memory_order_release);
+            return state.events[it->second];
+        }
+
+        uint32_t id = state.eventCount.load(std::memory_order_relaxed);
+        if(id == ProfilerState::kMaxEvents)
+        {
+            logWarning("Profiler: too many events, '" + name.str + "' will not be profiled");
+            return nullptr;
+        }
+
+        if(pEvent == nullptr)
+        {
+            pEvent = new Profiler::EventData;
+        }
+        pEvent->name = name.str;
+        pEvent->id = id;
+        state.events[id] = pEvent;
+        state.eventIds[name.hash] = id;
+        state.eventCount.store(id + 1, std::memory_order_release);
+        name.id.store(id, std::memory_order_release);
+        return pEvent;
+    }
+
+    static Profiler::EventData* getEventById(uint32_t id)
+    {
+        ProfilerState& state = getState();
+        return (id < state.eventCount.load(std::memory_order_acquire)) ? state.events[id] : nullptr;
+    }
+
+    void Profiler::initNewEvent(EventData *pEvent, const HashedString& name)
+    {
+        registerEvent(pEvent, name);
+    }
 
     Profiler::EventData* Profiler::createNewEvent(const HashedString& name)
     {
-        EventData *pData = new EventData;
-		initNewEvent(pData, name);
-        return pData;
+        return registerEvent(nullptr, name);
     }
 
     Profiler::EventData* Profiler::isEventRegistered(const HashedString& name)
-	{
-        auto event = sProfilerEvents.find(name.hash);
-        if(event == sProfilerEvents.end())
-		{
-			return nullptr;
-		}
-		else
-		{
-			return event->second;
-		}
-	}
+    {
+        uint32_t id = name.id.load(std::memory_order_acquire);
+        if(id == HashedString::kInvalidId)
+        {
+            // The event might have been registered through a different HashedString object
+            ProfilerState& state = getState();
+            std::lock_guard<std::mutex> lock(state.eventsMutex);
+            auto it = state.eventIds.find(name.hash);
+            if(it == state.eventIds.end())
+            {
+                return nullptr;
+            }
+            id = it->second;
+            name.id.store(id, std::memory_order_release);
+        }
+        return getEventById(id);
+    }
 
     Profiler::EventData* Profiler::getEvent(const HashedString& name)
     {
-        auto event = isEventRegistered(name);
-        if(event)
-		{
-			return event;
-		}
-		else
+        uint32_t id = name.id.load(std::memory_order_acquire);
+        if(id != HashedString::kInvalidId)
         {
-            return createNewEvent(name);
+            return getEventById(id);
         }
+        return registerEvent(nullptr, name);
     }
 
     void Profiler::startEvent(const HashedString& name, EventData* pData)
     {
-        pData->cpuStart = CpuTimer::getCurrentTimePoint();
-        EventData::FrameData& frame = pData->frameData[sGpuTimerIndex];
-        if (frame.currentTimer >= frame.pTimers.size())
+        if(pData == nullptr)
         {
-            frame.pTimers.push_back(GpuTimer::create());
+            return;
         }
-        frame.pTimers[frame.currentTimer]->begin();
-        pData->callStack.push(frame.currentTimer);
-        frame.currentTimer++;
-        sCurrentLevel++;
+        CpuTimer::TimePoint time = CpuTimer::getCurrentTimePoint();
+        ThreadEventBuffer* pBuffer = getThreadBuffer();
+        if(pBuffer->isMainThread)
+        {
+            EventData::FrameData& frame = pData->frameData[getState().gpuTimerIndex];
+            if (frame.currentTimer >= frame.pTimers.size())
+            {
+                frame.pTimers.push_back(GpuTimer::create());
+            }
+            frame.pTimers[frame.currentTimer]->begin();
+            pData->callStack.push(frame.currentTimer);
+            frame.currentTimer++;
+        }
+        pBuffer->push(pData->id, false, time);
     }
 
-	void Profiler::endEvent(const HashedString& name, EventData* pData)
+    void Profiler::endEvent(const HashedString& name, EventData* pData)
     {
-        pData->cpuEnd = CpuTimer::getCurrentTimePoint();
-        pData->cpuTotal += CpuTimer::calcDuration(pData->cpuStart, pData->cpuEnd);
+        if(pData == nullptr)
+        {
+            return;
+        }
+        ThreadEventBuffer* pBuffer = getThreadBuffer();
+        pBuffer->push(pData->id, true, CpuTimer::getCurrentTimePoint());
+        if(pBuffer->isMainThread && pData->callStack.size())
+        {
+            pData->frameData[getState().gpuTimerIndex].pTimers[pData->callStack.top()]->end();
+            pData->callStack.pop();
+        }
+    }
 
-        pData->frameData[sGpuTimerIndex].pTimers[pData->callStack.top()]->end();
-        pData->callStack.pop();
+    static uint32_t findOrCreateNode(ThreadEventBuffer& thread, uint32_t parent, uint32_t eventId)
+    {
+        const std::vector<uint32_t>& siblings = (parent == HierarchyNode::kNoParent) ? thread.roots : thread.nodes[parent].children;
+        for(uint32_t n : siblings)
+        {
+            if(thread.nodes[n].eventId == eventId) return n;
+        }
 
-        sCurrentLevel--;
+        HierarchyNode node;
+        node.eventId = eventId;
+        node.parent = parent;
+        node.level = (parent == HierarchyNode::kNoParent) ? 0 : thread.nodes[parent].level + 1;
+        uint32_t index = (uint32_t)thread.nodes.size();
+        thread.nodes.push_back(node);
+        (parent == HierarchyNode::kNoParent) ? thread.roots.push_back(index) : thread.nodes[parent].children.push_back(index);
+        getEventById(eventId)->level = node.level;
+        return index;
+    }
+
+    // Builds the thread's hierarchy from the records it appended since the last frame
+    static void processRecords(ThreadEventBuffer& thread, ProfilerState& state)
+    {
+        thread.drain([&thread, &state](const EventRecord& record)
+        {
+            // Scopes whose end record was dropped are closed here
+            uint32_t expectedSize = record.isEnd ? record.depth + 1 : record.depth;
+            while(thread.openScopes.size() > expectedSize)
+            {
+                thread.openScopes.pop_back();
+            }
+
+            if(record.isEnd == false)
+            {
+                uint32_t parent = thread.openScopes.empty() ? HierarchyNode::kNoParent : thread.openScopes.back().node;
+                thread.openScopes.push_back({ record.eventId, findOrCreateNode(thread, parent, record.eventId), record.time });
+            }
+            else if(thread.openScopes.size() == expectedSize && thread.openScopes.back().eventId == record.eventId)
+            {
+                const OpenScope& scope = thread.openScopes.back();
+                float duration = CpuTimer::calcDuration(scope.start, record.time);
+                thread.nodes[scope.node].cpuTime += duration;
+                Profiler::EventData* pEvent = getEventById(record.eventId);
+                pEvent->cpuTotal += duration;
+                pEvent->callCount++;
+                if(state.pTrace && scope.start >= state.traceStart)
+                {
+                    double start = std::chrono::duration<double, std::micro>(scope.start - state.traceStart).count();
+                    state.pTrace->addCompleteEvent(pEvent->name, thread.index, start, duration * 1000.0);
+                }
+                thread.openScopes.pop_back();
+            }
+        });
+    }
+
+    static void printNode(ThreadEventBuffer& thread, uint32_t nodeIndex, std::string& profileResults)
+    {
+        HierarchyNode& node = thread.nodes[nodeIndex];
+        const Profiler::EventData* pEvent = getEventById(node.eventId);
+        char event[1000];
+        uint32_t nameIndent = node.level * 2 + 1;
+        uint32_t cpuIndent = 32 - std::min(31u, nameIndent + (uint32_t)pEvent->name.size());
+        if(thread.isMainThread)
+        {
+            std::snprintf(event, 1000, "%*s%s %*.3f %36.3f\n", nameIndent, " ", pEvent->name.c_str(), cpuIndent, node.cpuTime, pEvent->gpuTotal);
+        }
+        else
+        {
+            std::snprintf(event, 1000, "%*s%s %*.3f\n", nameIndent, " ", pEvent->name.c_str(), cpuIndent, node.cpuTime);
+        }
+        profileResults += event;
+        node.cpuTime = 0;
+
+        for(uint32_t child : node.children)
+        {
+            printNode(thread, child, profileResults);
+        }
+    }
+
+    // Adds the thread names, the frame marker and the GPU times to the trace, and hands the frame's events to the writer thread
+    static void writeFrameToTrace(ProfilerState& state, uint32_t eventCount)
+    {
+        for(auto& pThread : state.threads)
+        {
+            if(pThread->traceNamed == false)
+            {
+                state.pTrace->setThreadName(pThread->index, pThread->isMainThread ? "Main thread" : "Thread " + std::to_string(pThread->index));
+                pThread->traceNamed = true;
+            }
+        }
+
+        double now = std::chrono::duration<double, std::micro>(CpuTimer::getCurrentTimePoint() - state.traceStart).count();
+        state.pTrace->addInstantEvent("Frame " + std::to_string(state.traceFrame++), now);
+
+        // The GPU timers don't provide timestamps, so the GPU times of the previous frame are exported as a counter track
+        std::vector<std::string> names;
+        std::vector<float> gpuTimes;
+        for(uint32_t i = 0; i < eventCount; i++)
+        {
+            if(state.events[i]->gpuTotal > 0)
+            {
+                names.push_back(state.events[i]->name);
+                gpuTimes.push_back(state.events[i]->gpuTotal);
+            }
+        }
+        if(names.size())
+        {
+            state.pTrace->addCounterEvent("GPU time (ms)", now, names, gpuTimes);
+        }
+        state.pTrace->flush();
     }
 
     void Profiler::endFrame(std::string& profileResults)
     {
+        assert(std::this_thread::get_id() == sMainThreadId);
+        ProfilerState& state = getState();
         profileResults = "Name\t\t\tCPU time(ms)\t\t\tGPU time(ms)\n";
 
-		for (EventData* pData : sProfilerVector)
-		{
+        // Reset the previous frame's results, and collect the GPU times
+        uint32_t eventCount = state.eventCount.load(std::memory_order_acquire);
+        for(uint32_t i = 0; i < eventCount; i++)
+        {
+            EventData* pData = state.events[i];
+            pData->cpuTotal = 0;
+            pData->callCount = 0;
             double gpuTime = 0;
-            for(size_t i = 0 ; i < pData->frameData[1 - sGpuTimerIndex].currentTimer ; i++)
+            for(size_t t = 0 ; t < pData->frameData[1 - state.gpuTimerIndex].currentTimer ; t++)
             {
-                gpuTime += pData->frameData[1 - sGpuTimerIndex].pTimers[i]->getElapsedTime();
+                gpuTime += pData->frameData[1 - state.gpuTimerIndex].pTimers[t]->getElapsedTime();
             }
-
-            pData->frameData[1 - sGpuTimerIndex].currentTimer = 0;
+            if(pData->frameData[1 - state.gpuTimerIndex].currentTimer)
+            {
+                pData->gpuHistogram.addSample((float)gpuTime);
+            }
+            pData->frameData[1 - state.gpuTimerIndex].currentTimer = 0;
+            pData->gpuTotal = (float)gpuTime;
             assert(pData->callStack.empty());
+        }
 
-			char event[1000];
-			uint32_t nameIndent = pData->level * 2 + 1;
-			uint32_t cpuIndent = 32 - (nameIndent + (uint32_t)pData->name.size());
-			std::snprintf(event, 1000, "%*s%s %*.3f %36.3f\n", nameIndent, " ", pData->name.c_str(), cpuIndent, pData->cpuTotal, gpuTime);
-#if _PROFILING_LOG == 1
-			pData->cpuMs[pData->stepNr] = pData->cpuTotal;
-			pData->gpuMs[pData->stepNr] = gpuTime;
-			pData->stepNr++;
-			if (pData->stepNr == _PROFILING_LOG_BATCH_SIZE)
-			{
-				std::ostringstream logOss, fileOss;
-				logOss << "dumping " << "profile_" << pData->name << "_" << pData->filesWritten;
-				Logger::log(Logger::Level::Info, logOss.str());
-				fileOss << "profile_" << pData->name << "_" << pData->filesWritten++;
-				std::ofstream out(fileOss.str().c_str());
-				for (int i = 0; i < _PROFILING_LOG_BATCH_SIZE; ++i)
-				{
-				 	out << pData->cpuMs[i] << " " << pData->gpuMs[i] << "\n";
-				}
-				pData->stepNr = 0;
-			}
-#endif
-            pData->cpuTotal = 0;
-			pData->gpuTotal = 0;
-            profileResults += event;
-        }
-
-        sGpuTimerIndex = 1 - sGpuTimerIndex;
-    }
-
-#if _PROFILING_LOG == 1
-	void Profiler::flushLog() {
-		for (EventData* pData : sProfilerVector)
-		{
-				std::ostringstream logOss, fileOss;
-				logOss << "dumping " << "profile_" << pData->name << "_" << pData->filesWritten;
-				Logger::log(Logger::Level::Info, logOss.str());
-				fileOss << "profile_" << pData->name << "_" << pData->filesWritten++;
-				std::ofstream out(fileOss.str().c_str());
-				for (int i = 0; i < pData->stepNr; ++i)
-				{
-					out << pData->cpuMs[i] << " " << pData->gpuMs[i] << "\n";
-				}
-				pData->stepNr = 0;
-			}
-	}
-#endif
+        std::lock_guard<std::mutex> lock(state.threadsMutex);
+        state.droppedLastFrame = 0;
+        for(auto& pThread : state.threads)
+        {
+            processRecords(*pThread, state);
+            state.droppedLastFrame += pThread->takeDroppedCount();
+        }
+
+        for(uint32_t i = 0; i < eventCount; i++)
+        {
+            if(state.events[i]->callCount)
+            {
+                state.events[i]->cpuHistogram.addSample(state.events[i]->cpuTotal);
+            }
+        }
+
+        // The main thread comes first, the other threads follow in the order they started profiling
+        std::stable_sort(state.threads.begin(), state.threads.end(), [](const std::shared_ptr<ThreadEventBuffer>& a, const std::shared_ptr<ThreadEventBuffer>& b) { return a->isMainThread > b->isMainThread; });
+        for(auto& pThread : state.threads)
+        {
+            if(pThread->isMainThread == false && pThread->roots.size())
+            {
+                profileResults += "Thread " + std::to_string(pThread->index) + "\n";
+            }
+            for(uint32_t root : pThread->roots)
+            {
+                printNode(*pThread, root, profileResults);
+            }
+        }
+
+        if(state.droppedLastFrame)
+        {
+            profileResults += std::to_string(state.droppedLastFrame) + " events were dropped\n";
+        }
+
+        if(state.pTrace)
+        {
+            writeFrameToTrace(state, eventCount);
+        }
+
+        // Release the buffers of threads which exited, once all their records were consumed
+        for(size_t i = 0; i < state.threads.size();)
+        {
+            if(state.threads[i]->threadExited.load(std::memory_order_acquire))
+            {
+                processRecords(*state.threads[i], state);
+                state.threads.erase(state.threads.begin() + i);
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        state.gpuTimerIndex = 1 - state.gpuTimerIndex;
+    }
+
+    uint64_t Profiler::getDroppedEventCount()
+    {
+        return getState().droppedLastFrame;
+    }
+
+    std::vector<Profiler::EventData*> Profiler::getEvents()
+    {
+        ProfilerState& state = getState();
+        uint32_t eventCount = state.eventCount.load(std::memory_order_acquire);
+        return std::vector<EventData*>(state.events, state.events + eventCount);
+    }
+
+    bool Profiler::startTrace(const std::string& filename)
+    {
+        ProfilerState& state = getState();
+        stopTrace();
+        state.pTrace = TraceWriter::create(filename);
+        state.traceStart = CpuTimer::getCurrentTimePoint();
+        state.traceFrame = 0;
+
+        std::lock_guard<std::mutex> lock(state.threadsMutex);
+        for(auto& pThread : state.threads)
+        {
+            pThread->traceNamed = false;
+        }
+        return state.pTrace != nullptr;
+    }
+
+    void Profiler::stopTrace()
+    {
+        // The writer's destructor writes the remaining events
+        getState().pTrace = nullptr;
+    }
+
+    bool Profiler::isTracing()
+    {
+        return getState().pTrace != nullptr;
+    }
 
     void Profiler::clearEvents()
     {
-        for (EventData* pData : sProfilerVector)
+        ProfilerState& state = getState();
         {
-            delete pData;
+            std::lock_guard<std::mutex> lock(state.threadsMutex);
+            for(auto& pThread : state.threads)
+            {
+                pThread->drain([](const EventRecord&) {});
+                pThread->nodes.clear();
+                pThread->roots.clear();
+                pThread->openScopes.clear();
+                pThread->takeDroppedCount();
+            }
+            state.droppedLastFrame = 0;
+        }
+
+        uint32_t eventCount = state.eventCount.load(std::memory_order_acquire);
+        for(uint32_t i = 0; i < eventCount; i++)
+        {
+            EventData* pData = state.events[i];
+            pData->frameData[0].currentTimer = 0;
+            pData->frameData[1].currentTimer = 0;
+            pData->callStack = std::stack<size_t>();
+            pData->cpuTotal = 0;
+            pData->gpuTotal = 0;
+            pData->callCount = 0;
+            pData->level = 0;
+            pData->cpuHistogram.reset();
+            pData->gpuHistogram.reset();
         }
-        sProfilerEvents.clear();
-        sProfilerVector.clear();
-        sCurrentLevel = 0;
-        sGpuTimerIndex = 0;
+        state.gpuTimerIndex = 0;
     }
-}
\ No newline at end of file
+}
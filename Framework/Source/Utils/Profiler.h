@@ -30,8 +30,10 @@
 #include <map>
 #include <functional>
 #include <vector>
+#include <atomic>
 #include "API/GpuTimer.h"
 #include "Utils/CpuTimer.h"
+#include "Utils/StreamingHistogram.h"
 #include "FalcorConfig.h"
 #include <stack>
 
@@ -42,15 +44,19 @@ namespace Falcor
     class GpuTimer;
 
     /** Basic wrapper to calculate and store a string's hash value.
+        The profiler caches the ID of the matching event in the object, so only the first use of a HashedString looks the event up.
     */
     struct HashedString
     {
         static std::hash<std::string> hashFunc;
+        static const uint32_t kInvalidId = (uint32_t)-1;
 
         HashedString(const std::string& s) : str(s), hash(hashFunc(s)) {}
+        HashedString(const HashedString& other) : str(other.str), hash(other.hash), id(other.id.load(std::memory_order_relaxed)) {}
 
         const std::string str;
         const size_t hash;
+        mutable std::atomic<uint32_t> id{ kInvalidId };   ///< The profiler event ID, assigned on first use
     };
 
     struct EventCounter
@@ -60,23 +66,31 @@ namespace Falcor
         int numDescriptorHeapAllocations = 0;
         int numDrawCalls = 0;
         int numMaterialChanges = 0;
+        int numProgramVariantChanges = 0;
+        int numVaoChanges = 0;
         int numParamBlockUpdates = 0;
         int numDescriptors = 0, numDescriptorTables = 0;
         int numSetRootDescriptorTableCalls = 0;
         int numDescriptorChunkSwitches = 0;
         int numOutOfChunks = 0;
+        int numOcclusionTests = 0;
+        int numOcclusionCulled = 0;
         void Clear()
         {
             numRootSignatureChanges = 0;
             numDescriptorHeapAllocations = 0;
             numDrawCalls = 0;
             numMaterialChanges = 0;
+            numProgramVariantChanges = 0;
+            numVaoChanges = 0;
             numFlushes = 0;
             numParamBlockUpdates = 0;
             numDescriptors = 0;
             numSetRootDescriptorTableCalls = 0;
             numDescriptorChunkSwitches = 0;
             numOutOfChunks = 0;
+            numOcclusionTests = 0;
+            numOcclusionCulled = 0;
         }
     };
 
@@ -84,40 +98,36 @@ namespace Falcor
 
     /** Container class for CPU/GPU profiling.
         This class uses the most accurately available CPU and GPU timers to profile given events. It automatically creates event hierarchies based on the order of the calls made.
-        This class uses a double-buffering scheme for GPU profiling to avoid GPU stalls.
-        CProfilerEvent is a wrapper class which together with scoping can simplify event profiling.
+        Events can be profiled from any thread. startEvent() and endEvent() append timestamped records to a ring buffer owned by the calling thread, without taking any locks. endFrame() drains the buffers and builds a separate hierarchy for each thread.
+        A profiled scope costs two clock reads and two ring-buffer appends (ProfilerTest measures it). If a thread records more than 4096 scopes between two endFrame() calls, the excess records are dropped and counted.
+        GPU time is only measured for events of the main thread, which owns the render context. GPU profiling uses a double-buffering scheme to avoid GPU stalls.
+        endFrame() adds each event's frame time to a histogram, from which percentiles over a sliding window and over the whole run can be queried.
+        The events can also be streamed to a trace file, see startTrace().
+        ProfilerEvent is a wrapper class which together with scoping can simplify event profiling.
     */
     class Profiler
     {
     public:
 
-#if _PROFILING_LOG == 1
-        static void flushLog();
-#endif
-
         struct EventData
         {
             virtual ~EventData() {}
             std::string name;
+            uint32_t id = HashedString::kInvalidId;
             struct FrameData
             {
                 std::vector<GpuTimer::SharedPtr> pTimers;
                 size_t currentTimer = 0;
             };
-            FrameData frameData[2]; // Double-buffering, to avoid GPU flushes
-
-            std::stack<size_t> callStack;
-            CpuTimer::TimePoint cpuStart;
-            CpuTimer::TimePoint cpuEnd;
-            float cpuTotal = 0;
-            float gpuTotal = 0;
-            uint32_t level;
-#if _PROFILING_LOG == 1
-            int stepNr = 0;
-            int filesWritten = 0;
-            float cpuMs[_PROFILING_LOG_BATCH_SIZE];
-            float gpuMs[_PROFILING_LOG_BATCH_SIZE];
-#endif
+            FrameData frameData[2]; // Double-buffering, to avoid GPU flushes. Only used by the main thread.
+
+            std::stack<size_t> callStack;   // GPU timers of the main thread's open scopes
+            float cpuTotal = 0;             ///< CPU time of the last frame, summed over all the threads
+            float gpuTotal = 0;             ///< GPU time of the last frame
+            uint32_t callCount = 0;         ///< Number of scopes which ended during the last frame, over all the threads
+            uint32_t level = 0;             ///< Depth of the event in the last hierarchy it was added to
+            StreamingHistogram cpuHistogram;    ///< Per-frame CPU times, for the frames where the event was called
+            StreamingHistogram gpuHistogram;    ///< Per-frame GPU times of the main thread's scopes
         };
 
         /** Start profiling a new event and update the events hierarchies.
@@ -144,8 +154,8 @@ namespace Falcor
         */
         static void endEvent(const HashedString& name, EventData *pEvent);
 
-        /** Finish profiling for the entire frame.
-            Due to the double-buffering nature of the profiler, the results returned are for the previous frame.
+        /** Finish profiling for the entire frame. Must be called from the main thread.
+            Due to the double-buffering nature of the profiler, the GPU results returned are for the previous frame.
             \param[out] profileResults A string containing the the profiling results.
         */
         static void endFrame(std::string& profileResults);
@@ -164,6 +174,7 @@ namespace Falcor
 
         /** Get the event, or create a new one if the event does not yet exist.
             This is a public interface to facilitate more complicated construction of event names and finegrained control over the profiled region.
+            Returns nullptr if the maximum number of events was reached.
         */
         static EventData* getEvent(const HashedString& name);
 
@@ -172,16 +183,35 @@ namespace Falcor
         */
         static EventData* isEventRegistered(const HashedString& name);
 
-        /** Clears all the events. 
-            Useful if you want to start profiling a different technique with different events.
+        /** Get all the registered events.
+        */
+        static std::vector<EventData*> getEvents();
+
+        /** Clears the results, the histograms and the hierarchies of all the events.
+            Useful if you want to start profiling a different technique with different events. Event IDs stay valid, since they are cached in HashedString objects.
+            Must not be called while other threads are profiling.
         */
         static void clearEvents();
 
-    private:
-        static std::map<size_t, EventData*> sProfilerEvents;
-        static std::vector<EventData*> sProfilerVector;
-        static uint32_t sCurrentLevel;
-        static uint32_t sGpuTimerIndex;
+        /** Get the number of records dropped because a thread's buffer was full, during the last frame
+        */
+        static uint64_t getDroppedEventCount();
+
+        /** Start streaming the events to a file in the Chrome trace event format, which can be opened with chrome://tracing or Perfetto.
+            endFrame() adds the CPU events of all the threads with their begin and end times, a marker for each frame, and the main thread's GPU times as a counter track.
+            Events are only recorded while gProfileEnabled is set. Must be called from the main thread.
+            \param[in] filename The trace file. It is overwritten.
+            \return true if the file was opened, otherwise false.
+        */
+        static bool startTrace(const std::string& filename);
+
+        /** Finish writing the trace file. Must be called from the main thread.
+        */
+        static void stopTrace();
+
+        /** Check if the events are streamed to a trace file.
+        */
+        static bool isTracing();
     };
 
     /** Helper class for starting and ending profiling events.
@@ -192,14 +222,16 @@ namespace Falcor
     {
     public:
         /** C'tor
+            \param[in] name The event name. The object keeps a reference to it, so it must outlive the scope. PROFILE uses a static HashedString.
         */
-        ProfilerEvent(const HashedString& name) : mName(name) { if(gProfileEnabled) { Profiler::startEvent(name); } }
+        ProfilerEvent(const HashedString& name) : mName(name) { if(gProfileEnabled) { mpEvent = Profiler::getEvent(name); Profiler::startEvent(name, mpEvent); } }
         /** D'tor
         */
-        ~ProfilerEvent() { if(gProfileEnabled) {Profiler::endEvent(mName); }}
+        ~ProfilerEvent() { if(mpEvent) { Profiler::endEvent(mName, mpEvent); } }
 
     private:
-        const HashedString mName;
+        const HashedString& mName;
+        Profiler::EventData* mpEvent = nullptr;
     };
 
 #if _PROFILING_ENABLED
@@ -0,0 +1,78 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Framework.h"
+#include "RadixSort.h"
+
+namespace Falcor
+{
+    void radixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values)
+    {
+        assert(keys.size() == values.size());
+        const size_t count = keys.size();
+        if (count < 2) return;
+
+        // Count the digits of all the passes at once
+        static const uint32_t kPassCount = sizeof(uint64_t);
+        std::vector<uint32_t> histograms(kPassCount * 256, 0);
+        for (uint64_t key : keys)
+        {
+            for (uint32_t pass = 0; pass < kPassCount; pass++)
+            {
+                histograms[pass * 256 + ((key >> (pass * 8)) & 0xff)]++;
+            }
+        }
+
+        std::vector<uint64_t> tempKeys(count);
+        std::vector<uint32_t> tempValues(count);
+        for (uint32_t pass = 0; pass < kPassCount; pass++)
+        {
+            uint32_t* pHistogram = &histograms[pass * 256];
+            const uint32_t shift = pass * 8;
+
+            // All the keys have the same digit, the pass wouldn't change the order
+            if (pHistogram[(keys[0] >> shift) & 0xff] == count) continue;
+
+            uint32_t offset = 0;
+            for (uint32_t digit = 0; digit < 256; digit++)
+            {
+                uint32_t digitCount = pHistogram[digit];
+                pHistogram[digit] = offset;
+                offset += digitCount;
+            }
+
+            for (size_t i = 0; i < count; i++)
+            {
+                uint32_t dst = pHistogram[(keys[i] >> shift) & 0xff]++;
+                tempKeys[dst] = keys[i];
+                tempValues[dst] = values[i];
+            }
+            keys.swap(tempKeys);
+            values.swap(tempValues);
+        }
+    }
+}
@@ -0,0 +1,173 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Framework.h"
+#include "StreamingHistogram.h"
+#include <cmath>
+#include <cfloat>
+
+namespace Falcor
+{
+    StreamingHistogram::StreamingHistogram(uint32_t windowSize) : mWindowSize(std::max(windowSize, 1u))
+    {
+        mWindowSamples.reserve(mWindowSize);
+        reset();
+    }
+
+    void StreamingHistogram::reset()
+    {
+        mRun.counts.fill(0);
+        mRun.count = 0;
+        mRun.sum = 0;
+        mWindow = mRun;
+        mRunMin = FLT_MAX;
+        mRunMax = -FLT_MAX;
+        mWindowSamples.clear();
+        mWindowNext = 0;
+    }
+
+    uint32_t StreamingHistogram::getBucketIndex(float value)
+    {
+        if(value <= 0 || std::isnan(value))
+        {
+            return 0;
+        }
+
+        // value = mantissa * 2^exponent, mantissa in [0.5, 1)
+        int exponent;
+        float mantissa = std::frexp(value, &exponent);
+        if(exponent <= kMinExponent)
+        {
+            return 0;
+        }
+        if(exponent > kMaxExponent)
+        {
+            return kBucketCount - 1;
+        }
+        uint32_t subBucket = std::min((uint32_t)((mantissa - 0.5f) * 2 * kSubBucketCount), kSubBucketCount - 1);
+        return (exponent - kMinExponent - 1) * kSubBucketCount + subBucket;
+    }
+
+    float StreamingHistogram::getBucketValue(uint32_t index)
+    {
+        // The center of the bucket
+        int exponent = (int)(index / kSubBucketCount) + kMinExponent + 1;
+        float mantissa = 0.5f + (float(index % kSubBucketCount) + 0.5f) / (2 * kSubBucketCount);
+        return std::ldexp(mantissa, exponent);
+    }
+
+    void StreamingHistogram::addSample(float value)
+    {
+        uint32_t bucket = getBucketIndex(value);
+        mRun.counts[bucket]++;
+        mRun.count++;
+        mRun.sum += value;
+        mRunMin = std::min(mRunMin, value);
+        mRunMax = std::max(mRunMax, value);
+
+        // Replace the oldest sample of the window
+        if(mWindowSamples.size() < mWindowSize)
+        {
+            mWindowSamples.push_back(value);
+        }
+        else
+        {
+            float oldest = mWindowSamples[mWindowNext];
+            mWindow.counts[getBucketIndex(oldest)]--;
+            mWindow.count--;
+            mWindow.sum -= oldest;
+            mWindowSamples[mWindowNext] = value;
+            mWindowNext = (mWindowNext + 1) % mWindowSize;
+        }
+        mWindow.counts[bucket]++;
+        mWindow.count++;
+        mWindow.sum += value;
+    }
+
+    float StreamingHistogram::calcPercentile(const Buckets& buckets, float percentile, float min, float max)
+    {
+        if(buckets.count == 0)
+        {
+            return 0;
+        }
+
+        uint64_t rank = std::max((uint64_t)std::ceil(double(percentile) / 100.0 * double(buckets.count)), (uint64_t)1);
+        uint64_t accumulated = 0;
+        for(uint32_t i = 0; i < kBucketCount; i++)
+        {
+            accumulated += buckets.counts[i];
+            if(accumulated >= rank)
+            {
+                return std::max(min, std::min(getBucketValue(i), max));
+            }
+        }
+        return max;
+    }
+
+    float StreamingHistogram::getPercentile(float percentile, bool window) const
+    {
+        Statistics stats = window ? getWindowStatistics() : getRunStatistics();
+        return calcPercentile(window ? mWindow : mRun, percentile, stats.min, stats.max);
+    }
+
+    StreamingHistogram::Statistics StreamingHistogram::getRunStatistics() const
+    {
+        Statistics stats;
+        if(mRun.count)
+        {
+            stats.count = mRun.count;
+            stats.min = mRunMin;
+            stats.max = mRunMax;
+            stats.mean = float(mRun.sum / double(mRun.count));
+            stats.p50 = calcPercentile(mRun, 50, stats.min, stats.max);
+            stats.p95 = calcPercentile(mRun, 95, stats.min, stats.max);
+            stats.p99 = calcPercentile(mRun, 99, stats.min, stats.max);
+        }
+        return stats;
+    }
+
+    StreamingHistogram::Statistics StreamingHistogram::getWindowStatistics() const
+    {
+        Statistics stats;
+        if(mWindow.count)
+        {
+            stats.count = mWindow.count;
+            stats.min = FLT_MAX;
+            stats.max = -FLT_MAX;
+            for(float s : mWindowSamples)
+            {
+                stats.min = std::min(stats.min, s);
+                stats.max = std::max(stats.max, s);
+            }
+            stats.mean = float(mWindow.sum / double(mWindow.count));
+            stats.p50 = calcPercentile(mWindow, 50, stats.min, stats.max);
+            stats.p95 = calcPercentile(mWindow, 95, stats.min, stats.max);
+            stats.p99 = calcPercentile(mWindow, 99, stats.min, stats.max);
+        }
+        return stats;
+    }
+}
@@ -0,0 +1,112 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <vector>
+#include <array>
+#include <cstdint>
+
+namespace Falcor
+{
+    /** Constant-memory histogram of a stream of samples, such as frame times in milliseconds.
+        Samples are counted in log-linear buckets: each power of 2 is split into 16 linear buckets, so percentiles are accurate to about 3% of the value. Values from 2^-10 to 2^18 are resolved, smaller and larger values are clamped.
+        Statistics are available for the whole run and for a sliding window over the last samples. The window keeps the raw samples, so its memory is proportional to the window size.
+    */
+    class StreamingHistogram
+    {
+    public:
+        static const uint32_t kDefaultWindowSize = 600;
+
+        struct Statistics
+        {
+            uint64_t count = 0;
+            float min = 0;
+            float max = 0;
+            float mean = 0;
+            float p50 = 0;
+            float p95 = 0;
+            float p99 = 0;
+        };
+
+        /** Constructor
+            \param[in] windowSize The number of samples in the sliding window.
+        */
+        StreamingHistogram(uint32_t windowSize = kDefaultWindowSize);
+
+        /** Add a sample.
+        */
+        void addSample(float value);
+
+        /** Get the statistics of all the samples since the last reset().
+        */
+        Statistics getRunStatistics() const;
+
+        /** Get the statistics of the last windowSize samples.
+        */
+        Statistics getWindowStatistics() const;
+
+        /** Get a percentile of the samples.
+            \param[in] percentile The percentile, in [0, 100].
+            \param[in] window If true, only the samples in the sliding window are used.
+        */
+        float getPercentile(float percentile, bool window = false) const;
+
+        /** Get the number of samples since the last reset().
+        */
+        uint64_t getSampleCount() const { return mRun.count; }
+
+        /** Remove all the samples.
+        */
+        void reset();
+
+    private:
+        static const int32_t kMinExponent = -10;
+        static const int32_t kMaxExponent = 18;
+        static const uint32_t kSubBucketCount = 16;
+        static const uint32_t kBucketCount = (kMaxExponent - kMinExponent) * kSubBucketCount;
+
+        struct Buckets
+        {
+            std::array<uint32_t, kBucketCount> counts;
+            uint64_t count = 0;
+            double sum = 0;
+        };
+
+        static uint32_t getBucketIndex(float value);
+        static float getBucketValue(uint32_t index);
+        static float calcPercentile(const Buckets& buckets, float percentile, float min, float max);
+
+        Buckets mRun;
+        Buckets mWindow;
+        float mRunMin;
+        float mRunMax;
+
+        uint32_t mWindowSize;
+        std::vector<float> mWindowSamples;
+        uint32_t mWindowNext = 0;
+    };
+}
@@ -0,0 +1,217 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "Framework.h"
+#include "TraceWriter.h"
+
+namespace Falcor
+{
+    static void appendEscaped(std::string& json, const std::string& s)
+    {
+        json += '"';
+        for(char c : s)
+        {
+            switch(c)
+            {
+            case '"': json += "\\\""; break;
+            case '\\': json += "\\\\"; break;
+            case '\n': json += "\\n"; break;
+            case '\t': json += "\\t"; break;
+            default:
+                if((unsigned char)c < 0x20)
+                {
+                    char code[8];
+                    std::snprintf(code, sizeof(code), "\\u%04x", (uint32_t)c);
+                    json += code;
+                }
+                else
+                {
+                    json += c;
+                }
+            }
+        }
+        json += '"';
+    }
+
+    static void appendNumber(std::string& json, double value)
+    {
+        char number[32];
+        std::snprintf(number, sizeof(number), "%.3f", value);
+        json += number;
+    }
+
+    TraceWriter::SharedPtr TraceWriter::create(const std::string& filename, size_t maxPendingBytes)
+    {
+        SharedPtr pWriter = SharedPtr(new TraceWriter(filename, maxPendingBytes));
+        if(pWriter->mFile.is_open() == false)
+        {
+            logError("Can't open trace file '" + filename + "'");
+            return nullptr;
+        }
+        pWriter->mThread = std::thread(&TraceWriter::writerThread, pWriter.get());
+        return pWriter;
+    }
+
+    TraceWriter::TraceWriter(const std::string& filename, size_t maxPendingBytes) : mFilename(filename), mFile(filename, std::ios::binary | std::ios::trunc), mMaxPendingBytes(maxPendingBytes)
+    {
+        mChunk.reserve(kChunkSize);
+    }
+
+    TraceWriter::~TraceWriter()
+    {
+        if(mThread.joinable())
+        {
+            flush();
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mTerminate = true;
+            }
+            mChunkAvailable.notify_one();
+            mThread.join();
+        }
+
+        if(mDroppedEvents)
+        {
+            logWarning("Trace '" + mFilename + "' is missing " + std::to_string(mDroppedEvents) + " events, the file couldn't be written fast enough");
+        }
+    }
+
+    void TraceWriter::beginEvent()
+    {
+        // Every event is preceded by a separator. The writer thread skips the first one.
+        mChunk += ",\n{";
+        mChunkEvents++;
+    }
+
+    void TraceWriter::addCompleteEvent(const std::string& name, uint32_t threadId, double timestamp, double duration)
+    {
+        beginEvent();
+        mChunk += "\"name\":";
+        appendEscaped(mChunk, name);
+        mChunk += ",\"ph\":\"X\",\"pid\":0,\"tid\":" + std::to_string(threadId) + ",\"ts\":";
+        appendNumber(mChunk, timestamp);
+        mChunk += ",\"dur\":";
+        appendNumber(mChunk, duration);
+        mChunk += "}";
+        if(mChunk.size() >= kChunkSize) flush();
+    }
+
+    void TraceWriter::addInstantEvent(const std::string& name, double timestamp)
+    {
+        beginEvent();
+        mChunk += "\"name\":";
+        appendEscaped(mChunk, name);
+        mChunk += ",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":";
+        appendNumber(mChunk, timestamp);
+        mChunk += "}";
+        if(mChunk.size() >= kChunkSize) flush();
+    }
+
+    void TraceWriter::addCounterEvent(const std::string& name, double timestamp, const std::vector<std::string>& series, const std::vector<float>& values)
+    {
+        assert(series.size() == values.size());
+        beginEvent();
+        mChunk += "\"name\":";
+        appendEscaped(mChunk, name);
+        mChunk += ",\"ph\":\"C\",\"pid\":0,\"ts\":";
+        appendNumber(mChunk, timestamp);
+        mChunk += ",\"args\":{";
+        for(size_t i = 0; i < series.size(); i++)
+        {
+            if(i) mChunk += ',';
+            appendEscaped(mChunk, series[i]);
+            mChunk += ':';
+            appendNumber(mChunk, values[i]);
+        }
+        mChunk += "}}";
+        if(mChunk.size() >= kChunkSize) flush();
+    }
+
+    void TraceWriter::setThreadName(uint32_t threadId, const std::string& name)
+    {
+        beginEvent();
+        mChunk += "\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" + std::to_string(threadId) + ",\"args\":{\"name\":";
+        appendEscaped(mChunk, name);
+        mChunk += "}}";
+    }
+
+    void TraceWriter::flush()
+    {
+        if(mChunk.empty())
+        {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if(mPendingBytes + mChunk.size() > mMaxPendingBytes)
+            {
+                mDroppedEvents += mChunkEvents;
+                mChunk.clear();
+                mChunkEvents = 0;
+                return;
+            }
+            mPendingBytes += mChunk.size();
+            mPendingChunks.push_back(std::move(mChunk));
+        }
+        mChunkAvailable.notify_one();
+
+        mChunk = std::string();
+        mChunk.reserve(kChunkSize);
+        mChunkEvents = 0;
+    }
+
+    void TraceWriter::writerThread()
+    {
+        mFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool firstChunk = true;
+        while(true)
+        {
+            std::string chunk;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mChunkAvailable.wait(lock, [this]() { return mTerminate || mPendingChunks.size(); });
+                if(mPendingChunks.empty())
+                {
+                    break;
+                }
+                chunk = std::move(mPendingChunks.front());
+                mPendingChunks.pop_front();
+            }
+
+            // Skip the separator of the first event
+            size_t offset = firstChunk ? 1 : 0;
+            mFile.write(chunk.data() + offset, chunk.size() - offset);
+            firstChunk = false;
+
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPendingBytes -= chunk.size();
+        }
+        mFile << "\n]}\n";
+        mFile.close();
+    }
+}
@@ -0,0 +1,118 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <condition_variable>
+
+namespace Falcor
+{
+    /** Streams events to a file in the Chrome trace event format, which can be opened with chrome://tracing or Perfetto.
+        Events are serialized into a chunk in memory. Full chunks are handed to a background thread which writes them to the file.
+        The amount of memory waiting to be written is bounded. When the writer thread can't keep up, new chunks are dropped and the dropped events are counted.
+        Timestamps and durations are in microseconds. The add*() functions are not thread-safe, the profiler calls them from endFrame().
+    */
+    class TraceWriter
+    {
+    public:
+        using SharedPtr = std::shared_ptr<TraceWriter>;
+        static const size_t kDefaultMaxPendingBytes = 64 * 1024 * 1024;
+
+        /** Create a new object and open the file.
+            \param[in] filename The output file. It is overwritten.
+            \param[in] maxPendingBytes The maximum amount of serialized events waiting to be written.
+            \return A new object, or nullptr if the file couldn't be opened.
+        */
+        static SharedPtr create(const std::string& filename, size_t maxPendingBytes = kDefaultMaxPendingBytes);
+
+        /** Writes the remaining events and closes the file.
+        */
+        ~TraceWriter();
+
+        /** Add an event with a start time and a duration ('X' phase).
+        */
+        void addCompleteEvent(const std::string& name, uint32_t threadId, double timestamp, double duration);
+
+        /** Add an instant event which spans all the threads ('i' phase), such as a frame marker.
+        */
+        void addInstantEvent(const std::string& name, double timestamp);
+
+        /** Add a sample of a counter track ('C' phase).
+            \param[in] name The track name.
+            \param[in] series The names of the values. The track displays a series for each of them.
+            \param[in] values The values.
+        */
+        void addCounterEvent(const std::string& name, double timestamp, const std::vector<std::string>& series, const std::vector<float>& values);
+
+        /** Set the name displayed for a thread ('M' phase).
+        */
+        void setThreadName(uint32_t threadId, const std::string& name);
+
+        /** Hand the events added so far to the writer thread.
+        */
+        void flush();
+
+        /** Get the number of events dropped because the writer thread couldn't keep up.
+        */
+        uint64_t getDroppedEventCount() const { return mDroppedEvents; }
+
+        /** Get the name of the output file.
+        */
+        const std::string& getFilename() const { return mFilename; }
+
+    private:
+        TraceWriter(const std::string& filename, size_t maxPendingBytes);
+        void beginEvent();
+        void writerThread();
+
+        static const size_t kChunkSize = 256 * 1024;
+
+        std::string mFilename;
+        std::ofstream mFile;
+        size_t mMaxPendingBytes;
+
+        // Producer side
+        std::string mChunk;
+        uint32_t mChunkEvents = 0;
+        uint64_t mDroppedEvents = 0;
+
+        // Shared with the writer thread
+        std::mutex mMutex;
+        std::condition_variable mChunkAvailable;
+        std::deque<std::string> mPendingChunks;
+        size_t mPendingBytes = 0;
+        bool mTerminate = false;
+        std::thread mThread;
+    };
+}
@@ -0,0 +1,618 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "AnimationTest.h"
+#include "Utils/CpuTimer.h"
+#include "Utils/JobSystem.h"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtx/transform.hpp"
+#include "Utils/Bitmap.h"
+#include <random>
+#include <fstream>
+
+void AnimationTest::addTests()
+{
+    addTestToList<TestComposeTransform>();
+    addTestToList<TestHierarchyOrder>();
+    addTestToList<TestAnimationScaling>();
+    addTestToList<TestBatch>();
+    addTestToList<TestClipAccuracy>();
+    addTestToList<TestClipBenchmark>();
+    addTestToList<TestLayerBlending>();
+    addTestToList<TestSharedRig>();
+}
+
+static glm::quat randomRotation(std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> dist(-1, 1);
+    return glm::normalize(glm::quat(dist(rng), dist(rng), dist(rng), dist(rng)));
+}
+
+static glm::mat4 randomTransform(std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> translation(-2, 2);
+    std::uniform_real_distribution<float> scale(0.5f, 1.5f);
+    glm::vec3 t(translation(rng), translation(rng), translation(rng));
+    glm::vec3 s(scale(rng), scale(rng), scale(rng));
+    return glm::translate(t) * glm::mat4_cast(randomRotation(rng)) * glm::scale(s);
+}
+
+std::vector<Bone> AnimationTest::createSkeleton(uint32_t boneCount, bool childrenFirst, uint32_t seed)
+{
+    // When childrenFirst is set, every bone's parent has a larger ID, which is the worst case for an in-order evaluation
+    std::mt19937 rng(seed);
+    std::vector<Bone> bones(boneCount);
+    for (uint32_t i = 0; i < boneCount; i++)
+    {
+        Bone& bone = bones[i];
+        bone.boneID = i;
+        bone.name = "Bone" + std::to_string(i);
+        if (childrenFirst)
+        {
+            bone.parentID = (i == boneCount - 1) ? AnimationController::kInvalidBoneID : std::uniform_int_distribution<uint32_t>(i + 1, std::min(i + 4, boneCount - 1))(rng);
+        }
+        else
+        {
+            bone.parentID = (i == 0) ? AnimationController::kInvalidBoneID : std::uniform_int_distribution<uint32_t>(i > 4 ? i - 4 : 0, i - 1)(rng);
+        }
+        bone.offset = randomTransform(rng);
+        bone.localTransform = randomTransform(rng);
+        bone.originalLocalTransform = bone.localTransform;
+        bone.globalTransform = glm::mat4();
+    }
+    return bones;
+}
+
+void AnimationTest::calcReferenceTransforms(const AnimationController* pController, std::vector<glm::mat4>& transforms, std::vector<glm::mat4>& invTransposeTransforms)
+{
+    // Walk up to the root for every bone, so the result doesn't depend on the order of the bones
+    const auto& bones = pController->getBones();
+    transforms.resize(bones.size());
+    invTransposeTransforms.resize(bones.size());
+    for (uint32_t i = 0; i < (uint32_t)bones.size(); i++)
+    {
+        glm::mat4 global = pController->getBoneLocalTransform(i);
+        for (uint32_t parent = bones[i].parentID; parent != AnimationController::kInvalidBoneID; parent = bones[parent].parentID)
+        {
+            global = pController->getBoneLocalTransform(parent) * global;
+        }
+        transforms[i] = global * bones[i].offset;
+        invTransposeTransforms[i] = glm::transpose(glm::inverse(transforms[i]));
+    }
+}
+
+bool AnimationTest::compareMatrices(const glm::mat4* pA, const glm::mat4* pB, uint32_t count, float epsilon)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            for (int r = 0; r < 4; r++)
+            {
+                float scale = std::max(1.0f, std::abs(pB[i][c][r]));
+                if (std::abs(pA[i][c][r] - pB[i][c][r]) > epsilon * scale) return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::vector<Animation::AnimationSet> AnimationTest::createClipSets(uint32_t boneCount, uint32_t keyCount, float duration, uint32_t seed)
+{
+    // Smooth curves sampled at every key, like exported motion capture. Some channels don't move, and every other bone has no scaling keys.
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(-1, 1);
+    std::vector<Animation::AnimationSet> sets(boneCount);
+    for (uint32_t b = 0; b < boneCount; b++)
+    {
+        const glm::vec3 axis = glm::normalize(glm::vec3(dist(rng), dist(rng), dist(rng)));
+        const glm::vec3 offset(dist(rng), dist(rng), dist(rng));
+        const float frequency = 2 + 2 * dist(rng);
+        const bool animatedTranslation = (b % 3) == 0;
+        const bool animatedRotation = (b % 5) != 4;
+        sets[b].boneID = b;
+        for (uint32_t k = 0; k < keyCount; k++)
+        {
+            const float time = duration * k / (keyCount - 1);
+            const float phase = 6.2831853f * time / duration;
+            const float angle = animatedRotation ? sin(phase * frequency) : 0.3f;
+            sets[b].translation.keys.push_back({ animatedTranslation ? offset * cos(phase) : offset, time });
+            sets[b].rotation.keys.push_back({ glm::quat(cos(angle * 0.5f), axis.x * sin(angle * 0.5f), axis.y * sin(angle * 0.5f), axis.z * sin(angle * 0.5f)), time });
+            if (b & 1)
+            {
+                sets[b].scaling.keys.push_back({ glm::vec3(1 + 0.25f * sin(phase)), time });
+            }
+        }
+    }
+    return sets;
+}
+
+float AnimationTest::calcMaxDifference(const AnimationController* pA, const AnimationController* pB)
+{
+    float maxDifference = 0;
+    for (uint32_t b = 0; b < pA->getBoneCount(); b++)
+    {
+        const glm::mat4& a = pA->getBoneLocalTransform(b);
+        const glm::mat4& c = pB->getBoneLocalTransform(b);
+        for (int i = 0; i < 4; i++)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                maxDifference = std::max(maxDifference, std::abs(a[i][j] - c[i][j]));
+            }
+        }
+    }
+    return maxDifference;
+}
+
+bool AnimationTest::writeSmdModel(const std::string& filename, uint32_t boneCount, uint32_t frameCount, std::vector<std::string>& createdFiles)
+{
+    // A Valve SMD file, which Assimp imports with a key per frame for every channel. Each bone skins one triangle.
+    const std::string textureName = filename + ".png";
+    uint8_t texels[4] = { 0xff, 0xff, 0xff, 0xff };
+    createdFiles.push_back(textureName);
+    createdFiles.push_back(filename);
+    Bitmap::saveImage(textureName, 1, 1, Bitmap::FileFormat::PngFile, Bitmap::ExportFlags::None, ResourceFormat::RGBA8Unorm, true, texels);
+
+    std::ofstream smd(filename);
+    smd << "version 1\nnodes\n";
+    for (uint32_t b = 0; b < boneCount; b++)
+    {
+        smd << b << " \"Bone" << b << "\" " << (b == 0 ? -1 : int32_t(b - 1) / 2) << "\n";
+    }
+    smd << "end\nskeleton\n";
+    for (uint32_t f = 0; f < frameCount; f++)
+    {
+        const float phase = 6.2831853f * f / frameCount;
+        smd << "time " << f << "\n";
+        for (uint32_t b = 0; b < boneCount; b++)
+        {
+            const float x = (b == 0) ? 2 * sin(phase) : 0;
+            const float angle = (b % 4 == 3) ? 0.2f : 0.5f * sin(phase * (1 + b % 3) + b);
+            smd << b << " " << x << " " << (b == 0 ? 0 : 1) << " 0 " << angle << " " << 0.5f * angle << " 0\n";
+        }
+    }
+    smd << "end\ntriangles\n";
+    for (uint32_t b = 0; b < boneCount; b++)
+    {
+        const float x = float(b);
+        smd << textureName << "\n";
+        smd << b << " " << x << " 0 0 0 0 1 0 0\n";
+        smd << b << " " << x + 0.5f << " 0 0 0 0 1 1 0\n";
+        smd << b << " " << x << " 0.5 0 0 0 1 0 1\n";
+    }
+    smd << "end\n";
+    return smd.good();
+}
+
+testing_func(AnimationTest, TestComposeTransform)
+{
+    std::vector<Bone> bones = createSkeleton(1, false, 1);
+    auto pController = AnimationController::create(bones);
+
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> dist(-3, 3);
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        glm::vec3 t(dist(rng), dist(rng), dist(rng));
+        glm::vec3 s(dist(rng), dist(rng), dist(rng));
+        glm::quat q = randomRotation(rng);
+        pController->setBoneLocalTransform(0, t, q, s);
+        glm::mat4 reference = glm::translate(t) * glm::mat4_cast(q) * glm::scale(s);
+        if (compareMatrices(&pController->getBoneLocalTransform(0), &reference, 1, 1e-5f) == false) return test_fail("The TRS matrix doesn't match translate * rotate * scale");
+    }
+    return test_pass();
+}
+
+testing_func(AnimationTest, TestHierarchyOrder)
+{
+    for (bool childrenFirst : { false, true })
+    {
+        auto pController = AnimationController::create(createSkeleton(64, childrenFirst, 3));
+
+        std::mt19937 rng(4);
+        for (uint32_t i = 0; i < pController->getBoneCount(); i++)
+        {
+            pController->setBoneLocalTransform(i, randomTransform(rng));
+        }
+        pController->animate(0);
+
+        std::vector<glm::mat4> transforms, invTransposeTransforms;
+        calcReferenceTransforms(pController.get(), transforms, invTransposeTransforms);
+        if (compareMatrices(pController->getBoneMatrices().data(), transforms.data(), pController->getBoneCount(), 1e-4f) == false) return test_fail("The bone matrices don't match the reference");
+        if (compareMatrices(pController->getBoneInvTransposeMatrices().data(), invTransposeTransforms.data(), pController->getBoneCount(), 1e-3f) == false) return test_fail("The inverse-transpose bone matrices don't match the reference");
+    }
+    return test_pass();
+}
+
+testing_func(AnimationTest, TestAnimationScaling)
+{
+    auto pController = AnimationController::create(createSkeleton(2, false, 5));
+
+    // The last key wraps around to the first one
+    Animation::AnimationSet set;
+    set.boneID = 1;
+    set.scaling.keys = { { glm::vec3(2), 0.0f }, { glm::vec3(4), 8.0f } };
+    pController->addAnimation(Animation::create("Scale", { set }, 10, 1));
+    pController->setActiveAnimation(0);
+
+    pController->animate(4.0);
+    glm::mat4 expected = glm::scale(glm::vec3(3));
+    if (compareMatrices(&pController->getBoneLocalTransform(1), &expected, 1, 1e-5f) == false) return test_fail("The scaling channel wasn't applied");
+
+    pController->animate(9.0);
+    if (compareMatrices(&pController->getBoneLocalTransform(1), &expected, 1, 1e-5f) == false) return test_fail("The interpolation between the last and the first key is wrong");
+    return test_pass();
+}
+
+testing_func(AnimationTest, TestBatch)
+{
+    const uint32_t kControllerCount = 256;
+    const uint32_t kBoneCount = 80;
+    const uint32_t kKeyCount = 30;
+    const float kDuration = 60;
+    std::vector<Bone> bones = createSkeleton(kBoneCount, false, 6);
+
+    // Every controller gets its own clip, so they can be animated concurrently
+    std::mt19937 rng(7);
+    std::vector<Animation::AnimationSet> sets(kBoneCount);
+    std::uniform_real_distribution<float> translation(-1, 1);
+    for (uint32_t b = 0; b < kBoneCount; b++)
+    {
+        sets[b].boneID = b;
+        for (uint32_t k = 0; k < kKeyCount; k++)
+        {
+            float time = kDuration * k / kKeyCount;
+            sets[b].translation.keys.push_back({ glm::vec3(translation(rng), translation(rng), translation(rng)), time });
+            sets[b].rotation.keys.push_back({ randomRotation(rng), time });
+        }
+    }
+
+    std::vector<AnimationController::UniquePtr> controllers;
+    std::vector<AnimationController*> pControllers;
+    for (uint32_t i = 0; i < kControllerCount; i++)
+    {
+        controllers.push_back(AnimationController::create(bones));
+        controllers.back()->addAnimation(Animation::create("Clip", sets, kDuration, 30));
+        controllers.back()->setActiveAnimation(0);
+        pControllers.push_back(controllers.back().get());
+    }
+
+    // Serial evaluation is the reference for the parallel one
+    const double kTime = 1.25;
+    AnimationController::animateBatch(pControllers.data(), kControllerCount, kTime, nullptr);
+    std::vector<glm::mat4> serial;
+    for (const auto& pController : controllers)
+    {
+        serial.insert(serial.end(), pController->getBoneMatrices().begin(), pController->getBoneMatrices().end());
+    }
+
+    JobSystem::SharedPtr pJobSystem = JobSystem::create();
+    AnimationController::animateBatch(pControllers.data(), kControllerCount, kTime, pJobSystem.get());
+    for (uint32_t i = 0; i < kControllerCount; i++)
+    {
+        if (compareMatrices(controllers[i]->getBoneMatrices().data(), &serial[i * kBoneCount], kBoneCount, 0) == false) return test_fail("The parallel evaluation doesn't match the serial one");
+    }
+
+    // Compare against the previous evaluation, which used a general 4x4 inverse per bone
+    const uint32_t kFrames = 20;
+    std::vector<glm::mat4> globals(kBoneCount), transforms(kBoneCount), invTransposes(kBoneCount);
+    auto start = CpuTimer::getCurrentTimePoint();
+    for (uint32_t f = 0; f < kFrames; f++)
+    {
+        for (const auto& pController : controllers)
+        {
+            for (uint32_t b = 0; b < kBoneCount; b++)
+            {
+                const glm::mat4& local = pController->getBoneLocalTransform(b);
+                globals[b] = (bones[b].parentID == AnimationController::kInvalidBoneID) ? local : globals[bones[b].parentID] * local;
+                transforms[b] = globals[b] * bones[b].offset;
+                invTransposes[b] = glm::transpose(glm::inverse(transforms[b]));
+            }
+        }
+    }
+    float referenceTime = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint()) / kFrames;
+
+    start = CpuTimer::getCurrentTimePoint();
+    for (uint32_t f = 0; f < kFrames; f++)
+    {
+        for (const auto& pController : controllers)
+        {
+            pController->animate(kTime);
+        }
+    }
+    float serialTime = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint()) / kFrames;
+
+    start = CpuTimer::getCurrentTimePoint();
+    for (uint32_t f = 0; f < kFrames; f++)
+    {
+        AnimationController::animateBatch(pControllers.data(), kControllerCount, kTime + f, pJobSystem.get());
+    }
+    float batchTime = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint()) / kFrames;
+
+    logInfo(std::to_string(kControllerCount) + " skeletons with " + std::to_string(kBoneCount) + " bones: hierarchy with general inverse " + std::to_string(referenceTime) + "ms, sampling and hierarchy "
+        + std::to_string(serialTime) + "ms on one thread, " + std::to_string(batchTime) + "ms on " + std::to_string(pJobSystem->getThreadCount()) + " threads");
+    return test_pass();
+}
+
+testing_func(AnimationTest, TestClipAccuracy)
+{
+    const uint32_t kBoneCount = 20;
+    const float kDuration = 90;
+    const float kTicksPerSecond = 30;
+    std::vector<Animation::AnimationSet> sets = createClipSets(kBoneCount, 91, kDuration, 8);
+    std::vector<Bone> bones = createSkeleton(kBoneCount, false, 9);
+
+    auto pRawController = AnimationController::create(bones);
+    pRawController->addAnimation(Animation::create("Raw", sets, kDuration, kTicksPerSecond));
+    pRawController->setActiveAnimation(0);
+
+    Animation::UniquePtr pCompressed = Animation::create("Compressed", sets, kDuration, kTicksPerSecond);
+    pCompressed->compress(AnimationClip::kDefaultSampleRate);
+    const AnimationClip* pClip = pCompressed->getClip();
+    if (pClip == nullptr || pCompressed->getAnimationSets().size() != 0) return test_fail("Compressing didn't replace the key-frames");
+    if (pClip->getFrameCount() != 91) return test_fail("The clip has the wrong number of frames");
+
+    // The translations of every third bone, the rotations of four bones out of five and the scaling of odd bones are animated
+    const uint32_t animatedChannels = (kBoneCount + 2) / 3 + (kBoneCount - kBoneCount / 5) + kBoneCount / 2;
+    if (pClip->getAnimatedChannelCount() != animatedChannels) return test_fail("Constant channels were not stripped");
+
+    size_t rawSize = Animation::create("Raw", sets, kDuration, kTicksPerSecond)->getMemorySize();
+    if (pCompressed->getMemorySize() * 3 > rawSize) return test_fail("The clip should be less than a third of the size of the key-frames");
+
+    auto pClipController = AnimationController::create(bones);
+    pClipController->addAnimation(std::move(pCompressed));
+    pClipController->setActiveAnimation(0);
+
+    // Seek to random times, which resets the search of the raw animation but not the clip's
+    std::mt19937 rng(10);
+    std::uniform_real_distribution<double> time(0, 3 * kDuration / kTicksPerSecond);
+    float maxError = 0;
+    for (uint32_t i = 0; i < 500; i++)
+    {
+        double t = time(rng);
+        pRawController->animate(t);
+        pClipController->animate(t);
+        maxError = std::max(maxError, calcMaxDifference(pRawController.get(), pClipController.get()));
+    }
+    if (maxError > 2e-3f) return test_fail("The clip doesn't match the key-frames. The error is " + std::to_string(maxError));
+
+    // The decompressed key-frames reproduce the clip
+    std::vector<Animation::AnimationSet> decompressed;
+    pClipController->getAnimation(0)->getClip()->decompress(decompressed);
+    auto pDecompressedController = AnimationController::create(bones);
+    pDecompressedController->addAnimation(Animation::create("Decompressed", decompressed, kDuration, kTicksPerSecond));
+    pDecompressedController->setActiveAnimation(0);
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        double t = time(rng);
+        pDecompressedController->animate(t);
+        pClipController->animate(t);
+        if (calcMaxDifference(pDecompressedController.get(), pClipController.get()) > 1e-3f) return test_fail("The decompressed key-frames don't match the clip");
+    }
+    return test_pass();
+}
+
+testing_func(AnimationTest, TestClipBenchmark)
+{
+    const std::string filename = "AnimationTest_Clip.smd";
+    std::vector<std::string> files;
+    bool written = writeSmdModel(filename, 60, 240, files);
+    Model::SharedPtr pModel = written ? Model::createFromFile(filename.c_str(), Model::LoadFlags::DontUseCache) : nullptr;
+    Model::SharedPtr pCompressedModel = written ? Model::createFromFile(filename.c_str(), Model::LoadFlags::DontUseCache | Model::LoadFlags::CompressAnimations) : nullptr;
+    for (const auto& file : files)
+    {
+        std::remove(file.c_str());
+    }
+
+    if (pModel == nullptr || pCompressedModel == nullptr) return test_fail("Failed to import the test model");
+    if (pModel->getAnimationsCount() == 0 || pModel->getAnimationsCount() != pCompressedModel->getAnimationsCount()) return test_fail("The test model has no animations");
+    for (uint32_t i = 0; i < pCompressedModel->getAnimationsCount(); i++)
+    {
+        if (pCompressedModel->getAnimationController()->getAnimation(i)->getClip() == nullptr) return test_fail("CompressAnimations didn't compress the animations");
+    }
+
+    // Time the imported key-frames against a compressed copy, playing forward and seeking to random times
+    AnimationController* pController = pModel->getAnimationController();
+    const Animation* pImported = pController->getAnimation(0);
+    Animation::UniquePtr pRaw = Animation::create(pImported->getName(), pImported->getAnimationSets(), pImported->getDuration(), pImported->getTicksPerSecond());
+    Animation::UniquePtr pCompressed = Animation::create(pImported->getName(), pImported->getAnimationSets(), pImported->getDuration(), pImported->getTicksPerSecond());
+    pCompressed->compress(AnimationClip::kDefaultSampleRate);
+
+    const uint32_t kIterations = 2000;
+    const double length = pImported->getDuration() / pImported->getTicksPerSecond();
+    std::vector<double> randomTimes(kIterations);
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<double> dist(0, length);
+    for (auto& t : randomTimes)
+    {
+        t = dist(rng);
+    }
+
+    auto timeAnimation = [&](Animation* pAnimation, bool seek)
+    {
+        Animation::Cursor cursor;
+        auto start = CpuTimer::getCurrentTimePoint();
+        for (uint32_t i = 0; i < kIterations; i++)
+        {
+            pAnimation->animate(seek ? randomTimes[i] : length * i / kIterations, pController, &cursor);
+        }
+        return CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint()) * 1000 / kIterations;
+    };
+
+    const float rawForward = timeAnimation(pRaw.get(), false);
+    const float rawSeek = timeAnimation(pRaw.get(), true);
+    const float clipForward = timeAnimation(pCompressed.get(), false);
+    const float clipSeek = timeAnimation(pCompressed.get(), true);
+
+    logInfo("Imported clip with " + std::to_string(pImported->getAnimationSets().size()) + " animation sets: key-frames " + std::to_string(pRaw->getMemorySize()) + " bytes, clip " + std::to_string(pCompressed->getMemorySize()) + " bytes ("
+        + std::to_string(pCompressed->getClip()->getAnimatedChannelCount()) + " animated channels)");
+    logInfo("Decode time per pose: key-frames " + std::to_string(rawForward) + "us forward, " + std::to_string(rawSeek) + "us seeking. Clip " + std::to_string(clipForward) + "us forward, " + std::to_string(clipSeek) + "us seeking");
+
+    if (pCompressed->getMemorySize() >= pRaw->getMemorySize()) return test_fail("The clip is larger than the key-frames");
+    return test_pass();
+}
+
+static Animation::UniquePtr createTranslationAnimation(const std::string& name, const std::vector<std::pair<uint32_t, glm::vec3>>& bones)
+{
+    // Constant translations, the other channels keep their default values
+    std::vector<Animation::AnimationSet> sets;
+    for (const auto& b : bones)
+    {
+        Animation::AnimationSet set;
+        set.boneID = b.first;
+        set.translation.keys = { { b.second, 0.0f }, { b.second, 5.0f } };
+        sets.push_back(set);
+    }
+    return Animation::create(name, sets, 10, 1);
+}
+
+testing_func(AnimationTest, TestLayerBlending)
+{
+    // An empty layer reproduces the bind pose
+    auto pBindController = AnimationController::create(createSkeleton(10, false, 11));
+    pBindController->addLayer();
+    pBindController->animate(0);
+    for (const auto& bone : pBindController->getBones())
+    {
+        if (compareMatrices(&pBindController->getBoneLocalTransform(bone.boneID), &bone.originalLocalTransform, 1, 1e-4f) == false) return test_fail("The bind pose wasn't decomposed correctly");
+    }
+
+    // The rest of the test uses an identity bind pose, so the channels an animation doesn't drive match the bind pose
+    std::vector<Bone> bones = createSkeleton(2, false, 12);
+    for (auto& bone : bones)
+    {
+        bone.originalLocalTransform = glm::mat4();
+    }
+    auto pController = AnimationController::create(bones);
+    pController->addAnimation(createTranslationAnimation("A", { { 1, glm::vec3(1, 0, 0) } }));
+    pController->addAnimation(createTranslationAnimation("B", { { 1, glm::vec3(3, 0, 0) } }));
+    pController->addAnimation(createTranslationAnimation("C", { { 0, glm::vec3(5, 5, 5) }, { 1, glm::vec3(5, 5, 5) } }));
+    pController->addAnimation(createTranslationAnimation("D", { { 1, glm::vec3(0, 1, 0) } }));
+
+    auto checkTranslation = [&](uint32_t boneID, const glm::vec3& expected)
+    {
+        return glm::length(glm::vec3(pController->getBoneLocalTransform(boneID)[3]) - expected) < 1e-4f;
+    };
+
+    // Cross-fade
+    const uint32_t baseLayer = pController->addLayer();
+    pController->playAnimation(baseLayer, 0);
+    pController->animate(0);
+    if (checkTranslation(1, glm::vec3(1, 0, 0)) == false) return test_fail("The layer's animation wasn't applied");
+    pController->playAnimation(baseLayer, 1, 2);
+    pController->animate(1);
+    if (checkTranslation(1, glm::vec3(2, 0, 0)) == false || pController->getAnimationWeight(baseLayer, 0) != 0.5f) return test_fail("Wrong pose in the middle of the cross-fade");
+    pController->animate(2);
+    pController->animate(3);
+    if (checkTranslation(1, glm::vec3(3, 0, 0)) == false || pController->getAnimationWeight(baseLayer, 0) != 0) return test_fail("Wrong pose at the end of the cross-fade");
+
+    // Two animations with the same weight
+    pController->setAnimationWeight(baseLayer, 0, 1);
+    pController->animate(4);
+    if (checkTranslation(1, glm::vec3(2, 0, 0)) == false) return test_fail("The weights of the layer's animations were not normalized");
+
+    // A masked layer only changes its bones
+    const uint32_t maskedLayer = pController->addLayer();
+    pController->setLayerBoneMask(maskedLayer, { 1, 0 });
+    pController->playAnimation(maskedLayer, 2);
+    pController->animate(5);
+    if (checkTranslation(0, glm::vec3(5, 5, 5)) == false || checkTranslation(1, glm::vec3(2, 0, 0)) == false) return test_fail("The bone mask wasn't applied");
+
+    // Additive layers add the difference from the bind pose
+    const uint32_t additiveLayer = pController->addLayer(AnimationController::LayerBlendMode::Additive);
+    pController->setAnimationWeight(additiveLayer, 3, 0.5f);
+    pController->animate(6);
+    if (checkTranslation(1, glm::vec3(2, 0.5f, 0)) == false) return test_fail("The additive layer wasn't applied");
+
+    // Half of the base layer's pose, on top of the bind pose
+    pController->setLayerWeight(baseLayer, 0.5f);
+    pController->animate(7);
+    if (checkTranslation(1, glm::vec3(1, 0.5f, 0)) == false) return test_fail("The layer weight wasn't applied");
+    return test_pass();
+}
+
+testing_func(AnimationTest, TestSharedRig)
+{
+    const uint32_t kBoneCount = 30;
+    const float kDuration = 60;
+    std::vector<Bone> bones = createSkeleton(kBoneCount, false, 13);
+    std::vector<Animation::AnimationSet> sets = createClipSets(kBoneCount, 61, kDuration, 14);
+
+    auto pController = AnimationController::create(bones);
+    pController->addAnimation(Animation::create("Clip", sets, kDuration, 30));
+    pController->setActiveAnimation(0);
+
+    // The copies share the rig, but each of them has its own pose
+    const uint32_t kCopyCount = 64;
+    std::vector<AnimationController::UniquePtr> copies;
+    std::vector<AnimationController*> pCopies;
+    for (uint32_t i = 0; i < kCopyCount; i++)
+    {
+        copies.push_back(AnimationController::create(*pController));
+        pCopies.push_back(copies.back().get());
+        if (&copies.back()->getBones() != &pController->getBones()) return test_fail("The bones were copied");
+        if (copies.back()->getSharedAnimation(0) != pController->getSharedAnimation(0)) return test_fail("The animation was copied");
+        if (copies.back()->getActiveAnimation() != 0) return test_fail("The copy doesn't play the same animation");
+    }
+
+    // Play the copies at different times, on several threads, and compare them with a controller which owns its data
+    auto pReference = AnimationController::create(bones);
+    pReference->addAnimation(Animation::create("Clip", sets, kDuration, 30));
+    pReference->setActiveAnimation(0);
+    JobSystem::SharedPtr pJobSystem = JobSystem::create();
+    for (uint32_t frame = 0; frame < 10; frame++)
+    {
+        pJobSystem->parallelFor(kCopyCount, 4, [&](uint32_t first, uint32_t last)
+        {
+            for (uint32_t i = first; i < last; i++)
+            {
+                pCopies[i]->animate(frame * 0.1 + i * 0.03);
+            }
+        });
+        for (uint32_t i = 0; i < kCopyCount; i += 7)
+        {
+            pReference->animate(frame * 0.1 + i * 0.03);
+            if (compareMatrices(pCopies[i]->getBoneMatrices().data(), pReference->getBoneMatrices().data(), kBoneCount, 1e-4f) == false) return test_fail("A copy doesn't match the reference pose");
+        }
+    }
+
+    // The rest of the memory of a copy is its pose
+    const size_t poseSize = kBoneCount * 4 * sizeof(glm::mat4);
+    const size_t sharedSize = pController->getAnimation(0)->getMemorySize() + kBoneCount * sizeof(Bone);
+    if (copies[0]->getInstanceMemorySize() > poseSize * 2) return test_fail("A copy uses more memory than its pose");
+    logInfo("Per-copy memory " + std::to_string(copies[0]->getInstanceMemorySize()) + " bytes, shared data " + std::to_string(sharedSize) + " bytes");
+    return test_pass();
+}
+
+int main()
+{
+    AnimationTest at;
+    at.init(true);
+    at.run();
+    return 0;
+}
@@ -0,0 +1,53 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#pragma once
+#include "TestBase.h"
+#include "Graphics/Model/AnimationController.h"
+#include "Graphics/Model/AnimationClip.h"
+
+class AnimationTest : public TestBase
+{
+private:
+    void addTests() override;
+    void onInit() override {};
+    register_testing_func(TestComposeTransform);
+    register_testing_func(TestHierarchyOrder);
+    register_testing_func(TestAnimationScaling);
+    register_testing_func(TestBatch);
+    register_testing_func(TestClipAccuracy);
+    register_testing_func(TestClipBenchmark);
+    register_testing_func(TestLayerBlending);
+    register_testing_func(TestSharedRig);
+
+    static std::vector<Bone> createSkeleton(uint32_t boneCount, bool childrenFirst, uint32_t seed);
+    static void calcReferenceTransforms(const AnimationController* pController, std::vector<glm::mat4>& transforms, std::vector<glm::mat4>& invTransposeTransforms);
+    static bool compareMatrices(const glm::mat4* pA, const glm::mat4* pB, uint32_t count, float epsilon);
+    static std::vector<Animation::AnimationSet> createClipSets(uint32_t boneCount, uint32_t keyCount, float duration, uint32_t seed);
+    static bool writeSmdModel(const std::string& filename, uint32_t boneCount, uint32_t frameCount, std::vector<std::string>& createdFiles);
+    static float calcMaxDifference(const AnimationController* pA, const AnimationController* pB);
+};
@@ -0,0 +1,488 @@
+/***************************************************************************
+# Copyright (c) 2017, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "BinaryModelImporterTest.h"
+#include "Utils/BinaryFileStream.h"
+#include "Utils/CpuTimer.h"
+#include "Graphics/Model/Loaders/BinaryModelSpec.h"
+#include "Graphics/Model/Loaders/BinaryImage.hpp"
+
+void BinaryModelImporterTest::addTests()
+{
+    addTestToList<TestMappedMatchesStream>();
+    addTestToList<TestChunkedRoundTrip>();
+    addTestToList<TestLodRoundTrip>();
+    addTestToList<TestCompressedTextureRoundTrip>();
+    addTestToList<TestLoadBenchmark>();
+}
+
+testing_func(BinaryModelImporterTest, TestMappedMatchesStream)
+{
+    const std::string filename = "BinaryModelImporterTest_Small.bin";
+    if (writeSyntheticModel(filename, 3000) == false)
+    {
+        return test_fail("Failed to write the test model");
+    }
+
+    Model::SharedPtr pStreamModel = Model::createFromFile(filename.c_str());
+    Model::SharedPtr pMappedModel = Model::createFromFile(filename.c_str(), Model::LoadFlags::MemoryMappedIO);
+    std::remove(filename.c_str());
+
+    if (pStreamModel == nullptr || pMappedModel == nullptr)
+    {
+        return test_fail("Failed to load the test model");
+    }
+
+    if (doModelsMatch(pStreamModel, pMappedModel) == false)
+    {
+        return test_fail("Memory mapped import doesn't match the stream import");
+    }
+
+    return test_pass();
+}
+
+testing_func(BinaryModelImporterTest, TestChunkedRoundTrip)
+{
+    const std::string legacyFilename = "BinaryModelImporterTest_Legacy.bin";
+    const std::string chunkedFilename = "BinaryModelImporterTest_Chunked.bin";
+    if (writeSyntheticModel(legacyFilename, 3000) == false)
+    {
+        return test_fail("Failed to write the test model");
+    }
+
+    // The legacy loader generates the tangent space. The exporter stores the bitangent buffer, so the v9 model has to load with the same vertex buffers.
+    Model::SharedPtr pLegacyModel = Model::createFromFile(legacyFilename.c_str());
+    std::remove(legacyFilename.c_str());
+    if (pLegacyModel == nullptr)
+    {
+        return test_fail("Failed to load the test model");
+    }
+    pLegacyModel->exportToBinaryFile(chunkedFilename);
+
+    Model::SharedPtr pStreamModel = Model::createFromFile(chunkedFilename.c_str());
+    Model::SharedPtr pMappedModel = Model::createFromFile(chunkedFilename.c_str(), Model::LoadFlags::MemoryMappedIO);
+    std::remove(chunkedFilename.c_str());
+
+    if (pStreamModel == nullptr || pMappedModel == nullptr)
+    {
+        return test_fail("Failed to load the exported model");
+    }
+
+    if (doModelsMatch(pLegacyModel, pStreamModel) == false || doModelsMatch(pLegacyModel, pMappedModel) == false)
+    {
+        return test_fail("Exported model doesn't match the original");
+    }
+
+    return test_pass();
+}
+
+testing_func(BinaryModelImporterTest, TestLodRoundTrip)
+{
+    const std::string legacyFilename = "BinaryModelImporterTest_LodLegacy.bin";
+    const std::string chunkedFilename = "BinaryModelImporterTest_LodChunked.bin";
+    if (writeSyntheticModel(legacyFilename, 3000) == false)
+    {
+        return test_fail("Failed to write the test model");
+    }
+
+    Model::SharedPtr pLegacyModel = Model::createFromFile(legacyFilename.c_str(), Model::LoadFlags::GenerateLods);
+    std::remove(legacyFilename.c_str());
+    if (pLegacyModel == nullptr)
+    {
+        return test_fail("Failed to load the test model");
+    }
+    if (pLegacyModel->getMesh(0)->getLodCount() < 2)
+    {
+        return test_fail("No LODs were generated");
+    }
+
+    // The LODs are stored in the exported file, so they load without the flag
+    pLegacyModel->exportToBinaryFile(chunkedFilename);
+    Model::SharedPtr pStreamModel = Model::createFromFile(chunkedFilename.c_str());
+    Model::SharedPtr pMappedModel = Model::createFromFile(chunkedFilename.c_str(), Model::LoadFlags::MemoryMappedIO);
+    std::remove(chunkedFilename.c_str());
+
+    if (pStreamModel == nullptr || pMappedModel == nullptr)
+    {
+        return test_fail("Failed to load the exported model");
+    }
+
+    if (doLodsMatch(pLegacyModel, pStreamModel) == false || doLodsMatch(pLegacyModel, pMappedModel) == false)
+    {
+        return test_fail("Exported LODs don't match the original");
+    }
+
+    return test_pass();
+}
+
+testing_func(BinaryModelImporterTest, TestCompressedTextureRoundTrip)
+{
+    const std::string legacyFilename = "BinaryModelImporterTest_BcLegacy.bin";
+    const std::string chunkedFilename = "BinaryModelImporterTest_BcChunked.bin";
+    if (writeSyntheticModel(legacyFilename, 3000) == false)
+    {
+        return test_fail("Failed to write the test model");
+    }
+
+    Model::SharedPtr pLegacyModel = Model::createFromFile(legacyFilename.c_str());
+    std::remove(legacyFilename.c_str());
+    if (pLegacyModel == nullptr)
+    {
+        return test_fail("Failed to load the test model");
+    }
+
+    // 3x2 blocks of 4x4 texels, so rows of blocks differ in size from rows of texels. BC1 has 8 bytes per block, BC3 has 16.
+    const uint32_t width = 12;
+    const uint32_t height = 8;
+    std::vector<uint8_t> bc1Data(3 * 2 * 8);
+    std::vector<uint8_t> bc3Data(3 * 2 * 16);
+    for (uint32_t i = 0; i < (uint32_t)bc1Data.size(); i++) bc1Data[i] = uint8_t(i * 13 + 1);
+    for (uint32_t i = 0; i < (uint32_t)bc3Data.size(); i++) bc3Data[i] = uint8_t(i * 29 + 7);
+
+    Texture::SharedPtr pBc1 = Texture::create2D(width, height, ResourceFormat::BC1Unorm, 1, 1, bc1Data.data());
+    Texture::SharedPtr pBc3 = Texture::create2D(width, height, ResourceFormat::BC3Unorm, 1, 1, bc3Data.data());
+    if (pBc1 == nullptr || pBc3 == nullptr)
+    {
+        return test_fail("Failed to create the compressed textures");
+    }
+    const Material::SharedPtr& pMaterial = pLegacyModel->getMesh(0)->getMaterial();
+    pMaterial->setLayerTexture(0, pBc1);
+    pMaterial->setAlphaMap(pBc3);
+
+    pLegacyModel->exportToBinaryFile(chunkedFilename);
+    Model::SharedPtr pStreamModel = Model::createFromFile(chunkedFilename.c_str());
+    Model::SharedPtr pMappedModel = Model::createFromFile(chunkedFilename.c_str(), Model::LoadFlags::MemoryMappedIO);
+    std::remove(chunkedFilename.c_str());
+
+    if (pStreamModel == nullptr || pMappedModel == nullptr)
+    {
+        return test_fail("Failed to load the exported model");
+    }
+
+    if (doModelsMatch(pLegacyModel, pStreamModel) == false || doModelsMatch(pLegacyModel, pMappedModel) == false)
+    {
+        return test_fail("Exported model doesn't match the original");
+    }
+
+    // Compare with the source data as well, in case the readback itself is wrong
+    RenderContext* pContext = gpDevice->getRenderContext().get();
+    const Material* pImported = pStreamModel->getMesh(0)->getMaterial().get();
+    if (pContext->readTextureSubresource(pImported->getLayer(0).pTexture.get(), 0) != bc1Data ||
+        pContext->readTextureSubresource(pImported->getAlphaMap().get(), 0) != bc3Data)
+    {
+        return test_fail("Compressed texture data changed in the round trip");
+    }
+
+    return test_pass();
+}
+
+testing_func(BinaryModelImporterTest, TestLoadBenchmark)
+{
+    const uint32_t vertexCount = 10000000;
+    const std::string filename = "BinaryModelImporterTest_Large.bin";
+    if (writeSyntheticModel(filename, vertexCount) == false)
+    {
+        return test_fail("Failed to write the test model");
+    }
+
+    // Tangent generation is identical for both paths and would dominate the measurement
+    const Model::LoadFlags flags = Model::LoadFlags::DontGenerateTangentSpace;
+
+    auto streamStart = CpuTimer::getCurrentTimePoint();
+    Model::SharedPtr pStreamModel = Model::createFromFile(filename.c_str(), flags);
+    float streamTime = CpuTimer::calcDuration(streamStart, CpuTimer::getCurrentTimePoint());
+    pStreamModel = nullptr;
+
+    auto mappedStart = CpuTimer::getCurrentTimePoint();
+    Model::SharedPtr pMappedModel = Model::createFromFile(filename.c_str(), flags | Model::LoadFlags::MemoryMappedIO);
+    float mappedTime = CpuTimer::calcDuration(mappedStart, CpuTimer::getCurrentTimePoint());
+    std::remove(filename.c_str());
+
+    if (pMappedModel == nullptr)
+    {
+        return test_fail("Failed to load the test model");
+    }
+
+    // Same model in the chunked v9 format, where the vertex blocks are uploaded directly from the mapping
+    const std::string chunkedFilename = "BinaryModelImporterTest_LargeChunked.bin";
+    pMappedModel->exportToBinaryFile(chunkedFilename);
+    pMappedModel = nullptr;
+
+    auto chunkedStart = CpuTimer::getCurrentTimePoint();
+    Model::SharedPtr pChunkedModel = Model::createFromFile(chunkedFilename.c_str(), flags | Model::LoadFlags::MemoryMappedIO);
+    float chunkedTime = CpuTimer::calcDuration(chunkedStart, CpuTimer::getCurrentTimePoint());
+    std::remove(chunkedFilename.c_str());
+
+    if (pChunkedModel == nullptr)
+    {
+        return test_fail("Failed to load the exported model");
+    }
+
+    logInfo("BinaryModelImporter, " + std::to_string(vertexCount) + " vertices. Stream: " + std::to_string(streamTime) + "ms, memory mapped: " + std::to_string(mappedTime) + "ms, v9 memory mapped: " + std::to_string(chunkedTime) + "ms");
+    return test_pass();
+}
+
+bool BinaryModelImporterTest::writeSyntheticModel(const std::string& filename, uint32_t vertexCount)
+{
+    BinaryFileStream stream(filename, BinaryFileStream::Mode::Write);
+
+    // Header. Version 8, a single texture, a single mesh with a single instance
+    stream.write("BinScene", 8);
+    stream << int32_t(8) << int32_t(1) << int32_t(1) << int32_t(1);
+
+    // A 4x4 RGBA8 diffuse texture, in a version 2 image with the channels implied by the format
+    const std::string textureName = "Synthetic";
+    stream << int32_t(textureName.size());
+    stream.write(textureName.data(), textureName.size());
+    stream.write("BinImage", 8);
+    std::vector<uint8_t> texels(4 * 4 * 4);
+    for (uint32_t i = 0; i < (uint32_t)texels.size(); i++)
+    {
+        texels[i] = uint8_t(i * 37);
+    }
+    stream << int32_t(2) << int32_t(4) << int32_t(4) << int32_t(4) << int32_t(0);
+    stream << int32_t(FW::ImageFormat::R8_G8_B8_A8) << int32_t(texels.size());
+    stream.write(texels.data(), texels.size());
+
+    // Mesh header and attributes
+    const int32_t attribs[][3] =
+    {
+        { AttribType_Position, AttribFormat_F32, 3 },
+        { AttribType_Normal, AttribFormat_F32, 3 },
+        { AttribType_TexCoord, AttribFormat_F32, 2 },
+    };
+    stream << int32_t(arraysize(attribs)) << int32_t(vertexCount) << int32_t(1);
+    stream.write(attribs, sizeof(attribs));
+
+    // Interleaved vertex data, written in batches to keep memory usage low
+    struct Vertex
+    {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec2 texC;
+    };
+    std::vector<Vertex> vertices(65536);
+    for (uint32_t first = 0; first < vertexCount; first += (uint32_t)vertices.size())
+    {
+        uint32_t count = std::min((uint32_t)vertices.size(), vertexCount - first);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            float t = float(first + i) / float(vertexCount);
+            vertices[i].position = glm::vec3(t * 10, sin(t * 100), cos(t * 100));
+            vertices[i].normal = glm::normalize(glm::vec3(0, sin(t * 100), cos(t * 100)));
+            vertices[i].texC = glm::vec2(t, float(i % 3) / 2.0f);
+        }
+        stream.write(vertices.data(), count * sizeof(Vertex));
+    }
+
+    // Submesh. Material constants, the texture slots with only the diffuse one used, and the triangle list
+    const float material[13] = { 0, 0, 0, 1, 1, 1, 0, 0, 0, 0, 1, 0, 0 };
+    stream.write(material, sizeof(material));
+    for (uint32_t i = 0; i <= TextureType_Glossiness; i++)
+    {
+        stream << int32_t((i == TextureType_Diffuse) ? 0 : -1);
+    }
+
+    const uint32_t triangleCount = vertexCount / 3;
+    stream << int32_t(triangleCount);
+    std::vector<uint32_t> indices(triangleCount * 3);
+    for (uint32_t i = 0; i < (uint32_t)indices.size(); i++)
+    {
+        indices[i] = i;
+    }
+    stream.write(indices.data(), indices.size() * sizeof(uint32_t));
+
+    // Instance
+    stream << int32_t(0) << int32_t(1) << glm::mat4();
+    stream << int32_t(0) << int32_t(0); // Empty name and metadata strings
+
+    bool result = stream.isGood();
+    stream.close();
+    return result;
+}
+
+bool BinaryModelImporterTest::doModelsMatch(const Model::SharedPtr& pModelA, const Model::SharedPtr& pModelB)
+{
+    if (pModelA->getMeshCount() != pModelB->getMeshCount() ||
+        pModelA->getVertexCount() != pModelB->getVertexCount() ||
+        pModelA->getIndexCount() != pModelB->getIndexCount())
+    {
+        return false;
+    }
+
+    // The bounding boxes are calculated from the de-interleaved position buffers
+    for (uint32_t i = 0; i < pModelA->getMeshCount(); i++)
+    {
+        const Mesh* pMeshA = pModelA->getMesh(i).get();
+        const Mesh* pMeshB = pModelB->getMesh(i).get();
+        const BoundingBox& boxA = pMeshA->getBoundingBox();
+        const BoundingBox& boxB = pMeshB->getBoundingBox();
+        if (boxA.center != boxB.center || boxA.extent != boxB.extent || pMeshA->getVertexCount() != pMeshB->getVertexCount())
+        {
+            return false;
+        }
+
+        // The buffers can be larger than the data, so only the used part is compared
+        const Vao* pVaoA = pMeshA->getVao().get();
+        const Vao* pVaoB = pMeshB->getVao().get();
+        if (pVaoA->getVertexBuffersCount() != pVaoB->getVertexBuffersCount() ||
+            doBuffersMatch(pVaoA->getIndexBuffer().get(), pVaoB->getIndexBuffer().get(), pMeshA->getIndexCount() * sizeof(uint32_t)) == false)
+        {
+            return false;
+        }
+
+        for (uint32_t b = 0; b < pVaoA->getVertexBuffersCount(); b++)
+        {
+            const uint32_t stride = pVaoA->getVertexLayout()->getBufferLayout(b)->getStride();
+            if (stride != pVaoB->getVertexLayout()->getBufferLayout(b)->getStride() ||
+                doBuffersMatch(pVaoA->getVertexBuffer(b).get(), pVaoB->getVertexBuffer(b).get(), (size_t)stride * pMeshA->getVertexCount()) == false)
+            {
+                return false;
+            }
+        }
+
+        if (doMaterialsMatch(pMeshA->getMaterial().get(), pMeshB->getMaterial().get()) == false)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool BinaryModelImporterTest::doBuffersMatch(const Buffer* pBufferA, const Buffer* pBufferB, size_t size)
+{
+    if (pBufferA == nullptr || pBufferB == nullptr)
+    {
+        return pBufferA == pBufferB;
+    }
+    if (pBufferA->getSize() < size || pBufferB->getSize() < size)
+    {
+        return false;
+    }
+
+    // Read both buffers back through staging copies, so the data the importers uploaded is compared
+    RenderContext* pContext = gpDevice->getRenderContext().get();
+    Buffer::SharedPtr pStagingA = Buffer::create(size, Buffer::BindFlags::None, Buffer::CpuAccess::Read, nullptr);
+    Buffer::SharedPtr pStagingB = Buffer::create(size, Buffer::BindFlags::None, Buffer::CpuAccess::Read, nullptr);
+    pContext->copyBufferRegion(pStagingA.get(), 0, pBufferA, 0, size);
+    pContext->copyBufferRegion(pStagingB.get(), 0, pBufferB, 0, size);
+    pContext->flush(true);
+
+    bool match = std::memcmp(pStagingA->map(Buffer::MapType::Read), pStagingB->map(Buffer::MapType::Read), size) == 0;
+    pStagingA->unmap();
+    pStagingB->unmap();
+    return match;
+}
+
+bool BinaryModelImporterTest::doTexturesMatch(const Texture* pTextureA, const Texture* pTextureB)
+{
+    if (pTextureA == nullptr || pTextureB == nullptr)
+    {
+        return pTextureA == pTextureB;
+    }
+    if (pTextureA->getWidth() != pTextureB->getWidth() || pTextureA->getHeight() != pTextureB->getHeight() || pTextureA->getFormat() != pTextureB->getFormat())
+    {
+        return false;
+    }
+
+    // The mips are generated on load, only the top level comes from the file
+    RenderContext* pContext = gpDevice->getRenderContext().get();
+    return pContext->readTextureSubresource(pTextureA, 0) == pContext->readTextureSubresource(pTextureB, 0);
+}
+
+bool BinaryModelImporterTest::doMaterialsMatch(const Material* pMaterialA, const Material* pMaterialB)
+{
+    if (pMaterialA == nullptr || pMaterialB == nullptr)
+    {
+        return pMaterialA == pMaterialB;
+    }
+
+    // Material::operator== compares the textures by pointer, which never match across models
+    if (pMaterialA->getNumLayers() != pMaterialB->getNumLayers() ||
+        pMaterialA->getHeightModifiers() != pMaterialB->getHeightModifiers() ||
+        pMaterialA->getAlphaThreshold() != pMaterialB->getAlphaThreshold() ||
+        pMaterialA->isDoubleSided() != pMaterialB->isDoubleSided())
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < pMaterialA->getNumLayers(); i++)
+    {
+        const Material::Layer layerA = pMaterialA->getLayer(i);
+        const Material::Layer layerB = pMaterialB->getLayer(i);
+        if (layerA.type != layerB.type || layerA.ndf != layerB.ndf || layerA.blend != layerB.blend ||
+            layerA.albedo != layerB.albedo || layerA.roughness != layerB.roughness || layerA.extraParam != layerB.extraParam || layerA.pmf != layerB.pmf ||
+            doTexturesMatch(layerA.pTexture.get(), layerB.pTexture.get()) == false)
+        {
+            return false;
+        }
+    }
+
+    return doTexturesMatch(pMaterialA->getNormalMap().get(), pMaterialB->getNormalMap().get()) &&
+        doTexturesMatch(pMaterialA->getAlphaMap().get(), pMaterialB->getAlphaMap().get()) &&
+        doTexturesMatch(pMaterialA->getAmbientOcclusionMap().get(), pMaterialB->getAmbientOcclusionMap().get()) &&
+        doTexturesMatch(pMaterialA->getHeightMap().get(), pMaterialB->getHeightMap().get());
+}
+
+bool BinaryModelImporterTest::doLodsMatch(const Model::SharedPtr& pModelA, const Model::SharedPtr& pModelB)
+{
+    if (doModelsMatch(pModelA, pModelB) == false)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < pModelA->getMeshCount(); i++)
+    {
+        const Mesh* pMeshA = pModelA->getMesh(i).get();
+        const Mesh* pMeshB = pModelB->getMesh(i).get();
+        if (pMeshA->getLodCount() != pMeshB->getLodCount())
+        {
+            return false;
+        }
+
+        for (uint32_t lod = 0; lod < pMeshA->getLodCount(); lod++)
+        {
+            const Mesh::Lod& lodA = pMeshA->getLod(lod);
+            const Mesh::Lod& lodB = pMeshB->getLod(lod);
+            if (lodA.indexCount != lodB.indexCount || lodA.screenSize != lodB.screenSize || lodA.error != lodB.error)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+int main()
+{
+    BinaryModelImporterTest bmit;
+    bmit.init(true);
+    bmit.run();
+    return 0;
+}
@@ -0,0 +1,338 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "CullingTest.h"
+#include "Graphics/Scene/BoundingVolumeHierarchy.h"
+#include "Graphics/Scene/OcclusionBuffer.h"
+#include "Utils/CpuTimer.h"
+#include "Utils/AABB.h"
+#include "glm/gtc/matrix_transform.hpp"
+#include <random>
+
+void CullingTest::addTests()
+{
+    addTestToList<TestBvhMatchesBruteForce>();
+    addTestToList<TestBvhRefit>();
+    addTestToList<TestBvhCullBenchmark>();
+    addTestToList<TestBatchCullBenchmark>();
+    addTestToList<TestOcclusionBuffer>();
+    addTestToList<TestOcclusionCullBenchmark>();
+}
+
+std::vector<BoundingBox> CullingTest::createBoxes(uint32_t count, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> position(-1000, 1000);
+    std::uniform_real_distribution<float> size(0.1f, 3);
+
+    std::vector<BoundingBox> boxes(count);
+    for (auto& box : boxes)
+    {
+        box.center = glm::vec3(position(rng), position(rng), position(rng));
+        box.extent = glm::vec3(size(rng), size(rng), size(rng));
+    }
+    return boxes;
+}
+
+Camera::SharedPtr CullingTest::createCamera()
+{
+    Camera::SharedPtr pCamera = Camera::create();
+    pCamera->setPosition(glm::vec3(0, 0, -1000));
+    pCamera->setTarget(glm::vec3(100, 50, 0));
+    pCamera->setUpVector(glm::vec3(0, 1, 0));
+    pCamera->setAspectRatio(16.0f / 9.0f);
+    pCamera->setFocalLength(50);
+    pCamera->setDepthRange(0.1f, 1500);
+    return pCamera;
+}
+
+bool CullingTest::compareWithBruteForce(const Camera* pCamera, const std::vector<BoundingBox>& boxes, std::vector<uint32_t>& visibleIds)
+{
+    std::vector<bool> visible(boxes.size(), false);
+    for (uint32_t id : visibleIds)
+    {
+        if (visible[id]) return false;
+        visible[id] = true;
+    }
+
+    for (uint32_t i = 0; i < (uint32_t)boxes.size(); i++)
+    {
+        if (visible[i] == pCamera->isObjectCulled(boxes[i])) return false;
+    }
+    return true;
+}
+
+testing_func(CullingTest, TestBvhMatchesBruteForce)
+{
+    std::vector<BoundingBox> boxes = createBoxes(100000, 1);
+    Camera::SharedPtr pCamera = createCamera();
+
+    BoundingVolumeHierarchy::SharedPtr pBvh = BoundingVolumeHierarchy::create();
+    pBvh->build(boxes);
+
+    std::vector<uint32_t> visibleIds;
+    pBvh->cull(pCamera.get(), visibleIds);
+    if (visibleIds.empty() || compareWithBruteForce(pCamera.get(), boxes, visibleIds) == false)
+    {
+        return test_fail("Hierarchical culling doesn't match the per-box test");
+    }
+
+    // A camera looking away from the boxes
+    pCamera->setPosition(glm::vec3(0, 0, -2000));
+    pCamera->setTarget(glm::vec3(0, 0, -3000));
+    pBvh->cull(pCamera.get(), visibleIds);
+    if (visibleIds.size() != 0)
+    {
+        return test_fail("Boxes behind the camera weren't culled");
+    }
+    return test_pass();
+}
+
+testing_func(CullingTest, TestBvhRefit)
+{
+    std::vector<BoundingBox> boxes = createBoxes(100000, 2);
+    Camera::SharedPtr pCamera = createCamera();
+
+    BoundingVolumeHierarchy::SharedPtr pBvh = BoundingVolumeHierarchy::create();
+    pBvh->build(boxes);
+
+    // Move 10% of the boxes
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> position(-1000, 1000);
+    for (uint32_t i = 0; i < (uint32_t)boxes.size(); i += 10)
+    {
+        boxes[i].center = glm::vec3(position(rng), position(rng), position(rng));
+        pBvh->update(i, boxes[i]);
+    }
+
+    std::vector<uint32_t> visibleIds;
+    pBvh->cull(pCamera.get(), visibleIds);
+    if (compareWithBruteForce(pCamera.get(), boxes, visibleIds) == false)
+    {
+        return test_fail("Culling results are wrong after refitting");
+    }
+    return test_pass();
+}
+
+testing_func(CullingTest, TestBvhCullBenchmark)
+{
+    const uint32_t kBoxCount = 1000000;
+    std::vector<BoundingBox> boxes = createBoxes(kBoxCount, 4);
+    Camera::SharedPtr pCamera = createCamera();
+
+    BoundingVolumeHierarchy::SharedPtr pBvh = BoundingVolumeHierarchy::create();
+    auto buildStart = CpuTimer::getCurrentTimePoint();
+    pBvh->build(boxes);
+    float buildTime = CpuTimer::calcDuration(buildStart, CpuTimer::getCurrentTimePoint());
+
+    std::vector<uint32_t> visibleIds;
+    auto cullStart = CpuTimer::getCurrentTimePoint();
+    pBvh->cull(pCamera.get(), visibleIds);
+    float cullTime = CpuTimer::calcDuration(cullStart, CpuTimer::getCurrentTimePoint());
+
+    uint32_t bruteForceCount = 0;
+    auto bruteForceStart = CpuTimer::getCurrentTimePoint();
+    for (const auto& box : boxes)
+    {
+        bruteForceCount += pCamera->isObjectCulled(box) ? 0 : 1;
+    }
+    float bruteForceTime = CpuTimer::calcDuration(bruteForceStart, CpuTimer::getCurrentTimePoint());
+
+    if (bruteForceCount != visibleIds.size())
+    {
+        return test_fail("Hierarchical culling doesn't match the per-box test");
+    }
+
+    logInfo("Culling " + std::to_string(kBoxCount) + " boxes, " + std::to_string(visibleIds.size()) + " visible. BVH build: " + std::to_string(buildTime) + "ms, BVH cull: " + std::to_string(cullTime) + "ms, per-box cull: " + std::to_string(bruteForceTime) + "ms");
+    return test_pass();
+}
+
+testing_func(CullingTest, TestBatchCullBenchmark)
+{
+    const uint32_t kBoxCount = 1000003; // Not a multiple of the SIMD width, so the scalar tail is exercised
+    std::vector<BoundingBox> boxes = createBoxes(kBoxCount, 5);
+    Camera::SharedPtr pCamera = createCamera();
+
+    std::vector<float> streams[6];
+    for (auto& s : streams) s.resize(kBoxCount);
+    for (uint32_t i = 0; i < kBoxCount; i++)
+    {
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            streams[c][i] = boxes[i].center[c];
+            streams[c + 3][i] = boxes[i].extent[c];
+        }
+    }
+
+    BoundingBoxStreams soa;
+    for (uint32_t c = 0; c < 3; c++)
+    {
+        soa.pCenter[c] = streams[c].data();
+        soa.pExtent[c] = streams[c + 3].data();
+    }
+    soa.count = kBoxCount;
+
+    std::vector<uint32_t> reference((kBoxCount + 31) / 32, 0);
+    for (uint32_t i = 0; i < kBoxCount; i++)
+    {
+        if (pCamera->isObjectCulled(boxes[i]) == false) reference[i / 32] |= 1u << (i % 32);
+    }
+
+    const Camera::CullingPath paths[] = { Camera::CullingPath::Scalar, Camera::CullingPath::Sse, Camera::CullingPath::Avx2 };
+    const char* names[] = { "Scalar", "SSE", "AVX2" };
+    std::vector<uint32_t> mask(reference.size());
+    for (uint32_t p = 0; p < arraysize(paths); p++)
+    {
+        if (Camera::isCullingPathSupported(paths[p]) == false)
+        {
+            logInfo(std::string(names[p]) + " culling isn't supported on this CPU, skipping");
+            continue;
+        }
+
+        auto start = CpuTimer::getCurrentTimePoint();
+        pCamera->cullBoundingBoxes(soa, mask.data(), paths[p]);
+        float time = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+
+        if (mask != reference)
+        {
+            return test_fail(std::string(names[p]) + " batch culling doesn't match the per-box test");
+        }
+        logInfo(std::string(names[p]) + " batch culling: " + std::to_string(kBoxCount) + " boxes in " + std::to_string(time) + "ms (" + std::to_string(kBoxCount / time / 1000.0f) + " Mboxes/s)");
+    }
+    return test_pass();
+}
+
+testing_func(CullingTest, TestOcclusionBuffer)
+{
+    Camera::SharedPtr pCamera = Camera::create();
+    pCamera->setPosition(glm::vec3(0, 0, 0));
+    pCamera->setTarget(glm::vec3(0, 0, -1));
+    pCamera->setUpVector(glm::vec3(0, 1, 0));
+    pCamera->setAspectRatio(2.0f);
+    pCamera->setFocalLength(21);
+    pCamera->setDepthRange(0.1f, 1000);
+
+    OcclusionBuffer::SharedPtr pBuffer = OcclusionBuffer::create(250, 125);
+    if (pBuffer->getWidth() != 256 || pBuffer->getHeight() != 128) return test_fail("Size wasn't rounded up to whole tiles");
+
+    // A wall in front of the camera
+    BoundingBox wall = BoundingBox::fromMinMax(glm::vec3(-5, -5, -10.5f), glm::vec3(5, 5, -9.5f));
+    pBuffer->clear(pCamera->getViewProjMatrix());
+    pBuffer->rasterizeBox(wall, glm::mat4());
+    pBuffer->updateHierarchy();
+
+    struct
+    {
+        glm::vec3 center;
+        bool visible;
+        const char* desc;
+    } cases[] =
+    {
+        { glm::vec3(0, 0, -20), false, "Box behind the occluder" },
+        { glm::vec3(8, 0, -30), false, "Distant box behind the occluder" },
+        { glm::vec3(0, 0, -5), true, "Box in front of the occluder" },
+        { glm::vec3(12, 0, -20), true, "Box partially behind the occluder" },
+        { glm::vec3(20, 0, -30), true, "Box beside the occluder" },
+        { glm::vec3(0, 0, 0), true, "Box around the camera" },
+    };
+    for (const auto& c : cases)
+    {
+        BoundingBox box;
+        box.center = c.center;
+        box.extent = glm::vec3(1);
+        if (pBuffer->isVisible(box) != c.visible) return test_fail(std::string(c.desc) + " has the wrong visibility");
+    }
+    if (pBuffer->isVisible(wall) == false) return test_fail("Occluder culls itself");
+
+    // The same wall as triangles, moved behind the boxes
+    const glm::vec3 positions[] = { glm::vec3(-5, -5, 0), glm::vec3(5, -5, 0), glm::vec3(5, 5, 0), glm::vec3(-5, 5, 0) };
+    const uint32_t indices[] = { 0, 1, 2, 0, 2, 3 };
+    pBuffer->clear(pCamera->getViewProjMatrix());
+    pBuffer->rasterizeTriangles(positions, arraysize(positions), indices, arraysize(indices), glm::translate(glm::mat4(), glm::vec3(0, 0, -50)));
+    pBuffer->updateHierarchy();
+    BoundingBox box;
+    box.center = glm::vec3(0, 0, -20);
+    box.extent = glm::vec3(1);
+    if (pBuffer->isVisible(box) == false) return test_fail("Box in front of a moved occluder is culled");
+    box.center = glm::vec3(0, 0, -60);
+    if (pBuffer->isVisible(box)) return test_fail("Box behind a moved occluder isn't culled");
+    return test_pass();
+}
+
+testing_func(CullingTest, TestOcclusionCullBenchmark)
+{
+    const uint32_t kBoxCount = 100000;
+    std::vector<BoundingBox> boxes = createBoxes(kBoxCount, 6);
+    Camera::SharedPtr pCamera = createCamera();
+
+    // Rows of walls across the view, like the partitions of a large interior
+    std::vector<BoundingBox> walls;
+    for (int32_t z = -900; z <= 900; z += 150)
+    {
+        for (int32_t x = -900; x <= 900; x += 200)
+        {
+            walls.push_back(BoundingBox::fromMinMax(glm::vec3(x - 90, -1000, z - 2), glm::vec3(x + 90, 1000, z + 2)));
+        }
+    }
+
+    OcclusionBuffer::SharedPtr pBuffer = OcclusionBuffer::create();
+    auto rasterStart = CpuTimer::getCurrentTimePoint();
+    pBuffer->clear(pCamera->getViewProjMatrix());
+    for (const auto& wall : walls)
+    {
+        pBuffer->rasterizeBox(wall, glm::mat4());
+    }
+    pBuffer->updateHierarchy();
+    float rasterTime = CpuTimer::calcDuration(rasterStart, CpuTimer::getCurrentTimePoint());
+
+    std::vector<uint32_t> frustumVisible;
+    for (uint32_t i = 0; i < kBoxCount; i++)
+    {
+        if (pCamera->isObjectCulled(boxes[i]) == false) frustumVisible.push_back(i);
+    }
+
+    uint32_t visibleCount = 0;
+    auto testStart = CpuTimer::getCurrentTimePoint();
+    for (uint32_t id : frustumVisible)
+    {
+        visibleCount += pBuffer->isVisible(boxes[id]) ? 1 : 0;
+    }
+    float testTime = CpuTimer::calcDuration(testStart, CpuTimer::getCurrentTimePoint());
+
+    if (visibleCount == frustumVisible.size()) return test_fail("No box was occluded");
+
+    logInfo("Occlusion culling " + std::to_string(frustumVisible.size()) + " boxes against " + std::to_string(walls.size()) + " occluders, " + std::to_string(visibleCount) + " visible. Rasterization: " + std::to_string(rasterTime) + "ms, tests: " + std::to_string(testTime) + "ms");
+    return test_pass();
+}
+
+int main()
+{
+    CullingTest ct;
+    ct.init(true);
+    ct.run();
+    return 0;
+}
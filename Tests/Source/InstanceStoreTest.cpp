@@ -0,0 +1,257 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "InstanceStoreTest.h"
+#include "Utils/CpuTimer.h"
+#include "Utils/Math/FalcorMath.h"
+#include "glm/gtc/matrix_transform.hpp"
+#include <algorithm>
+
+void InstanceStoreTest::addTests()
+{
+    addTestToList<TestTransformUpdate>();
+    addTestToList<TestSlotReuse>();
+    addTestToList<TestChangeLog>();
+    addTestToList<TestBatchedUpdateBenchmark>();
+}
+
+InstanceStore::TransformParams InstanceStoreTest::createParams(std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> position(-100, 100);
+    std::uniform_real_distribution<float> scale(0.5f, 2);
+
+    InstanceStore::TransformParams params;
+    params.translation = glm::vec3(position(rng), position(rng), position(rng));
+    params.target = params.translation + glm::vec3(position(rng), position(rng), position(rng));
+    params.scale = glm::vec3(scale(rng), scale(rng), scale(rng));
+    return params;
+}
+
+glm::mat4 InstanceStoreTest::calcReferenceMatrix(const InstanceStore::TransformParams& params)
+{
+    glm::mat4 translationMtx = glm::translate(glm::mat4(), params.translation);
+    glm::mat4 rotationMtx = createMatrixFromLookAt(params.translation, params.target, params.up);
+    glm::mat4 scalingMtx = glm::scale(glm::mat4(), params.scale);
+    return translationMtx * rotationMtx * scalingMtx;
+}
+
+testing_func(InstanceStoreTest, TestTransformUpdate)
+{
+    InstanceStore::SharedPtr pStore = InstanceStore::create();
+    BoundingBox localBox = BoundingBox::fromMinMax(glm::vec3(-1), glm::vec3(1));
+    std::mt19937 rng(1);
+
+    const uint32_t kSlotCount = 20000;
+    std::vector<InstanceStore::TransformParams> base(kSlotCount);
+    std::vector<InstanceStore::TransformParams> movable(kSlotCount);
+    for (uint32_t i = 0; i < kSlotCount; i++)
+    {
+        uint32_t slot = pStore->allocateSlot(localBox);
+        if (slot != i) return test_fail("Slots of a new store should be allocated in order");
+        base[i] = createParams(rng);
+        movable[i] = createParams(rng);
+        pStore->setBaseParams(slot, base[i]);
+        pStore->setMovableParams(slot, movable[i]);
+    }
+
+    // Update half of the slots lazily, the rest in the batched pass
+    for (uint32_t i = 0; i < kSlotCount; i += 2)
+    {
+        pStore->updateSlot(i);
+    }
+    pStore->updateTransforms();
+
+    // Move again, so the previous transform is the first movable one
+    std::vector<InstanceStore::TransformParams> moved(kSlotCount);
+    for (uint32_t i = 0; i < kSlotCount; i++)
+    {
+        moved[i] = createParams(rng);
+        pStore->setMovableParams(i, moved[i]);
+    }
+    pStore->updateTransforms();
+
+    for (uint32_t i = 0; i < kSlotCount; i++)
+    {
+        glm::mat4 baseMtx = calcReferenceMatrix(base[i]);
+        glm::mat4 world = calcReferenceMatrix(moved[i]) * baseMtx;
+        glm::mat4 prevWorld = calcReferenceMatrix(movable[i]) * baseMtx;
+
+        if (pStore->isDirty(i)) return test_fail("Slot is still dirty after the batched update");
+        if (pStore->getTransformMatrix(i) != world) return test_fail("Wrong transform matrix");
+        if (pStore->getPrevTransformMatrix(i) != prevWorld) return test_fail("Wrong previous transform matrix");
+
+        // The normal matrix is the inverse transpose of the transform
+        glm::mat3 normalCheck = glm::transpose(glm::mat3(pStore->getNormalMatrix(i))) * glm::mat3(world);
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            for (uint32_t r = 0; r < 3; r++)
+            {
+                if (std::abs(normalCheck[c][r] - (c == r ? 1.0f : 0.0f)) > 1e-4f) return test_fail("Wrong normal matrix");
+            }
+        }
+
+        BoundingBox box = pStore->getBoundingBox(i);
+        BoundingBox refBox = localBox.transform(world);
+        if (box.center != refBox.center || box.extent != refBox.extent) return test_fail("Wrong world bounding box");
+    }
+
+    BoundingBoxStreams streams = pStore->getBoundingBoxStreams();
+    if (streams.count != kSlotCount || streams.pCenter[1][7] != pStore->getBoundingBox(7).center.y)
+    {
+        return test_fail("Bounding box streams don't match the slots");
+    }
+    return test_pass();
+}
+
+testing_func(InstanceStoreTest, TestSlotReuse)
+{
+    InstanceStore::SharedPtr pStore = InstanceStore::create();
+    BoundingBox localBox = BoundingBox::fromMinMax(glm::vec3(-1), glm::vec3(1));
+
+    uint32_t a = pStore->allocateSlot(localBox);
+    uint32_t b = pStore->allocateSlot(localBox);
+    InstanceStore::TransformParams params;
+    params.translation = glm::vec3(10, 0, 0);
+    params.target = glm::vec3(10, 0, 1);
+    pStore->setBaseParams(a, params);
+    pStore->setMovableParams(a, params);
+
+    // Release a dirty slot and reuse it before the batched update
+    pStore->releaseSlot(a);
+    if (pStore->isVisible(a) || pStore->getActiveSlotCount() != 1) return test_fail("Released slot is still active");
+
+    uint32_t c = pStore->allocateSlot(localBox);
+    if (c != a) return test_fail("Released slot wasn't reused");
+    if (pStore->getSlotCount() != 2 || pStore->isVisible(c) == false) return test_fail("Reused slot has the wrong state");
+    pStore->updateTransforms();
+
+    glm::mat4 defaultMtx = calcReferenceMatrix(InstanceStore::TransformParams());
+    if (pStore->getTransformMatrix(c) != defaultMtx * defaultMtx || pStore->getPrevTransformMatrix(c) != defaultMtx)
+    {
+        return test_fail("Reused slot kept the transform of the released one");
+    }
+    if (pStore->isDirty(b)) return test_fail("Untouched slot is dirty");
+    return test_pass();
+}
+
+testing_func(InstanceStoreTest, TestChangeLog)
+{
+    InstanceStore::SharedPtr pStore = InstanceStore::create();
+    BoundingBox localBox = BoundingBox::fromMinMax(glm::vec3(-1), glm::vec3(1));
+    uint32_t slots[3];
+    for (uint32_t& slot : slots)
+    {
+        slot = pStore->allocateSlot(localBox);
+    }
+    pStore->updateTransforms();
+    uint64_t cursor = pStore->getChangeLogEnd();
+    uint64_t staleCursor = cursor;
+
+    // Change a slot twice, and update another one on demand before the batched update
+    InstanceStore::TransformParams params;
+    params.translation = glm::vec3(1, 2, 3);
+    params.target = glm::vec3(1, 2, 4);
+    pStore->setBaseParams(slots[1], params);
+    pStore->setMovableParams(slots[1], params);
+    pStore->setMovableParams(slots[2], params);
+    pStore->updateSlot(slots[2]);
+
+    std::vector<uint32_t> changed;
+    if (pStore->getChangedSlots(cursor, changed) == false || changed.empty() == false) return test_fail("Changes were logged before the batched update");
+    pStore->updateTransforms();
+    if (pStore->getChangedSlots(cursor, changed) == false) return test_fail("Change log was trimmed");
+    std::sort(changed.begin(), changed.end());
+    if (changed.size() != 2 || changed[0] != slots[1] || changed[1] != slots[2]) return test_fail("Wrong slots in the change log");
+
+    pStore->updateTransforms();
+    if (pStore->getChangedSlots(cursor, changed) == false || changed.empty() == false) return test_fail("Unchanged slots were logged");
+
+    // A cursor which isn't read for a long time falls behind the trimmed log
+    for (uint32_t i = 0; i < 64 * 1024; i++)
+    {
+        pStore->setMovableParams(slots[0], params);
+        pStore->updateTransforms();
+    }
+    if (pStore->getChangedSlots(staleCursor, changed)) return test_fail("Stale cursor wasn't detected");
+    if (staleCursor != pStore->getChangeLogEnd()) return test_fail("Stale cursor wasn't moved to the end of the log");
+    if (pStore->getChangedSlots(cursor, changed)) return test_fail("Stale cursor wasn't detected");
+    return test_pass();
+}
+
+testing_func(InstanceStoreTest, TestBatchedUpdateBenchmark)
+{
+    const uint32_t kSlotCount = 100000;
+    InstanceStore::SharedPtr pStore = InstanceStore::create();
+    BoundingBox localBox = BoundingBox::fromMinMax(glm::vec3(-1), glm::vec3(1));
+    std::mt19937 rng(2);
+
+    std::vector<InstanceStore::TransformParams> params(kSlotCount);
+    for (uint32_t i = 0; i < kSlotCount; i++)
+    {
+        pStore->allocateSlot(localBox);
+        params[i] = createParams(rng);
+    }
+
+    for (uint32_t i = 0; i < kSlotCount; i++)
+    {
+        pStore->setMovableParams(i, params[i]);
+    }
+    auto lazyStart = CpuTimer::getCurrentTimePoint();
+    for (uint32_t i = 0; i < kSlotCount; i++)
+    {
+        pStore->updateSlot(i);
+    }
+    float lazyTime = CpuTimer::calcDuration(lazyStart, CpuTimer::getCurrentTimePoint());
+    pStore->updateTransforms();
+
+    for (uint32_t i = 0; i < kSlotCount; i++)
+    {
+        pStore->setMovableParams(i, params[kSlotCount - i - 1]);
+    }
+    auto batchStart = CpuTimer::getCurrentTimePoint();
+    pStore->updateTransforms();
+    float batchTime = CpuTimer::calcDuration(batchStart, CpuTimer::getCurrentTimePoint());
+
+    for (uint32_t i = 0; i < kSlotCount; i += 997)
+    {
+        if (pStore->getTransformMatrix(i) != calcReferenceMatrix(params[kSlotCount - i - 1]) * calcReferenceMatrix(InstanceStore::TransformParams()))
+        {
+            return test_fail("Batched update produced a wrong transform");
+        }
+    }
+
+    logInfo("Updating " + std::to_string(kSlotCount) + " instances. Per-slot: " + std::to_string(lazyTime) + "ms, batched: " + std::to_string(batchTime) + "ms");
+    return test_pass();
+}
+
+int main()
+{
+    InstanceStoreTest ist;
+    ist.init(true);
+    ist.run();
+    return 0;
+}
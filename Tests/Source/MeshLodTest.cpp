@@ -0,0 +1,288 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "MeshLodTest.h"
+#include "Utils/CpuTimer.h"
+#include "glm/gtc/matrix_transform.hpp"
+#include <map>
+#include <set>
+#include <cfloat>
+
+void MeshLodTest::addTests()
+{
+    addTestToList<TestSimplifyPlane>();
+    addTestToList<TestSimplifySeams>();
+    addTestToList<TestLodChain>();
+    addTestToList<TestLodSelection>();
+}
+
+void MeshLodTest::createGrid(uint32_t size, bool splitSeam, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices)
+{
+    // A unit square in the XY plane. When splitting the seam, the middle column is duplicated for the right half, like a UV seam.
+    uint32_t rowLength = size + 1;
+    uint32_t seam = size / 2;
+    positions.clear();
+    indices.clear();
+    for (uint32_t y = 0; y <= size; y++)
+    {
+        for (uint32_t x = 0; x <= size; x++)
+        {
+            positions.push_back(glm::vec3(float(x) / size, float(y) / size, 0));
+        }
+    }
+    uint32_t seamBase = (uint32_t)positions.size();
+    if (splitSeam)
+    {
+        for (uint32_t y = 0; y <= size; y++)
+        {
+            positions.push_back(positions[y * rowLength + seam]);
+        }
+    }
+
+    auto vertex = [&](uint32_t x, uint32_t y, bool right)
+    {
+        return (splitSeam && right && x == seam) ? seamBase + y : y * rowLength + x;
+    };
+
+    for (uint32_t y = 0; y < size; y++)
+    {
+        for (uint32_t x = 0; x < size; x++)
+        {
+            bool right = x >= seam;
+            uint32_t v00 = vertex(x, y, right);
+            uint32_t v10 = vertex(x + 1, y, right);
+            uint32_t v01 = vertex(x, y + 1, right);
+            uint32_t v11 = vertex(x + 1, y + 1, right);
+            uint32_t quad[] = { v00, v10, v11, v00, v11, v01 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+void MeshLodTest::createSphere(uint32_t subdivisions, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices)
+{
+    const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+    positions = { {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0}, {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t}, {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1} };
+    indices = { 0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11, 1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+        3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9, 4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1 };
+    for (auto& p : positions)
+    {
+        p = glm::normalize(p);
+    }
+
+    for (uint32_t s = 0; s < subdivisions; s++)
+    {
+        std::map<std::pair<uint32_t, uint32_t>, uint32_t> midpoints;
+        auto midpoint = [&](uint32_t a, uint32_t b)
+        {
+            auto key = std::make_pair(std::min(a, b), std::max(a, b));
+            auto it = midpoints.find(key);
+            if (it != midpoints.end())
+            {
+                return it->second;
+            }
+            uint32_t index = (uint32_t)positions.size();
+            positions.push_back(glm::normalize(positions[a] + positions[b]));
+            midpoints[key] = index;
+            return index;
+        };
+
+        std::vector<uint32_t> subdivided;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            uint32_t ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            uint32_t tris[] = { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca };
+            subdivided.insert(subdivided.end(), tris, tris + 12);
+        }
+        indices.swap(subdivided);
+    }
+}
+
+float MeshLodTest::calcArea(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, float* pMinNormalZ)
+{
+    float area = 0;
+    *pMinNormalZ = 1;
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        glm::vec3 n = glm::cross(positions[indices[i + 1]] - positions[indices[i]], positions[indices[i + 2]] - positions[indices[i]]);
+        float length = glm::length(n);
+        area += length * 0.5f;
+        *pMinNormalZ = std::min(*pMinNormalZ, length > 0 ? n.z / length : -1.0f);
+    }
+    return area;
+}
+
+testing_func(MeshLodTest, TestSimplifyPlane)
+{
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    createGrid(32, false, positions, indices);
+
+    // A flat plane can be reduced to a few triangles without any error
+    std::vector<uint32_t> simplified;
+    float error = MeshSimplifier::simplify(positions.data(), (uint32_t)positions.size(), indices.data(), (uint32_t)indices.size(), 6, 1e-4f, simplified);
+    if (simplified.size() > indices.size() / 20) return test_fail("The plane wasn't simplified");
+    if (error > 1e-4f) return test_fail("The error of the plane should be zero");
+
+    // The border must be preserved and no triangle may flip
+    float minNormalZ;
+    float area = calcArea(positions, simplified, &minNormalZ);
+    if (std::abs(area - 1) > 1e-3f) return test_fail("The simplified plane doesn't cover the original area");
+    if (minNormalZ < 0.99f) return test_fail("A triangle of the simplified plane was flipped");
+
+    // A target above the index count leaves the mesh untouched
+    MeshSimplifier::simplify(positions.data(), (uint32_t)positions.size(), indices.data(), (uint32_t)indices.size(), (uint32_t)indices.size(), 1, simplified);
+    if (simplified != indices) return test_fail("Simplifying to the original index count should return the original mesh");
+    return test_pass();
+}
+
+testing_func(MeshLodTest, TestSimplifySeams)
+{
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    const uint32_t kSize = 32;
+    createGrid(kSize, true, positions, indices);
+
+    std::vector<uint32_t> simplified;
+    MeshSimplifier::simplify(positions.data(), (uint32_t)positions.size(), indices.data(), (uint32_t)indices.size(), 6, 1e-4f, simplified);
+    if (simplified.size() > indices.size() / 2) return test_fail("The plane wasn't simplified");
+
+    // Every vertex on both sides of the seam must still be used, otherwise the seam opens
+    std::set<uint32_t> used(simplified.begin(), simplified.end());
+    uint32_t seamBase = (kSize + 1) * (kSize + 1);
+    for (uint32_t y = 0; y <= kSize; y++)
+    {
+        if (used.count(y * (kSize + 1) + kSize / 2) == 0 || used.count(seamBase + y) == 0) return test_fail("A seam vertex was removed");
+    }
+
+    float minNormalZ;
+    float area = calcArea(positions, simplified, &minNormalZ);
+    if (std::abs(area - 1) > 1e-3f) return test_fail("The simplified plane doesn't cover the original area");
+    if (minNormalZ < 0.99f) return test_fail("A triangle of the simplified plane was flipped");
+    return test_pass();
+}
+
+testing_func(MeshLodTest, TestLodChain)
+{
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    createSphere(6, positions, indices);
+
+    std::vector<MeshLodData> lods;
+    auto start = CpuTimer::getCurrentTimePoint();
+    MeshSimplifier::generateLodChain(positions.data(), (uint32_t)positions.size(), indices.data(), (uint32_t)indices.size(), 4, lods);
+    float time = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+    logInfo("Generated " + std::to_string(lods.size()) + " LODs for " + std::to_string(indices.size() / 3) + " triangles in " + std::to_string(time) + "ms");
+
+    if (lods.size() != 3) return test_fail("A dense sphere should get the maximal number of LODs");
+    size_t prevIndexCount = indices.size();
+    float prevScreenSize = FLT_MAX;
+    for (const auto& lod : lods)
+    {
+        if (lod.indices.size() > prevIndexCount * 0.9f) return test_fail("LODs must reduce the triangle count");
+        if (lod.screenSize >= prevScreenSize) return test_fail("LOD screen sizes must decrease");
+
+        // The vertices stay on the sphere, so the error is the distance of the triangle centers to the surface
+        float maxDistance = 0;
+        for (size_t i = 0; i < lod.indices.size(); i += 3)
+        {
+            glm::vec3 center = (positions[lod.indices[i]] + positions[lod.indices[i + 1]] + positions[lod.indices[i + 2]]) * (1.0f / 3.0f);
+            maxDistance = std::max(maxDistance, 1 - glm::length(center));
+        }
+        float maxError = 2 * 2.0f / (lod.screenSize * 1080.0f);
+        if (lod.error > maxError || maxDistance > maxError * 2) return test_fail("The LOD error exceeds its bound");
+
+        prevIndexCount = lod.indices.size();
+        prevScreenSize = lod.screenSize;
+    }
+
+    // Out-of-range indices, as found in a corrupt file, are skipped
+    std::vector<uint32_t> badIndices = indices;
+    for (size_t i = 0; i < badIndices.size(); i += 97)
+    {
+        badIndices[i] = 0x7fffffff;
+    }
+    MeshSimplifier::generateLodChain(positions.data(), (uint32_t)positions.size(), badIndices.data(), (uint32_t)badIndices.size(), 4, lods);
+    for (const auto& lod : lods)
+    {
+        for (uint32_t index : lod.indices)
+        {
+            if (index >= positions.size()) return test_fail("A LOD references a vertex which doesn't exist");
+        }
+    }
+
+    // Coarse meshes don't get LODs
+    createSphere(0, positions, indices);
+    MeshSimplifier::generateLodChain(positions.data(), (uint32_t)positions.size(), indices.data(), (uint32_t)indices.size(), 4, lods);
+    if (lods.empty() == false) return test_fail("An icosahedron shouldn't get LODs");
+    return test_pass();
+}
+
+testing_func(MeshLodTest, TestLodSelection)
+{
+    // With a 90 degrees field of view, a unit sphere at distance 10 covers a tenth of the screen height
+    glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 1000.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0));
+    float size = LodSelector::calcScreenSize(glm::vec3(0, 0, -10), 1, view, proj);
+    if (std::abs(size - 0.1f) > 1e-4f) return test_fail("Wrong screen size");
+    size = LodSelector::calcScreenSize(glm::vec3(0, 20, 0), 1, view, proj);
+    if (std::abs(size - 0.05f) > 1e-4f) return test_fail("The screen size shouldn't depend on the view direction");
+    if (LodSelector::calcScreenSize(glm::vec3(0, 0, -0.5f), 1, view, proj) < 1) return test_fail("A sphere containing the camera should use the first LOD");
+    glm::mat4 ortho = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, 0.1f, 1000.0f);
+    if (std::abs(LodSelector::calcScreenSize(glm::vec3(0, 0, -500), 1, view, ortho) - 0.1f) > 1e-4f) return test_fail("Wrong orthographic screen size");
+
+    const float screenSizes[] = { FLT_MAX, 0.25f, 0.125f, 0.0625f };
+    if (LodSelector::selectLod(screenSizes, 4, 1) != 0) return test_fail("Large objects should use the first LOD");
+    if (LodSelector::selectLod(screenSizes, 4, 0.2f) != 1) return test_fail("Wrong LOD");
+    if (LodSelector::selectLod(screenSizes, 4, 0.1f) != 2) return test_fail("Wrong LOD");
+    if (LodSelector::selectLod(screenSizes, 4, 0.01f) != 3) return test_fail("Small objects should use the last LOD");
+    if (LodSelector::selectLod(screenSizes, 1, 0.01f) != 0) return test_fail("Meshes without LODs should use the first LOD");
+
+    // Oscillating around a switch size by less than the hysteresis keeps the LOD
+    float selectionSize = LodSelector::applyHysteresis(0.13f, -1, 0.1f);
+    uint32_t lod = LodSelector::selectLod(screenSizes, 4, selectionSize);
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        float screenSize = (i & 1) ? 0.122f : 0.128f;
+        selectionSize = LodSelector::applyHysteresis(screenSize, selectionSize, 0.1f);
+        if (LodSelector::selectLod(screenSizes, 4, selectionSize) != lod) return test_fail("The LOD changed within the hysteresis");
+    }
+
+    // Larger changes switch the LOD
+    selectionSize = LodSelector::applyHysteresis(0.1f, selectionSize, 0.1f);
+    if (LodSelector::selectLod(screenSizes, 4, selectionSize) != 2) return test_fail("The LOD didn't change beyond the hysteresis");
+    return test_pass();
+}
+
+int main()
+{
+    MeshLodTest mlt;
+    mlt.init(true);
+    mlt.run();
+    return 0;
+}
@@ -0,0 +1,306 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "ModelCacheTest.h"
+#include "Graphics/Model/ModelCache.h"
+#include "Utils/CpuTimer.h"
+#include "Utils/Bitmap.h"
+#include <fstream>
+
+static const char* kCacheDirectory = "ModelCacheTest_Cache";
+
+void ModelCacheTest::addTests()
+{
+    addTestToList<TestHitAfterMiss>();
+    addTestToList<TestLoadFlagsAreKeyed>();
+    addTestToList<TestLruEviction>();
+    addTestToList<TestLoadBenchmark>();
+}
+
+testing_func(ModelCacheTest, TestHitAfterMiss)
+{
+    std::vector<std::string> files;
+    if (writeSyntheticModel("ModelCacheTest_Hit", 64, files) == false)
+    {
+        removeFiles(files);
+        return test_fail("Failed to write the test model");
+    }
+
+    resetCache();
+    Model::SharedPtr pSourceModel = Model::createFromFile("ModelCacheTest_Hit.obj");
+    ModelCache::Statistics afterMiss = ModelCache::getStatistics();
+    Model::SharedPtr pCachedModel = Model::createFromFile("ModelCacheTest_Hit.obj");
+    ModelCache::Statistics afterHit = ModelCache::getStatistics();
+    removeFiles(files);
+
+    if (pSourceModel == nullptr || pCachedModel == nullptr)
+    {
+        return test_fail("Failed to load the test model");
+    }
+
+    if (afterMiss.misses != 1 || afterMiss.hits != 0 || afterMiss.entryCount != 1 || afterMiss.bytesWritten == 0)
+    {
+        return test_fail("First load should have been a miss which created an entry");
+    }
+
+    if (afterHit.misses != 1 || afterHit.hits != 1 || afterHit.bytesRead != afterMiss.bytesWritten)
+    {
+        return test_fail("Second load should have been a hit");
+    }
+
+    if (doModelsMatch(pSourceModel, pCachedModel) == false)
+    {
+        return test_fail("Cached model doesn't match the model imported from the source file");
+    }
+
+    return test_pass();
+}
+
+testing_func(ModelCacheTest, TestLoadFlagsAreKeyed)
+{
+    std::vector<std::string> files;
+    if (writeSyntheticModel("ModelCacheTest_Flags", 16, files) == false)
+    {
+        removeFiles(files);
+        return test_fail("Failed to write the test model");
+    }
+
+    resetCache();
+    Model::SharedPtr pModel = Model::createFromFile("ModelCacheTest_Flags.obj");
+    Model::SharedPtr pLinearModel = Model::createFromFile("ModelCacheTest_Flags.obj", Model::LoadFlags::AssumeLinearSpaceTextures);
+    // MemoryMappedIO doesn't change the imported model, so it should share the entry
+    Model::SharedPtr pMappedModel = Model::createFromFile("ModelCacheTest_Flags.obj", Model::LoadFlags::MemoryMappedIO);
+    Model::SharedPtr pUncachedModel = Model::createFromFile("ModelCacheTest_Flags.obj", Model::LoadFlags::DontUseCache);
+    ModelCache::Statistics stats = ModelCache::getStatistics();
+    removeFiles(files);
+
+    if (pModel == nullptr || pLinearModel == nullptr || pMappedModel == nullptr || pUncachedModel == nullptr)
+    {
+        return test_fail("Failed to load the test model");
+    }
+
+    if (stats.misses != 2 || stats.hits != 1 || stats.entryCount != 2)
+    {
+        return test_fail("Load flags were not keyed correctly");
+    }
+
+    return test_pass();
+}
+
+testing_func(ModelCacheTest, TestLruEviction)
+{
+    std::vector<std::string> files;
+    const std::string names[] = { "ModelCacheTest_LruA", "ModelCacheTest_LruB", "ModelCacheTest_LruC" };
+    for (const auto& name : names)
+    {
+        if (writeSyntheticModel(name, 32, files) == false)
+        {
+            removeFiles(files);
+            return test_fail("Failed to write the test models");
+        }
+    }
+
+    resetCache();
+    Model::createFromFile("ModelCacheTest_LruA.obj");
+    uint64_t entrySize = ModelCache::getStatistics().cacheSize;
+
+    // Room for two entries. Loading C evicts A, reusing B makes C the least-recently-used entry, so reloading A evicts C.
+    // The index is reloaded from disk after reusing B, to check that the use order of hits is persisted.
+    ModelCache::setMaxSize(entrySize * 2 + entrySize / 2);
+    Model::createFromFile("ModelCacheTest_LruB.obj");
+    Model::createFromFile("ModelCacheTest_LruC.obj");
+    ModelCache::Statistics afterC = ModelCache::getStatistics();
+    Model::createFromFile("ModelCacheTest_LruB.obj");
+    ModelCache::setDirectory(kCacheDirectory);
+    Model::createFromFile("ModelCacheTest_LruA.obj");
+    ModelCache::Statistics afterA = ModelCache::getStatistics();
+    Model::createFromFile("ModelCacheTest_LruB.obj");
+    ModelCache::Statistics afterB = ModelCache::getStatistics();
+    removeFiles(files);
+    ModelCache::setMaxSize(2ull * 1024 * 1024 * 1024);
+
+    if (afterC.evictions != 1 || afterC.entryCount != 2 || afterC.cacheSize > entrySize * 2 + entrySize / 2)
+    {
+        return test_fail("Cache size limit was not enforced");
+    }
+
+    if (afterA.misses != 4 || afterA.hits != 1 || afterA.evictions != 2)
+    {
+        return test_fail("Evicted entry was found in the cache");
+    }
+
+    if (afterB.hits != 2)
+    {
+        return test_fail("Recently-used entry was evicted");
+    }
+
+    return test_pass();
+}
+
+testing_func(ModelCacheTest, TestLoadBenchmark)
+{
+    std::vector<std::string> files;
+    if (writeSyntheticModel("ModelCacheTest_Large", 512, files) == false)
+    {
+        removeFiles(files);
+        return test_fail("Failed to write the test model");
+    }
+
+    resetCache();
+    auto sourceStart = CpuTimer::getCurrentTimePoint();
+    Model::SharedPtr pSourceModel = Model::createFromFile("ModelCacheTest_Large.obj", Model::LoadFlags::DontUseCache);
+    float sourceTime = CpuTimer::calcDuration(sourceStart, CpuTimer::getCurrentTimePoint());
+
+    // Populate the cache. This includes the time it takes to write the entry.
+    auto missStart = CpuTimer::getCurrentTimePoint();
+    Model::createFromFile("ModelCacheTest_Large.obj");
+    float missTime = CpuTimer::calcDuration(missStart, CpuTimer::getCurrentTimePoint());
+
+    auto hitStart = CpuTimer::getCurrentTimePoint();
+    Model::SharedPtr pCachedModel = Model::createFromFile("ModelCacheTest_Large.obj");
+    float hitTime = CpuTimer::calcDuration(hitStart, CpuTimer::getCurrentTimePoint());
+    removeFiles(files);
+
+    if (pSourceModel == nullptr || pCachedModel == nullptr || ModelCache::getStatistics().hits != 1)
+    {
+        return test_fail("Failed to load the test model");
+    }
+
+    logInfo("ModelCache, " + std::to_string(pSourceModel->getPrimitiveCount()) + " triangles. Assimp: " + std::to_string(sourceTime) + "ms, miss: " + std::to_string(missTime) + "ms, hit: " + std::to_string(hitTime) + "ms");
+    return test_pass();
+}
+
+bool ModelCacheTest::writeSyntheticModel(const std::string& name, uint32_t gridSize, std::vector<std::string>& createdFiles)
+{
+    // A textured height-field grid, so importing it goes through parsing, tangent generation and texture loading
+    const uint32_t kTextureSize = 64;
+    std::vector<uint8_t> texels(kTextureSize * kTextureSize * 4);
+    for (uint32_t i = 0; i < kTextureSize * kTextureSize; i++)
+    {
+        texels[i * 4 + 0] = uint8_t(i);
+        texels[i * 4 + 1] = uint8_t(i / kTextureSize);
+        texels[i * 4 + 2] = uint8_t(gridSize);
+        texels[i * 4 + 3] = 0xff;
+    }
+
+    createdFiles.push_back(name + ".obj");
+    createdFiles.push_back(name + ".mtl");
+    createdFiles.push_back(name + ".png");
+    Bitmap::saveImage(name + ".png", kTextureSize, kTextureSize, Bitmap::FileFormat::PngFile, Bitmap::ExportFlags::None, ResourceFormat::RGBA8Unorm, true, texels.data());
+
+    std::ofstream mtl(name + ".mtl");
+    mtl << "newmtl " << name << "\nKd 1 1 1\nmap_Kd " << name << ".png\n";
+
+    // Models with the same grid size must still have different content, otherwise they would share a cache entry
+    const float frequency = float(name.size() + name.back());
+    std::ofstream obj(name + ".obj");
+    obj << "mtllib " << name << ".mtl\nusemtl " << name << "\n";
+    for (uint32_t y = 0; y <= gridSize; y++)
+    {
+        for (uint32_t x = 0; x <= gridSize; x++)
+        {
+            float u = float(x) / gridSize;
+            float v = float(y) / gridSize;
+            obj << "v " << u << " " << 0.1f * sin(u * frequency) * cos(v * frequency) << " " << v << "\n";
+            obj << "vt " << u << " " << v << "\n";
+            obj << "vn 0 1 0\n";
+        }
+    }
+    for (uint32_t y = 0; y < gridSize; y++)
+    {
+        for (uint32_t x = 0; x < gridSize; x++)
+        {
+            uint32_t i0 = y * (gridSize + 1) + x + 1;
+            uint32_t i1 = i0 + 1;
+            uint32_t i2 = i0 + gridSize + 1;
+            uint32_t i3 = i2 + 1;
+            obj << "f " << i0 << "/" << i0 << "/" << i0 << " " << i2 << "/" << i2 << "/" << i2 << " " << i1 << "/" << i1 << "/" << i1 << "\n";
+            obj << "f " << i1 << "/" << i1 << "/" << i1 << " " << i2 << "/" << i2 << "/" << i2 << " " << i3 << "/" << i3 << "/" << i3 << "\n";
+        }
+    }
+
+    return mtl.good() && obj.good();
+}
+
+bool ModelCacheTest::doModelsMatch(const Model::SharedPtr& pModelA, const Model::SharedPtr& pModelB)
+{
+    if (pModelA->getName() != pModelB->getName() ||
+        pModelA->getVertexCount() != pModelB->getVertexCount() ||
+        pModelA->getIndexCount() != pModelB->getIndexCount() ||
+        pModelA->getMeshCount() != pModelB->getMeshCount() ||
+        pModelA->getTextureCount() != pModelB->getTextureCount() ||
+        pModelA->getBoundingBox().center != pModelB->getBoundingBox().center ||
+        pModelA->getBoundingBox().extent != pModelB->getBoundingBox().extent)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < pModelA->getMeshCount(); i++)
+    {
+        const auto& pMaterialA = pModelA->getMesh(i)->getMaterial();
+        const auto& pMaterialB = pModelB->getMesh(i)->getMaterial();
+        if (pMaterialA->getNumLayers() != pMaterialB->getNumLayers() || pModelA->getMeshInstanceCount(i) != pModelB->getMeshInstanceCount(i))
+        {
+            return false;
+        }
+
+        for (uint32_t l = 0; l < pMaterialA->getNumLayers(); l++)
+        {
+            const auto& pTextureA = pMaterialA->getLayer(l).pTexture;
+            const auto& pTextureB = pMaterialB->getLayer(l).pTexture;
+            if ((pTextureA == nullptr) != (pTextureB == nullptr) || (pTextureA && pTextureA->getFormat() != pTextureB->getFormat()))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void ModelCacheTest::resetCache()
+{
+    ModelCache::setDirectory(kCacheDirectory);
+    ModelCache::clear();
+    ModelCache::resetStatistics();
+}
+
+void ModelCacheTest::removeFiles(const std::vector<std::string>& files)
+{
+    for (const auto& f : files)
+    {
+        std::remove(f.c_str());
+    }
+}
+
+int main()
+{
+    ModelCacheTest mct;
+    mct.init(true);
+    mct.run();
+    return 0;
+}
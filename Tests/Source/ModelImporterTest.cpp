@@ -0,0 +1,184 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "ModelImporterTest.h"
+#include "Graphics/Model/Loaders/ModelImporter.h"
+#include "Utils/CpuTimer.h"
+#include <fstream>
+
+namespace
+{
+    // Gives the tests access to the material table the importers use
+    class MaterialTable : public ModelImporter
+    {
+    public:
+        Material::SharedPtr add(const Material::SharedPtr& pMaterial) { return checkForExistingMaterial(pMaterial); }
+    };
+}
+
+void ModelImporterTest::addTests()
+{
+    addTestToList<TestMaterialDedup>();
+    addTestToList<TestMaterialImportBenchmark>();
+}
+
+testing_func(ModelImporterTest, TestMaterialDedup)
+{
+    MaterialTable table;
+    Material::SharedPtr pFirst = createMaterial(1);
+    if (table.add(pFirst) != pFirst) return test_fail("The first material wasn't added");
+
+    // Same values, different name and ID
+    Material::SharedPtr pSame = createMaterial(1);
+    if (pSame->getContentHash() != pFirst->getContentHash()) return test_fail("Equal materials have different hashes");
+    if (table.add(pSame) != pFirst) return test_fail("An equal material wasn't found");
+
+    Material::SharedPtr pOtherAlbedo = createMaterial(2);
+    if (table.add(pOtherAlbedo) != pOtherAlbedo) return test_fail("A material with a different albedo was merged");
+
+    Material::SharedPtr pDoubleSided = createMaterial(1);
+    pDoubleSided->setDoubleSided(true);
+    if (table.add(pDoubleSided) != pDoubleSided) return test_fail("A double-sided material was merged with a single-sided one");
+
+    Material::SharedPtr pAlphaTested = createMaterial(1);
+    pAlphaTested->setAlphaThreshold(0.25f);
+    if (table.add(pAlphaTested) != pAlphaTested) return test_fail("A material with a different alpha threshold was merged");
+
+    if (table.add(createMaterial(2)) != pOtherAlbedo) return test_fail("The table lost a material");
+    return test_pass();
+}
+
+testing_func(ModelImporterTest, TestMaterialImportBenchmark)
+{
+    const uint32_t kMaterialCount = 50000;
+    const uint32_t kLinearCount = 5000;
+
+    // Every other material is added twice
+    std::vector<Material::SharedPtr> materials;
+    for (uint32_t i = 0; i < kMaterialCount; i++)
+    {
+        materials.push_back(createMaterial(i));
+        if ((i & 1) == 0)
+        {
+            materials.push_back(createMaterial(i));
+        }
+    }
+
+    MaterialTable table;
+    uint32_t uniqueCount = 0;
+    auto hashStart = CpuTimer::getCurrentTimePoint();
+    for (const auto& pMaterial : materials)
+    {
+        uniqueCount += (table.add(pMaterial) == pMaterial) ? 1 : 0;
+    }
+    float hashTime = CpuTimer::calcDuration(hashStart, CpuTimer::getCurrentTimePoint());
+    if (uniqueCount != kMaterialCount) return test_fail("The table found " + std::to_string(uniqueCount) + " unique materials instead of " + std::to_string(kMaterialCount));
+
+    // The search the table replaced. It grows quadratically, so it only runs on the first materials.
+    std::vector<Material::SharedPtr> linearTable;
+    const size_t linearAdds = kLinearCount * 3 / 2;
+    auto linearStart = CpuTimer::getCurrentTimePoint();
+    for (size_t i = 0; i < linearAdds; i++)
+    {
+        bool found = false;
+        for (const auto& pMaterial : linearTable)
+        {
+            if (*pMaterial == *materials[i])
+            {
+                found = true;
+                break;
+            }
+        }
+        if (found == false) linearTable.push_back(materials[i]);
+    }
+    float linearTime = CpuTimer::calcDuration(linearStart, CpuTimer::getCurrentTimePoint());
+
+    // Import a model with a triangle per material
+    std::vector<std::string> files;
+    if (writeMaterialModel("ModelImporterTest_Materials", kMaterialCount, files) == false)
+    {
+        removeFiles(files);
+        return test_fail("Failed to write the test model");
+    }
+    auto importStart = CpuTimer::getCurrentTimePoint();
+    Model::SharedPtr pModel = Model::createFromFile("ModelImporterTest_Materials.obj", Model::LoadFlags::DontUseCache);
+    float importTime = CpuTimer::calcDuration(importStart, CpuTimer::getCurrentTimePoint());
+    removeFiles(files);
+
+    if (pModel == nullptr) return test_fail("Failed to load the test model");
+    if (pModel->getMaterialCount() != kMaterialCount) return test_fail("The model has " + std::to_string(pModel->getMaterialCount()) + " materials instead of " + std::to_string(kMaterialCount));
+
+    logInfo("Material dedupe: " + std::to_string(materials.size()) + " materials in " + std::to_string(hashTime) + "ms with the hash table, " + std::to_string(linearAdds) + " materials in " + std::to_string(linearTime) + "ms with a linear search");
+    logInfo("Imported " + std::to_string(kMaterialCount) + " materials in " + std::to_string(importTime) + "ms");
+    return test_pass();
+}
+
+Material::SharedPtr ModelImporterTest::createMaterial(uint32_t index)
+{
+    Material::Layer layer;
+    layer.type = Material::Layer::Type::Lambert;
+    layer.albedo = glm::vec4(float(index % 250) / 250, float(index / 250 % 250) / 250, float(index / 62500) / 250, 1);
+    Material::SharedPtr pMaterial = Material::create("Material" + std::to_string(index));
+    pMaterial->addLayer(layer);
+    return pMaterial;
+}
+
+bool ModelImporterTest::writeMaterialModel(const std::string& name, uint32_t materialCount, std::vector<std::string>& createdFiles)
+{
+    // CAD exports often have a material per part. Each triangle gets its own diffuse color.
+    createdFiles.push_back(name + ".obj");
+    createdFiles.push_back(name + ".mtl");
+    std::ofstream mtl(name + ".mtl");
+    std::ofstream obj(name + ".obj");
+    obj << "mtllib " << name << ".mtl\nvn 0 1 0\n";
+    for (uint32_t i = 0; i < materialCount; i++)
+    {
+        mtl << "newmtl m" << i << "\nKd " << float(i % 250) / 250 << " " << float(i / 250 % 250) / 250 << " " << float(i / 62500) / 250 << "\n";
+
+        float x = float(i % 256);
+        float z = float(i / 256);
+        obj << "v " << x << " 0 " << z << "\nv " << x << " 0 " << z + 1 << "\nv " << x + 1 << " 0 " << z << "\n";
+        obj << "usemtl m" << i << "\nf " << i * 3 + 1 << "//1 " << i * 3 + 2 << "//1 " << i * 3 + 3 << "//1\n";
+    }
+    return mtl.good() && obj.good();
+}
+
+void ModelImporterTest::removeFiles(const std::vector<std::string>& files)
+{
+    for (const auto& f : files)
+    {
+        std::remove(f.c_str());
+    }
+}
+
+int main()
+{
+    ModelImporterTest mit;
+    mit.init(true);
+    mit.run();
+    return 0;
+}
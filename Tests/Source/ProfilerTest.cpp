@@ -0,0 +1,244 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "ProfilerTest.h"
+#include "Utils/CpuTimer.h"
+#include "Utils/StreamingHistogram.h"
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include "rapidjson/document.h"
+
+void ProfilerTest::addTests()
+{
+    addTestToList<TestMultithreadedEvents>();
+    addTestToList<TestScopeCost>();
+    addTestToList<TestTraceExport>();
+    addTestToList<TestHistogramPercentiles>();
+}
+
+static void profileNestedScopes(uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        PROFILE(ProfilerTestOuter);
+        {
+            PROFILE(ProfilerTestInner);
+        }
+    }
+}
+
+testing_func(ProfilerTest, TestMultithreadedEvents)
+{
+    const uint32_t kThreadCount = 4;
+    const uint32_t kScopeCount = 500;
+
+    bool profileEnabled = gProfileEnabled;
+    gProfileEnabled = true;
+    Profiler::clearEvents();
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < kThreadCount; i++)
+    {
+        threads.push_back(std::thread(profileNestedScopes, kScopeCount));
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    std::string results;
+    Profiler::endFrame(results);
+    gProfileEnabled = profileEnabled;
+
+    Profiler::EventData* pOuter = Profiler::isEventRegistered(HashedString("ProfilerTestOuter"));
+    Profiler::EventData* pInner = Profiler::isEventRegistered(HashedString("ProfilerTestInner"));
+    if (pOuter == nullptr || pInner == nullptr)
+    {
+        return test_fail("Events weren't registered");
+    }
+
+    if (pOuter->callCount != kThreadCount * kScopeCount || pInner->callCount != kThreadCount * kScopeCount || Profiler::getDroppedEventCount() != 0)
+    {
+        return test_fail("Events were lost");
+    }
+
+    if (pInner->level != pOuter->level + 1)
+    {
+        return test_fail("Wrong event hierarchy");
+    }
+
+    if (results.find("Thread") == std::string::npos)
+    {
+        return test_fail("The results don't contain the worker threads");
+    }
+    return test_pass();
+}
+
+testing_func(ProfilerTest, TestScopeCost)
+{
+    const uint32_t kFrameCount = 50;
+    const uint32_t kScopesPerFrame = 2000;
+
+    bool profileEnabled = gProfileEnabled;
+    gProfileEnabled = true;
+    Profiler::clearEvents();
+
+    // Measure the scopes on a worker thread, to exclude the main thread's GPU timers
+    float time = 0;
+    std::string results;
+    for (uint32_t frame = 0; frame < kFrameCount; frame++)
+    {
+        std::thread worker([&time]()
+        {
+            auto start = CpuTimer::getCurrentTimePoint();
+            profileNestedScopes(kScopesPerFrame / 2);
+            time += CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+        });
+        worker.join();
+        Profiler::endFrame(results);
+        if (Profiler::getDroppedEventCount() != 0)
+        {
+            gProfileEnabled = profileEnabled;
+            return test_fail("Events were dropped");
+        }
+    }
+    gProfileEnabled = profileEnabled;
+
+    double nsPerScope = (double)time * 1e6 / (kFrameCount * kScopesPerFrame);
+    logInfo("Profiler scope cost: " + std::to_string(nsPerScope) + "ns");
+    return test_pass();
+}
+
+testing_func(ProfilerTest, TestTraceExport)
+{
+    const uint32_t kFrameCount = 3;
+    const uint32_t kScopeCount = 100;
+    const std::string filename = getExecutableDirectory() + "/ProfilerTestTrace.json";
+
+    bool profileEnabled = gProfileEnabled;
+    gProfileEnabled = true;
+    Profiler::clearEvents();
+    if (Profiler::startTrace(filename) == false)
+    {
+        gProfileEnabled = profileEnabled;
+        return test_fail("Can't create the trace file");
+    }
+
+    std::string results;
+    for (uint32_t frame = 0; frame < kFrameCount; frame++)
+    {
+        std::thread worker(profileNestedScopes, kScopeCount);
+        worker.join();
+        Profiler::endFrame(results);
+    }
+    Profiler::stopTrace();
+    gProfileEnabled = profileEnabled;
+
+    std::ifstream file(filename);
+    std::stringstream json;
+    json << file.rdbuf();
+    rapidjson::Document trace;
+    trace.Parse(json.str().c_str());
+    if (trace.HasParseError() || trace.HasMember("traceEvents") == false || trace["traceEvents"].IsArray() == false)
+    {
+        return test_fail("The trace isn't valid JSON");
+    }
+
+    uint32_t innerEvents = 0;
+    uint32_t frameMarkers = 0;
+    const rapidjson::Value& events = trace["traceEvents"];
+    for (uint32_t i = 0; i < events.Size(); i++)
+    {
+        const rapidjson::Value& event = events[i];
+        std::string phase = event["ph"].GetString();
+        std::string name = event["name"].GetString();
+        if (phase == "X" && name == "ProfilerTestInner")
+        {
+            if (event["dur"].GetDouble() < 0) return test_fail("Negative event duration");
+            innerEvents++;
+        }
+        frameMarkers += (phase == "i") ? 1 : 0;
+    }
+
+    if (innerEvents != kFrameCount * kScopeCount || frameMarkers != kFrameCount)
+    {
+        return test_fail("Events are missing from the trace");
+    }
+    return test_pass();
+}
+
+testing_func(ProfilerTest, TestHistogramPercentiles)
+{
+    const uint32_t kWindowSize = 100;
+    StreamingHistogram histogram(kWindowSize);
+
+    // 1..1000ms, uniformly distributed
+    for (uint32_t i = 1; i <= 1000; i++)
+    {
+        histogram.addSample((float)i);
+    }
+
+    // The bucket resolution is about 3%
+    auto isClose = [](float value, float expected) { return std::abs(value - expected) <= expected * 0.035f; };
+
+    StreamingHistogram::Statistics run = histogram.getRunStatistics();
+    if (run.count != 1000 || run.min != 1 || run.max != 1000 || isClose(run.mean, 500.5f) == false)
+    {
+        return test_fail("Wrong run statistics");
+    }
+    if (isClose(run.p50, 500) == false || isClose(run.p95, 950) == false || isClose(run.p99, 990) == false)
+    {
+        return test_fail("Wrong run percentiles");
+    }
+
+    StreamingHistogram::Statistics window = histogram.getWindowStatistics();
+    if (window.count != kWindowSize || window.min != 901 || window.max != 1000 || isClose(window.p50, 950) == false)
+    {
+        return test_fail("Wrong window statistics");
+    }
+
+    // Samples leaving the window shouldn't affect it
+    for (uint32_t i = 0; i < kWindowSize; i++)
+    {
+        histogram.addSample(2);
+    }
+    window = histogram.getWindowStatistics();
+    if (window.max != 2 || isClose(window.p99, 2) == false || histogram.getRunStatistics().max != 1000)
+    {
+        return test_fail("The window wasn't updated");
+    }
+    return test_pass();
+}
+
+int main()
+{
+    ProfilerTest pt;
+    pt.init(true);
+    pt.run();
+    return 0;
+}
@@ -0,0 +1,209 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "ProgramCacheTest.h"
+#include "Graphics/Program/ProgramCache.h"
+#include <fstream>
+
+static const char* kCacheDirectory = "ProgramCacheTest_Cache";
+static const char* kShaderFile = "ProgramCacheTest.slang";
+static const char* kIncludeFile = "ProgramCacheTest_Include.slang";
+
+void ProgramCacheTest::addTests()
+{
+    addTestToList<TestHitAfterMiss>();
+    addTestToList<TestDefinesAreKeyed>();
+    addTestToList<TestIncludeChangeInvalidates>();
+}
+
+testing_func(ProgramCacheTest, TestHitAfterMiss)
+{
+    writeShaderFiles("return v * 2;");
+    resetCache();
+    ProgramVersion::SharedConstPtr pCompiled = compile();
+    ProgramCache::Statistics afterMiss = ProgramCache::getStatistics();
+    ProgramVersion::SharedConstPtr pCached = compile();
+    ProgramCache::Statistics afterHit = ProgramCache::getStatistics();
+    removeFiles();
+
+    if (pCompiled == nullptr || pCached == nullptr)
+    {
+        return test_fail("Failed to create the test program");
+    }
+
+    if (afterMiss.misses != 1 || afterMiss.hits != 0 || afterMiss.bytesWritten == 0)
+    {
+        return test_fail("First compilation should have been a miss which created an entry");
+    }
+
+    if (afterHit.misses != 1 || afterHit.hits != 1 || afterHit.bytesRead != afterMiss.bytesWritten)
+    {
+        return test_fail("Second compilation should have been a hit");
+    }
+
+    if (doReflectorsMatch(pCompiled->getReflector().get(), pCached->getReflector().get()) == false)
+    {
+        return test_fail("Cached reflection data doesn't match the compiled program");
+    }
+
+    return test_pass();
+}
+
+testing_func(ProgramCacheTest, TestDefinesAreKeyed)
+{
+    writeShaderFiles("return v * 2;");
+    resetCache();
+    Program::DefineList defines;
+    defines.add("SCALE_TWICE");
+    compile();
+    compile(defines);
+    compile(defines);
+    ProgramCache::Statistics stats = ProgramCache::getStatistics();
+    removeFiles();
+
+    if (stats.misses != 2 || stats.hits != 1)
+    {
+        return test_fail("Define lists were not keyed correctly");
+    }
+
+    return test_pass();
+}
+
+testing_func(ProgramCacheTest, TestIncludeChangeInvalidates)
+{
+    writeShaderFiles("return v * 2;");
+    resetCache();
+    compile();
+
+    // The include file is not part of the key, it's validated against the hash stored in the entry
+    writeShaderFiles("return v * 3 + 1;");
+    compile();
+    compile();
+    ProgramCache::Statistics stats = ProgramCache::getStatistics();
+    removeFiles();
+
+    if (stats.misses != 2 || stats.hits != 1)
+    {
+        return test_fail("Changing an included file should invalidate the entry");
+    }
+
+    return test_pass();
+}
+
+void ProgramCacheTest::writeShaderFiles(const std::string& includeBody)
+{
+    std::ofstream include(kIncludeFile, std::ios::trunc);
+    include << "float4 scaleValue(float4 v)\n{\n    " << includeBody << "\n}\n";
+
+    std::ofstream shader(kShaderFile, std::ios::trunc);
+    shader << "#include \"" << kIncludeFile << "\"\n"
+        << "RWStructuredBuffer<float4> gOutput;\n"
+        << "Texture2D gInput;\n"
+        << "cbuffer PerFrameCB\n{\n    float4 gScale;\n    uint gCount;\n};\n"
+        << "[numthreads(8, 4, 1)]\n"
+        << "void main(uint3 threadId : SV_DispatchThreadID)\n{\n"
+        << "    float4 v = gInput[threadId.xy] * gScale;\n"
+        << "#ifdef SCALE_TWICE\n    v = scaleValue(v);\n#endif\n"
+        << "    gOutput[threadId.x + threadId.y * gCount] = scaleValue(v);\n}\n";
+}
+
+ProgramVersion::SharedConstPtr ProgramCacheTest::compile(const Program::DefineList& defines)
+{
+    // A new program object every time, so that versions are not reused from memory
+    ComputeProgram::SharedPtr pProgram = ComputeProgram::createFromFile(kShaderFile, defines);
+    return pProgram ? pProgram->getActiveVersion() : nullptr;
+}
+
+bool ProgramCacheTest::doReflectorsMatch(const ProgramReflection* pA, const ProgramReflection* pB)
+{
+    if (pA->getThreadGroupSize() != pB->getThreadGroupSize() || pA->getParameterBlockCount() != pB->getParameterBlockCount())
+    {
+        return false;
+    }
+
+    const auto& resourcesA = pA->getDefaultParameterBlock()->getResourceVec();
+    const auto& resourcesB = pB->getDefaultParameterBlock()->getResourceVec();
+    if (resourcesA.size() != resourcesB.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < resourcesA.size(); i++)
+    {
+        if (resourcesA[i].name != resourcesB[i].name || resourcesA[i].regIndex != resourcesB[i].regIndex || resourcesA[i].regSpace != resourcesB[i].regSpace || resourcesA[i].setType != resourcesB[i].setType)
+        {
+            return false;
+        }
+    }
+
+    // Check the constant buffer layout
+    const ReflectionVar::SharedConstPtr pCbA = pA->getResource("PerFrameCB");
+    const ReflectionVar::SharedConstPtr pCbB = pB->getResource("PerFrameCB");
+    if (pCbA == nullptr || pCbB == nullptr)
+    {
+        return false;
+    }
+
+    const ReflectionResourceType* pTypeA = pCbA->getType()->asResourceType();
+    const ReflectionResourceType* pTypeB = pCbB->getType()->asResourceType();
+    if (pTypeA->getSize() != pTypeB->getSize())
+    {
+        return false;
+    }
+
+    for (const char* var : { "gScale", "gCount" })
+    {
+        ReflectionVar::SharedConstPtr pVarA = pTypeA->findMember(var);
+        ReflectionVar::SharedConstPtr pVarB = pTypeB->findMember(var);
+        if (pVarA == nullptr || pVarB == nullptr || pVarA->getOffset() != pVarB->getOffset())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ProgramCacheTest::resetCache()
+{
+    ProgramCache::setDirectory(kCacheDirectory);
+    ProgramCache::clear();
+    ProgramCache::resetStatistics();
+}
+
+void ProgramCacheTest::removeFiles()
+{
+    std::remove(kShaderFile);
+    std::remove(kIncludeFile);
+}
+
+int main()
+{
+    ProgramCacheTest pct;
+    pct.init(true);
+    pct.run();
+    return 0;
+}
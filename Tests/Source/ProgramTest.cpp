@@ -0,0 +1,266 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "ProgramTest.h"
+#include "Graphics/Program/ProgramCache.h"
+#include "Utils/CpuTimer.h"
+#include <atomic>
+
+static const char* kComputeShader =
+    "RWStructuredBuffer<float4> gOutput;\n"
+    "cbuffer PerFrameCB\n{\n    float4 gScale;\n};\n"
+    "[numthreads(64, 1, 1)]\n"
+    "void main(uint3 threadId : SV_DispatchThreadID)\n{\n"
+    "    float4 v = gScale;\n"
+    "#ifdef VARIANT_A\n    v *= 2;\n#endif\n"
+    "#ifdef VARIANT_B\n    v += 1;\n#endif\n"
+    "    gOutput[threadId.x] = v;\n}\n";
+
+void ProgramTest::addTests()
+{
+    addTestToList<TestAsyncSkip>();
+    addTestToList<TestAsyncFallback>();
+    addTestToList<TestPrewarm>();
+    addTestToList<TestDefineListHash>();
+    addTestToList<TestDefineToggleBenchmark>();
+}
+
+testing_func(ProgramTest, TestAsyncSkip)
+{
+    ComputeProgram::SharedPtr pProgram = createProgram();
+    pProgram->setCompileMode(Program::CompileMode::AsyncSkip);
+
+    std::atomic<uint32_t> succeeded(0);
+    pProgram->setCompilationCallback([&succeeded](const Program::DefineList&, bool success) { if (success) succeeded++; });
+
+    pProgram->addDefine("VARIANT_A");
+    if (pProgram->getActiveVersion() != nullptr && Program::getPendingCompilationCount() != 0)
+    {
+        return test_fail("No version should be returned while the variant is compiling");
+    }
+
+    Program::waitForPendingCompilations();
+    if (Program::getPendingCompilationCount() != 0 || pProgram->isActiveVersionReady() == false || pProgram->getActiveVersion() == nullptr)
+    {
+        return test_fail("Variant wasn't ready after waiting for the compilation");
+    }
+
+    if (succeeded != 1)
+    {
+        return test_fail("Completion callback wasn't invoked");
+    }
+    return test_pass();
+}
+
+testing_func(ProgramTest, TestAsyncFallback)
+{
+    ComputeProgram::SharedPtr pProgram = createProgram();
+    pProgram->setCompileMode(Program::CompileMode::AsyncFallback);
+    pProgram->setFallbackDefines(Program::DefineList());
+    pProgram->prewarm({ Program::DefineList() });
+    Program::waitForPendingCompilations();
+    ProgramVersion::SharedConstPtr pFallback = pProgram->getActiveVersion();
+
+    pProgram->addDefine("VARIANT_B");
+    ProgramVersion::SharedConstPtr pWhileCompiling = pProgram->getActiveVersion();
+    bool wasReady = pProgram->isActiveVersionReady();
+    Program::waitForPendingCompilations();
+    ProgramVersion::SharedConstPtr pVariant = pProgram->getActiveVersion();
+
+    if (pFallback == nullptr || pVariant == nullptr || pVariant == pFallback)
+    {
+        return test_fail("Failed to compile the variants");
+    }
+
+    if (wasReady == false && pWhileCompiling != pFallback)
+    {
+        return test_fail("The fallback version should be used while the variant is compiling");
+    }
+    return test_pass();
+}
+
+testing_func(ProgramTest, TestPrewarm)
+{
+    ComputeProgram::SharedPtr pProgram = createProgram();
+    pProgram->setCompileMode(Program::CompileMode::AsyncSkip);
+
+    std::vector<Program::DefineList> variants(3);
+    variants[1].add("VARIANT_A");
+    variants[2].add("VARIANT_A");
+    variants[2].add("VARIANT_B");
+    pProgram->prewarm(variants);
+    Program::waitForPendingCompilations();
+
+    for (const auto& defines : variants)
+    {
+        pProgram->replaceAllDefines(defines);
+        if (pProgram->isActiveVersionReady() == false || pProgram->getActiveVersion() == nullptr)
+        {
+            return test_fail("Prewarmed variant wasn't compiled");
+        }
+    }
+    return test_pass();
+}
+
+testing_func(ProgramTest, TestDefineListHash)
+{
+    Program::DefineList a;
+    a.add("VARIANT_A");
+    a.add("VARIANT_B", "1");
+
+    // Same contents, different order of operations
+    Program::DefineList b;
+    b.add("VARIANT_B", "2");
+    b.add("TEMP");
+    b.add("VARIANT_A");
+    b.remove("TEMP");
+    b.add("VARIANT_B", "1");
+
+    if (a.getHash() != b.getHash() || a != b)
+    {
+        return test_fail("Define lists with the same contents should be equal");
+    }
+
+    b.add("VARIANT_B", "3");
+    if (a.getHash() == b.getHash() || a == b)
+    {
+        return test_fail("Changing a value should change the hash");
+    }
+
+    b.clear();
+    if (b.getHash() != Program::DefineList().getHash() || b.empty() == false)
+    {
+        return test_fail("A cleared list should match an empty list");
+    }
+    return test_pass();
+}
+
+testing_func(ProgramTest, TestDefineToggleBenchmark)
+{
+    // Mimics SceneRenderer: per draw, set the vertex attributes, the skinning define and the material description, fetch the version, and restore the defines
+    const uint32_t kDrawCount = 100000;
+    const uint32_t kMaterialCount = 8;
+    std::vector<std::string> materialDescs;
+    for (uint32_t i = 0; i < kMaterialCount; i++)
+    {
+        materialDescs.push_back("{{MatLambert, DescSample, ChannelRGB, ChannelNone, NormalMap" + std::to_string(i) + "}, {MatConductor, DescConst, ChannelRGB}, AlphaMap, HeightMap}");
+    }
+
+    ComputeProgram::SharedPtr pProgram = createProgram();
+    pProgram->addDefine("HAS_NORMAL");
+    pProgram->addDefine("HAS_TEXCRD");
+    std::vector<Program::DefineList> variants;
+    for (uint32_t i = 0; i < kMaterialCount * 2; i++)
+    {
+        Program::DefineList defines = pProgram->getActiveDefinesList();
+        defines.add("_MS_STATIC_MATERIAL_DESC", materialDescs[i / 2]);
+        if (i & 1) defines.add("_VERTEX_BLENDING");
+        variants.push_back(defines);
+    }
+    pProgram->prewarm(variants);
+    Program::waitForPendingCompilations();
+
+    // The previous implementation: an ordered map keyed by the define map, with the same find-then-assign updates
+    using LegacyDefineList = std::map<std::string, std::string>;
+    std::map<const LegacyDefineList, ProgramVersion::SharedConstPtr> legacyVersions;
+    for (const auto& v : variants)
+    {
+        pProgram->replaceAllDefines(v);
+        legacyVersions[LegacyDefineList(v.begin(), v.end())] = pProgram->getActiveVersion();
+    }
+    LegacyDefineList legacyDefines(pProgram->getActiveDefinesList().begin(), pProgram->getActiveDefinesList().end());
+    legacyDefines.erase("_MS_STATIC_MATERIAL_DESC");
+    legacyDefines.erase("_VERTEX_BLENDING");
+    auto legacyAdd = [&legacyDefines](const std::string& name, const std::string& value)
+    {
+        if (legacyDefines.find(name) != legacyDefines.end() && legacyDefines[name] == value) return;
+        legacyDefines[name] = value;
+    };
+    auto legacyRemove = [&legacyDefines](const std::string& name)
+    {
+        if (legacyDefines.find(name) != legacyDefines.end()) legacyDefines.erase(name);
+    };
+
+    uint32_t legacyFound = 0;
+    auto legacyStart = CpuTimer::getCurrentTimePoint();
+    for (uint32_t draw = 0; draw < kDrawCount; draw++)
+    {
+        bool skinned = (draw % 3) == 0;
+        legacyRemove("HAS_NORMAL");
+        legacyRemove("HAS_TEXCRD");
+        legacyAdd("HAS_NORMAL", "");
+        legacyAdd("HAS_TEXCRD", "");
+        if (skinned) legacyAdd("_VERTEX_BLENDING", "");
+        legacyAdd("_MS_STATIC_MATERIAL_DESC", materialDescs[draw % kMaterialCount]);
+        legacyFound += legacyVersions.find(legacyDefines)->second ? 1 : 0;
+        legacyRemove("_MS_STATIC_MATERIAL_DESC");
+        if (skinned) legacyRemove("_VERTEX_BLENDING");
+    }
+    float legacyTime = CpuTimer::calcDuration(legacyStart, CpuTimer::getCurrentTimePoint());
+
+    pProgram->removeDefine("_MS_STATIC_MATERIAL_DESC");
+    pProgram->removeDefine("_VERTEX_BLENDING");
+    uint32_t found = 0;
+    auto start = CpuTimer::getCurrentTimePoint();
+    for (uint32_t draw = 0; draw < kDrawCount; draw++)
+    {
+        bool skinned = (draw % 3) == 0;
+        pProgram->removeDefine("HAS_NORMAL");
+        pProgram->removeDefine("HAS_TEXCRD");
+        pProgram->addDefine("HAS_NORMAL");
+        pProgram->addDefine("HAS_TEXCRD");
+        if (skinned) pProgram->addDefine("_VERTEX_BLENDING");
+        pProgram->addDefine("_MS_STATIC_MATERIAL_DESC", materialDescs[draw % kMaterialCount]);
+        found += pProgram->getActiveVersion() ? 1 : 0;
+        pProgram->removeDefine("_MS_STATIC_MATERIAL_DESC");
+        if (skinned) pProgram->removeDefine("_VERTEX_BLENDING");
+    }
+    float time = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint());
+
+    if (found != kDrawCount || legacyFound != kDrawCount)
+    {
+        return test_fail("Failed to find the prewarmed versions");
+    }
+
+    logInfo("Define toggling, " + std::to_string(kDrawCount) + " draws. Ordered map: " + std::to_string(legacyTime) + "ms, hashed: " + std::to_string(time) + "ms, speedup: " + std::to_string(legacyTime / time) + "x");
+    return test_pass();
+}
+
+ComputeProgram::SharedPtr ProgramTest::createProgram()
+{
+    // Make sure the variants are actually compiled
+    ProgramCache::setEnabled(false);
+    return ComputeProgram::createFromString(kComputeShader);
+}
+
+int main()
+{
+    ProgramTest pt;
+    pt.init(true);
+    pt.run();
+    return 0;
+}
@@ -0,0 +1,209 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "SceneImporterTest.h"
+#include "Utils/CpuTimer.h"
+#include "Utils/Bitmap.h"
+#include <fstream>
+
+void SceneImporterTest::addTests()
+{
+    addTestToList<TestParallelMatchesSerial>();
+    addTestToList<TestLoadBenchmark>();
+}
+
+testing_func(SceneImporterTest, TestParallelMatchesSerial)
+{
+    const std::string sceneFile = "SceneImporterTest_Small.fscene";
+    std::vector<std::string> files;
+    if (writeSyntheticScene(sceneFile, 16, files) == false)
+    {
+        removeFiles(files);
+        return test_fail("Failed to write the test scene");
+    }
+
+    Scene::SharedPtr pSerialScene = Scene::loadFromFile(sceneFile, Model::LoadFlags::DontUseCache, Scene::LoadFlags::SerialModelLoading);
+    Scene::SharedPtr pParallelScene = Scene::loadFromFile(sceneFile, Model::LoadFlags::DontUseCache);
+    removeFiles(files);
+
+    if (pSerialScene == nullptr || pParallelScene == nullptr)
+    {
+        return test_fail("Failed to load the test scene");
+    }
+
+    if (doScenesMatch(pSerialScene, pParallelScene) == false)
+    {
+        return test_fail("Parallel scene load doesn't match the serial load");
+    }
+
+    return test_pass();
+}
+
+testing_func(SceneImporterTest, TestLoadBenchmark)
+{
+    const uint32_t modelCount = 300;
+    const std::string sceneFile = "SceneImporterTest_Large.fscene";
+    std::vector<std::string> files;
+    if (writeSyntheticScene(sceneFile, modelCount, files) == false)
+    {
+        removeFiles(files);
+        return test_fail("Failed to write the test scene");
+    }
+
+    auto serialStart = CpuTimer::getCurrentTimePoint();
+    Scene::SharedPtr pSerialScene = Scene::loadFromFile(sceneFile, Model::LoadFlags::DontUseCache, Scene::LoadFlags::SerialModelLoading);
+    float serialTime = CpuTimer::calcDuration(serialStart, CpuTimer::getCurrentTimePoint());
+    pSerialScene = nullptr;
+
+    auto parallelStart = CpuTimer::getCurrentTimePoint();
+    Scene::SharedPtr pParallelScene = Scene::loadFromFile(sceneFile, Model::LoadFlags::DontUseCache);
+    float parallelTime = CpuTimer::calcDuration(parallelStart, CpuTimer::getCurrentTimePoint());
+    removeFiles(files);
+
+    if (pParallelScene == nullptr)
+    {
+        return test_fail("Failed to load the test scene");
+    }
+
+    logInfo("SceneImporter, " + std::to_string(modelCount) + " models. Serial: " + std::to_string(serialTime) + "ms, parallel: " + std::to_string(parallelTime) + "ms");
+    return test_pass();
+}
+
+bool SceneImporterTest::writeSyntheticScene(const std::string& sceneFile, uint32_t modelCount, std::vector<std::string>& createdFiles)
+{
+    // Each model is a textured grid in its own OBJ file, so loading it goes through parsing, tangent generation and texture decoding
+    const uint32_t kGridSize = 64;
+    const uint32_t kTextureSize = 256;
+    std::vector<uint8_t> texels(kTextureSize * kTextureSize * 4);
+
+    std::ofstream scene(sceneFile);
+    createdFiles.push_back(sceneFile);
+    scene << "{\n\t\"version\": 2,\n\t\"models\": [\n";
+
+    for (uint32_t m = 0; m < modelCount; m++)
+    {
+        const std::string name = "SceneImporterTest_" + std::to_string(m);
+        createdFiles.push_back(name + ".obj");
+        createdFiles.push_back(name + ".mtl");
+        createdFiles.push_back(name + ".png");
+
+        for (uint32_t i = 0; i < kTextureSize * kTextureSize; i++)
+        {
+            texels[i * 4 + 0] = uint8_t(i + m);
+            texels[i * 4 + 1] = uint8_t(i / kTextureSize);
+            texels[i * 4 + 2] = uint8_t(m);
+            texels[i * 4 + 3] = 0xff;
+        }
+        Bitmap::saveImage(name + ".png", kTextureSize, kTextureSize, Bitmap::FileFormat::PngFile, Bitmap::ExportFlags::None, ResourceFormat::RGBA8Unorm, true, texels.data());
+
+        std::ofstream mtl(name + ".mtl");
+        mtl << "newmtl " << name << "\nKd 1 1 1\nmap_Kd " << name << ".png\n";
+
+        // Vary the height field per model, so Assimp can't merge anything across files
+        std::ofstream obj(name + ".obj");
+        obj << "mtllib " << name << ".mtl\nusemtl " << name << "\n";
+        for (uint32_t y = 0; y <= kGridSize; y++)
+        {
+            for (uint32_t x = 0; x <= kGridSize; x++)
+            {
+                float u = float(x) / kGridSize;
+                float v = float(y) / kGridSize;
+                obj << "v " << u << " " << 0.1f * sin(u * (m + 1)) * cos(v * (m + 1)) << " " << v << "\n";
+                obj << "vt " << u << " " << v << "\n";
+                obj << "vn 0 1 0\n";
+            }
+        }
+        for (uint32_t y = 0; y < kGridSize; y++)
+        {
+            for (uint32_t x = 0; x < kGridSize; x++)
+            {
+                uint32_t i0 = y * (kGridSize + 1) + x + 1;
+                uint32_t i1 = i0 + 1;
+                uint32_t i2 = i0 + kGridSize + 1;
+                uint32_t i3 = i2 + 1;
+                obj << "f " << i0 << "/" << i0 << "/" << i0 << " " << i2 << "/" << i2 << "/" << i2 << " " << i1 << "/" << i1 << "/" << i1 << "\n";
+                obj << "f " << i1 << "/" << i1 << "/" << i1 << " " << i2 << "/" << i2 << "/" << i2 << " " << i3 << "/" << i3 << "/" << i3 << "\n";
+            }
+        }
+
+        scene << "\t\t{\n\t\t\t\"file\": \"" << name << ".obj\",\n\t\t\t\"name\": \"" << name << "\",\n";
+        scene << "\t\t\t\"instances\": [ { \"name\": \"" << name << "_0\", \"translation\": [" << m << ", 0, 0] } ]\n";
+        scene << "\t\t}" << ((m + 1 < modelCount) ? ",\n" : "\n");
+    }
+
+    scene << "\t]\n}\n";
+    return scene.good();
+}
+
+bool SceneImporterTest::doScenesMatch(const Scene::SharedPtr& pSceneA, const Scene::SharedPtr& pSceneB)
+{
+    if (pSceneA->getModelCount() != pSceneB->getModelCount())
+    {
+        return false;
+    }
+
+    // Models and instances have to come out in the same order, regardless of which file finished decoding first
+    for (uint32_t i = 0; i < pSceneA->getModelCount(); i++)
+    {
+        const auto& pModelA = pSceneA->getModel(i);
+        const auto& pModelB = pSceneB->getModel(i);
+        if (pModelA->getName() != pModelB->getName() ||
+            pModelA->getVertexCount() != pModelB->getVertexCount() ||
+            pModelA->getIndexCount() != pModelB->getIndexCount() ||
+            pModelA->getTextureCount() != pModelB->getTextureCount() ||
+            pSceneA->getModelInstanceCount(i) != pSceneB->getModelInstanceCount(i))
+        {
+            return false;
+        }
+
+        for (uint32_t j = 0; j < pSceneA->getModelInstanceCount(i); j++)
+        {
+            if (pSceneA->getModelInstance(i, j)->getName() != pSceneB->getModelInstance(i, j)->getName())
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void SceneImporterTest::removeFiles(const std::vector<std::string>& files)
+{
+    for (const auto& f : files)
+    {
+        std::remove(f.c_str());
+    }
+}
+
+int main()
+{
+    SceneImporterTest sit;
+    sit.init(true);
+    sit.run();
+    return 0;
+}
@@ -0,0 +1,504 @@
+/***************************************************************************
+# Copyright (c) 2015, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+***************************************************************************/
+#include "SceneRendererTest.h"
+#include "Utils/CpuTimer.h"
+#include <cfloat>
+
+void SceneRendererTest::addTests()
+{
+    addTestToList<TestDrawListOrder>();
+    addTestToList<TestDrawListCulling>();
+    addTestToList<TestDrawListSorting>();
+    addTestToList<TestInstanceBatching>();
+    addTestToList<TestMaterialProgramVersions>();
+    addTestToList<TestSceneExtents>();
+    addTestToList<TestDrawListBenchmark>();
+}
+
+Scene::SharedPtr SceneRendererTest::createScene(uint32_t modelCount, uint32_t instancesPerModel, uint32_t meshesPerModel, uint32_t instancesPerMesh, uint32_t seed, uint32_t materialCount)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> position(-1000, 1000);
+    std::uniform_real_distribution<float> localPosition(-20, 20);
+    std::uniform_real_distribution<float> angle(0, 6.28f);
+
+    // The draw list is built on the CPU, the meshes don't need any geometry
+    BoundingBox meshBox = BoundingBox::fromMinMax(glm::vec3(-1), glm::vec3(1));
+    Scene::SharedPtr pScene = Scene::create();
+
+    // If materialCount isn't 0, the meshes share a pool of materials
+    std::vector<Material::SharedPtr> materials(materialCount);
+    for (uint32_t i = 0; i < materialCount; i++)
+    {
+        materials[i] = Material::create("Material" + std::to_string(i));
+    }
+
+    for (uint32_t m = 0; m < modelCount; m++)
+    {
+        Model::SharedPtr pModel = Model::create();
+        for (uint32_t mesh = 0; mesh < meshesPerModel; mesh++)
+        {
+            Material::SharedPtr pMaterial = materialCount ? materials[rng() % materialCount] : Material::create("Material" + std::to_string(m) + "_" + std::to_string(mesh));
+            Mesh::SharedPtr pMesh = Mesh::create({}, 0, nullptr, 0, nullptr, Vao::Topology::TriangleList, pMaterial, meshBox, false);
+            for (uint32_t i = 0; i < instancesPerMesh; i++)
+            {
+                pModel->addMeshInstance(pMesh, glm::translate(glm::mat4(), glm::vec3(localPosition(rng), localPosition(rng), localPosition(rng))));
+            }
+        }
+
+        for (uint32_t i = 0; i < instancesPerModel; i++)
+        {
+            glm::vec3 translation(position(rng), position(rng), position(rng));
+            glm::vec3 rotation(angle(rng), angle(rng), angle(rng));
+            pScene->addModelInstance(pModel, "Instance" + std::to_string(i), translation, rotation);
+        }
+    }
+    return pScene;
+}
+
+Camera::SharedPtr SceneRendererTest::createCamera()
+{
+    Camera::SharedPtr pCamera = Camera::create();
+    pCamera->setPosition(glm::vec3(0, 0, -1000));
+    pCamera->setTarget(glm::vec3(100, 50, 0));
+    pCamera->setUpVector(glm::vec3(0, 1, 0));
+    pCamera->setAspectRatio(16.0f / 9.0f);
+    pCamera->setFocalLength(50);
+    pCamera->setDepthRange(0.1f, 1500);
+    return pCamera;
+}
+
+bool SceneRendererTest::compareDrawLists(const SceneRenderer::DrawList& a, const SceneRenderer::DrawList& b)
+{
+    if (a.packets.size() != b.packets.size() || a.instances.size() != b.instances.size()) return false;
+    for (size_t i = 0; i < a.packets.size(); i++)
+    {
+        const auto& pa = a.packets[i];
+        const auto& pb = b.packets[i];
+        if (pa.pModelInstance != pb.pModelInstance || pa.meshID != pb.meshID || pa.firstInstance != pb.firstInstance || pa.instanceCount != pb.instanceCount) return false;
+    }
+    for (size_t i = 0; i < a.instances.size(); i++)
+    {
+        if (a.instances[i].pMeshInstance != b.instances[i].pMeshInstance || a.instances[i].worldMat != b.instances[i].worldMat) return false;
+    }
+    return true;
+}
+
+testing_func(SceneRendererTest, TestDrawListOrder)
+{
+    Scene::SharedPtr pScene = createScene(20, 50, 3, 4, 1);
+    SceneRenderer::SharedPtr pRenderer = SceneRenderer::create(pScene);
+
+    // Without culling and sorting, every mesh instance is drawn, in the order of the single-threaded path
+    SceneRenderer::DrawList drawList;
+    pRenderer->setDrawListSorting(false);
+    pRenderer->setJobSystem(JobSystem::create(1));
+    pRenderer->buildDrawList(nullptr, drawList);
+    if (drawList.packets.size() != 20 * 50 * 3 || drawList.instances.size() != 20 * 50 * 3 * 4)
+    {
+        return test_fail("Draw list doesn't contain all the mesh instances");
+    }
+
+    uint32_t packetID = 0;
+    for (uint32_t modelID = 0; modelID < pScene->getModelCount(); modelID++)
+    {
+        for (uint32_t instanceID = 0; instanceID < pScene->getModelInstanceCount(modelID); instanceID++)
+        {
+            for (uint32_t meshID = 0; meshID < 3; meshID++, packetID++)
+            {
+                const auto& packet = drawList.packets[packetID];
+                if (packet.pModelInstance != pScene->getModelInstance(modelID, instanceID).get() || packet.meshID != meshID || packet.instanceCount != 4)
+                {
+                    return test_fail("Draw list packets are out of order");
+                }
+            }
+        }
+    }
+
+    // The result doesn't depend on the number of threads
+    SceneRenderer::DrawList parallelList;
+    pRenderer->setJobSystem(JobSystem::create(8));
+    pRenderer->buildDrawList(nullptr, parallelList);
+    if (compareDrawLists(drawList, parallelList) == false)
+    {
+        return test_fail("Multi-threaded draw list differs from the single-threaded one");
+    }
+    return test_pass();
+}
+
+testing_func(SceneRendererTest, TestDrawListCulling)
+{
+    Scene::SharedPtr pScene = createScene(20, 50, 3, 4, 2);
+    SceneRenderer::SharedPtr pRenderer = SceneRenderer::create(pScene);
+    Camera::SharedPtr pCamera = createCamera();
+
+    SceneRenderer::DrawList drawList;
+    pRenderer->buildDrawList(pCamera.get(), drawList);
+
+    // Count the mesh instances which pass the per-box test
+    uint32_t visibleCount = 0;
+    for (uint32_t modelID = 0; modelID < pScene->getModelCount(); modelID++)
+    {
+        const Model* pModel = pScene->getModel(modelID).get();
+        for (uint32_t instanceID = 0; instanceID < pScene->getModelInstanceCount(modelID); instanceID++)
+        {
+            glm::mat4 transform = pScene->getModelInstance(modelID, instanceID)->getTransformMatrix();
+            for (uint32_t meshID = 0; meshID < pModel->getMeshCount(); meshID++)
+            {
+                for (uint32_t i = 0; i < pModel->getMeshInstanceCount(meshID); i++)
+                {
+                    BoundingBox box = pModel->getMeshInstance(meshID, i)->getBoundingBox().transform(transform);
+                    visibleCount += pCamera->isObjectCulled(box) ? 0 : 1;
+                }
+            }
+        }
+    }
+
+    if (visibleCount == 0 || drawList.instances.size() != visibleCount)
+    {
+        return test_fail("Draw list doesn't match the per-box culling test");
+    }
+    for (const auto& packet : drawList.packets)
+    {
+        if (packet.instanceCount == 0) return test_fail("Draw list contains an empty packet");
+    }
+    return test_pass();
+}
+
+uint32_t SceneRendererTest::countMaterialChanges(const SceneRenderer::DrawList& drawList, bool resetPerModelInstance)
+{
+    // Mirrors the material binding of the submit phase
+    uint32_t changes = 0;
+    const Material* pLastMaterial = nullptr;
+    const Scene::ModelInstance* pLastInstance = nullptr;
+    for (const auto& packet : drawList.packets)
+    {
+        if (resetPerModelInstance && packet.pModelInstance != pLastInstance) pLastMaterial = nullptr;
+        pLastInstance = packet.pModelInstance;
+        if (packet.pMaterial != pLastMaterial) changes++;
+        pLastMaterial = packet.pMaterial;
+    }
+    return changes;
+}
+
+namespace
+{
+    class TransparentSceneRenderer : public SceneRenderer
+    {
+    public:
+        TransparentSceneRenderer(const Scene::SharedPtr& pScene) : SceneRenderer(pScene) {}
+    protected:
+        bool isTransparent(const Mesh* pMesh) const override { return (pMesh->getId() % 2) == 1; }
+    };
+}
+
+testing_func(SceneRendererTest, TestDrawListSorting)
+{
+    Scene::SharedPtr pScene = createScene(20, 50, 4, 4, 4, 8);
+    SceneRenderer::SharedPtr pRenderer = SceneRenderer::create(pScene);
+    Camera::SharedPtr pCamera = createCamera();
+
+    SceneRenderer::DrawList unsorted;
+    pRenderer->setDrawListSorting(false);
+    pRenderer->buildDrawList(pCamera.get(), unsorted);
+
+    SceneRenderer::DrawList sorted;
+    pRenderer->setDrawListSorting(true);
+    pRenderer->buildDrawList(pCamera.get(), sorted);
+
+    if (sorted.packets.size() != unsorted.packets.size() || sorted.instances.size() != unsorted.instances.size())
+    {
+        return test_fail("Sorting changed the content of the draw list");
+    }
+    for (size_t i = 1; i < sorted.packets.size(); i++)
+    {
+        if (sorted.packets[i - 1].sortKey > sorted.packets[i].sortKey) return test_fail("Packets are not sorted by key");
+    }
+
+    uint32_t unsortedChanges = countMaterialChanges(unsorted, true);
+    uint32_t sortedChanges = countMaterialChanges(sorted, false);
+    if (sortedChanges > 8)
+    {
+        return test_fail("Sorted opaque draws should bind each material once");
+    }
+
+    // Transparent packets are drawn last, back-to-front
+    TransparentSceneRenderer transparentRenderer(pScene);
+    SceneRenderer::DrawList mixed;
+    transparentRenderer.buildDrawList(pCamera.get(), mixed);
+    bool transparentStarted = false;
+    float lastDistance = FLT_MAX;
+    for (const auto& packet : mixed.packets)
+    {
+        bool transparent = (packet.pMesh->getId() % 2) == 1;
+        if (transparentStarted && transparent == false) return test_fail("Opaque packet drawn after a transparent one");
+        transparentStarted = transparent;
+        if (transparent)
+        {
+            // Depth buckets are quantized, allow for the bucket size
+            float distance = glm::length(glm::vec3(mixed.instances[packet.firstInstance].worldMat[3]) - pCamera->getPosition());
+            if (distance > lastDistance + pCamera->getFarPlane() / 8192) return test_fail("Transparent packets are not sorted back-to-front");
+            lastDistance = distance;
+        }
+    }
+
+    logInfo("Material changes for " + std::to_string(sorted.packets.size()) + " packets. Unsorted: " + std::to_string(unsortedChanges) + ", sorted: " + std::to_string(sortedChanges));
+    return test_pass();
+}
+
+testing_func(SceneRendererTest, TestInstanceBatching)
+{
+    // 8 meshes with their own material, drawn by 100 model instances each
+    Scene::SharedPtr pScene = createScene(4, 100, 2, 3, 7);
+    SceneRenderer::SharedPtr pRenderer = SceneRenderer::create(pScene);
+
+    // Without batching, every packet is drawn on its own
+    SceneRenderer::DrawList drawList;
+    pRenderer->buildDrawList(nullptr, drawList);
+    if (drawList.batches.size() != drawList.packets.size())
+    {
+        return test_fail("Packets were merged with instance batching disabled");
+    }
+
+    pRenderer->setInstanceBatching(true);
+    pRenderer->buildDrawList(nullptr, drawList);
+    if (drawList.packets.size() != 4 * 100 * 2 || drawList.batches.size() != 4 * 2)
+    {
+        return test_fail("Packets sharing a mesh and a material were not merged");
+    }
+    if (drawList.instanceData.size() != drawList.instances.size())
+    {
+        return test_fail("Instance data doesn't cover all the instances");
+    }
+
+    // The instance data follows the batch order, and the batches cover all the packets in order
+    uint32_t nextPacket = 0;
+    uint32_t nextInstance = 0;
+    for (const auto& batch : drawList.batches)
+    {
+        if (batch.firstPacket != nextPacket || batch.firstInstance != nextInstance) return test_fail("Batches are not contiguous");
+        const auto& first = drawList.packets[batch.firstPacket];
+        uint32_t instanceCount = 0;
+        for (uint32_t p = batch.firstPacket; p < batch.firstPacket + batch.packetCount; p++)
+        {
+            const auto& packet = drawList.packets[p];
+            if (packet.pMesh != first.pMesh || packet.pMaterial != first.pMaterial) return test_fail("Batch mixes meshes or materials");
+            for (uint32_t i = 0; i < packet.instanceCount; i++, instanceCount++)
+            {
+                const PerInstanceData& data = drawList.instanceData[batch.firstInstance + instanceCount];
+                const auto& instance = drawList.instances[packet.firstInstance + i];
+                if (data.worldMat != instance.worldMat || data.prevWorldMat != instance.prevWorldMat || data.drawId != batch.firstInstance + instanceCount)
+                {
+                    return test_fail("Instance data doesn't match the draw list");
+                }
+
+                // The normal matrix is combined from the model and mesh instances' ones
+                glm::mat3 normalCheck = glm::transpose(glm::mat3(data.worldInvTransposeMat)) * glm::mat3(data.worldMat);
+                for (uint32_t c = 0; c < 3; c++)
+                {
+                    for (uint32_t r = 0; r < 3; r++)
+                    {
+                        if (std::abs(normalCheck[c][r] - (c == r ? 1.0f : 0.0f)) > 1e-4f) return test_fail("Wrong normal matrix");
+                    }
+                }
+            }
+        }
+        if (instanceCount != batch.instanceCount) return test_fail("Wrong batch instance count");
+        nextPacket += batch.packetCount;
+        nextInstance += batch.instanceCount;
+    }
+    if (nextPacket != drawList.packets.size())
+    {
+        return test_fail("Batches don't cover all the packets");
+    }
+
+    // Meshes sharing a material but not their geometry are drawn separately
+    Scene::SharedPtr pSharedScene = createScene(4, 100, 2, 3, 7, 2);
+    SceneRenderer::SharedPtr pSharedRenderer = SceneRenderer::create(pSharedScene);
+    pSharedRenderer->setInstanceBatching(true);
+    pSharedRenderer->buildDrawList(nullptr, drawList);
+    if (drawList.batches.size() != 4 * 2)
+    {
+        return test_fail("Batches with a shared material mix meshes");
+    }
+
+    logInfo("Draw calls for " + std::to_string(drawList.packets.size()) + " packets: " + std::to_string(drawList.batches.size()));
+    return test_pass();
+}
+
+namespace
+{
+    // Records the material and program version of every draw instead of drawing. The test meshes have no geometry.
+    class RecordingSceneRenderer : public SceneRenderer
+    {
+    public:
+        struct Draw
+        {
+            const Material* pMaterial;
+            const ProgramVersion* pVersion;
+        };
+
+        RecordingSceneRenderer(const Scene::SharedPtr& pScene) : SceneRenderer(pScene) {}
+        std::vector<Draw> draws;
+    protected:
+        void executeDraw(const CurrentWorkingData& currentData, uint32_t indexCount, uint32_t instanceCount) override
+        {
+            draws.push_back({ currentData.pMaterial, currentData.pState->getProgram()->getActiveVersion().get() });
+        }
+    };
+}
+
+testing_func(SceneRendererTest, TestMaterialProgramVersions)
+{
+    // Few materials shared by many meshes, so the sorted list has long runs of the same material
+    Scene::SharedPtr pScene = createScene(10, 20, 4, 2, 11, 3);
+    RecordingSceneRenderer renderer(pScene);
+    renderer.setDrawListMode(true);
+    Camera::SharedPtr pCamera = createCamera();
+
+    GraphicsProgram::SharedPtr pProgram = GraphicsProgram::createFromFile("Framework/Shaders/SceneEditorVS.slang", "Framework/Shaders/SceneEditorPS.slang");
+    GraphicsState::SharedPtr pState = GraphicsState::create();
+    pState->setProgram(pProgram);
+    GraphicsVars::SharedPtr pVars = GraphicsVars::create(pProgram->getActiveVersion()->getReflector());
+    const ProgramVersion* pGenericVersion = pProgram->getActiveVersion().get();
+
+    RenderContext* pContext = gpDevice->getRenderContext().get();
+    pContext->pushGraphicsState(pState);
+    pContext->pushGraphicsVars(pVars);
+    renderer.renderScene(pContext, pCamera.get());
+    pContext->popGraphicsVars();
+    pContext->popGraphicsState();
+
+    if (renderer.draws.empty())
+    {
+        return test_fail("Nothing was drawn");
+    }
+
+    // Each material run uses one program version, and the version only changes with the material
+    uint32_t materialChanges = 1;
+    for (size_t i = 1; i < renderer.draws.size(); i++)
+    {
+        const auto& prev = renderer.draws[i - 1];
+        const auto& draw = renderer.draws[i];
+        if (draw.pMaterial == prev.pMaterial && draw.pVersion != prev.pVersion)
+        {
+            return test_fail("Program version changed within a run of the same material");
+        }
+        if (draw.pMaterial != prev.pMaterial) materialChanges++;
+    }
+    if (materialChanges > 3)
+    {
+        return test_fail("Sorted draws should bind each material once");
+    }
+
+    // The patched define doesn't leak out of renderScene()
+    if (pProgram->getActiveVersion().get() != pGenericVersion)
+    {
+        return test_fail("Program wasn't restored after rendering");
+    }
+
+    return test_pass();
+}
+
+testing_func(SceneRendererTest, TestSceneExtents)
+{
+    Scene::SharedPtr pScene = createScene(2, 10, 1, 1, 13);
+    const float radius = pScene->getRadius();
+
+    // Pull the instances in. The incremental update must shrink the extents to what a full update computes.
+    for (uint32_t m = 0; m < pScene->getModelCount(); m++)
+    {
+        for (uint32_t i = 0; i < pScene->getModelInstanceCount(m); i++)
+        {
+            const auto& pInstance = pScene->getModelInstance(m, i);
+            pInstance->setTranslation(pInstance->getTranslation() * 0.1f, false);
+        }
+    }
+    const vec3 center = pScene->getCenter();
+    const float shrunkRadius = pScene->getRadius();
+    if (shrunkRadius >= radius)
+    {
+        return test_fail("Extents didn't shrink when the instances moved in");
+    }
+
+    pScene->invalidateExtents();
+    if (pScene->getCenter() != center || pScene->getRadius() != shrunkRadius)
+    {
+        return test_fail("Incremental extents don't match a full update");
+    }
+
+    // Moving an instance out grows them again
+    pScene->getModelInstance(1, 0)->setTranslation(vec3(5000, 0, 0), false);
+    if (pScene->getRadius() <= shrunkRadius)
+    {
+        return test_fail("Extents didn't grow when an instance moved out");
+    }
+    return test_pass();
+}
+
+testing_func(SceneRendererTest, TestDrawListBenchmark)
+{
+    // 100k mesh instances
+    Scene::SharedPtr pScene = createScene(100, 100, 5, 2, 3);
+    SceneRenderer::SharedPtr pRenderer = SceneRenderer::create(pScene);
+    pRenderer->setObjectCullState(false);
+
+    SceneRenderer::DrawList drawList;
+    std::string results;
+    uint32_t threadCounts[] = { 1, 0 };
+    for (uint32_t threadCount : threadCounts)
+    {
+        JobSystem::SharedPtr pJobSystem = JobSystem::create(threadCount);
+        pRenderer->setJobSystem(pJobSystem);
+        pRenderer->buildDrawList(nullptr, drawList); // Warm up
+
+        const uint32_t kIterations = 10;
+        auto start = CpuTimer::getCurrentTimePoint();
+        for (uint32_t i = 0; i < kIterations; i++)
+        {
+            pRenderer->buildDrawList(nullptr, drawList);
+        }
+        float time = CpuTimer::calcDuration(start, CpuTimer::getCurrentTimePoint()) / kIterations;
+        results += " " + std::to_string(pJobSystem->getThreadCount()) + " threads: " + std::to_string(time) + "ms.";
+    }
+
+    if (drawList.instances.size() != 100000)
+    {
+        return test_fail("Draw list doesn't contain all the mesh instances");
+    }
+    logInfo("Building a draw list of " + std::to_string(drawList.packets.size()) + " packets and " + std::to_string(drawList.instances.size()) + " instances." + results);
+    return test_pass();
+}
+
+int main()
+{
+    SceneRendererTest srt;
+    srt.init(true);
+    srt.run();
+    return 0;
+}